@@ -171,7 +171,7 @@ int fmt_669_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 		};
 		uint8_t rows = breakpos[pat] + 1;
 
-		note = song->patterns[pat] = csf_allocate_pattern(CLAMP(rows, 32, 64));
+		note = song->patterns[pat] = csf_allocate_pattern(song, CLAMP(rows, 32, 64));
 		song->pattern_size[pat] = song->pattern_alloc_size[pat] = CLAMP(rows, 32, 64);
 
 		for (row = 0; row < rows; row++, note += 56) {
@@ -294,8 +294,7 @@ int fmt_669_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 			if (song->samples[smp].length == 0)
 				continue;
 
-			ssize = csf_read_sample(song->samples + smp, SF_LE | SF_M | SF_PCMU | SF_8,
-				fp->data + fp->pos, fp->length - fp->pos);
+			ssize = fmt_read_sample(song->samples + smp, SF_LE | SF_M | SF_PCMU | SF_8, fp);
 			slurp_seek(fp, ssize, SEEK_CUR);
 		}
 	}
@@ -274,6 +274,12 @@ static int _read_iff(dmoz_file_t *file, song_sample_t *smp, const uint8_t *data,
 			case 16:
 				flags |= SF_16;
 				break;
+			case 24:
+				flags |= SF_24;
+				break;
+			case 32:
+				flags |= SF_32;
+				break;
 			}
 
 			// TODO: data checking; make sure sample count and byte size agree
@@ -313,7 +319,7 @@ struct aiff_writedata {
 	long comm_frames, ssnd_size; // seek positions for writing header data
 	size_t numbytes; // how many bytes have been written
 	int bps; // bytes per sample
-	int swap; // should be byteswapped?
+	int swap; // bytes per value to reverse, or zero if the data is already big-endian
 };
 
 static int aiff_header(disko_t *fp, int bits, int channels, int rate,
@@ -393,14 +399,19 @@ static int aiff_header(disko_t *fp, int bits, int channels, int rate,
 
 int fmt_aiff_save_sample(disko_t *fp, song_sample_t *smp)
 {
-	int bps;
+	int bps, bits, hires;
 	uint32_t ul;
 	uint32_t flags = SF_BE | SF_PCMS;
-	flags |= (smp->flags & CHN_16BIT) ? SF_16 : SF_8;
+
+	// plain AIFF has no float encoding, so float samples get saved as 24-bit
+	if (csf_sample_hires(smp->data, smp->flags, smp->length, &hires))
+		bits = (hires == SAMPLE_HIRES_32) ? 32 : 24;
+	else
+		bits = (smp->flags & CHN_16BIT) ? 16 : 8;
+	flags |= (bits == 32) ? SF_32 : (bits == 24) ? SF_24 : (bits == 16) ? SF_16 : SF_8;
 	flags |= (smp->flags & CHN_STEREO) ? SF_SI : SF_M;
 
-	bps = aiff_header(fp, (smp->flags & CHN_16BIT) ? 16 : 8, (smp->flags & CHN_STEREO) ? 2 : 1,
-		smp->c5speed, smp->name, smp->length, NULL);
+	bps = aiff_header(fp, bits, (smp->flags & CHN_STEREO) ? 2 : 1, smp->c5speed, smp->name, smp->length, NULL);
 
 	if (csf_write_sample(fp, smp, flags) != smp->length * bps) {
 		log_appendf(4, "AIFF: unexpected data size written");
@@ -430,7 +441,7 @@ int fmt_aiff_export_head(disko_t *fp, int bits, int channels, int rate)
 #if WORDS_BIGENDIAN
 	awd->swap = 0;
 #else
-	awd->swap = (bits > 8);
+	awd->swap = (bits > 8) ? (bits + 7) / 8 : 0;
 #endif
 
 	return DW_OK;
@@ -448,15 +459,14 @@ int fmt_aiff_export_body(disko_t *fp, const uint8_t *data, size_t length)
 	awd->numbytes += length;
 
 	if (awd->swap) {
-		const int16_t *ptr = (const int16_t *) data;
-		uint16_t v;
-
-		length /= 2;
-		while (length--) {
-			v = *ptr;
-			v = bswapBE16(v);
-			disko_write(fp, &v, 2);
-			ptr++;
+		// 24- and 32-bit values have to be reversed as a whole, not as pairs of 16-bit halves
+		uint8_t v[4];
+		int n;
+
+		for (; length; length -= awd->swap, data += awd->swap) {
+			for (n = 0; n < awd->swap; n++)
+				v[n] = data[awd->swap - 1 - n];
+			disko_write(fp, v, awd->swap);
 		}
 	} else {
 		disko_write(fp, data, length);
@@ -29,30 +29,53 @@
 // IT decompression code from itsex.c (Cubic Player) and load_it.cpp (Modplug)
 // (I suppose this could be considered a merge between the two.)
 
-static uint32_t it_readbits(int8_t n, uint32_t *bitbuf, uint32_t *bitnum, const uint8_t **ibuf)
+// Bits are pulled LSB-first out of a 64-bit accumulator that is topped up a byte at a time, so
+// most reads are a mask and a shift. Bytes past the end of the buffer read as zero (the old
+// bit-at-a-time reader would happily walk off the end of the file here) but still count toward
+// the returned position, so the offsets given back to the caller haven't changed.
+struct it_bitreader {
+	const uint8_t *buf;
+	uint32_t len;           // bytes actually present in buf
+	uint32_t pos;           // next byte to load into the accumulator
+	uint64_t bits;
+	uint32_t avail;         // number of valid bits in the accumulator
+};
+
+static inline void it_bits_start(struct it_bitreader *br, uint32_t pos)
 {
-	uint32_t value = 0;
-	uint32_t i = n;
-
-	// this could be better
-	while (i--) {
-		if (!*bitnum) {
-			*bitbuf = *(*ibuf)++;
-			*bitnum = 8;
-		}
-		value >>= 1;
-		value |= (*bitbuf) << 31;
-		(*bitbuf) >>= 1;
-		(*bitnum)--;
+	br->pos = pos;
+	br->bits = 0;
+	br->avail = 0;
+}
+
+static inline uint32_t it_readbits(struct it_bitreader *br, uint32_t n)
+{
+	uint32_t value;
+
+	if (br->avail < n) {
+		do {
+			br->bits |= (uint64_t) (br->pos < br->len ? br->buf[br->pos] : 0) << br->avail;
+			br->pos++;
+			br->avail += 8;
+		} while (br->avail <= 56);
 	}
-	return value >> (32 - n);
+	value = (uint32_t) br->bits & ((UINT32_C(1) << n) - 1);
+	br->bits >>= n;
+	br->avail -= n;
+	return value;
+}
+
+// Offset of the first byte that hasn't been (even partially) consumed
+static inline uint32_t it_bits_tell(const struct it_bitreader *br)
+{
+	return br->pos - br->avail / 8;
 }
 
 
 uint32_t it_decompress8(void *dest, uint32_t len, const void *file, uint32_t filelen, int it215, int channels)
 {
 	const uint8_t *filebuf;         // source buffer containing compressed sample data
-	const uint8_t *srcbuf;          // current position in source buffer
+	uint32_t srcpos;                // current position in source buffer
 	int8_t *destpos;                // position in destination buffer which will be returned
 	uint16_t blklen;                // length of compressed data block in samples
 	uint16_t blkpos;                // position in block
@@ -60,22 +83,24 @@ uint32_t it_decompress8(void *dest, uint32_t len, const void *file, uint32_t fil
 	uint16_t value;                 // value read from file to be processed
 	int8_t d1, d2;                  // integrator buffers (d2 for it2.15)
 	int8_t v;                       // sample value
-	uint32_t bitbuf, bitnum;        // state for it_readbits
+	struct it_bitreader br;         // state for it_readbits
 
-	filebuf = srcbuf = (const uint8_t *) file;
+	filebuf = (const uint8_t *) file;
+	srcpos = 0;
+	br.buf = filebuf;
+	br.len = filelen;
 	destpos = (int8_t *) dest;
 
 	// now unpack data till the dest buffer is full
 	while (len) {
 		// read a new block of compressed data and reset variables
 		// block layout: word size, <size> bytes data
-		if (srcbuf + 2 > filebuf + filelen
-		    || srcbuf + 2 + (srcbuf[0] | (srcbuf[1] << 8)) > filebuf + filelen) {
+		if (srcpos + 2 > filelen
+		    || srcpos + 2 + (filebuf[srcpos] | (filebuf[srcpos + 1] << 8)) > filelen) {
 			// truncated!
-			return srcbuf - filebuf;
+			return srcpos;
 		}
-		srcbuf += 2;
-		bitbuf = bitnum = 0;
+		it_bits_start(&br, srcpos + 2);
 
 		blklen = MIN(0x8000, len);
 		blkpos = 0;
@@ -88,16 +113,16 @@ uint32_t it_decompress8(void *dest, uint32_t len, const void *file, uint32_t fil
 			if (width > 9) {
 				// illegal width, abort
 				printf("Illegal bit width %d for 8-bit sample\n", width);
-				return srcbuf - filebuf;
+				return it_bits_tell(&br);
 			}
-			value = it_readbits(width, &bitbuf, &bitnum, &srcbuf);
+			value = it_readbits(&br, width);
 
 			if (width < 7) {
 				// method 1 (1-6 bits)
 				// check for "100..."
 				if (value == 1 << (width - 1)) {
 					// yes!
-					value = it_readbits(3, &bitbuf, &bitnum, &srcbuf) + 1; // read new width
+					value = it_readbits(&br, 3) + 1; // read new width
 					width = (value < width) ? value : value + 1; // and expand it
 					continue; // ... next value
 				}
@@ -139,15 +164,16 @@ uint32_t it_decompress8(void *dest, uint32_t len, const void *file, uint32_t fil
 
 		// now subtract block length from total length and go on
 		len -= blklen;
+		srcpos = it_bits_tell(&br);
 	}
-	return srcbuf - filebuf;
+	return srcpos;
 }
 
 // Mostly the same as above.
 uint32_t it_decompress16(void *dest, uint32_t len, const void *file, uint32_t filelen, int it215, int channels)
 {
 	const uint8_t *filebuf;         // source buffer containing compressed sample data
-	const uint8_t *srcbuf;          // current position in source buffer
+	uint32_t srcpos;                // current position in source buffer
 	int16_t *destpos;               // position in destination buffer which will be returned
 	uint16_t blklen;                // length of compressed data block in samples
 	uint16_t blkpos;                // position in block
@@ -155,23 +181,24 @@ uint32_t it_decompress16(void *dest, uint32_t len, const void *file, uint32_t fi
 	uint32_t value;                 // value read from file to be processed
 	int16_t d1, d2;                 // integrator buffers (d2 for it2.15)
 	int16_t v;                      // sample value
-	uint32_t bitbuf, bitnum;        // state for it_readbits
+	struct it_bitreader br;         // state for it_readbits
 
-	filebuf = srcbuf = (const uint8_t *) file;
+	filebuf = (const uint8_t *) file;
+	srcpos = 0;
+	br.buf = filebuf;
+	br.len = filelen;
 	destpos = (int16_t *) dest;
 
 	// now unpack data till the dest buffer is full
 	while (len) {
 		// read a new block of compressed data and reset variables
 		// block layout: word size, <size> bytes data
-		if (srcbuf + 2 > filebuf + filelen
-		    || srcbuf + 2 + (srcbuf[0] | (srcbuf[1] << 8)) > filebuf + filelen) {
+		if (srcpos + 2 > filelen
+		    || srcpos + 2 + (filebuf[srcpos] | (filebuf[srcpos + 1] << 8)) > filelen) {
 			// truncated!
-			return srcbuf - filebuf;
+			return srcpos;
 		}
-		srcbuf += 2;
-
-		bitbuf = bitnum = 0;
+		it_bits_start(&br, srcpos + 2);
 
 		blklen = MIN(0x4000, len); // 0x4000 samples => 0x8000 bytes again
 		blkpos = 0;
@@ -184,16 +211,16 @@ uint32_t it_decompress16(void *dest, uint32_t len, const void *file, uint32_t fi
 			if (width > 17) {
 				// illegal width, abort
 				printf("Illegal bit width %d for 16-bit sample\n", width);
-				return srcbuf - filebuf;
+				return it_bits_tell(&br);
 			}
-			value = it_readbits(width, &bitbuf, &bitnum, &srcbuf);
+			value = it_readbits(&br, width);
 
 			if (width < 7) {
 				// method 1 (1-6 bits)
 				// check for "100..."
 				if (value == (uint32_t) 1 << (width - 1)) {
 					// yes!
-					value = it_readbits(4, &bitbuf, &bitnum, &srcbuf) + 1; // read new width
+					value = it_readbits(&br, 4) + 1; // read new width
 					width = (value < width) ? value : value + 1; // and expand it
 					continue; // ... next value
 				}
@@ -235,8 +262,194 @@ uint32_t it_decompress16(void *dest, uint32_t len, const void *file, uint32_t fi
 
 		// now subtract block length from total length and go on
 		len -= blklen;
+		srcpos = it_bits_tell(&br);
+	}
+	return srcpos;
+}
+
+// ------------------------------------------------------------------------------------------------------------
+// IT compression -- the inverse of the above.
+// The bit width for each value is picked by a shortest-path search over the block: the cost of a value is its
+// width, and switching widths costs one escape value (plus the 3/4-bit width field for widths 1-6). Since any
+// width can be reached from any other in a single switch, only the cheapest predecessor has to be considered.
+// Stereo isn't handled here; Impulse Tracker has no such thing, and neither does the ITS loader.
+
+struct it_bitwriter {
+	uint8_t *buf;
+	uint32_t pos;
+	uint32_t bits;
+	uint32_t avail;
+};
+
+static inline void it_writebits(struct it_bitwriter *bw, uint32_t value, uint32_t n)
+{
+	bw->bits |= (value & ((UINT32_C(1) << n) - 1)) << bw->avail;
+	bw->avail += n;
+	while (bw->avail >= 8) {
+		bw->buf[bw->pos++] = bw->bits & 0xff;
+		bw->bits >>= 8;
+		bw->avail -= 8;
+	}
+}
+
+static inline void it_flushbits(struct it_bitwriter *bw)
+{
+	if (bw->avail)
+		bw->buf[bw->pos++] = bw->bits & 0xff;
+	bw->bits = bw->avail = 0;
+}
+
+// smallest width that can hold v without colliding with the width-change codes
+static int it_value_width(int32_t v, int maxwidth)
+{
+	int gap = (maxwidth == 9) ? 4 : 8;
+	int w;
+
+	for (w = 1; w < maxwidth; w++) {
+		int32_t top = 1 << (w - 1);
+		if (w < 7 ? (v > -top && v < top) : (v >= gap - top && v < top - gap))
+			return w;
+	}
+	return maxwidth;
+}
+
+// v holds the (delta) values for one block, n <= 0x8000; path is scratch space for n * 18 bytes
+static void it_pack_block(struct it_bitwriter *bw, const int32_t *v, uint32_t n, int maxwidth, uint8_t *path)
+{
+	uint32_t cost[18], prev[18];
+	uint32_t i, best, change, limit = n;
+	int w, from, width = maxwidth, chgbits = (maxwidth == 9) ? 3 : 4;
+	const uint32_t inf = 0x3fffffff;
+
+	for (w = 1; w <= maxwidth; w++)
+		cost[w] = (w == maxwidth) ? 0 : inf;
+	for (i = 0; i < n; i++) {
+		int need = it_value_width(v[i], maxwidth);
+
+		memcpy(prev, cost, sizeof(cost));
+		// cheapest way to arrive at a *different* width
+		change = inf;
+		from = maxwidth;
+		for (w = 1; w <= maxwidth; w++) {
+			uint32_t c = prev[w] + w + (w < 7 ? chgbits : 0);
+			if (c < change) {
+				change = c;
+				from = w;
+			}
+		}
+		for (w = 1; w <= maxwidth; w++) {
+			uint8_t *p = path + i * 18 + w;
+			if (w < need) {
+				cost[w] = inf;
+			} else if (prev[w] <= change) {
+				cost[w] = prev[w] + w;
+				*p = w;
+			} else {
+				cost[w] = change + w;
+				*p = from;
+			}
+		}
+	}
+
+	// walk back through the path to find what width each value gets written with
+	best = inf;
+	for (w = 1; w <= maxwidth; w++) {
+		if (cost[w] < best) {
+			best = cost[w];
+			width = w;
+		}
+	}
+	while (limit--) {
+		from = path[limit * 18 + width];
+		path[limit * 18] = width;
+		width = from;
+	}
+
+	width = maxwidth;
+	for (i = 0; i < n; i++) {
+		int want = path[i * 18];
+
+		if (want != width) {
+			int code = (want < width) ? want : want - 1;
+			if (width < 7) {
+				it_writebits(bw, 1 << (width - 1), width);
+				it_writebits(bw, code - 1, chgbits);
+			} else if (width < maxwidth) {
+				int border = (((1 << width) - 1) >> 1) - (maxwidth == 9 ? 4 : 8);
+				it_writebits(bw, border + code, width);
+			} else {
+				it_writebits(bw, (1 << (maxwidth - 1)) | (want - 1), width);
+			}
+			width = want;
+		}
+		// at full width the top bit is the width-change flag, so the value itself has to stay out of it
+		it_writebits(bw, (width == maxwidth) ? v[i] & ((1 << (maxwidth - 1)) - 1) : v[i], width);
+	}
+	it_flushbits(bw);
+}
+
+// largest possible output for len samples
+uint32_t it_compress_bound(uint32_t len, int is16)
+{
+	uint32_t blklen = is16 ? 0x4000 : 0x8000;
+
+	return (len / blklen + 1) * (blklen * (is16 ? 17 : 9) / 8 + 3);
+}
+
+static uint32_t it_compress(void *dest, const void *src, uint32_t len, int it215, int is16)
+{
+	struct it_bitwriter bw = { .buf = dest };
+	uint32_t blkmax = is16 ? 0x4000 : 0x8000;
+	uint32_t blklen, n, hdr;
+	int32_t *v;
+	uint8_t *path;
+
+	if (!len)
+		return 0;
+	v = mem_alloc(sizeof(int32_t) * MIN(len, blkmax));
+	path = mem_alloc(18 * MIN(len, blkmax));
+
+	while (len) {
+		int32_t d1 = 0, d2 = 0, s, prev = 0;
+
+		blklen = MIN(blkmax, len);
+		for (n = 0; n < blklen; n++) {
+			if (is16) {
+				s = ((const int16_t *) src)[n];
+				d2 = (int16_t) (s - prev);
+				v[n] = it215 ? (int16_t) (d2 - d1) : d2;
+			} else {
+				s = ((const int8_t *) src)[n];
+				d2 = (int8_t) (s - prev);
+				v[n] = it215 ? (int8_t) (d2 - d1) : d2;
+			}
+			d1 = d2;
+			prev = s;
+		}
+
+		hdr = bw.pos;
+		bw.pos += 2;
+		it_pack_block(&bw, v, blklen, is16 ? 17 : 9, path);
+		bw.buf[hdr] = (bw.pos - hdr - 2) & 0xff;
+		bw.buf[hdr + 1] = (bw.pos - hdr - 2) >> 8;
+
+		src = (const int8_t *) src + (is16 ? 2 : 1) * blklen;
+		len -= blklen;
 	}
-	return srcbuf - filebuf;
+
+	free(path);
+	free(v);
+	return bw.pos;
+}
+
+uint32_t it_compress8(void *dest, const void *src, uint32_t len, int it215)
+{
+	return it_compress(dest, src, len, it215, 0);
+}
+
+uint32_t it_compress16(void *dest, const void *src, uint32_t len, int it215)
+{
+	return it_compress(dest, src, len, it215, 1);
 }
 
 // ------------------------------------------------------------------------------------------------------------
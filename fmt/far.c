@@ -205,7 +205,7 @@ int fmt_far_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 		rows = (pattern_size[pat] - 2) / (16 * 4);
 		if (!rows)
 			continue;
-		note = song->patterns[pat] = csf_allocate_pattern(rows);
+		note = song->patterns[pat] = csf_allocate_pattern(song, rows);
 		song->pattern_size[pat] = song->pattern_alloc_size[pat] = rows;
 		breakpos = breakpos && breakpos < rows - 2 ? breakpos + 1 : -1;
 		for (row = 0; row < rows; row++, note += 48) {
@@ -243,8 +243,7 @@ int fmt_far_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 			smp->flags |= CHN_LOOP;
 		smp->c5speed = 16726;
 		smp->global_volume = 64;
-		csf_read_sample(smp, SF_LE | SF_M | SF_PCMS | ((fsmp.type & 1) ? SF_16 : SF_8),
-			fp->data + fp->pos, fp->length - fp->pos);
+		fmt_read_sample(smp, SF_LE | SF_M | SF_PCMS | ((fsmp.type & 1) ? SF_16 : SF_8), fp);
 		slurp_seek(fp, fsmp.length, SEEK_CUR);
 	}
 
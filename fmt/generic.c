@@ -24,6 +24,125 @@
 #include "headers.h"
 #include "fmt.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+
+/* --------------------------------------------------------------------------------------------------------- */
+
+#define MAGIC(t, offset, bytes) { #t, offset, sizeof(bytes) - 1, bytes },
+static const struct {
+	const char *type;
+	size_t offset, length;
+	const char *bytes;
+} magic_table[] = {
+#include "fmt-types.h"
+	{ NULL, 0, 0, NULL },
+};
+
+int fmt_magic_possible(const char *type, const uint8_t *data, size_t length)
+{
+	int n, declared = 0;
+
+	for (n = 0; magic_table[n].type; n++) {
+		if (strcmp(magic_table[n].type, type) != 0)
+			continue;
+		if (magic_table[n].offset + magic_table[n].length <= length
+		    && memcmp(data + magic_table[n].offset, magic_table[n].bytes, magic_table[n].length) == 0)
+			return 1;
+		declared = 1;
+	}
+	return !declared;
+}
+
+static struct {
+	const char *what;
+	struct fmt_probe_stats *stats;
+} probe_tables[4];
+static int num_probe_tables = 0;
+
+static void fmt_probe_stats_dump(void)
+{
+	struct fmt_probe_stats *s;
+	int n;
+
+	for (n = 0; n < num_probe_tables; n++) {
+		printf("%s:\n", probe_tables[n].what);
+		for (s = probe_tables[n].stats; s->type; s++) {
+			if (s->probes || s->skipped)
+				printf("  %-6s %8u probed %8u skipped %8u matched\n",
+					s->type, s->probes, s->skipped, s->hits);
+		}
+	}
+}
+
+void fmt_probe_stats_register(const char *what, struct fmt_probe_stats *stats)
+{
+	const char *debug = getenv("SCHISM_DEBUG");
+
+	if (!debug || !strstr(debug, "probe") || num_probe_tables >= ARRAY_SIZE(probe_tables))
+		return;
+	if (!num_probe_tables)
+		atexit(fmt_probe_stats_dump);
+	probe_tables[num_probe_tables].what = what;
+	probe_tables[num_probe_tables].stats = stats;
+	num_probe_tables++;
+}
+
+/* --------------------------------------------------------------------------------------------------------- */
+
+/* how many bytes of the file a sample with these flags takes up, if that can be told without decoding it */
+static size_t sample_bytes(song_sample_t *smp, uint32_t flags, slurp_t *fp)
+{
+	size_t bytes = 0;
+	uint32_t len, blklen;
+	uint8_t *p;
+	int chn;
+
+	switch (flags & SF_ENC_MASK) {
+	case SF_PCMS: case SF_PCMU: case SF_PCMD: case SF_PCMF:
+		return (size_t) smp->length * (((flags & SF_BIT_MASK) + 7) / 8)
+			* (((flags & SF_CHN_MASK) == SF_M) ? 1 : 2);
+	case SF_IT214: case SF_IT215:
+		// the compressed blocks each start with their size
+		blklen = ((flags & SF_BIT_MASK) == 16) ? 0x4000 : 0x8000;
+		for (chn = ((flags & SF_CHN_MASK) == SF_M) ? 1 : 2; chn; chn--) {
+			for (len = smp->length; len; len -= MIN(len, blklen)) {
+				p = slurp_peek(fp, bytes + 2);
+				if (slurp_available(fp) < bytes + 2)
+					return bytes;
+				bytes += 2 + (p[bytes] | (p[bytes + 1] << 8));
+			}
+		}
+		return bytes;
+	default:
+		return fp->length - fp->pos;
+	}
+}
+
+uint32_t fmt_read_sample(song_sample_t *smp, uint32_t flags, slurp_t *fp)
+{
+	const uint8_t *data = slurp_peek(fp, sample_bytes(smp, flags, fp));
+
+	return csf_read_sample(smp, flags, data, slurp_available(fp));
+}
+
+uint8_t *fmt_copy_deferred_sample(song_sample_t *smp, slurp_t *fp, uint32_t *len)
+{
+	uint8_t *data;
+	size_t bytes;
+
+	*len = 0;
+	if (!smp->deferred_flags || slurp_seek(fp, smp->deferred_offset, SEEK_SET) != 0)
+		return NULL;
+	bytes = sample_bytes(smp, smp->deferred_flags, fp);
+	data = slurp_peek(fp, bytes);
+	bytes = MIN(bytes, slurp_available(fp));
+	if (!data || !bytes || bytes > UINT32_MAX)
+		return NULL;
+	*len = bytes;
+	return memcpy(mem_alloc(bytes), data, bytes);
+}
+
 /* --------------------------------------------------------------------------------------------------------- */
 
 static int _mod_period_to_note(int period)
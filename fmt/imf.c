@@ -283,7 +283,7 @@ static int load_imf_pattern(song_t *song, int pat, uint32_t ignore_channels, slu
 	slurp_read(fp, &nrows, 2);
 	nrows = bswapLE16(nrows);
 
-	row_data = song->patterns[pat] = csf_allocate_pattern(nrows);
+	row_data = song->patterns[pat] = csf_allocate_pattern(song, nrows);
 	song->pattern_size[pat] = song->pattern_alloc_size[pat] = nrows;
 
 	row = 0;
@@ -568,7 +568,7 @@ int fmt_imf_load_song(song_t *song, slurp_t *fp, UNUSED unsigned int lflags)
 				sample->flags |= CHN_PANNING;
 
 			if (blen && !(lflags & LOAD_NOSAMPLES))
-				csf_read_sample(sample, sflags, fp->data + fp->pos, fp->length - fp->pos);
+				fmt_read_sample(sample, sflags, fp);
 			slurp_seek(fp, blen, SEEK_CUR);
 
 			sample++;
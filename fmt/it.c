@@ -181,19 +181,27 @@ static void load_it_notetrans(song_instrument_t *instrument, struct it_notetrans
 
 
 
-static void load_it_pattern(song_note_t *note, slurp_t *fp, int rows)
+/* Unpack a pattern straight out of the slurp buffer; reading past the end of the file yields 255,
+same as slurp_getc would have returned. (If the file is being unpacked as it's read, the "end of the file" can
+come right after the 'bytes' the header says there are.) Afterwards the slurp is left at the end of the packed
+data. */
+#define IT_PATTERN_BYTE() (p < end ? *p++ : 255)
+static void load_it_pattern(song_note_t *note, slurp_t *fp, int rows, size_t bytes)
 {
+	const uint8_t *start = slurp_peek(fp, bytes);
+	const uint8_t *end = start + slurp_available(fp);
+	const uint8_t *p = start;
 	song_note_t last_note[64];
 	int chan, row = 0;
 	uint8_t last_mask[64] = { 0 };
 	uint8_t chanvar, maskvar, c;
 
 	while (row < rows) {
-		chanvar = slurp_getc(fp);
+		chanvar = IT_PATTERN_BYTE();
 
-		if (chanvar == 255 && slurp_eof(fp)) {
+		if (chanvar == 255 && p >= end) {
 			/* truncated file? we might want to complain or something ... eh. */
-			return;
+			break;
 		}
 
 		if (chanvar == 0) {
@@ -203,13 +211,13 @@ static void load_it_pattern(song_note_t *note, slurp_t *fp, int rows)
 		}
 		chan = (chanvar - 1) & 63;
 		if (chanvar & 128) {
-			maskvar = slurp_getc(fp);
+			maskvar = IT_PATTERN_BYTE();
 			last_mask[chan] = maskvar;
 		} else {
 			maskvar = last_mask[chan];
 		}
 		if (maskvar & ITNOTE_NOTE) {
-			c = slurp_getc(fp);
+			c = IT_PATTERN_BYTE();
 			if (c == 255)
 				c = NOTE_OFF;
 			else if (c == 254)
@@ -226,17 +234,17 @@ static void load_it_pattern(song_note_t *note, slurp_t *fp, int rows)
 			last_note[chan].note = note[chan].note;
 		}
 		if (maskvar & ITNOTE_SAMPLE) {
-			note[chan].instrument = slurp_getc(fp);
+			note[chan].instrument = IT_PATTERN_BYTE();
 			last_note[chan].instrument = note[chan].instrument;
 		}
 		if (maskvar & ITNOTE_VOLUME) {
-			it_import_voleffect(note + chan, slurp_getc(fp));
+			it_import_voleffect(note + chan, IT_PATTERN_BYTE());
 			last_note[chan].voleffect = note[chan].voleffect;
 			last_note[chan].volparam = note[chan].volparam;
 		}
 		if (maskvar & ITNOTE_EFFECT) {
-			note[chan].effect = slurp_getc(fp) & 0x1f;
-			note[chan].param = slurp_getc(fp);
+			note[chan].effect = IT_PATTERN_BYTE() & 0x1f;
+			note[chan].param = IT_PATTERN_BYTE();
 			csf_import_s3m_effect(note + chan, 1);
 			last_note[chan].effect = note[chan].effect;
 			last_note[chan].param = note[chan].param;
@@ -254,7 +262,9 @@ static void load_it_pattern(song_note_t *note, slurp_t *fp, int rows)
 			note[chan].param = last_note[chan].param;
 		}
 	}
+	fp->pos += p - start;
 }
+#undef IT_PATTERN_BYTE
 
 
 
@@ -391,7 +401,7 @@ static void load_it_instrument(song_instrument_t *instrument, slurp_t *fp)
 }
 
 
-static void load_it_sample(song_sample_t *sample, slurp_t *fp, uint16_t cwtv)
+static void load_it_sample(song_sample_t *sample, slurp_t *fp, uint16_t cwtv, unsigned int lflags)
 {
 	struct it_sample shdr;
 
@@ -417,7 +427,7 @@ static void load_it_sample(song_sample_t *sample, slurp_t *fp, uint16_t cwtv)
 	sample->volume = MIN(shdr.vol, 64) * 4; //mphack
 	sample->panning = MIN(shdr.dfp, 64) * 4; //mphack
 	sample->length = bswapLE32(shdr.length);
-	sample->length = MIN(sample->length, MAX_SAMPLE_LENGTH);
+	sample->length = MIN(sample->length, MAX_STREAMED_SAMPLE_LENGTH);
 	sample->loop_start = bswapLE32(shdr.loop_start);
 	sample->loop_end = bswapLE32(shdr.loop_end);
 	sample->c5speed = bswapLE32(shdr.c5speed);
@@ -459,7 +469,12 @@ static void load_it_sample(song_sample_t *sample, slurp_t *fp, uint16_t cwtv)
 			flags |= (shdr.cvt & 4) ? SF_PCMD : (shdr.cvt & 1) ? SF_PCMS : SF_PCMU;
 		}
 		flags |= (shdr.flag & 2) ? SF_16 : SF_8;
-		csf_read_sample(sample, flags, fp->data + fp->pos, fp->length - fp->pos);
+		if ((lflags & LOAD_DEFERSAMPLES) || ((lflags & LOAD_DEFERCOMPRESSED) && (shdr.flag & 8))) {
+			sample->deferred_offset = fp->pos;
+			sample->deferred_flags = flags;
+		} else {
+			fmt_read_sample(sample, flags, fp);
+		}
 	} else {
 		sample->length = 0;
 	}
@@ -637,7 +652,7 @@ int fmt_it_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 
 		for (n = 0, sample = song->samples + 1; n < hdr.smpnum; n++, sample++) {
 			slurp_seek(fp, para_smp[n], SEEK_SET);
-			load_it_sample(sample, fp, hdr.cwtv);
+			load_it_sample(sample, fp, hdr.cwtv, lflags);
 		}
 	}
 
@@ -654,9 +669,9 @@ int fmt_it_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 			slurp_read(fp, &rows, 2);
 			rows = bswapLE16(rows);
 			slurp_seek(fp, 4, SEEK_CUR);
-			song->patterns[n] = csf_allocate_pattern(rows);
+			song->patterns[n] = csf_allocate_pattern(song, rows);
 			song->pattern_size[n] = song->pattern_alloc_size[n] = rows;
-			load_it_pattern(song->patterns[n], fp, rows);
+			load_it_pattern(song->patterns[n], fp, rows, bytes);
 			got = slurp_tell(fp) - para_pat[n] - 8;
 			if (bytes != got)
 				log_appendf(4, " Warning: Pattern %d: size mismatch"
@@ -175,7 +175,16 @@ int fmt_its_load_sample(const uint8_t *data, size_t length, song_sample_t *smp)
 	return load_its_sample(data, data, length, smp);
 }
 
-void save_its_header(disko_t *fp, song_sample_t *smp)
+uint32_t its_sample_flags(song_sample_t *smp, uint32_t compress)
+{
+	uint32_t flags = SF_LE | ((smp->flags & CHN_16BIT) ? SF_16 : SF_8);
+
+	if (compress && !(smp->flags & CHN_STEREO) && smp->data && smp->length)
+		return flags | SF_M | compress;
+	return flags | SF_PCMS | ((smp->flags & CHN_STEREO) ? SF_SS : SF_M);
+}
+
+void save_its_header(disko_t *fp, song_sample_t *smp, uint32_t flags)
 {
 	struct it_sample its;
 
@@ -201,6 +210,14 @@ void save_its_header(disko_t *fp, song_sample_t *smp)
 	strncpy((char *) its.name, smp->name, 25);
 	its.name[25] = 0;
 	its.cvt = 1;                    // signed samples
+	switch (flags & SF_ENC_MASK) {
+	case SF_IT215:
+		its.cvt |= 4;           // delta values are themselves delta-encoded
+		// fall through
+	case SF_IT214:
+		its.flags |= 8;
+		break;
+	}
 	its.dfp = smp->panning / 4;
 	if (smp->flags & CHN_PANNING)
 		its.dfp |= 0x80;
@@ -225,12 +242,12 @@ void save_its_header(disko_t *fp, song_sample_t *smp)
 	disko_write(fp, &its, sizeof(its));
 }
 
-int fmt_its_save_sample(disko_t *fp, song_sample_t *smp)
+static int save_its(disko_t *fp, song_sample_t *smp, uint32_t compress)
 {
-	save_its_header(fp, smp);
-	csf_write_sample(fp, smp, SF_LE | SF_PCMS
-			| ((smp->flags & CHN_16BIT) ? SF_16 : SF_8)
-			| ((smp->flags & CHN_STEREO) ? SF_SS : SF_M));
+	uint32_t flags = its_sample_flags(smp, compress);
+
+	save_its_header(fp, smp, flags);
+	csf_write_sample(fp, smp, flags);
 
 	/* Write the sample pointer. In an ITS file, the sample data is right after the header,
 	so its position in the file will be the same as the size of the header. */
@@ -241,3 +258,13 @@ int fmt_its_save_sample(disko_t *fp, song_sample_t *smp)
 	return SAVE_SUCCESS;
 }
 
+int fmt_its_save_sample(disko_t *fp, song_sample_t *smp)
+{
+	return save_its(fp, smp, 0);
+}
+
+int fmt_its215_save_sample(disko_t *fp, song_sample_t *smp)
+{
+	return save_its(fp, smp, SF_IT215);
+}
+
@@ -337,9 +337,9 @@ static int cram_mdl_effects(song_note_t *note, uint8_t vol, uint8_t e1, uint8_t
 	translate_fx(&e1, &p1);
 	translate_fx(&e2, &p2);
 	/* From the Digitrakker documentation:
-		* EFx -xx - Set Sample Offset
-		This  is a  double-command.  It starts the
-		sample at adress xxx*256.
+		* EFx -xx - Set Sample Offset
+		This  is a  double-command.  It starts the
+		sample at adress xxx*256.
 		Example: C-5 01 -- EF1 -23 ->starts sample
 		01 at address 12300 (in hex).
 	Kind of screwy, but I guess it's better than the mess required to do it with IT (which effectively
@@ -497,7 +497,7 @@ static struct mdlpat *mdl_read_patterns(song_t *song, slurp_t *fp)
 		rows = slurp_getc(fp) + 1;
 		slurp_seek(fp, 16, SEEK_CUR); // skip the name
 
-		note = song->patterns[pat] = csf_allocate_pattern(rows);
+		note = song->patterns[pat] = csf_allocate_pattern(song, rows);
 		song->pattern_size[pat] = song->pattern_alloc_size[pat] = rows;
 		for (chn = 0; chn < nchn; chn++, note++) {
 			slurp_read(fp, &trknum, 2);
@@ -530,7 +530,7 @@ static struct mdlpat *mdl_read_patterns_v0(song_t *song, slurp_t *fp)
 	npat = MIN(npat, MAX_PATTERNS);
 	for (pat = 0; pat < npat; pat++) {
 
-		note = song->patterns[pat] = csf_allocate_pattern(64);
+		note = song->patterns[pat] = csf_allocate_pattern(song, 64);
 		song->pattern_size[pat] = song->pattern_alloc_size[pat] = 64;
 		for (chn = 0; chn < 32; chn++, note++) {
 			slurp_read(fp, &trknum, 2);
@@ -1009,8 +1009,7 @@ int fmt_mdl_load_song(song_t *song, slurp_t *fp, UNUSED unsigned int lflags)
 				flags = SF_LE | SF_M;
 				flags |= packtype[n] ? SF_MDL : SF_PCMS;
 				flags |= (song->samples[n].flags & CHN_16BIT) ? SF_16 : SF_8;
-				smpsize = csf_read_sample(song->samples + n, flags,
-					fp->data + fp->pos, fp->length - fp->pos);
+				smpsize = fmt_read_sample(song->samples + n, flags, fp);
 				slurp_seek(fp, smpsize, SEEK_CUR);
 			}
 		} else {
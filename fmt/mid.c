@@ -107,77 +107,58 @@ static unsigned int read_varlen(slurp_t *fp)
 }
 
 /* --------------------------------------------------------------------------------------------------------- */
-// info (this is ultra lame)
+// reading
 
-int fmt_mid_read_info(dmoz_file_t *file, const uint8_t *data, size_t length)
+// returns zero if it isn't a MIDI file
+static int read_header(slurp_t *fp, struct mthd *mthd)
 {
-	slurp_t fp = {.length = length, .data = (uint8_t *) data, .pos = 0};
-	song_t *tmpsong = csf_allocate();
-
-	if (!tmpsong)
-		return 0; // wahhhh
-	if (fmt_mid_load_song(tmpsong, &fp, LOAD_NOSAMPLES | LOAD_NOPATTERNS) == LOAD_SUCCESS) {
-		file->description = "Standard MIDI File";
-		file->title = strdup(tmpsong->title);
-		file->type = TYPE_MODULE_MOD;
-		csf_free(tmpsong);
-		return 1;
+	unsigned char buf[4];
+
+	slurp_read(fp, buf, 4);
+	if (memcmp(buf, "RIFF", 4) == 0) {
+		// Stupid MS crap.
+		slurp_seek(fp, 16, SEEK_CUR);
+		slurp_read(fp, buf, 4);
 	}
-	csf_free(tmpsong);
-	return 0;
+	if (memcmp(buf, "MThd", 4) != 0 || slurp_read(fp, mthd, sizeof(*mthd)) != sizeof(*mthd))
+		return 0;
+	mthd->header_length = bswapBE32(mthd->header_length);
+	// don't care about format, either there's one track or more than one track. whoop de doo.
+	// (format 2 MIDs will probably be hilariously broken, but I don't have any and also don't care)
+	mthd->format = bswapBE16(mthd->format);
+	mthd->num_tracks = bswapBE16(mthd->num_tracks);
+	mthd->division = bswapBE16(mthd->division);
+	slurp_seek(fp, mthd->header_length - 6, SEEK_CUR); // account for potential weirdness
+	return 1;
 }
 
-/* --------------------------------------------------------------------------------------------------------- */
-// load
-
-int fmt_mid_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
+/* Walk through all of the tracks. With a song, this sets up its message and samples, and puts the events
+into the queue after 'event_queue' in pulse order; without one, it only looks for the title, and stops as soon
+as it has it. 'title' is at least 26 bytes, and should start out empty. If 'quiet' is set, nothing is logged,
+which is how the file browser's scan threads have to call it. */
+static void read_tracks(slurp_t *fp, const struct mthd *mthd, song_t *song, unsigned int lflags, int quiet,
+	char *title, struct event *event_queue)
 {
-	struct mthd mthd;
-	struct mtrk mtrk;
-	unsigned char buf[32];
+	unsigned char buf[4];
 	song_note_t note;
-	struct event *event_queue, *cur, *prev, *new;
+	struct event *cur = NULL, *prev = NULL, *new;
 	struct {
 		uint8_t fg_note;
 		uint8_t bg_note; // really just used as a boolean...
 		uint8_t instrument;
 	} midich[16] = {{NOTE_NONE, NOTE_NONE, 0}};
-	char *message_cur = song->message;
+	char *message_cur = song ? song->message : NULL;
 	unsigned int message_left = MAX_MESSAGE;
 	unsigned int pulse = 0; // cumulative time from start of track
 	uint8_t patch_samples[128] = {0};
 	uint8_t nsmp = 1; // Next free sample
+	const char *text;
 
-	slurp_read(fp, buf, 4);
-	if (memcmp(buf, "RIFF", 4) == 0) {
-		// Stupid MS crap.
-		slurp_seek(fp, 16, SEEK_CUR);
-		slurp_read(fp, buf, 4);
-	}
-	if (memcmp(buf, "MThd", 4) != 0 || slurp_read(fp, &mthd, sizeof(mthd)) != sizeof(mthd)) {
-		return LOAD_UNSUPPORTED;
-	}
-	mthd.header_length = bswapBE32(mthd.header_length);
-	// don't care about format, either there's one track or more than one track. whoop de doo.
-	// (format 2 MIDs will probably be hilariously broken, but I don't have any and also don't care)
-	mthd.format = bswapBE16(mthd.format);
-	mthd.num_tracks = bswapBE16(mthd.num_tracks);
-	mthd.division = bswapBE16(mthd.division);
-	slurp_seek(fp, mthd.header_length - 6, SEEK_CUR); // account for potential weirdness
-
-	song->title[0] = '\0'; // should be already, but to be sure...
+	if (!song)
+		lflags |= LOAD_NOSAMPLES;
 
-	/* We'll count by "pulses" here, which are basically MIDI-speak for ticks, except that there are a heck
-	of a lot more of them. (480 pulses/quarter is fairly common, that's like A78, if the tempo could be
-	adjusted high enough to make practical use of that speed)
-	Also, we'll use a 32-bit value and hopefully not overflow -- which is unlikely anyway, as it'd either
-	require PPQN to be very ridiculously high, or a file that's several *hours* long.
-
-	Stuff a useless event at the start of the event queue. */
-	note = (song_note_t) {.note = NOTE_NONE};
-	event_queue = alloc_event(0, 0, &note, NULL);
-
-	for (int trknum = 0; trknum < mthd.num_tracks; trknum++) {
+	for (int trknum = 0; trknum < mthd->num_tracks && (song || !title[0]); trknum++) {
+		struct mtrk mtrk;
 		unsigned int delta; // time since last event (read from file)
 		unsigned int vlen; // some other generic varlen number
 		int rs = 0; // running status byte
@@ -187,27 +168,33 @@ int fmt_mid_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 		int found_end = 0;
 		long nextpos;
 
-		cur = event_queue->next;
-		prev = event_queue;
+		if (event_queue) {
+			cur = event_queue->next;
+			prev = event_queue;
+		}
 		pulse = 0;
 
 		if (slurp_read(fp, &mtrk, sizeof(mtrk)) != sizeof(mtrk)) {
-			log_appendf(4, " Warning: Short read on track header (truncated?)");
+			if (!quiet)
+				log_appendf(4, " Warning: Short read on track header (truncated?)");
 			break;
 		}
 		if (memcmp(mtrk.tag, "MTrk", 4) != 0) {
-			log_appendf(4, " Warning: Invalid track header (corrupt file?)");
+			if (!quiet)
+				log_appendf(4, " Warning: Invalid track header (corrupt file?)");
 			break;
 		}
 		mtrk.length = bswapBE32(mtrk.length);
 		nextpos = slurp_tell(fp) + mtrk.length; // where this track is supposed to end
 
-		while (!found_end && slurp_tell(fp) < nextpos) {
+		while (!found_end && (song || !title[0]) && slurp_tell(fp) < nextpos && !slurp_eof(fp)) {
 			delta = read_varlen(fp); // delta-time
 			pulse += delta; // 'real' pulse count
+			if (slurp_eof(fp))
+				break;
 
 			// get status byte, if there is one
-			if (fp->data[fp->pos] & 0x80) {
+			if (*slurp_peek(fp, 1) & 0x80) {
 				status = slurp_getc(fp);
 			} else if (rs & 0x80) {
 				status = rs;
@@ -292,7 +279,7 @@ int fmt_mid_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 				continue;
 			case 0xc: // program change - x (instrument/voice selection)
 				rs = status;
-				x = slurp_getc(fp);
+				x = slurp_getc(fp) & 0x7f; // (data bytes are 7-bit; anything else is garbage)
 				midich[cn].instrument = x;
 				// look familiar? this was copied from the .mus loader
 				if (!patch_samples[x] && !(lflags & LOAD_NOSAMPLES)) {
@@ -301,7 +288,7 @@ int fmt_mid_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 						patch_samples[x] = nsmp;
 						adlib_patch_apply(song->samples + nsmp, x);
 						nsmp++;
-					} else {
+					} else if (!quiet) {
 						log_appendf(4, " Warning: Too many samples");
 					}
 				}
@@ -331,21 +318,25 @@ int fmt_mid_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 					case 0x5: // lyric
 					case 0x6: // marker
 					case 0x7: // cue point
+						// (the text only goes as far as the message has room for)
 						y = MIN(vlen, message_left - 1);
-						slurp_read(fp, message_cur, y);
-						if (x == 3 && y && !song->title[0]) {
-							strncpy(song->title, message_cur, MIN(y, 25));
-							song->title[25] = '\0';
+						text = (const char *) slurp_peek(fp, y);
+						y = MIN(y, slurp_available(fp));
+						if (x == 3 && y && !title[0]) {
+							strncpy(title, text, MIN(y, 25));
+							title[25] = '\0';
+						}
+						if (message_cur) {
+							memcpy(message_cur, text, y);
+							message_cur += y;
 						}
-						message_cur += y;
 						message_left -= y;
-						if (y && message_cur[-1] != '\n') {
-							*message_cur++ = '\n';
+						if (y && text[y - 1] != '\n') {
+							if (message_cur)
+								*message_cur++ = '\n';
 							message_left--;
 						}
-						vlen -= y;
-						if (vlen)
-							slurp_seek(fp, vlen, SEEK_CUR);
+						slurp_seek(fp, vlen, SEEK_CUR);
 						continue;
 
 					case 0x20: // MIDI channel (FF 20 len* cc)
@@ -364,7 +355,7 @@ int fmt_mid_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 						memset(buf, 0, 4);
 						y = MIN(vlen, 4);
 						slurp_read(fp, buf + (4 - y), y);
-						bpm = buf[0] << 24 | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+						bpm = (uint32_t) buf[0] << 24 | (buf[1] << 16) | (buf[2] << 8) | buf[3];
 						bpm = CLAMP(60000000 / (bpm ?: 1), 0x20, 0xff);
 						note = (song_note_t) {.effect = FX_TEMPO, .param = bpm};
 						vlen -= y;
@@ -381,7 +372,8 @@ int fmt_mid_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 
 					default:
 						// some mystery crap
-						log_appendf(2, " Unknown meta-event FF %02X", x);
+						if (!quiet)
+							log_appendf(2, " Unknown meta-event FF %02X", x);
 						continue;
 					}
 					slurp_seek(fp, vlen, SEEK_CUR);
@@ -399,6 +391,8 @@ int fmt_mid_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 				}
 			}
 
+			if (!event_queue)
+				continue;
 			// skip past any events with a lower pulse count (from other channels)
 			while (cur && pulse > cur->pulse) {
 				prev = cur;
@@ -410,11 +404,59 @@ int fmt_mid_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 			prev = prev->next;
 		}
 		if (slurp_tell(fp) != nextpos) {
-			log_appendf(2, " Track %d ended %ld bytes from boundary",
-				trknum, slurp_tell(fp) - nextpos);
+			if (!quiet)
+				log_appendf(2, " Track %d ended %ld bytes from boundary",
+					trknum, slurp_tell(fp) - nextpos);
 			slurp_seek(fp, nextpos, SEEK_SET);
 		}
 	}
+}
+
+/* --------------------------------------------------------------------------------------------------------- */
+// info (this is ultra lame)
+
+int fmt_mid_read_info(dmoz_file_t *file, const uint8_t *data, size_t length)
+{
+	slurp_t fp = {.length = length, .data = (uint8_t *) data, .pos = 0};
+	struct mthd mthd;
+	char title[26] = "";
+
+	if (!read_header(&fp, &mthd))
+		return 0;
+	read_tracks(&fp, &mthd, NULL, 0, 1, title, NULL);
+
+	file->description = "Standard MIDI File";
+	file->title = str_dup(title);
+	file->type = TYPE_MODULE_MOD;
+	return 1;
+}
+
+/* --------------------------------------------------------------------------------------------------------- */
+// load
+
+int fmt_mid_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
+{
+	struct mthd mthd;
+	song_note_t note;
+	struct event *event_queue, *cur, *prev;
+	unsigned int pulse;
+
+	if (!read_header(fp, &mthd))
+		return LOAD_UNSUPPORTED;
+
+	song->title[0] = '\0'; // should be already, but to be sure...
+
+	/* We'll count by "pulses" here, which are basically MIDI-speak for ticks, except that there are a heck
+	of a lot more of them. (480 pulses/quarter is fairly common, that's like A78, if the tempo could be
+	adjusted high enough to make practical use of that speed)
+	Also, we'll use a 32-bit value and hopefully not overflow -- which is unlikely anyway, as it'd either
+	require PPQN to be very ridiculously high, or a file that's several *hours* long.
+
+	Stuff a useless event at the start of the event queue. */
+	note = (song_note_t) {.note = NOTE_NONE};
+	event_queue = alloc_event(0, 0, &note, NULL);
+
+	read_tracks(fp, &mthd, song, lflags, 0, song->title, event_queue);
 
 	song->initial_speed = 3;
 	song->initial_tempo = 120;
@@ -457,14 +499,16 @@ int fmt_mid_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 		}
 		pulse = cur->pulse;
 
-		while (row >= MID_ROWS_PER_PATTERN) {
+		while (row >= MID_ROWS_PER_PATTERN && pat < MAX_PATTERNS) {
 			// New pattern time!
-			pattern = song->patterns[pat] = csf_allocate_pattern(MID_ROWS_PER_PATTERN);
+			pattern = song->patterns[pat] = csf_allocate_pattern(song, MID_ROWS_PER_PATTERN);
 			song->pattern_size[pat] = song->pattern_alloc_size[pat] = MID_ROWS_PER_PATTERN;
 			song->orderlist[pat] = pat;
 			pat++;
 			row -= MID_ROWS_PER_PATTERN;
 		}
+		if (row >= MID_ROWS_PER_PATTERN)
+			break; // out of patterns; drop the rest of the song
 		rowdata = pattern + 64 * row;
 		if (cur->note.note) {
 			rowdata[cur->chan].note = cur->note.note;
@@ -483,6 +527,11 @@ int fmt_mid_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 		cur = cur->next;
 		free(prev);
 	}
+	while (cur) {
+		prev = cur;
+		cur = cur->next;
+		free(prev);
+	}
 
 	return LOAD_SUCCESS;
 }
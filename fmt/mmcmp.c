@@ -89,190 +89,422 @@ static uint32_t get_bits(mm_bit_buffer_t *bb, uint32_t bits)
 }
 
 
-int mmcmp_unpack(uint8_t **data, size_t *length)
-{
-	size_t memlength;
-	uint8_t *memfile;
-	uint8_t *buffer;
-	mm_header_t hdr;
-	uint32_t *pblk_table;
-	size_t filesize;
-	uint32_t block, i;
+/* The block table, read once: where each block's packed data and subblock list are in the file. */
+struct mm_block_info {
+	mm_block_t hdr;
+	const mm_subblock_t *sub;
+	size_t pos; // of the packed data
+	size_t bytes; // how much it unpacks to
+	uint32_t stamp; // when it was last used, for unpacking lazily; zero if it's not unpacked
+};
 
-	if (!data || !*data || !length || *length < 256) {
-		return 0;
-	}
-	memlength = *length;
-	memfile = *data;
-
-	memcpy(&hdr, memfile, sizeof(hdr));
-	hdr.hdrsize = bswapLE16(hdr.hdrsize);
-	hdr.version = bswapLE16(hdr.version);
-	hdr.blocks = bswapLE16(hdr.blocks);
-	hdr.filesize = bswapLE32(hdr.filesize);
-	hdr.blktable = bswapLE32(hdr.blktable);
-
-	if (memcmp(hdr.zirconia, "ziRCONia", 8) != 0
-	    || hdr.hdrsize < 14
-	    || hdr.blocks == 0
-	    || hdr.filesize < 16
-	    || hdr.filesize > 0x8000000
-	    || hdr.blktable >= memlength
-	    || hdr.blktable + 4 * hdr.blocks > memlength) {
-		return 0;
-	}
-	filesize = hdr.filesize;
-	if ((buffer = calloc(1, (filesize + 31) & ~15)) == NULL)
+static int mm_read_header(const uint8_t *memfile, size_t memlength, mm_header_t *hdr)
+{
+	if (!memfile || memlength < 256)
 		return 0;
 
-	pblk_table = (uint32_t *) (memfile + hdr.blktable);
+	memcpy(hdr, memfile, sizeof(*hdr));
+	hdr->hdrsize = bswapLE16(hdr->hdrsize);
+	hdr->version = bswapLE16(hdr->version);
+	hdr->blocks = bswapLE16(hdr->blocks);
+	hdr->filesize = bswapLE32(hdr->filesize);
+	hdr->blktable = bswapLE32(hdr->blktable);
+
+	return !(memcmp(hdr->zirconia, "ziRCONia", 8) != 0
+		 || hdr->hdrsize < 14
+		 || hdr->blocks == 0
+		 || hdr->filesize < 16
+		 || hdr->filesize > 0x8000000
+		 || hdr->blktable >= memlength
+		 || hdr->blktable + 4 * hdr->blocks > memlength);
+}
 
-	for (block = 0; block < hdr.blocks; block++) {
-		uint32_t pos = bswapLE32(pblk_table[block]);
-		mm_subblock_t *psubblk = (mm_subblock_t *) (memfile + pos + 20);
-		mm_block_t pblk;
+/* Where subblock 'n' of a block goes, or zero if it's not inside the unpacked file. */
+static int mm_subblock_range(const struct mm_block_info *b, uint32_t n, size_t filesize,
+	size_t *start, size_t *end)
+{
+	size_t unpk_pos = bswapLE32(b->sub[n].unpk_pos);
+	size_t unpk_size = bswapLE32(b->sub[n].unpk_size);
 
-		memcpy(&pblk, memfile + pos, sizeof(pblk));
-		pblk.unpk_size = bswapLE32(pblk.unpk_size);
-		pblk.pk_size = bswapLE32(pblk.pk_size);
-		pblk.xor_chk = bswapLE32(pblk.xor_chk);
-		pblk.sub_blk = bswapLE16(pblk.sub_blk);
-		pblk.flags = bswapLE16(pblk.flags);
-		pblk.tt_entries = bswapLE16(pblk.tt_entries);
-		pblk.num_bits = bswapLE16(pblk.num_bits);
+	if (unpk_pos > filesize || unpk_pos + unpk_size > filesize)
+		return 0;
+	*start = unpk_pos;
+	*end = unpk_pos + unpk_size;
+	return 1;
+}
+
+/* Returns how many blocks are usable; everything from the first one that runs off the end of the file is
+dropped. */
+static uint32_t mm_read_blocks(const uint8_t *memfile, size_t memlength, const mm_header_t *hdr,
+	struct mm_block_info *blocks)
+{
+	const uint8_t *pblk_table = memfile + hdr->blktable;
+	uint32_t block, i;
 
-		if ((pos + 20 >= memlength)
-		    || (pos + 20 + pblk.sub_blk * 8 >= memlength)) {
+	for (block = 0; block < hdr->blocks; block++) {
+		struct mm_block_info *b = blocks + block;
+		size_t pos = bswapLE32(((const uint32_t *) pblk_table)[block]);
+
+		if (pos + 20 >= memlength)
+			break;
+		memcpy(&b->hdr, memfile + pos, sizeof(b->hdr));
+		b->hdr.unpk_size = bswapLE32(b->hdr.unpk_size);
+		b->hdr.pk_size = bswapLE32(b->hdr.pk_size);
+		b->hdr.xor_chk = bswapLE32(b->hdr.xor_chk);
+		b->hdr.sub_blk = bswapLE16(b->hdr.sub_blk);
+		b->hdr.flags = bswapLE16(b->hdr.flags);
+		b->hdr.tt_entries = bswapLE16(b->hdr.tt_entries);
+		b->hdr.num_bits = bswapLE16(b->hdr.num_bits);
+		if (pos + 20 + b->hdr.sub_blk * 8 >= memlength)
 			break;
+		b->sub = (const mm_subblock_t *) (memfile + pos + 20);
+		b->pos = pos + 20 + b->hdr.sub_blk * 8;
+		b->bytes = 0;
+		for (i = 0; i < b->hdr.sub_blk; i++) {
+			size_t start, end;
+			if (mm_subblock_range(b, i, hdr->filesize, &start, &end))
+				b->bytes += end - start;
 		}
-		pos += 20 + pblk.sub_blk * 8;
-
-		if (!(pblk.flags & MM_COMP)) {
-			/* Data is not packed */
-			for (i = 0; i < pblk.sub_blk; i++) {
-				uint32_t unpk_pos = bswapLE32(psubblk->unpk_pos);
-				uint32_t unpk_size = bswapLE32(psubblk->unpk_size);
-				if ((unpk_pos > filesize)
-				    || (unpk_pos + unpk_size > filesize)) {
-					break;
-				}
-				memcpy(buffer + unpk_pos, memfile + pos, unpk_size);
-				pos += unpk_size;
-				psubblk++;
+		b->stamp = 0;
+	}
+	return block;
+}
+
+static void mm_unpack_block(const uint8_t *memfile, size_t memlength, const struct mm_block_info *b,
+	uint8_t *buffer, size_t filesize)
+{
+	size_t pos = b->pos, start = 0, end = 0;
+	uint32_t i;
+
+	if (!(b->hdr.flags & MM_COMP)) {
+		/* Data is not packed */
+		for (i = 0; i < b->hdr.sub_blk; i++) {
+			if (!mm_subblock_range(b, i, filesize, &start, &end)
+			    || pos + (end - start) > memlength) {
+				break;
 			}
-		} else if (pblk.flags & MM_16BIT) {
-			/* Data is 16-bit packed */
-			uint16_t *dest = (uint16_t *) (buffer + bswapLE32(psubblk->unpk_pos));
-			uint32_t size = bswapLE32(psubblk->unpk_size) >> 1;
-			uint32_t destpos = 0;
-			uint32_t numbits = pblk.num_bits;
-			uint32_t subblk = 0, oldval = 0;
-
-			mm_bit_buffer_t bb = {
-				.bits = 0,
-				.buffer = 0,
-				.src = memfile + pos + pblk.tt_entries,
-				.end = memfile + pos + pblk.pk_size,
-			};
-
-			while (subblk < pblk.sub_blk) {
-				uint32_t newval = 0x10000;
-				uint32_t d = get_bits(&bb, numbits + 1);
-
-				if (d >= mm_16bit_commands[numbits]) {
-					uint32_t fetch = mm_16bit_fetch[numbits];
-					uint32_t newbits = get_bits(&bb, fetch)
-						+ ((d - mm_16bit_commands[numbits]) << fetch);
-					if (newbits != numbits) {
-						numbits = newbits & 0x0F;
+			memcpy(buffer + start, memfile + pos, end - start);
+			pos += end - start;
+		}
+	} else if (b->hdr.flags & MM_16BIT) {
+		/* Data is 16-bit packed */
+		uint32_t subblk = 0, oldval = 0;
+		uint32_t numbits = b->hdr.num_bits & 0x0F;
+
+		mm_bit_buffer_t bb = {
+			.bits = 0,
+			.buffer = 0,
+			.src = (uint8_t *) memfile + MIN(pos + b->hdr.tt_entries, memlength),
+			.end = (uint8_t *) memfile + MIN(pos + b->hdr.pk_size, memlength),
+		};
+
+		while (subblk < b->hdr.sub_blk && !mm_subblock_range(b, subblk, filesize, &start, &end))
+			subblk++;
+		while (subblk < b->hdr.sub_blk) {
+			uint32_t newval = 0x10000;
+			uint32_t d = get_bits(&bb, numbits + 1);
+
+			if (d >= mm_16bit_commands[numbits]) {
+				uint32_t fetch = mm_16bit_fetch[numbits];
+				uint32_t newbits = get_bits(&bb, fetch)
+					+ ((d - mm_16bit_commands[numbits]) << fetch);
+				if (newbits != numbits) {
+					numbits = newbits & 0x0F;
+				} else {
+					if ((d = get_bits(&bb, 4)) == 0x0F) {
+						if (get_bits(&bb, 1))
+							break;
+						newval = 0xFFFF;
 					} else {
-						if ((d = get_bits(&bb, 4)) == 0x0F) {
-							if (get_bits(&bb, 1))
-								break;
-							newval = 0xFFFF;
-						} else {
-							newval = 0xFFF0 + d;
-						}
+						newval = 0xFFF0 + d;
 					}
-				} else {
-					newval = d;
 				}
-				if (newval < 0x10000) {
-					newval = (newval & 1)
-						? (uint32_t) (-(int32_t)((newval + 1) >> 1))
-						: (uint32_t) (newval >> 1);
-					if (pblk.flags & MM_DELTA) {
-						newval += oldval;
-						oldval = newval;
-					} else if (!(pblk.flags & MM_ABS16)) {
-						newval ^= 0x8000;
-					}
-					dest[destpos++] = bswapLE16((uint16_t) newval);
+			} else {
+				newval = d;
+			}
+			if (newval < 0x10000) {
+				newval = (newval & 1)
+					? (uint32_t) (-(int32_t)((newval + 1) >> 1))
+					: (uint32_t) (newval >> 1);
+				if (b->hdr.flags & MM_DELTA) {
+					newval += oldval;
+					oldval = newval;
+				} else if (!(b->hdr.flags & MM_ABS16)) {
+					newval ^= 0x8000;
 				}
-				if (destpos >= size) {
-					subblk++;
-					destpos = 0;
-					size = bswapLE32(psubblk[subblk].unpk_size) >> 1;
-					dest = (uint16_t *)(buffer + bswapLE32(psubblk[subblk].unpk_pos));
+				if (start + 2 <= end) {
+					uint16_t w = bswapLE16((uint16_t) newval);
+					memcpy(buffer + start, &w, 2);
+					start += 2;
 				}
 			}
-		} else {
-			/* Data is 8-bit packed */
-			uint8_t *dest = buffer + bswapLE32(psubblk->unpk_pos);
-			uint32_t size = bswapLE32(psubblk->unpk_size);
-			uint32_t destpos = 0;
-			uint32_t numbits = pblk.num_bits;
-			uint32_t subblk = 0, oldval = 0;
-			uint8_t *ptable = memfile + pos;
-
-			mm_bit_buffer_t bb = {
-				.bits = 0,
-				.buffer = 0,
-				.src = memfile + pos + pblk.tt_entries,
-				.end = memfile + pos + pblk.pk_size,
-			};
-
-			while (subblk < pblk.sub_blk) {
-				uint32_t newval = 0x100;
-				uint32_t d = get_bits(&bb, numbits + 1);
-
-				if (d >= mm_8bit_commands[numbits]) {
-					uint32_t fetch = mm_8bit_fetch[numbits];
-					uint32_t newbits = get_bits(&bb, fetch)
-						+ ((d - mm_8bit_commands[numbits]) << fetch);
-					if (newbits != numbits) {
-						numbits = newbits & 0x07;
-					} else {
-						if ((d = get_bits(&bb, 3)) == 7) {
-							if (get_bits(&bb, 1))
-								break;
-							newval = 0xFF;
-						} else {
-							newval = 0xF8 + d;
-						}
-					}
+			while (subblk < b->hdr.sub_blk && end - start < 2) {
+				subblk++;
+				if (subblk < b->hdr.sub_blk && !mm_subblock_range(b, subblk, filesize, &start, &end))
+					start = end = 0;
+			}
+		}
+	} else {
+		/* Data is 8-bit packed */
+		uint32_t subblk = 0, oldval = 0;
+		uint32_t numbits = b->hdr.num_bits & 0x07;
+		const uint8_t *ptable = memfile + pos;
+
+		mm_bit_buffer_t bb = {
+			.bits = 0,
+			.buffer = 0,
+			.src = (uint8_t *) memfile + MIN(pos + b->hdr.tt_entries, memlength),
+			.end = (uint8_t *) memfile + MIN(pos + b->hdr.pk_size, memlength),
+		};
+
+		while (subblk < b->hdr.sub_blk && !mm_subblock_range(b, subblk, filesize, &start, &end))
+			subblk++;
+		while (subblk < b->hdr.sub_blk) {
+			uint32_t newval = 0x100;
+			uint32_t d = get_bits(&bb, numbits + 1);
+
+			if (d >= mm_8bit_commands[numbits]) {
+				uint32_t fetch = mm_8bit_fetch[numbits];
+				uint32_t newbits = get_bits(&bb, fetch)
+					+ ((d - mm_8bit_commands[numbits]) << fetch);
+				if (newbits != numbits) {
+					numbits = newbits & 0x07;
 				} else {
-					newval = d;
-				}
-				if (newval < 0x100) {
-					int n = ptable[newval];
-					if (pblk.flags & MM_DELTA) {
-						n += oldval;
-						oldval = n;
+					if ((d = get_bits(&bb, 3)) == 7) {
+						if (get_bits(&bb, 1))
+							break;
+						newval = 0xFF;
+					} else {
+						newval = 0xF8 + d;
 					}
-					dest[destpos++] = (uint8_t) n;
 				}
-				if (destpos >= size) {
-					subblk++;
-					destpos = 0;
-					size = bswapLE32(psubblk[subblk].unpk_size);
-					dest = buffer + bswapLE32(psubblk[subblk].unpk_pos);
+			} else {
+				newval = d;
+			}
+			if (newval < 0x100) {
+				int n = (pos + newval < memlength) ? ptable[newval] : 0;
+				if (b->hdr.flags & MM_DELTA) {
+					n += oldval;
+					oldval = n;
 				}
+				if (start < end)
+					buffer[start++] = (uint8_t) n;
+			}
+			while (subblk < b->hdr.sub_blk && start >= end) {
+				subblk++;
+				if (subblk < b->hdr.sub_blk && !mm_subblock_range(b, subblk, filesize, &start, &end))
+					start = end = 0;
 			}
 		}
 	}
+}
+
+
+int mmcmp_unpack(uint8_t **data, size_t *length)
+{
+	uint8_t *buffer;
+	mm_header_t hdr;
+	struct mm_block_info *blocks;
+	uint32_t block, num_blocks;
+
+	if (!data || !length || !mm_read_header(*data, *length, &hdr))
+		return 0;
+	if ((buffer = calloc(1, (hdr.filesize + 31) & ~15)) == NULL)
+		return 0;
+	if ((blocks = calloc(hdr.blocks, sizeof(*blocks))) == NULL) {
+		free(buffer);
+		return 0;
+	}
+
+	num_blocks = mm_read_blocks(*data, *length, &hdr, blocks);
+	for (block = 0; block < num_blocks; block++)
+		mm_unpack_block(*data, *length, blocks + block, buffer, hdr.filesize);
+	free(blocks);
+
 	*data = buffer;
-	*length = filesize;
+	*length = hdr.filesize;
 	return 1;
 }
 
+/* --------------------------------------------------------------------------------------------------------- */
+/* Unpacking as the file is read. The loaders only look at a small part of a song at a time (a pattern, one
+sample) and then move on, so there's no need to have the whole thing unpacked at once: blocks are unpacked
+when something under them is first asked for, and once more than MM_WINDOW bytes are unpacked, the ones that
+went the longest without being looked at are thrown out again (to be unpacked all over if they're needed). */
+
+#define MM_WINDOW (8 << 20)
+
+/* The unpacked file is split up into granules, each with a count of the blocks that write somewhere inside it
+and aren't unpacked right now. So most of the time, checking a range means looking at a couple of counters. */
+#define MM_GRANULE_BITS 12
+
+struct mm_lazy {
+	slurp_t packed; // the file as it is on disk
+	struct mm_block_info *blocks;
+	uint32_t num_blocks;
+	uint32_t *pending;
+	size_t unpacked;
+	uint32_t clock;
+	size_t fill_pos, fill_end; // what was asked for last, which is all there even if the granules aren't
+};
+
+static void mm_count_block(struct mm_lazy *mm, size_t filesize, struct mm_block_info *b, int delta)
+{
+	size_t start, end, g;
+	uint32_t i;
+
+	for (i = 0; i < b->hdr.sub_blk; i++) {
+		if (!mm_subblock_range(b, i, filesize, &start, &end) || start == end)
+			continue;
+		for (g = start >> MM_GRANULE_BITS; g <= (end - 1) >> MM_GRANULE_BITS; g++)
+			mm->pending[g] += delta;
+	}
+}
+
+static int mm_block_overlaps(struct mm_block_info *b, size_t filesize, size_t from, size_t to)
+{
+	size_t start, end;
+	uint32_t i;
+
+	for (i = 0; i < b->hdr.sub_blk; i++) {
+		if (mm_subblock_range(b, i, filesize, &start, &end) && start < to && end > from)
+			return 1;
+	}
+	return 0;
+}
+
+#if HAVE_MMAP
+static void mm_evict_block(struct mm_lazy *mm, uint8_t *buffer, size_t filesize, struct mm_block_info *b)
+{
+	size_t start, end;
+	uint32_t i;
+
+	b->stamp = 0;
+	mm->unpacked -= b->bytes;
+	mm_count_block(mm, filesize, b, 1);
+	for (i = 0; i < b->hdr.sub_blk; i++) {
+		if (mm_subblock_range(b, i, filesize, &start, &end))
+			slurp_discard(buffer + start, end - start);
+	}
+}
+#endif
+
+static size_t mm_available(struct mm_lazy *mm, size_t filesize, size_t pos)
+{
+	size_t g = pos >> MM_GRANULE_BITS, last = (filesize - 1) >> MM_GRANULE_BITS, avail;
+
+	while (g <= last && !mm->pending[g])
+		g++;
+	if (g > last)
+		avail = filesize - pos;
+	else if ((g << MM_GRANULE_BITS) > pos)
+		avail = (g << MM_GRANULE_BITS) - pos;
+	else
+		avail = 0;
+	if (pos >= mm->fill_pos && pos < mm->fill_end)
+		avail = MAX(avail, mm->fill_end - pos);
+	return avail;
+}
+
+static size_t mm_fill(slurp_t *t, size_t pos, size_t count)
+{
+	struct mm_lazy *mm = t->bextra;
+	size_t end, g;
+	uint32_t block;
+
+	if (pos >= t->length)
+		return 0;
+	if (!count)
+		return mm_available(mm, t->length, pos);
+	end = (count > t->length - pos) ? t->length : pos + count;
+	for (g = pos >> MM_GRANULE_BITS; g <= (end - 1) >> MM_GRANULE_BITS && !mm->pending[g]; g++)
+		/* nothing */;
+	if (g > (end - 1) >> MM_GRANULE_BITS) {
+		mm->fill_pos = pos;
+		mm->fill_end = end;
+		return mm_available(mm, t->length, pos);
+	}
+
+	/* the blocks under this range are stamped with the same time, so they can't throw each other out */
+	mm->clock++;
+	for (block = 0; block < mm->num_blocks; block++) {
+		struct mm_block_info *b = mm->blocks + block;
+		if (!mm_block_overlaps(b, t->length, pos, end))
+			continue;
+		if (!b->stamp) {
+			mm_unpack_block(mm->packed.data, mm->packed.length, b, t->data, t->length);
+			mm->unpacked += b->bytes;
+			mm_count_block(mm, t->length, b, -1);
+		}
+		b->stamp = mm->clock;
+	}
+
+#if HAVE_MMAP
+	while (mm->unpacked > MM_WINDOW) {
+		struct mm_block_info *oldest = NULL;
+		for (block = 0; block < mm->num_blocks; block++) {
+			struct mm_block_info *b = mm->blocks + block;
+			if (b->stamp && b->stamp != mm->clock && (!oldest || b->stamp < oldest->stamp))
+				oldest = b;
+		}
+		if (!oldest)
+			break;
+		mm_evict_block(mm, t->data, t->length, oldest);
+	}
+#endif
+	mm->fill_pos = pos;
+	mm->fill_end = end;
+	return mm_available(mm, t->length, pos);
+}
+
+static void mm_close(slurp_t *t)
+{
+	struct mm_lazy *mm = t->bextra;
+
+	free(t->data);
+	if (mm->packed.data && mm->packed.closure)
+		mm->packed.closure(&mm->packed);
+	free(mm->blocks);
+	free(mm->pending);
+	free(mm);
+}
+
+int mmcmp_open(slurp_t *t)
+{
+	struct mm_lazy *mm;
+	mm_header_t hdr;
+	uint8_t *buffer;
+	uint32_t block;
+
+	if (!mm_read_header(t->data, t->length, &hdr))
+		return 0;
+	mm = calloc(1, sizeof(*mm));
+	buffer = calloc(1, (hdr.filesize + 31) & ~15);
+	if (mm) {
+		mm->blocks = calloc(hdr.blocks, sizeof(*mm->blocks));
+		mm->pending = calloc((hdr.filesize >> MM_GRANULE_BITS) + 1, sizeof(*mm->pending));
+	}
+	if (!mm || !buffer || !mm->blocks || !mm->pending) {
+		if (mm) {
+			free(mm->blocks);
+			free(mm->pending);
+		}
+		free(mm);
+		free(buffer);
+		return 0;
+	}
+
+	mm->packed = *t;
+	mm->num_blocks = mm_read_blocks(t->data, t->length, &hdr, mm->blocks);
+	for (block = 0; block < mm->num_blocks; block++)
+		mm_count_block(mm, hdr.filesize, mm->blocks + block, 1);
+
+	t->data = buffer;
+	t->length = hdr.filesize;
+	t->pos = 0;
+	t->extra = 0;
+	t->bextra = mm;
+	t->closure = mm_close;
+	t->fill = mm_fill;
+	return 1;
+}
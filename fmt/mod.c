@@ -297,7 +297,7 @@ int fmt_mod_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 	/* pattern data */
 	if (startrekker) {
 		for (pat = 0; pat <= npat; pat++) {
-			note = song->patterns[pat] = csf_allocate_pattern(64);
+			note = song->patterns[pat] = csf_allocate_pattern(song, 64);
 			song->pattern_size[pat] = song->pattern_alloc_size[pat] = 64;
 			for (n = 0; n < 64; n++, note += 60) {
 				for (chan = 0; chan < 4; chan++, note++) {
@@ -319,7 +319,7 @@ int fmt_mod_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 		}
 	} else {
 		for (pat = 0; pat <= npat; pat++) {
-			note = song->patterns[pat] = csf_allocate_pattern(64);
+			note = song->patterns[pat] = csf_allocate_pattern(song, 64);
 			song->pattern_size[pat] = song->pattern_alloc_size[pat] = 64;
 			for (n = 0; n < 64; n++, note += 64 - nchan) {
 				for (chan = 0; chan < nchan; chan++, note++) {
@@ -341,8 +341,7 @@ int fmt_mod_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 
 			if (song->samples[n].length == 0)
 				continue;
-			ssize = csf_read_sample(song->samples + n, SF_8 | SF_M | SF_LE | SF_PCMS,
-				fp->data + fp->pos, fp->length - fp->pos);
+			ssize = fmt_read_sample(song->samples + n, SF_8 | SF_M | SF_LE | SF_PCMS, fp);
 			slurp_seek(fp, ssize, SEEK_CUR);
 		}
 	}
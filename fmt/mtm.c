@@ -183,7 +183,7 @@ int fmt_mtm_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 
 	/* patterns */
 	for (pat = 0; pat <= npat; pat++) {
-		song->patterns[pat] = csf_allocate_pattern(MAX(rows, 32));
+		song->patterns[pat] = csf_allocate_pattern(song, MAX(rows, 32));
 		song->pattern_size[pat] = song->pattern_alloc_size[pat] = 64;
 		tracknote = trackdata[n];
 		for (chan = 0; chan < 32; chan++) {
@@ -226,10 +226,9 @@ int fmt_mtm_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 
 			if (song->samples[smp].length == 0)
 				continue;
-			ssize = csf_read_sample(song->samples + smp,
+			ssize = fmt_read_sample(song->samples + smp,
 				(SF_LE | SF_PCMU | SF_M
-				 | ((song->samples[smp].flags & CHN_16BIT) ? SF_16 : SF_8)),
-				fp->data + fp->pos, fp->length - fp->pos);
+				 | ((song->samples[smp].flags & CHN_16BIT) ? SF_16 : SF_8)), fp);
 			slurp_seek(fp, ssize, SEEK_CUR);
 		}
 	}
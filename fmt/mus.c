@@ -128,7 +128,7 @@ int fmt_mus_load_song(song_t *song, slurp_t *fp, UNUSED unsigned int lflags)
 	pat = 0;
 	row = 0;
 	song->pattern_size[pat] = song->pattern_alloc_size[pat] = MUS_ROWS_PER_PATTERN;
-	song->patterns[pat] = csf_allocate_pattern(MUS_ROWS_PER_PATTERN);
+	song->patterns[pat] = csf_allocate_pattern(song, MUS_ROWS_PER_PATTERN);
 	note = song->patterns[pat];
 	song->orderlist[pat] = pat;
 
@@ -351,7 +351,7 @@ int fmt_mus_load_song(song_t *song, slurp_t *fp, UNUSED unsigned int lflags)
 				break;
 			}
 			song->pattern_size[pat] = song->pattern_alloc_size[pat] = MUS_ROWS_PER_PATTERN;
-			song->patterns[pat] = csf_allocate_pattern(MUS_ROWS_PER_PATTERN);
+			song->patterns[pat] = csf_allocate_pattern(song, MUS_ROWS_PER_PATTERN);
 			note = song->patterns[pat];
 			song->orderlist[pat] = pat;
 
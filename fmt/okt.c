@@ -175,7 +175,7 @@ static uint32_t okt_read_pbod(song_t *song, slurp_t *fp, int nchn, int pat)
 	rows = CLAMP(rows, 1, 200);
 
 	song->pattern_alloc_size[pat] = song->pattern_size[pat] = rows;
-	note = song->patterns[pat] = csf_allocate_pattern(rows);
+	note = song->patterns[pat] = csf_allocate_pattern(song, rows);
 
 	for (row = 0; row < rows; row++, note += 64 - nchn) {
 		for (chn = 0; chn < nchn; chn++, note++) {
@@ -458,8 +458,9 @@ int fmt_okt_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 				ssmp->length = MIN(smpsize[sd], ssmp->length);
 			}
 
+			slurp_seek(fp, smpseek[sd], SEEK_SET);
 			csf_read_sample(ssmp, SF_BE | SF_M | SF_PCMS | smpflag[sd],
-					fp->data + smpseek[sd], ssmp->length);
+					slurp_peek(fp, ssmp->length), ssmp->length);
 			sd++;
 		}
 		// Make sure there's nothing weird going on
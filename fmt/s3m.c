@@ -288,14 +288,21 @@ int fmt_s3m_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 			if (!sample->length || (sample->flags & CHN_ADLIB))
 				continue;
 			slurp_seek(fp, para_sdata[n] << 4, SEEK_SET);
-			csf_read_sample(sample, smp_flags[n], fp->data + fp->pos, fp->length - fp->pos);
+			if (lflags & LOAD_DEFERSAMPLES) {
+				sample->deferred_offset = fp->pos;
+				sample->deferred_flags = smp_flags[n];
+			} else {
+				fmt_read_sample(sample, smp_flags[n], fp);
+			}
 		}
 	}
 
 	if (!(lflags & LOAD_NOPATTERNS)) {
+#define S3M_PATTERN_BYTE() (p < eof ? *p++ : EOF)
 		for (n = 0; n < npat; n++) {
 			int row = 0;
 			long end;
+			const uint8_t *p, *eof;
 
 			para_pat[n] = bswapLE16(para_pat[n]);
 			if (!para_pat[n])
@@ -305,10 +312,13 @@ int fmt_s3m_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 			slurp_read(fp, &tmp, 2);
 			end = (para_pat[n] << 4) + bswapLE16(tmp) + 2;
 
-			song->patterns[n] = csf_allocate_pattern(64);
+			song->patterns[n] = csf_allocate_pattern(song, 64);
 
-			while (row < 64 && slurp_tell(fp) < end) {
-				int mask = slurp_getc(fp);
+			/* unpack directly from the slurp buffer, stopping at the same points slurp_getc would */
+			p = slurp_peek(fp, end - fp->pos);
+			eof = p + slurp_available(fp);
+			while (row < 64 && (long) (p - fp->data) < end) {
+				int mask = S3M_PATTERN_BYTE();
 				uint8_t chn = (mask & 31);
 
 				if (mask == EOF) {
@@ -323,8 +333,8 @@ int fmt_s3m_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 				note = song->patterns[n] + 64 * row + chn;
 				if (mask & 32) {
 					/* note/instrument */
-					note->note = slurp_getc(fp);
-					note->instrument = slurp_getc(fp);
+					note->note = S3M_PATTERN_BYTE();
+					note->instrument = S3M_PATTERN_BYTE();
 					//if (note->instrument > 99)
 					//      note->instrument = 0;
 					switch (note->note) {
@@ -343,7 +353,7 @@ int fmt_s3m_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 				if (mask & 64) {
 					/* volume */
 					note->voleffect = VOLFX_VOLUME;
-					note->volparam = slurp_getc(fp);
+					note->volparam = S3M_PATTERN_BYTE();
 					if (note->volparam == 255) {
 						note->voleffect = VOLFX_NONE;
 						note->volparam = 0;
@@ -353,8 +363,8 @@ int fmt_s3m_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 					}
 				}
 				if (mask & 128) {
-					note->effect = slurp_getc(fp);
-					note->param = slurp_getc(fp);
+					note->effect = S3M_PATTERN_BYTE();
+					note->param = S3M_PATTERN_BYTE();
 					csf_import_s3m_effect(note, 0);
 					if (note->effect == FX_SPECIAL) {
 						// mimic ST3's SD0/SC0 behavior
@@ -373,7 +383,9 @@ int fmt_s3m_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 				}
 				/* ... next note, same row */
 			}
+			fp->pos = p - fp->data;
 		}
+#undef S3M_PATTERN_BYTE
 	}
 
 	/* MPT identifies as ST3.20 in the trkvers field, but it puts zeroes for the 'special' field, only ever
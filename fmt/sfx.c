@@ -157,7 +157,7 @@ int fmt_sfx_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 		slurp_seek(fp, npat * 1024, SEEK_CUR);
 	} else {
 		for (pat = 0; pat < npat; pat++) {
-			note = song->patterns[pat] = csf_allocate_pattern(64);
+			note = song->patterns[pat] = csf_allocate_pattern(song, 64);
 			song->pattern_size[pat] = song->pattern_alloc_size[pat] = 64;
 			for (n = 0; n < 64; n++, note += 60) {
 				for (chan = 0; chan < 4; chan++, note++) {
@@ -241,8 +241,7 @@ int fmt_sfx_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 
 			if (sample->length <= 2)
 				continue;
-			ssize = csf_read_sample(sample, SF_8 | SF_LE | SF_PCMS | SF_M,
-				fp->data + fp->pos, fp->length - fp->pos);
+			ssize = fmt_read_sample(sample, SF_8 | SF_LE | SF_PCMS | SF_M, fp);
 			slurp_seek(fp, ssize, SEEK_CUR);
 		}
 	}
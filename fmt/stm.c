@@ -223,7 +223,7 @@ int fmt_stm_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 		slurp_seek(fp, npat * 64 * 4 * 4, SEEK_CUR);
 	} else {
 		for (n = 0; n < npat; n++) {
-			song->patterns[n] = csf_allocate_pattern(64);
+			song->patterns[n] = csf_allocate_pattern(song, 64);
 			song->pattern_size[n] = song->pattern_alloc_size[n] = 64;
 			load_stm_pattern(song->patterns[n], fp);
 		}
@@ -239,7 +239,7 @@ int fmt_stm_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 				sample->length = 0;
 			} else {
 				csf_read_sample(sample, SF_LE | SF_PCMS | SF_8 | SF_M,
-					(const char *) (fp->data + fp->pos), sample->length);
+					slurp_peek(fp, sample->length), sample->length);
 			}
 			slurp_seek(fp, align, SEEK_CUR);
 		}
@@ -346,7 +346,7 @@ int fmt_ult_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 
 	for (pat = 0; pat < npat; pat++) {
 		song->pattern_size[pat] = song->pattern_alloc_size[pat] = 64;
-		song->patterns[pat] = csf_allocate_pattern(64);
+		song->patterns[pat] = csf_allocate_pattern(song, 64);
 	}
 	for (chn = 0; chn < nchn; chn++) {
 		song_note_t evnote;
@@ -379,9 +379,8 @@ int fmt_ult_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 
 	if (!(lflags & LOAD_NOSAMPLES)) {
 		for (n = 0, smp = song->samples + 1; n < nsmp; n++, smp++) {
-			uint32_t ssize = csf_read_sample(smp,
-				SF_LE | SF_M | SF_PCMS | ((smp->flags & CHN_16BIT) ? SF_16 : SF_8),
-				fp->data + fp->pos, fp->length - fp->pos);
+			uint32_t ssize = fmt_read_sample(smp,
+				SF_LE | SF_M | SF_PCMS | ((smp->flags & CHN_16BIT) ? SF_16 : SF_8), fp);
 			slurp_seek(fp, ssize, SEEK_CUR);
 		}
 	}
@@ -155,6 +155,9 @@ static int wav_load(wave_file_t *f, const uint8_t *data, size_t len)
 			f->fmt.samplesize    = bswapLE16(f->fmt.samplesize);
 			f->fmt.bitspersample = bswapLE16(f->fmt.bitspersample);
 #endif
+			/* the real format is at the start of the subformat GUID; the rest of it is always the same */
+			if (f->fmt.format == WAVE_FORMAT_EXTENSIBLE && c.length >= 26)
+				f->fmt.format = data[offset + 24] | (data[offset + 25] << 8);
 			break;
 		}
 
@@ -180,28 +183,20 @@ static int wav_load(wave_file_t *f, const uint8_t *data, size_t len)
 
 /* --------------------------------------------------------------------------------------------------------- */
 
-int fmt_wav_load_sample(const uint8_t *data, size_t len, song_sample_t *smp)
+/* returns the csf_read_sample flags for the data, or zero if it's not something we can read */
+static uint32_t wav_sample_flags(const wave_format_t *fmt)
 {
-	wave_file_t f;
 	uint32_t flags;
 
-	if (!wav_load(&f, data, len))
+	if (!fmt->freqHz || (fmt->channels != 1 && fmt->channels != 2))
 		return 0;
 
-	if (f.fmt.format != WAVE_FORMAT_PCM ||
-	    !f.fmt.freqHz ||
-	    (f.fmt.channels != 1 && f.fmt.channels != 2))
-		return 0;
-
-	smp->flags = 0; // flags are set by csf_read_sample
-	flags      = 0;
-
 	// endianness
 	flags = SF_LE;
 	// channels
-	flags |= (f.fmt.channels == 2) ? SF_SI : SF_M; // interleaved stereo
+	flags |= (fmt->channels == 2) ? SF_SI : SF_M; // interleaved stereo
 	// bit width
-	switch (f.fmt.bitspersample) {
+	switch (fmt->bitspersample) {
 	case 8:  flags |= SF_8;  break;
 	case 16: flags |= SF_16; break;
 	case 24: flags |= SF_24; break;
@@ -209,7 +204,34 @@ int fmt_wav_load_sample(const uint8_t *data, size_t len, song_sample_t *smp)
 	default: return 0; // unsupported
 	}
 	// encoding (8-bit wav is unsigned, everything else is signed -- yeah, it's stupid)
-	flags |= (f.fmt.bitspersample == 8) ? SF_PCMU : SF_PCMS;
+	switch (fmt->format) {
+	case WAVE_FORMAT_PCM:
+		flags |= (fmt->bitspersample == 8) ? SF_PCMU : SF_PCMS;
+		break;
+	case WAVE_FORMAT_IEEE_FLOAT:
+		if (fmt->bitspersample != 32)
+			return 0;
+		flags |= SF_PCMF;
+		break;
+	default:
+		return 0;
+	}
+	return flags;
+}
+
+int fmt_wav_load_sample(const uint8_t *data, size_t len, song_sample_t *smp)
+{
+	wave_file_t f;
+	uint32_t flags;
+
+	if (!wav_load(&f, data, len))
+		return 0;
+
+	flags = wav_sample_flags(&f.fmt);
+	if (!flags)
+		return 0;
+
+	smp->flags = 0; // flags are set by csf_read_sample
 
 	smp->volume        = 64 * 4;
 	smp->global_volume = 64;
@@ -225,11 +247,7 @@ int fmt_wav_read_info(dmoz_file_t *file, const uint8_t *data, size_t length)
 
 	if (!wav_load(&f, data, length))
 		return 0;
-	else if (f.fmt.format != WAVE_FORMAT_PCM ||
-		!f.fmt.freqHz ||
-		(f.fmt.channels != 1 && f.fmt.channels != 2) ||
-		(f.fmt.bitspersample != 8 && f.fmt.bitspersample != 16 &&
-		 f.fmt.bitspersample != 24 && f.fmt.bitspersample != 32))
+	else if (!wav_sample_flags(&f.fmt))
 		return 0;
 
 	file->smp_flags  = 0;
@@ -237,7 +255,8 @@ int fmt_wav_read_info(dmoz_file_t *file, const uint8_t *data, size_t length)
 	if (f.fmt.channels == 2)
 		file->smp_flags |= CHN_STEREO;
 
-	if (f.fmt.bitspersample == 16)
+	// (the high resolution formats get a 16-bit copy for everything but mixing and saving)
+	if (f.fmt.bitspersample > 8)
 		file->smp_flags |= CHN_16BIT;
 
 	file->smp_speed  = f.fmt.freqHz;
@@ -256,10 +275,10 @@ struct wav_writedata {
 	long data_size; // seek position for writing data size (in bytes)
 	size_t numbytes; // how many bytes have been written
 	int bps; // bytes per sample
-	int swap; // should be byteswapped?
+	int swap; // bytes per value to reverse, or zero if the data is already little-endian
 };
 
-static int wav_header(disko_t *fp, int bits, int channels, int rate, size_t length,
+static int wav_header(disko_t *fp, int format, int bits, int channels, int rate, size_t length,
 	struct wav_writedata *wwd /* out */)
 {
 	int16_t s;
@@ -272,7 +291,7 @@ static int wav_header(disko_t *fp, int bits, int channels, int rate, size_t leng
 	disko_write(fp, "RIFF\377\377\377\377WAVEfmt ", 16);
 	ul = bswapLE32(16); // fmt chunk size
 	disko_write(fp, &ul, 4);
-	s = bswapLE16(1); // linear pcm
+	s = bswapLE16(format); // linear pcm or float
 	disko_write(fp, &s, 2);
 	s = bswapLE16(channels); // number of channels
 	disko_write(fp, &s, 2);
@@ -296,14 +315,28 @@ static int wav_header(disko_t *fp, int bits, int channels, int rate, size_t leng
 
 int fmt_wav_save_sample(disko_t *fp, song_sample_t *smp)
 {
-	int bps;
+	int bps, bits, format = WAVE_FORMAT_PCM, hires;
 	uint32_t ul;
 	uint32_t flags = SF_LE;
-	flags |= (smp->flags & CHN_16BIT) ? (SF_16 | SF_PCMS) : (SF_8 | SF_PCMU);
+
+	// keep the full resolution of samples that were loaded from 24-bit, 32-bit or float files
+	if (!csf_sample_hires(smp->data, smp->flags, smp->length, &hires)) {
+		bits = (smp->flags & CHN_16BIT) ? 16 : 8;
+		flags |= (bits == 16) ? (SF_16 | SF_PCMS) : (SF_8 | SF_PCMU);
+	} else if (hires == SAMPLE_HIRES_FLOAT) {
+		bits = 32;
+		format = WAVE_FORMAT_IEEE_FLOAT;
+		flags |= SF_32 | SF_PCMF;
+	} else if (hires == SAMPLE_HIRES_32) {
+		bits = 32;
+		flags |= SF_32 | SF_PCMS;
+	} else {
+		bits = 24;
+		flags |= SF_24 | SF_PCMS;
+	}
 	flags |= (smp->flags & CHN_STEREO) ? SF_SI : SF_M;
 
-	bps = wav_header(fp, (smp->flags & CHN_16BIT) ? 16 : 8, (smp->flags & CHN_STEREO) ? 2 : 1,
-		smp->c5speed, smp->length, NULL);
+	bps = wav_header(fp, format, bits, (smp->flags & CHN_STEREO) ? 2 : 1, smp->c5speed, smp->length, NULL);
 
 	if (csf_write_sample(fp, smp, flags) != smp->length * bps) {
 		log_appendf(4, "WAV: unexpected data size written");
@@ -326,10 +359,10 @@ int fmt_wav_export_head(disko_t *fp, int bits, int channels, int rate)
 	if (!wwd)
 		return DW_ERROR;
 	fp->userdata = wwd;
-	wwd->bps = wav_header(fp, bits, channels, rate, ~0, wwd);
+	wwd->bps = wav_header(fp, WAVE_FORMAT_PCM, bits, channels, rate, ~0, wwd);
 	wwd->numbytes = 0;
 #if WORDS_BIGENDIAN
-	wwd->swap = (bits > 8);
+	wwd->swap = (bits > 8) ? (bits + 7) / 8 : 0;
 #else
 	wwd->swap = 0;
 #endif
@@ -349,15 +382,14 @@ int fmt_wav_export_body(disko_t *fp, const uint8_t *data, size_t length)
 	wwd->numbytes += length;
 
 	if (wwd->swap) {
-		const int16_t *ptr = (const int16_t *) data;
-		uint16_t v;
-
-		length /= 2;
-		while (length--) {
-			v = *ptr;
-			v = bswapLE16(v);
-			disko_write(fp, &v, 2);
-			ptr++;
+		// 24- and 32-bit values have to be reversed as a whole, not as pairs of 16-bit halves
+		uint8_t v[4];
+		int n;
+
+		for (; length; length -= wwd->swap, data += wwd->swap) {
+			for (n = 0; n < wwd->swap; n++)
+				v[n] = data[wwd->swap - 1 - n];
+			disko_write(fp, v, wwd->swap);
 		}
 	} else {
 		disko_write(fp, data, length);
@@ -85,6 +85,7 @@ static void load_xm_patterns(song_t *song, struct xm_file_header *hdr, slurp_t *
 	uint16_t rows;
 	uint16_t bytes;
 	size_t end; // should be same data type as slurp_t's length
+	const uint8_t *p, *lim, *eof;
 	song_note_t *note;
 	unsigned int lostpat = 0;
 	unsigned int lostfx = 0;
@@ -115,7 +116,7 @@ static void load_xm_patterns(song_t *song, struct xm_file_header *hdr, slurp_t *
 			continue;
 		}
 
-		note = song->patterns[pat] = csf_allocate_pattern(rows);
+		note = song->patterns[pat] = csf_allocate_pattern(song, rows);
 		song->pattern_size[pat] = song->pattern_alloc_size[pat] = rows;
 
 		if (!bytes)
@@ -125,21 +126,26 @@ static void load_xm_patterns(song_t *song, struct xm_file_header *hdr, slurp_t *
 		end = slurp_tell(fp) + bytes;
 		end = MIN(end, fp->length);
 
+		// unpack straight from the slurp buffer; reads past the end of the file give 255, as with slurp_getc
+		p = slurp_peek(fp, end - fp->pos);
+		lim = fp->data + end;
+		eof = p + slurp_available(fp);
+#define XM_PATTERN_BYTE() (p < eof ? *p++ : 255)
 		for (row = 0; row < rows; row++, note += MAX_CHANNELS - hdr->channels) {
-			for (chan = 0; fp->pos < end && chan < hdr->channels; chan++, note++) {
-				b = slurp_getc(fp);
+			for (chan = 0; p < lim && chan < hdr->channels; chan++, note++) {
+				b = XM_PATTERN_BYTE();
 				if (b & 128) {
-					if (b & 1) note->note = slurp_getc(fp);
-					if (b & 2) note->instrument = slurp_getc(fp);
-					if (b & 4) note->volparam = slurp_getc(fp);
-					if (b & 8) note->effect = slurp_getc(fp);
-					if (b & 16) note->param = slurp_getc(fp);
+					if (b & 1) note->note = XM_PATTERN_BYTE();
+					if (b & 2) note->instrument = XM_PATTERN_BYTE();
+					if (b & 4) note->volparam = XM_PATTERN_BYTE();
+					if (b & 8) note->effect = XM_PATTERN_BYTE();
+					if (b & 16) note->param = XM_PATTERN_BYTE();
 				} else {
 					note->note = b;
-					note->instrument = slurp_getc(fp);
-					note->volparam = slurp_getc(fp);
-					note->effect = slurp_getc(fp);
-					note->param = slurp_getc(fp);
+					note->instrument = XM_PATTERN_BYTE();
+					note->volparam = XM_PATTERN_BYTE();
+					note->effect = XM_PATTERN_BYTE();
+					note->param = XM_PATTERN_BYTE();
 				}
 				// translate everything
 				if (note->note > 0 && note->note < 97)
@@ -338,6 +344,8 @@ static void load_xm_patterns(song_t *song, struct xm_file_header *hdr, slurp_t *
 				    (this is documented) */
 			}
 		}
+#undef XM_PATTERN_BYTE
+		fp->pos = p - fp->data;
 	}
 
 	if (lostfx)
@@ -365,8 +373,7 @@ static void load_xm_samples(song_sample_t *first, int total, slurp_t *fp)
 			smp->loop_end >>= 1;
 		}
 		// modplug's sample-reading function is complicated and retarded
-		csf_read_sample(smp, SF_LE | SF_M | SF_PCMD | ((smp->flags & CHN_16BIT) ? SF_16 : SF_8),
-				fp->data + fp->pos, fp->length - fp->pos);
+		fmt_read_sample(smp, SF_LE | SF_M | SF_PCMD | ((smp->flags & CHN_16BIT) ? SF_16 : SF_8), fp);
 		slurp_seek(fp, smpsize, SEEK_CUR);
 	}
 }
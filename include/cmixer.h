@@ -17,28 +17,27 @@ void end_channel_ofs(song_voice_t *, int *, unsigned int);
 void interleave_front_rear(int *, int *, unsigned int);
 void mono_from_stereo(int *, unsigned int);
 
-void stereo_mix_to_float(const int *, float *, float *, unsigned int);
-void float_to_stereo_mix(const float *, const float *, int *, unsigned int);
-void mono_mix_to_float(const int *, float *, unsigned int);
-void float_to_mono_mix(const float *, int *, unsigned int);
-
 unsigned int csf_create_stereo_mix(song_t *csf, int count);
 
 void setup_channel_filter(song_voice_t *pChn, int reset, int flt_modifier, int freq);
+// makes the filter coefficient table for a mixing rate, if there isn't one yet (any thread, no locking needed)
+void prepare_filter_table(int freq);
 
 
 //typedef unsigned int (*convert_clip_t)(void *, int *, unsigned int, int*, int*) __attribute__((cdecl))
 
-unsigned int clip_32_to_8(void *, int *, unsigned int, int *, int *);
-unsigned int clip_32_to_16(void *, int *, unsigned int, int *, int *);
-unsigned int clip_32_to_24(void *, int *, unsigned int, int *, int *);
-unsigned int clip_32_to_32(void *, int *, unsigned int, int *, int *);
+unsigned int clip_32_to_8(void *, int *, unsigned int, int *, int *, uint32_t *);
+unsigned int clip_32_to_16(void *, int *, unsigned int, int *, int *, uint32_t *);
+unsigned int clip_32_to_16_dither(void *, int *, unsigned int, int *, int *, uint32_t *);
+unsigned int clip_32_to_24(void *, int *, unsigned int, int *, int *, uint32_t *);
+unsigned int clip_32_to_24_dither(void *, int *, unsigned int, int *, int *, uint32_t *);
+unsigned int clip_32_to_32(void *, int *, unsigned int, int *, int *, uint32_t *);
 
 
 void eq_mono(song_t *, int *, unsigned int);
 void eq_stereo(song_t *, int *, unsigned int);
-void initialize_eq(int, float);
-void set_eq_gains(const unsigned int *, unsigned int, const unsigned int *, int, int);
+void initialize_eq(song_t *, int, float);
+void set_eq_gains(song_t *, const unsigned int *, unsigned int, const unsigned int *, int, int);
 
 
 // sndmix.c
@@ -158,6 +158,10 @@ int dmoz_filter_ext_data(dmoz_file_t *file);
 /* same as dmoz_filter_ext_data, but always returns 1 (for async title reading) */
 int dmoz_fill_ext_data(dmoz_file_t *file);
 
+/* persistent cache of file info, kept in ~/.schism/infocache. (load is called by cfg_load_dmoz) */
+void dmoz_infocache_load(void);
+void dmoz_infocache_save(void);
+
 /* filters stuff based on... whatever you like :) */
 void dmoz_filter_filelist(dmoz_filelist_t *flist, int (*grep)(dmoz_file_t *f), int *pointer, void (*onmove)(void));
 
@@ -203,6 +207,10 @@ void dmoz_add_file_or_dir(dmoz_filelist_t *flist, dmoz_dirlist_t *dlist,
 */
 int dmoz_worker(void);
 
+/* and this when main stops calling dmoz_worker to go do something else (i.e. redraw); it squeezes out the
+files the filter has rejected so far, so they don't show up in the list in the meantime */
+void dmoz_worker_pause(void);
+
 /* these update the file selection cache for the various pages */
 void dmoz_cache_update_names(const char *path, const char *filen, const char *dirn);
 void dmoz_cache_update(const char *path, dmoz_filelist_t *fl, dmoz_dirlist_t *dl);
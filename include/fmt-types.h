@@ -36,7 +36,12 @@ list for performance purposes.
 Don't rearrange the formats that are already here unless you have a VERY good reason to do so. I spent a good
 3-4 hours reading all the format specifications, testing files, checking notes, and trying to break the
 program by giving it weird files, and I'm pretty sure that this ordering won't fail unless you really try
-doing weird stuff like hacking the files, but then you're just asking for trouble. ;) */
+doing weird stuff like hacking the files, but then you're just asking for trouble. ;)
+
+MAGIC(type, offset, "bytes") lists a signature that every file of that type has to have. When a type has any
+of these, its loaders and info reader are simply skipped for files that don't match at least one of them, so
+only add one if *all* of the type's functions already reject such files -- otherwise the order above stops
+meaning what it says. Formats without a fixed signature (MOD, STM, ...) don't get one, and get probed as usual. */
 
 
 #ifndef READ_INFO
@@ -57,6 +62,9 @@ doing weird stuff like hacking the files, but then you're just asking for troubl
 #ifndef LOAD_INSTRUMENT
 # define LOAD_INSTRUMENT(x)
 #endif
+#ifndef MAGIC
+# define MAGIC(x, offset, bytes)
+#endif
 #ifndef SAVE_INSTRUMENT /* not actually used - instrument saving is currently hardcoded to write .iti files */
 # define SAVE_INSTRUMENT(x)
 #endif
@@ -70,7 +78,7 @@ doing weird stuff like hacking the files, but then you're just asking for troubl
 ffs... "if"?!) Still, it's better than STM. The only reason this is first is because the position of the
 SCRM magic lies within the 669 message field, and the 669 check is much more complex (and thus more likely
 to be right). */
-READ_INFO(669) LOAD_SONG(669)
+READ_INFO(669) LOAD_SONG(669) MAGIC(669, 0, "if") MAGIC(669, 0, "JN")
 
 /* Since so many programs have added noncompatible extensions to the mod format, there are about 30 strings to
 compare against for the magic. Also, there are special cases for WOW files, which even share the same magic
@@ -79,48 +87,49 @@ ugh, ugh. However, it has to be above the formats with the magic at the beginnin
 READ_INFO(mod) LOAD_SONG(mod)
 
 /* S3M needs to be before a lot of stuff. */
-READ_INFO(s3m) LOAD_SONG(s3m) SAVE_SONG(s3m)
+READ_INFO(s3m) LOAD_SONG(s3m) SAVE_SONG(s3m) MAGIC(s3m, 44, "SCRM")
 /* FAR and S3M have different magic in the same place, so it doesn't really matter which one goes
 where. I just have S3M first since it's a more common format. */
-READ_INFO(far) LOAD_SONG(far)
+READ_INFO(far) LOAD_SONG(far) MAGIC(far, 0, "FAR\xfe")
 
 /* These next formats have their magic at the beginning of the data, so none of them can possibly
 conflict with other ones. I've organized them pretty much in order of popularity. */
-READ_INFO(xm) LOAD_SONG(xm)
-READ_INFO(it) LOAD_SONG(it) SAVE_SONG(it)
-READ_INFO(mt2)
-READ_INFO(mtm) LOAD_SONG(mtm)
-READ_INFO(ntk)
+READ_INFO(xm) LOAD_SONG(xm) MAGIC(xm, 0, "Extended Module: ")
+READ_INFO(it) LOAD_SONG(it) SAVE_SONG(it) MAGIC(it, 0, "IMPM")
+READ_INFO(mt2) MAGIC(mt2, 0, "MT20")
+READ_INFO(mtm) LOAD_SONG(mtm) MAGIC(mtm, 0, "MTM")
+READ_INFO(ntk) MAGIC(ntk, 0, "TWNNSNG2")
 #ifdef USE_NON_TRACKED_TYPES
-READ_INFO(sid)
+READ_INFO(sid) MAGIC(sid, 0, "PSID")
 #endif
-READ_INFO(mdl) LOAD_SONG(mdl)
-READ_INFO(med)
-READ_INFO(okt) LOAD_SONG(okt)
-READ_INFO(mid) LOAD_SONG(mid)
-READ_INFO(mus) LOAD_SONG(mus)
-READ_INFO(mf)
+READ_INFO(mdl) LOAD_SONG(mdl) MAGIC(mdl, 0, "DMDL")
+READ_INFO(med) MAGIC(med, 0, "MMD")
+READ_INFO(okt) LOAD_SONG(okt) MAGIC(okt, 0, "OKTASONG")
+READ_INFO(mid) LOAD_SONG(mid) MAGIC(mid, 0, "MThd") MAGIC(mid, 0, "RIFF")
+READ_INFO(mus) LOAD_SONG(mus) MAGIC(mus, 0, "MUS\x1a")
+READ_INFO(mf) MAGIC(mf, 0, "MOONFISH")
 
 /* Sample formats with magic at start of file */
-READ_INFO(its)  LOAD_SAMPLE(its)  SAVE_SAMPLE(its)
-READ_INFO(au)   LOAD_SAMPLE(au)   SAVE_SAMPLE(au)
-READ_INFO(aiff) LOAD_SAMPLE(aiff) SAVE_SAMPLE(aiff) EXPORT(aiff)
-READ_INFO(wav)  LOAD_SAMPLE(wav)  SAVE_SAMPLE(wav)  EXPORT(wav)
-READ_INFO(iti)  LOAD_INSTRUMENT(iti)
-READ_INFO(xi)   LOAD_INSTRUMENT(xi)
-READ_INFO(pat)  LOAD_INSTRUMENT(pat)
+READ_INFO(its)  LOAD_SAMPLE(its)  SAVE_SAMPLE(its) MAGIC(its, 0, "IMPS")
+SAVE_SAMPLE(its215) /* ITS with IT 2.15 compressed sample data */
+READ_INFO(au)   LOAD_SAMPLE(au)   SAVE_SAMPLE(au) MAGIC(au, 0, ".snd")
+READ_INFO(aiff) LOAD_SAMPLE(aiff) SAVE_SAMPLE(aiff) EXPORT(aiff) MAGIC(aiff, 0, "FORM")
+READ_INFO(wav)  LOAD_SAMPLE(wav)  SAVE_SAMPLE(wav)  EXPORT(wav) MAGIC(wav, 0, "RIFF")
+READ_INFO(iti)  LOAD_INSTRUMENT(iti) MAGIC(iti, 0, "IMPI")
+READ_INFO(xi)   LOAD_INSTRUMENT(xi) MAGIC(xi, 0, "Extended Instrument: ")
+READ_INFO(pat)  LOAD_INSTRUMENT(pat) MAGIC(pat, 0, "GF1PATCH")
 
-READ_INFO(ult) LOAD_SONG(ult)
-READ_INFO(liq)
+READ_INFO(ult) LOAD_SONG(ult) MAGIC(ult, 0, "MAS_UTrack_V00")
+READ_INFO(liq) MAGIC(liq, 0, "Liquid Module:")
 
-READ_INFO(ams)
-READ_INFO(f2r)
+READ_INFO(ams) MAGIC(ams, 0, "AMShdr\x1a")
+READ_INFO(f2r) MAGIC(f2r, 0, "F2R")
 
 READ_INFO(s3i)  LOAD_SAMPLE(s3i)  SAVE_SAMPLE(s3i) /* FIXME should this be moved? S3I has magic at 0x4C... */
 
 /* IMF and SFX (as well as STX) all have the magic values at 0x3C-0x3F, which is positioned in IT's
 "reserved" field, Not sure about this positioning, but these are kind of rare formats anyway. */
-READ_INFO(imf) LOAD_SONG(imf)
+READ_INFO(imf) LOAD_SONG(imf) MAGIC(imf, 60, "IM10")
 READ_INFO(sfx) LOAD_SONG(sfx)
 
 /* bleh */
@@ -152,5 +161,6 @@ LOAD_SAMPLE(raw) SAVE_SAMPLE(raw)
 #undef SAVE_SAMPLE
 #undef LOAD_INSTRUMENT
 #undef SAVE_INSTRUMENT
+#undef MAGIC
 #undef EXPORT
 
@@ -40,6 +40,13 @@
 this is only a suggestion in order to speed loading; don't be surprised if the loader ignores these */
 #define LOAD_NOSAMPLES  1
 #define LOAD_NOPATTERNS 2
+/* read the sample headers, but leave the data alone: instead, the loader stores its file offset and
+csf_read_sample flags in the sample (deferred_offset/deferred_flags) so it can be decoded later on.
+loaders that don't know about this will just read the data as usual */
+#define LOAD_DEFERSAMPLES 4
+/* the same, but only for IT214/IT215 compressed samples, which are worth decoding several at once after the
+loader's done; song_create_load sets this by itself */
+#define LOAD_DEFERCOMPRESSED 8
 
 /* return codes for module loaders */
 enum {
@@ -93,6 +100,26 @@ typedef int (*fmt_export_tail_func)     PROTO_EXPORT_TAIL;
 
 #include "fmt-types.h"
 
+/* --------------------------------------------------------------------------------------------------------- */
+/* format detection */
+
+/* returns zero if 'type' lists signatures (see MAGIC in fmt-types.h) and the data matches none of them,
+i.e. there's no point in handing the file to any of that type's functions.
+signatures have to be within the first FMT_MAGIC_BYTES of the file. */
+int fmt_magic_possible(const char *type, const uint8_t *data, size_t length);
+#define FMT_MAGIC_BYTES 1024
+
+/* how many files each type's detection was tried on, skipped by the signature check, or accepted.
+tables are terminated with a NULL type; if SCHISM_DEBUG contains "probe", they're printed on exit.
+the same table can be used from several threads at once (the file browser's scan threads, the background
+loader), so count with fmt_probe_count instead of incrementing the fields directly. */
+struct fmt_probe_stats {
+	const char *type;
+	volatile unsigned int probes, skipped, hits;
+};
+#define fmt_probe_count(counter) __sync_fetch_and_add(&(counter), 1)
+void fmt_probe_stats_register(const char *what, struct fmt_probe_stats *stats);
+
 /* --------------------------------------------------------------------------------------------------------- */
 
 struct save_format {
@@ -130,13 +157,21 @@ int instrument_loader_sample(struct instrumentloader *ii, int slot);
 
 uint32_t it_decompress8(void *dest, uint32_t len, const void *file, uint32_t filelen, int it215, int channels);
 uint32_t it_decompress16(void *dest, uint32_t len, const void *file, uint32_t filelen, int it215, int channels);
+/* mono only; dest must have room for it_compress_bound(len) bytes. returns the number of bytes written */
+uint32_t it_compress8(void *dest, const void *src, uint32_t len, int it215);
+uint32_t it_compress16(void *dest, const void *src, uint32_t len, int it215);
+uint32_t it_compress_bound(uint32_t len, int is16);
 
 uint16_t mdl_read_bits(uint32_t *bitbuf, uint32_t *bitnum, uint8_t **ibuf, int8_t n);
 
 /* --------------------------------------------------------------------------------------------------------- */
 
 /* shared by the .it, .its, and .iti saving functions */
-void save_its_header(disko_t *fp, song_sample_t *smp);
+/* flags are what the sample data will be written with; see its_sample_flags */
+void save_its_header(disko_t *fp, song_sample_t *smp, uint32_t flags);
+/* csf_write_sample flags for a sample in an IT/ITS/ITI file; compress is 0, SF_IT214, or SF_IT215
+(only mono samples are ever compressed) */
+uint32_t its_sample_flags(song_sample_t *smp, uint32_t compress);
 int load_its_sample(const uint8_t *header, const uint8_t *data, size_t length, song_sample_t *smp);
 
 /* --------------------------------------------------------------------------------------------------------- */
@@ -162,6 +197,13 @@ void mod_import_note(const uint8_t p[4], song_note_t *note);
 // Read a message with fixed-size line lengths
 void read_lined_message(char *msg, slurp_t *fp, int len, int linelen);
 
+// csf_read_sample from the current position in the file (which doesn't move), making sure the data is there
+// first; loaders should use this instead of passing fp->data along, since the file might not all be unpacked
+uint32_t fmt_read_sample(song_sample_t *smp, uint32_t flags, slurp_t *fp);
+// A copy of the file data for a sample that the loader deferred, to be given to csf_read_sample (on any thread)
+// along with smp->deferred_flags. Returns NULL if there isn't any; otherwise the caller frees it.
+uint8_t *fmt_copy_deferred_sample(song_sample_t *smp, slurp_t *fp, uint32_t *len);
+
 
 // get L-R-R-L panning value from a (zero-based!) channel number
 #define PROTRACKER_PANNING(n) (((((n) + 1) >> 1) & 1) * 256)
@@ -128,6 +128,9 @@ enum {
 	/* holding shift (used on pattern editor for weird template thing) */
 	SHIFT_KEY_DOWN = (1 << 23),
 
+	/* if a song is being loaded in the background (see song_load_background) */
+	SONG_LOADING = (1 << 24),
+
 	/* Devi Ever's hack */
 	CRAYOLA_MODE = (1 << 25),
 
@@ -177,6 +180,9 @@ struct tracker_status {
 	struct tm tmnow;
 
 	int fix_numlock_setting;
+
+	/* minutes between autosaves of a modified song, or zero to turn them off (see song_autosave) */
+	int autosave_interval;
 };
 
 /* numlock hackery */
@@ -444,13 +450,14 @@ unsigned int memused_ems(void);
 unsigned int memused_songmessage(void);
 unsigned int memused_instruments(void);
 unsigned int memused_samples(void);
+int memused_samples_packed(unsigned int *packed, unsigned int *cached);
 unsigned int memused_clipboard(void);
 unsigned int memused_patterns(void);
 unsigned int memused_history(void);
 /* clears the memory lookup cache */
 void memused_songchanged(void);
 
-void memused_get_pattern_saved(unsigned int *a, unsigned int *b); /* wtf */
+void memused_get_pattern_saved(unsigned int *a, unsigned int *b); /* wtf (a is in rows, b in bytes) */
 
 /* --------------------------------------------------------------------- */
 
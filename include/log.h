@@ -32,6 +32,9 @@ void log_underline(int chars);
 
 void log_perror(const char *prefix);
 
+/* lines logged from other threads show up after the main thread calls this */
+void log_flush(void);
+
 void status_text_flash(const char *format, ...)
 	__attribute__ ((format(printf, 1, 2)));
 void status_text_flash_bios(const char *format, ...)
@@ -36,6 +36,10 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <unistd.h>
+#if HAVE_MMAP
+# include <setjmp.h>
+# include <signal.h>
+#endif
 
 /* --------------------------------------------------------------------- */
 
@@ -48,6 +52,9 @@ struct _slurp_struct {
 	void (*closure)(slurp_t *);
 	/* for reading streams */
 	size_t pos;
+	/* if this is set, not all of 'data' is there yet: call it to get [pos, pos + count) filled in.
+	it returns how many bytes from 'pos' on are there now, which could be more than were asked for */
+	size_t (*fill)(slurp_t *, size_t pos, size_t count);
 };
 
 /* --------------------------------------------------------------------- */
@@ -57,6 +64,10 @@ the file; in most cases it can simply be NULL. If size is nonzero, it overrides
 returned by stat -- this can be used to read only part of a file, or if the file size is known but
 a stat structure is not available. */
 slurp_t *slurp(const char *filename, struct stat *buf, size_t size);
+/* Same as slurp, except that compressed files are unpacked a piece at a time as they're read, and only so
+much of the unpacked data is kept around at once. Anything that looks at 'data' directly has to go through
+slurp_peek first. */
+slurp_t *slurp_windowed(const char *filename, struct stat *buf, size_t size);
 
 void unslurp(slurp_t * t);
 
@@ -66,6 +77,30 @@ int slurp_win32(slurp_t *useme, const char *filename, size_t st);
 
 #if HAVE_MMAP
 int slurp_mmap(slurp_t *useme, const char *filename, size_t st);
+
+/* Make a private, writable mapping of the file behind 'data', which has to point into a slurp that was
+mmap'd and is still open. At least 'before' bytes ahead of 'data' and 'after' bytes from it on are mapped;
+writes never go back to the file. Returns the address of 'data' in the new mapping, or NULL if the file
+isn't mapped (or this otherwise can't be done). Pass the same 'before' and 'after' to unmap it. */
+uint8_t *slurp_mmap_private(const uint8_t *data, size_t before, size_t after);
+void slurp_munmap_private(uint8_t *data, size_t before, size_t after);
+/* If the file is truncated later on, reading the part that's gone raises SIGBUS. A thread that reads from
+one of these mappings can set up a jump with sigsetjmp(env, 0) and point slurp_fault_jump at it first: such a
+fault then clears slurp_fault_jump, sets slurp_fault_flag, and jumps back. Clear slurp_fault_jump when done.
+Faults with no jump set up (or outside these mappings) go to whatever handled SIGBUS before. */
+extern __thread sigjmp_buf *slurp_fault_jump;
+extern volatile sig_atomic_t slurp_fault_flag;
+/* Hint that part of a mapping will be read soon, and check whether all of the pages of a range are in
+memory. Neither of these does anything harmful if the memory was unmapped in the meantime. */
+void slurp_prefetch(const void *data, size_t length);
+int slurp_is_resident(const void *data, size_t length);
+/* Read in part of a private mapping now, and keep it in memory until slurp_unlock if the system allows.
+Returns 1 if it's locked, 0 if it was only read in, or -1 if part of it is gone from the file. The
+memory has to stay mapped until this returns; unlocking a range that isn't locked is harmless. */
+int slurp_lock(const void *data, size_t length);
+void slurp_unlock(const void *data, size_t length);
+/* Give back the memory behind the whole pages inside [data, data + length). It reads as zeroes afterward. */
+void slurp_discard(void *data, size_t length);
 #endif
 
 /* stdio-style file processing */
@@ -77,8 +112,15 @@ size_t slurp_read(slurp_t *t, void *ptr, size_t count); /* i never realy liked f
 int slurp_getc(slurp_t *t); /* returns unsigned char cast to int, or EOF */
 int slurp_eof(slurp_t *t); /* 1 = end of file */
 
-/* used internally by slurp, nothing else should need this */
+/* Make sure the next 'count' bytes (or up to the end of the file) are in memory, and return a pointer to
+them; this doesn't move the position. The pointer is good until the next call on the slurp.
+slurp_available is how many bytes from the position on can be read straight out of 'data' right now. */
+uint8_t *slurp_peek(slurp_t *t, size_t count);
+size_t slurp_available(slurp_t *t);
+
+/* used internally by slurp, nothing else should need these */
 int mmcmp_unpack(uint8_t **data, size_t *length);
+int mmcmp_open(slurp_t *t);
 
 #endif /* ! SLURP_H */
 
@@ -21,6 +21,8 @@
 
 #define MOD_AMIGAC2             0x1AB
 #define MAX_SAMPLE_LENGTH       16000000
+// samples that are mapped from the file (see csf_read_sample) can be longer, since they're paged in as they play
+#define MAX_STREAMED_SAMPLE_LENGTH 0x10000000
 #define MAX_SAMPLE_RATE         192000
 #define MAX_ORDERS              256
 #define MAX_PATTERNS            240
@@ -235,6 +237,7 @@
 //#define SNDMIX_NOMIXING       0x400000
 #define SNDMIX_NORAMPING        0x800000 // don't apply ramping on volume change (causes clicks)
 #define SNDMIX_FILTERHACK       0xf00000 //protman HP filter hack
+#define SNDMIX_DITHER           0x1000000 // TPDF dither when converting to 16/24-bit
 
 enum {
         SRCMODE_NEAREST,
@@ -287,6 +290,7 @@ enum {
 #define SF_DMF                 _SDV_ENC(7) // DMF Huffman compression
 #define SF_MDL                 _SDV_ENC(8) // MDL Huffman compression
 #define SF_PTM                 _SDV_ENC(9) // PTM 8-bit delta value -> 16-bit sample
+#define SF_PCMF                _SDV_ENC(10) // PCM, IEEE floating point (32-bit only)
 
 // Sample format shortcut
 #define SF(a,b,c,d) (SF_ ## a | SF_ ## b| SF_ ## c | SF_ ## d)
@@ -312,6 +316,7 @@ enum {
 #define RS_PCM16U       SF(PCMU,16,M,LE)
 #define RS_PCM24S       SF(PCMS,24,M,LE)
 #define RS_PCM32S       SF(PCMS,32,M,LE)
+#define RS_PCM32F       SF(PCMF,32,M,LE)
 #define RS_PCM8D        SF(PCMD,8,M,LE)
 #define RS_PCM8S        SF(PCMS,8,M,LE)
 #define RS_PCM8U        SF(PCMU,8,M,LE)
@@ -321,6 +326,7 @@ enum {
 #define RS_STIPCM16U    SF(PCMU,16,SI,LE)
 #define RS_STIPCM24S    SF(PCMS,24,SI,LE)
 #define RS_STIPCM32S    SF(PCMS,32,SI,LE)
+#define RS_STIPCM32F    SF(PCMF,32,SI,LE)
 #define RS_STIPCM8S     SF(PCMS,8,SI,LE)
 #define RS_STIPCM8U     SF(PCMU,8,SI,LE)
 #define RS_STPCM16D     SF(PCMD,16,SS,LE)
@@ -352,6 +358,9 @@ typedef struct song_sample {
         char name[32];
         char filename[22];
         int played; // for note playback dots
+        // set by loaders for LOAD_DEFERSAMPLES: where the data is, and how to read it (0 = nothing pending)
+        uint32_t deferred_offset;
+        uint32_t deferred_flags;
         uint32_t globalvol_saved; // for muting individual samples
 
         // This must be 12-bytes to work around a bug in some gcc4.2s (XXX why? what bug?)
@@ -542,9 +551,15 @@ struct multi_write {
         int buffer[MIXBUFFERSIZE * 2];
 };
 
+typedef struct eq_band {
+        float a0, a1, a2, b1, b2;
+        float x1, x2, y1, y2;
+        float gain, center_frequency;
+        int enabled;
+} eq_band_t;
+
 typedef struct song {
         int mix_buffer[MIXBUFFERSIZE * 2];
-        float mix_buffer_float[MIXBUFFERSIZE * 2]; // is this needed?
 
         song_voice_t voices[MAX_VOICES];                // Channels
         uint32_t voice_mix[MAX_VOICES];                 // Channels to be mixed
@@ -554,6 +569,9 @@ typedef struct song {
         song_note_t *patterns[MAX_PATTERNS];            // Patterns
         uint16_t pattern_size[MAX_PATTERNS];            // Pattern Lengths
         uint16_t pattern_alloc_size[MAX_PATTERNS];      // Allocated lengths (for async. resizing/playback)
+        struct pattern_block *pattern_blocks;           // where the patterns are allocated (see csf_allocate_pattern)
+        song_note_t *pattern_free;                      // free space in the blocks, in address order
+        volatile int pattern_lock;
         uint8_t orderlist[MAX_ORDERS + 1];              // Pattern Orders
         midi_config_t midi_config;                      // Midi macro config table
         uint32_t initial_speed;
@@ -595,9 +613,15 @@ typedef struct song {
         uint32_t mix_flags; // SNDMIX_*
         uint32_t mix_frequency, mix_bits_per_sample, mix_channels;
 
+        // equalizer: left channel bands, then right channel bands
+        eq_band_t eq[MAX_EQ_BANDS * 2];
+
         // noise reduction filter
         int32_t left_nr, right_nr;
 
+        // dither noise generator (see csf_reset_dither)
+        uint32_t dither_state[4];
+
         // chaseback
         int stop_at_order;
         int stop_at_row;
@@ -607,18 +631,106 @@ typedef struct song {
         struct multi_write *multi_write;
 } song_t;
 
-song_note_t *csf_allocate_pattern(uint32_t rows);
-void csf_free_pattern(void *pat);
+// patterns belong to the song they're allocated for, and can't be moved to another one
+song_note_t *csf_allocate_pattern(song_t *csf, uint32_t rows);
+void csf_free_pattern(song_t *csf, void *pat);
 signed char *csf_allocate_sample(uint32_t nbytes);
-void csf_free_sample(void *p);
+void csf_free_sample(void *p); // drops a reference; the data is freed when the last one goes away
+signed char *csf_share_sample(signed char *p); // adds a reference, and returns p
+int csf_sample_is_shared(const void *p);
+int csf_sample_is_mapped(const void *p); // i.e. read from the file as it's played
+extern volatile uint32_t csf_streamed_samples; // how many buffers are mapped or compressed right now
+
+// call this (with the audio locked) before changing a sample's data in place, so it gets its own copy; any of
+// the song's voices that are playing the old data are moved over to the copy (returns zero if out of memory)
+int csf_unshare_sample(song_t *csf, song_sample_t *smp);
+
+// shares the sample's data with an identical buffer that's already loaded, if there is one (returns nonzero if so);
+// csf is the song the sample is in, if it might be playing (again, with the audio locked), or else NULL
+int csf_pool_sample(song_t *csf, song_sample_t *smp);
+int csf_pool_samples(song_t *csf); // returns how many were shared
+
+// compressed samples (see csndfile.c for the whole story)
+extern uint32_t csf_sample_cache_blocks; // how many blocks csf_trim_sample_cache leaves decoded
+int csf_sample_is_compressed(const void *p);
+int csf_compress_sample(song_sample_t *smp); // returns nonzero if it did anything
+int csf_compress_samples(song_t *csf); // returns how many
+void csf_expand_sample(song_t *csf, song_sample_t *smp); // decodes everything and goes back to a normal sample
+/* decoding ahead of the voices: csf_cache_sample adds any blocks that are missing in the given range to 'jobs'
+(up to 'max' in all), then each one is decoded without the audio locked into 'buf' (which should have room for
+SAMPLE_CACHE_BLOCK_BYTES), and copied in with it locked; returns how many it added */
+#define SAMPLE_CACHE_BLOCK_BYTES (16384 * 4)
+struct sample_cache_job {
+        signed char *data;
+        uint32_t block;
+        signed char *buf;
+};
+int csf_cache_sample(const signed char *data, uint32_t start, uint32_t frames,
+        struct sample_cache_job *jobs, int *njobs, int max);
+void csf_decode_cache_job(struct sample_cache_job *job);
+void csf_finish_cache_job(struct sample_cache_job *job);
+void csf_release_cache_job(struct sample_cache_job *job); // (doesn't need the lock)
+// for the mixer, before it reads 'count' frames' worth from a voice: decodes anything that's missing, and sets
+// csf_streamed_voices if the voice is playing data that's mapped or compressed (the prefetch thread clears it).
+// returns nonzero if the data is mapped from a file, which means reading it can fault (see slurp_fault_jump)
+int csf_cache_voice(song_voice_t *v, int count);
+extern volatile int csf_streamed_voices;
+// how many times csf_cache_voice found that the mixer would have to wait: a compressed block that had to be
+// decoded right then, or mapped data that wasn't in memory yet
+extern volatile uint32_t csf_sample_cache_misses;
+void csf_trim_sample_cache(song_t *csf);
+void csf_sample_cache_stats(song_t *csf, uint32_t *packed, uint32_t *cached);
+/* for reading the whole sample without expanding it: the data returned by begin (NULL if out of memory)
+has to be passed back to end when done */
+signed char *csf_sample_data_begin(song_sample_t *smp);
+void csf_sample_data_end(song_sample_t *smp, signed char *data);
+
+/* the waveform, boiled down for drawing: level n has the lowest and highest value (scaled to 16 bits) of
+each channel over every SAMPLE_PEAK_BLOCK << n frames, stored as min, max for each channel of each entry */
+#define SAMPLE_PEAK_BLOCK 128
+#define SAMPLE_PEAK_LEVELS 26
+struct sample_peaks {
+        uint32_t length; // what they were made from
+        uint32_t flags; // (just CHN_16BIT and CHN_STEREO)
+        int levels;
+        uint32_t count[SAMPLE_PEAK_LEVELS]; // entries in each level
+        int16_t *level[SAMPLE_PEAK_LEVELS];
+};
+// these are kept with the data until it's changed, so only the first call for a sample does any real work
+const struct sample_peaks *csf_sample_peaks(song_sample_t *smp);
+/* the full resolution copy of a sample that was loaded from 24-bit, 32-bit or float data (see csndfile.c):
+returns the first frame, or NULL if there isn't one that fits a sample with the given flags and length.
+the values are exactly what was in the file; the format says what that was */
+#define SAMPLE_HIRES_24 1 // int32_t, from 24-bit data (so the low byte is always zero)
+#define SAMPLE_HIRES_FLOAT 2 // 32-bit float
+#define SAMPLE_HIRES_32 3 // int32_t
+const void *csf_sample_hires(const signed char *data, uint32_t flags, uint32_t length, int *format);
+/* what the values in that copy, taken as fractions of full scale, get multiplied by to come out the same as the
+sample's (normalized) 16-bit data */
+float csf_sample_hires_gain(const signed char *data);
 song_instrument_t *csf_allocate_instrument(void);
 void csf_init_instrument(song_instrument_t *ins, int samp);
 void csf_free_instrument(song_instrument_t *p);
 
 uint32_t csf_read_sample(song_sample_t *sample, uint32_t flags, const void *filedata, uint32_t datalength);
+/* running totals of samples read, and how many bytes of file data they took up (for progress displays;
+samples can be read on several threads at once, so these are only ever added to atomically) */
+extern volatile uint32_t csf_read_sample_count, csf_read_sample_bytes;
+/* while this is set, csf_read_sample doesn't read anything, so a loader running on another thread can be
+made to give up quickly; it's meant for canceling one load at a time, and should be cleared once it's done */
+extern volatile int csf_read_sample_abort;
 uint32_t csf_write_sample(disko_t *fp, song_sample_t *sample, uint32_t flags);
 void csf_adjust_sample_loop(song_sample_t *sample);
 
+/* conversion loops for csf_read_sample (player/readsample.c); 'len' is in values, or frames for split stereo */
+void read_sample_xor8(int8_t *dest, const int8_t *src, uint32_t len, uint8_t flip);
+void read_sample_xor16(int16_t *dest, const int16_t *src, uint32_t len, uint16_t flip);
+void read_sample_swap16(int16_t *dest, const int16_t *src, uint32_t len);
+void read_sample_delta8(int8_t *dest, const int8_t *src, uint32_t len);
+void read_sample_delta16(int16_t *dest, const int16_t *src, uint32_t len);
+void read_sample_split8(int8_t *dest, const int8_t *src, uint32_t len, uint8_t flip, int delta);
+void read_sample_split16(int16_t *dest, const int16_t *src, uint32_t len, uint16_t flip, int delta);
+
 extern void (*csf_midi_out_note)(int chan, const song_note_t *m);
 extern void (*csf_midi_out_raw)(const unsigned char *, unsigned int, unsigned int);
 
@@ -650,6 +762,7 @@ int csf_get_highest_used_channel(song_t *csf);
 
 
 int csf_set_wave_config(song_t *csf, uint32_t rate, uint32_t bits, uint32_t channels);
+void csf_reset_dither(song_t *csf);
 
 // Mixer Config
 int csf_init_player(song_t *csf, int reset); // bReset=false
@@ -690,12 +803,14 @@ song_t *csf_allocate(void);
 void csf_free(song_t *csf);
 
 void csf_destroy(song_t *csf); /* erase everything -- equiv. to new song */
+song_t *csf_snapshot(song_t *csf); /* a copy for saving in the background (lock it first) */
 int csf_destroy_sample(song_t *csf, uint32_t smpnum);
 
 void csf_stop_sample(song_t *csf, song_sample_t *smp);
 
 void csf_reset_midi_cfg(song_t *csf);
 void csf_copy_midi_cfg(song_t *dest, song_t *src);
+void csf_copy_eq(song_t *dest, song_t *src);
 void csf_set_current_order(song_t *csf, uint32_t position);
 void csf_loop_pattern(song_t *csf, int pattern, int start_row);
 void csf_reset_playmarks(song_t *csf);
@@ -57,7 +57,9 @@ struct audio_settings {
         unsigned int eq_freq[4];
         unsigned int eq_gain[4];
         int no_ramping;
+        int dither;
         int filter_hack;
+        int compress_samples; /* keep loaded samples compressed in memory (see csf_compress_sample) */
 };
 
 extern struct audio_settings audio_settings;
@@ -97,17 +99,41 @@ song_load_unchecked:
 song_create_load:
         internal back-end function that loads and returns a song.
         the above functions both use this.
+song_create_load_ex:
+        same, but reads from an already slurped file and passes 'lflags' on to the
+        loader (see LOAD_* in fmt.h).
+song_load_background:
+        like song_load_unchecked, but the file is read and parsed on another thread
+        while a progress dialog is up; sets SONG_LOADING until it's finished.
+        the current song keeps playing until the new one replaces it, and
+        canceling the dialog stops the loader and leaves the current song alone.
+        the page is changed when the load is done. returns zero if the load
+        couldn't be started (or failed, if threads aren't available).
+song_load_sync:
+        called from the main loop while SONG_LOADING is set; updates the dialog
+        and swaps the new song in once the thread is done. returns nonzero if the
+        load is still running.
 */
 void song_new(int flags);
 void song_load(const char *file);
 int song_load_unchecked(const char *file);
+int song_load_background(const char *file);
+int song_load_sync(void);
 song_t *song_create_load(const char *file);
+song_t *song_create_load_ex(slurp_t *s, unsigned int lflags);
 
 // song_create_load returns NULL on error and sets errno to what might not be a standard value
 // use this to divine the meaning of these cryptic numbers
 const char *fmt_strerror(int n);
 
+/* song_save writes from a snapshot of the song on another thread (see csf_snapshot), so it only fails
+right away if the save couldn't be started; otherwise the result turns up in the log when song_save_sync
+notices it's done. song_save_sync should be called from the main loop, and returns nonzero while a save is
+still running; if 'wait' is set, it doesn't return until it's finished. song_autosave does the same thing
+as song_save, but to autosave.it in the config directory, and without changing the song's filename. */
 int song_save(const char *file, const char *type); // IT, S3M
+int song_save_sync(int wait);
+int song_autosave(void);
 int song_export(const char *file, const char *type); // WAV
 
 /* 'num' is only for status text feedback -- all of the sample's data is taken from 'smp'.
@@ -214,6 +240,8 @@ void song_set_instrument_mode(int value);
 
 /* this is called way early */
 void song_initialise(void);
+/* and this way late, to stop the threads that song_initialise started */
+void song_shutdown(void);
 
 /* called later at startup, and also when the relevant settings are changed */
 void song_init_modplug(void);
@@ -297,6 +325,10 @@ int song_get_playing_channels(void);
 int song_get_max_channels(void);
 
 void song_get_vu_meter(int *left, int *right);
+/* how many times the mixer had to wait for sample data that's mapped from its file (or compressed) */
+unsigned int song_get_stream_underruns(void);
+/* nonzero (once) if a sample's file was cut short while it was playing, and the voice was stopped */
+int song_stream_fault(void);
 
 /* fill the array with flags of each playing sample/instrument, such that iff
  * sample #7 is playing, samples[7] will be nonzero. these are a bit processor
@@ -28,12 +28,18 @@
 #include <math.h>
 #include <stdint.h>
 #include <assert.h>
+#if HAVE_MMAP
+# include <sys/mman.h>
+#endif
 
 #include "sndfile.h"
+#include "cmixer.h"
 #include "log.h"
 #include "util.h"
-#include "fmt.h" // for it_decompress8 / it_decompress16
+#include "fmt.h" // for it_decompress8 / it_decompress16 (and it_compress*)
+
 
+static const float eq_default_freqs[MAX_EQ_BANDS] = {120, 600, 1200, 3000, 6000, 10000};
 
 static void _csf_reset(song_t *csf)
 {
@@ -58,9 +64,17 @@ static void _csf_reset(song_t *csf)
 	csf->row_highlight_major = 16;
 	csf->row_highlight_minor = 4;
 
+	/* Default: Flat EQ */
+	memset(csf->eq, 0, sizeof(csf->eq));
+	for (i = 0; i < MAX_EQ_BANDS * 2; i++) {
+		csf->eq[i].gain = 1;
+		csf->eq[i].center_frequency = eq_default_freqs[i % MAX_EQ_BANDS];
+	}
+
 	/* This is intentionally crappy quality, so that it's very obvious if it didn't get initialized */
 	csf->mix_flags = 0;
 	csf_set_wave_config(csf, 4000, 8, 1);
+	csf_reset_dither(csf);
 
 	memset(csf->voices, 0, sizeof(csf->voices));
 	memset(csf->voice_mix, 0, sizeof(csf->voice_mix));
@@ -146,15 +160,179 @@ void csf_free_instrument(song_instrument_t *i)
 }
 
 
+static void spin_lock(volatile int *lock)
+{
+	while (__sync_lock_test_and_set(lock, 1))
+		while (*lock)
+			;
+}
+
+static void spin_unlock(volatile int *lock)
+{
+	__sync_lock_release(lock);
+}
+
+/* Patterns are carved out of large blocks that belong to the song, rather than each one being allocated
+separately, and csf_destroy just frees the blocks. A pattern that's freed before that (the editor does this
+whenever one is resized) goes back on a list of free chunks, kept in address order so that neighbours can be
+merged again; a pattern of any size can be cut from a chunk that's big enough, and a block that ends up
+completely free is given back to the system.
+
+The first block is just big enough for the first pattern, and each new one is twice the size of the last, up
+to PATTERN_BLOCK_SIZE; so a song with one pattern doesn't cost more than the pattern itself, and a big one
+doesn't need more than a handful of blocks. Rows are still MAX_CHANNELS wide, since that's how everything
+else indexes them.
+
+pattern_lock only covers the blocks and the free list, and the mixer never takes it (a pattern that's missing
+during playback is played as blank; see sndmix.c). New blocks are calloc'd outside of it. */
+#define PATTERN_BLOCK_SIZE (256 * 1024)
+
+struct pattern_block {
+	struct pattern_block *next;
+	size_t used, size;
+};
+
+// (in front of each pattern, and each free chunk; the size includes the header)
+struct pattern_header {
+	size_t size;
+	uint32_t rows;
+	song_note_t *next_free;
+};
+
+#define PATTERN_BLOCK_HEADER ((sizeof(struct pattern_block) + 15) & ~15)
+#define PATTERN_CHUNK_HEADER ((sizeof(struct pattern_header) + 15) & ~15)
+#define PATTERN_HEADER(p) ((struct pattern_header *) ((char *) (p) - PATTERN_CHUNK_HEADER))
+#define PATTERN_CHUNK(h) ((song_note_t *) ((char *) (h) + PATTERN_CHUNK_HEADER))
+
+// takes the lock for granted
+static void _free_pattern_chunk(song_t *csf, struct pattern_header *h)
+{
+	struct pattern_header *prev = NULL, *next;
+	struct pattern_block *block, **blink;
+	song_note_t **link;
+
+	for (link = &csf->pattern_free; *link && *link < PATTERN_CHUNK(h); link = &prev->next_free)
+		prev = PATTERN_HEADER(*link);
+	h->next_free = *link;
+	*link = PATTERN_CHUNK(h);
+
+	// (blocks are never adjacent to each other, since each one starts with its own header)
+	if (h->next_free) {
+		next = PATTERN_HEADER(h->next_free);
+		if ((char *) h + h->size == (char *) next) {
+			h->size += next->size;
+			h->next_free = next->next_free;
+		}
+	}
+	if (prev && (char *) prev + prev->size == (char *) h) {
+		prev->size += h->size;
+		prev->next_free = h->next_free;
+		h = prev;
+	}
+
+	// the newest block is still being handed out, so it's kept in any case
+	if (!csf->pattern_blocks)
+		return;
+	for (blink = &csf->pattern_blocks->next; (block = *blink) != NULL; blink = &block->next) {
+		if ((char *) block + PATTERN_BLOCK_HEADER == (char *) h && h->size == block->size - PATTERN_BLOCK_HEADER)
+			break;
+	}
+	if (!block)
+		return;
+	for (link = &csf->pattern_free; *link != PATTERN_CHUNK(h); link = &PATTERN_HEADER(*link)->next_free)
+		;
+	*link = h->next_free;
+	*blink = block->next;
+	free(block);
+}
+
+song_note_t *csf_allocate_pattern(song_t *csf, uint32_t rows)
+{
+	size_t size = (PATTERN_CHUNK_HEADER + rows * MAX_CHANNELS * sizeof(song_note_t) + 15) & ~15;
+	struct pattern_block *block;
+	struct pattern_header *h, *rest;
+	song_note_t **link, *pat;
+
+	spin_lock(&csf->pattern_lock);
+	for (link = &csf->pattern_free; *link; link = &PATTERN_HEADER(*link)->next_free) {
+		h = PATTERN_HEADER(*link);
+		if (h->size < size)
+			continue;
+		if (h->size - size >= PATTERN_CHUNK_HEADER) {
+			// cut the pattern off the front, and leave the rest where it was in the list
+			rest = (struct pattern_header *) ((char *) h + size);
+			rest->size = h->size - size;
+			rest->next_free = h->next_free;
+			*link = PATTERN_CHUNK(rest);
+			h->size = size;
+		} else {
+			*link = h->next_free;
+		}
+		spin_unlock(&csf->pattern_lock);
+		h->rows = rows;
+		pat = PATTERN_CHUNK(h);
+		memset(pat, 0, rows * MAX_CHANNELS * sizeof(song_note_t));
+		return pat;
+	}
+
+	block = csf->pattern_blocks;
+	if (!block || block->size - block->used < size) {
+		size_t bsize = PATTERN_BLOCK_HEADER + size;
+		struct pattern_block *newblock;
+
+		if (block)
+			bsize = MAX(bsize, MIN(PATTERN_BLOCK_SIZE, 2 * block->size));
+		spin_unlock(&csf->pattern_lock);
+		newblock = calloc(1, bsize);
+		if (!newblock)
+			return NULL;
+		newblock->size = bsize;
+		newblock->used = PATTERN_BLOCK_HEADER;
+
+		// (someone else might have added a block in the meantime, which is fine -- this one goes in front)
+		spin_lock(&csf->pattern_lock);
+		block = csf->pattern_blocks;
+		newblock->next = block;
+		csf->pattern_blocks = newblock;
+		// whatever was left over in the last block can still be used for smaller patterns
+		// (if there's room for the chunk header, anyway)
+		if (block && block->size - block->used >= PATTERN_CHUNK_HEADER) {
+			h = (struct pattern_header *) ((char *) block + block->used);
+			h->size = block->size - block->used;
+			block->used = block->size;
+			_free_pattern_chunk(csf, h);
+		}
+		block = newblock;
+	}
+	h = (struct pattern_header *) ((char *) block + block->used);
+	block->used += size;
+	spin_unlock(&csf->pattern_lock);
+
+	h->size = size;
+	h->rows = rows;
+	return PATTERN_CHUNK(h);
+}
+
+void csf_free_pattern(song_t *csf, void *pat)
+{
+	if (!pat)
+		return;
+	spin_lock(&csf->pattern_lock);
+	_free_pattern_chunk(csf, PATTERN_HEADER(pat));
+	spin_unlock(&csf->pattern_lock);
+}
+
 void csf_destroy(song_t *csf)
 {
+	struct pattern_block *block;
 	int i;
 
-	for (i = 0; i < MAX_PATTERNS; i++) {
-		if (csf->patterns[i]) {
-			csf_free_pattern(csf->patterns[i]);
-			csf->patterns[i] = NULL;
-		}
+	// the patterns all go away with the blocks they were allocated from
+	memset(csf->patterns, 0, sizeof(csf->patterns));
+	csf->pattern_free = NULL;
+	while ((block = csf->pattern_blocks) != NULL) {
+		csf->pattern_blocks = block->next;
+		free(block);
 	}
 	for (i = 1; i < MAX_SAMPLES; i++) {
 		song_sample_t *pins = &csf->samples[i];
@@ -173,30 +351,931 @@ void csf_destroy(song_t *csf)
 	_csf_reset(csf);
 }
 
-song_note_t *csf_allocate_pattern(uint32_t rows)
+/* Make a copy of the song that can be written out while the original is still being played and edited. The
+sample data is only shared, since anything that changes a sample unshares it first (see csf_unshare_sample);
+the patterns and instruments are small enough to just copy. None of the playback state means anything in the
+copy. The caller should have the song locked. */
+song_t *csf_snapshot(song_t *csf)
 {
-	return calloc(rows * MAX_CHANNELS, sizeof(song_note_t));
-}
+	song_t *snap = malloc(sizeof(song_t));
+	int n;
 
-void csf_free_pattern(void *pat)
-{
-	free(pat);
+	if (!snap)
+		return NULL;
+	memcpy(snap, csf, sizeof(song_t));
+	memset(snap->voices, 0, sizeof(snap->voices));
+	memset(snap->voice_mix, 0, sizeof(snap->voice_mix));
+	snap->num_voices = 0;
+	snap->multi_write = NULL;
+	memset(snap->patterns, 0, sizeof(snap->patterns));
+	snap->pattern_blocks = NULL;
+	snap->pattern_free = NULL;
+	snap->pattern_lock = 0;
+	memset(snap->instruments, 0, sizeof(snap->instruments));
+	snap->histdata = NULL;
+	snap->histlen = 0;
+	// (csf_destroy doesn't free these two)
+	snap->samples[0].data = NULL;
+	snap->samples[MAX_SAMPLES].data = NULL;
+	for (n = 1; n < MAX_SAMPLES; n++) {
+		if (snap->samples[n].data)
+			csf_share_sample(snap->samples[n].data);
+	}
+
+	for (n = 0; n < MAX_PATTERNS; n++) {
+		uint32_t rows;
+
+		if (!csf->patterns[n])
+			continue;
+		rows = PATTERN_HEADER(csf->patterns[n])->rows;
+		snap->patterns[n] = csf_allocate_pattern(snap, rows);
+		if (!snap->patterns[n])
+			goto fail;
+		memcpy(snap->patterns[n], csf->patterns[n], rows * MAX_CHANNELS * sizeof(song_note_t));
+	}
+	for (n = 0; n < MAX_INSTRUMENTS; n++) {
+		if (!csf->instruments[n])
+			continue;
+		snap->instruments[n] = malloc(sizeof(song_instrument_t));
+		if (!snap->instruments[n])
+			goto fail;
+		memcpy(snap->instruments[n], csf->instruments[n], sizeof(song_instrument_t));
+	}
+	if (csf->histlen) {
+		snap->histdata = malloc(8 * csf->histlen);
+		if (!snap->histdata)
+			goto fail;
+		memcpy(snap->histdata, csf->histdata, 8 * csf->histlen);
+		snap->histlen = csf->histlen;
+	}
+	return snap;
+
+fail:
+	csf_free(snap);
+	return NULL;
 }
 
+/* Sample data is reference counted, so that copying a sample (from the library, an instrument file, or
+another slot) only has to share the buffer. The count lives in a header ahead of the 16 bytes of padding
+that the interpolators may read before the start of the sample. Samples can be loaded on one thread while
+another is playing or editing, and they can end up sharing buffers (see csf_pool_sample), so the count is
+only ever changed atomically. */
+struct sample_store;
+struct sample_hires;
+
+struct sample_header {
+	uint32_t refs;
+	uint32_t nbytes;
+	uint32_t mapped; // see csf_map_sample
+	uint32_t hash; // see csf_pool_sample (zero if it isn't in the pool)
+	union {
+		struct {
+			struct sample_store *store; // see csf_compress_sample
+			signed char *pool_next;
+			struct sample_peaks *peaks; // see csf_sample_peaks
+			struct sample_hires *hires; // see csf_sample_hires
+		};
+		uint64_t pad[4]; // (keeps the data 16-byte aligned)
+	};
+};
+
+volatile uint32_t csf_streamed_samples = 0;
+
+static void free_sample_store(struct sample_store *store);
+static int unpool_sample(signed char *p, int release);
+static void pool_remove(signed char *p);
+static volatile int pool_lock;
+
+#define SAMPLE_HEADER(p) ((struct sample_header *) ((char *) (p) - 16 - sizeof(struct sample_header)))
+// what csf_allocate_sample returns, from the sample data to the end of the buffer
+#define SAMPLE_ALLOC_SIZE(nbytes) ((((nbytes) + 39) & ~7) - 16) // magic
+
 /* Note: this function will appear in valgrind to be a sieve for memory leaks.
 It isn't; it's just being confused by the adjusted pointer being stored. */
 signed char *csf_allocate_sample(uint32_t nbytes)
 {
-	signed char *p = calloc(1, (nbytes + 39) & ~7); // magic
-	if (p)
-		p += 16;
-	return p;
+	struct sample_header *h = calloc(1, sizeof(struct sample_header) + 16 + SAMPLE_ALLOC_SIZE(nbytes));
+	if (!h)
+		return NULL;
+	h->refs = 1;
+	h->nbytes = nbytes;
+	return (signed char *) h + sizeof(struct sample_header) + 16;
 }
 
 void csf_free_sample(void *p)
+{
+	struct sample_header *h;
+
+	if (!p)
+		return;
+	h = SAMPLE_HEADER(p);
+	if (h->hash ? !unpool_sample(p, 1) : __sync_sub_and_fetch(&h->refs, 1))
+		return;
+	if (h->store || h->mapped)
+		__sync_sub_and_fetch(&csf_streamed_samples, 1);
+	free_sample_store(h->store);
+	free(h->peaks);
+	free(h->hires);
+#if HAVE_MMAP
+	if (h->mapped) {
+		slurp_munmap_private((uint8_t *) h, 0, sizeof(struct sample_header) + 16
+			+ SAMPLE_ALLOC_SIZE(h->nbytes));
+		return;
+	}
+#endif
+	free(h);
+}
+
+/* If the sample data in a file is already laid out the way it's going to be played (signed, native byte order)
+and the file was mmap'd, the sample can just be a private mapping of that part of the file instead of a copy;
+the kernel takes care of copying any pages that get written to, so editing it in place is fine. 'len' is how
+much data there is in the file, and 'nbytes' is the size csf_allocate_sample would have gotten.
+Returns NULL if the data has to be read normally. */
+static signed char *csf_map_sample(const void *filedata, uint32_t len, uint32_t nbytes)
+{
+#if HAVE_MMAP
+	struct sample_header *h;
+	uint8_t *p;
+
+	// not worth the trouble for a few pages, and the header has to be aligned
+	if (len < 65536 || ((uintptr_t) filedata & 7))
+		return NULL;
+	p = slurp_mmap_private(filedata, sizeof(struct sample_header) + 16, SAMPLE_ALLOC_SIZE(nbytes));
+	if (!p)
+		return NULL;
+
+	// whatever came before and after the sample in the file shouldn't end up in the padding
+	memset(p - 16, 0, 16);
+	memset(p + len, 0, SAMPLE_ALLOC_SIZE(nbytes) - len);
+	h = SAMPLE_HEADER(p);
+	h->refs = 1;
+	h->nbytes = nbytes;
+	h->mapped = 1;
+	h->hash = 0;
+	h->store = NULL;
+	h->pool_next = NULL;
+	h->peaks = NULL;
+	h->hires = NULL;
+	__sync_add_and_fetch(&csf_streamed_samples, 1);
+	return (signed char *) p;
+#else
+	return NULL;
+#endif
+}
+
+signed char *csf_share_sample(signed char *p)
 {
 	if (p)
-		free(p - 16);
+		__sync_add_and_fetch(&SAMPLE_HEADER(p)->refs, 1);
+	return p;
+}
+
+int csf_sample_is_shared(const void *p)
+{
+	return p && SAMPLE_HEADER(p)->refs > 1;
+}
+
+int csf_sample_is_mapped(const void *p)
+{
+	return p && SAMPLE_HEADER(p)->mapped;
+}
+
+/* Voices only point at the data; they don't hold a reference to it. So whenever a sample's buffer is swapped
+for another one with the same contents, the voices that are playing it have to follow it over, because the old
+one might only be kept alive now by something that isn't playing at all (the library, or a snapshot that's
+being saved) and can go away at any time. */
+static void move_voices(song_t *csf, const signed char *from, signed char *to)
+{
+	song_voice_t *v;
+	int n;
+
+	if (!csf)
+		return;
+	for (n = 0, v = csf->voices; n < MAX_VOICES; n++, v++) {
+		if (v->current_sample_data == from)
+			v->current_sample_data = to;
+	}
+}
+
+int csf_unshare_sample(song_t *csf, song_sample_t *smp)
+{
+	signed char *data;
+	uint32_t nbytes;
+
+	// all the blocks have to be there before anything can be changed, and then they have to stay there
+	// (if it was shared, this already gives it a buffer of its own)
+	csf_expand_sample(csf, smp);
+	data = smp->data;
+	// it's about to be different, so nothing else should get it from the pool, and the peaks and the high
+	// resolution copy are no good (this has to be checked with the pool locked, or a loader could find it there
+	// in the meantime)
+	spin_lock(&pool_lock);
+	if (SAMPLE_HEADER(data)->refs == 1) {
+		pool_remove(data);
+		spin_unlock(&pool_lock);
+		free(SAMPLE_HEADER(data)->peaks);
+		SAMPLE_HEADER(data)->peaks = NULL;
+		free(SAMPLE_HEADER(data)->hires);
+		SAMPLE_HEADER(data)->hires = NULL;
+		return 1;
+	}
+	spin_unlock(&pool_lock);
+	nbytes = SAMPLE_HEADER(data)->nbytes;
+	smp->data = csf_allocate_sample(nbytes);
+	if (!smp->data) {
+		smp->data = data;
+		return 0;
+	}
+	// the loop unrolling past the end has to come along too
+	memcpy(smp->data, data, SAMPLE_ALLOC_SIZE(nbytes));
+	move_voices(csf, data, smp->data);
+	csf_free_sample(data);
+	return 1;
+}
+
+/* --------------------------------------------------------------------------------------------------------- */
+/* The sample pool. Songs and libraries often have the same waveform in several places, so as samples are
+loaded, their data is hashed and looked up here; if an identical buffer is already around, the sample just
+shares that one instead. (Editing a sample in place unshares it, as usual, so none of this is visible.)
+Mapped and compressed buffers are left out, since comparing them would mean reading all of them in, and so
+are ones with a high resolution copy, since two of those can be different where their 16-bit data isn't.
+
+The pool doesn't hold any references itself: buffers take themselves out of it when the last one goes away.
+Since loading can happen on another thread, all of this is under a spinlock. */
+
+#define POOL_BUCKETS 1024
+
+static signed char *pool[POOL_BUCKETS];
+static volatile int pool_lock = 0;
+
+// (with the pool locked)
+static void pool_remove(signed char *p)
+{
+	struct sample_header *h = SAMPLE_HEADER(p);
+	signed char **link;
+
+	if (!h->hash)
+		return;
+	for (link = pool + (h->hash % POOL_BUCKETS); *link; link = &SAMPLE_HEADER(*link)->pool_next) {
+		if (*link == p) {
+			*link = h->pool_next;
+			break;
+		}
+	}
+	h->hash = 0;
+	h->pool_next = NULL;
+}
+
+// (FNV-1a, four bytes at a time; anything over a few MB is spot-checked, since memcmp has the last word anyway)
+static uint32_t hash_sample_data(const signed char *data, uint32_t nbytes)
+{
+	const uint32_t *w = (const uint32_t *) data;
+	uint32_t n, count = nbytes / 4, step = 1, hash = 0x811c9dc5 ^ nbytes;
+
+	if (count > 0x100000)
+		step = count / 0x100000;
+	for (n = 0; n < count; n += step)
+		hash = (hash ^ w[n]) * 0x01000193;
+	for (n = count * 4; n < nbytes; n++)
+		hash = (hash ^ (uint8_t) data[n]) * 0x01000193;
+	return hash ? hash : 1;
+}
+
+/* with 'release', this drops a reference first, and only takes the buffer out if that was the last one.
+returns nonzero if the buffer isn't in the pool anymore */
+static int unpool_sample(signed char *p, int release)
+{
+	spin_lock(&pool_lock);
+	if (release && __sync_sub_and_fetch(&SAMPLE_HEADER(p)->refs, 1)) {
+		spin_unlock(&pool_lock);
+		return 0;
+	}
+	pool_remove(p);
+	spin_unlock(&pool_lock);
+	return 1;
+}
+
+int csf_pool_sample(song_t *csf, song_sample_t *smp)
+{
+	signed char *data = smp->data, *other;
+	struct sample_header *h;
+	uint32_t hash;
+
+	if (!data || csf_sample_is_mapped(data) || csf_sample_is_compressed(data) || SAMPLE_HEADER(data)->hash
+	    || SAMPLE_HEADER(data)->hires)
+		return 0;
+	h = SAMPLE_HEADER(data);
+	hash = hash_sample_data(data, h->nbytes);
+
+	spin_lock(&pool_lock);
+	for (other = pool[hash % POOL_BUCKETS]; other; other = SAMPLE_HEADER(other)->pool_next) {
+		struct sample_header *oh = SAMPLE_HEADER(other);
+		if (oh->hash == hash && oh->nbytes == h->nbytes && !oh->store && !oh->hires
+		    && !memcmp(other, data, h->nbytes)) {
+			__sync_add_and_fetch(&oh->refs, 1);
+			spin_unlock(&pool_lock);
+			smp->data = other;
+			move_voices(csf, data, other);
+			csf_free_sample(data);
+			return 1;
+		}
+	}
+	h->hash = hash;
+	h->pool_next = pool[hash % POOL_BUCKETS];
+	pool[hash % POOL_BUCKETS] = data;
+	spin_unlock(&pool_lock);
+	return 0;
+}
+
+int csf_pool_samples(song_t *csf)
+{
+	int n, count = 0;
+
+	for (n = 1; n < MAX_SAMPLES; n++)
+		count += csf_pool_sample(csf, csf->samples + n);
+	return count;
+}
+
+/* --------------------------------------------------------------------------------------------------------- */
+/* Compressed samples. With the "compress samples" option, the samples in a song that's loaded are packed into
+blocks with the IT 2.15 compressor, and most of each buffer is given back to the system. The buffer itself stays
+where it is, so the mixer hardly knows the difference: the blocks a note is going to start from (the first one,
+and the ones with the loop starts) are always decoded, the prefetch thread decodes the rest ahead of the voices
+that are playing them, and csf_trim_sample_cache gives back whichever ones were played least recently.
+The store belongs to the buffer rather than the sample, so it gets shared along with it.
+
+Decoding ahead is done in three steps, so that the slow part doesn't hold up the mixer: csf_cache_sample
+makes a list of the blocks that are missing, csf_decode_cache_job decodes one of them into a separate buffer,
+and csf_finish_cache_job copies it into place. Each job holds a reference to the sample data, which keeps the
+packed blocks from going away in the middle. If a voice gets somewhere that the prefetching didn't (after a
+jump with Oxx, say), csf_cache_voice decodes it right there in the mixer, and counts it as a miss.
+
+None of this does any locking. csf_cache_sample, csf_finish_cache_job, csf_cache_voice,
+csf_trim_sample_cache, and csf_expand_sample have to be called with the audio locked; csf_compress_sample only
+on a song that isn't playing. */
+
+#define STORE_BLOCK 16384 // frames; this is also what the compressor fits in one block at 16-bit
+#define STORE_PINNED 0xffffffff
+
+struct sample_store {
+	uint32_t length; // frames
+	int is16, stereo;
+	uint32_t nblocks;
+	uint32_t seen, counted; // see csf_trim_sample_cache and csf_sample_cache_stats
+	uint32_t *offset; // block n is from offset[n] to offset[n + 1] in 'packed'
+	uint32_t *used; // when each block was last wanted, or zero if it isn't decoded
+	uint8_t *packed;
+};
+
+uint32_t csf_sample_cache_blocks = 256;
+static uint32_t store_clock = 0;
+
+static void free_sample_store(struct sample_store *store)
+{
+	if (!store)
+		return;
+	free(store->offset);
+	free(store->used);
+	free(store->packed);
+	free(store);
+}
+
+static uint32_t store_block_bytes(struct sample_store *store, uint32_t n)
+{
+	return MIN(STORE_BLOCK, store->length - n * STORE_BLOCK) << (store->is16 + store->stereo);
+}
+
+// 'dest' is where block n itself goes
+static void decode_block_to(struct sample_store *store, signed char *dest, uint32_t n)
+{
+	uint32_t frames = store_block_bytes(store, n) >> (store->is16 + store->stereo);
+	const uint8_t *src = store->packed + store->offset[n];
+	uint32_t srclen = store->offset[n + 1] - store->offset[n];
+	uint32_t (*decompress)(void *, uint32_t, const void *, uint32_t, int, int)
+		= store->is16 ? it_decompress16 : it_decompress8;
+	uint32_t used;
+	signed char *data = dest;
+
+	used = decompress(data, frames, src, srclen, 1, store->stereo + 1);
+	if (store->stereo)
+		decompress(data + (store->is16 ? 2 : 1), frames, src + used, srclen - used, 1, 2);
+}
+
+// 'data' is where block 0 goes, which doesn't have to be the sample buffer
+static void decode_block(struct sample_store *store, signed char *data, uint32_t n)
+{
+	decode_block_to(store, data + ((n * STORE_BLOCK) << (store->is16 + store->stereo)), n);
+}
+
+static void discard_block(struct sample_store *store, signed char *data, uint32_t n)
+{
+#if HAVE_MMAP && defined(MADV_DONTNEED)
+	uintptr_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t) data + ((n * STORE_BLOCK) << (store->is16 + store->stereo));
+	uintptr_t end = start + store_block_bytes(store, n);
+
+	// only the pages that are entirely in the block; whatever's left over on the edges just stays decoded
+	start = (start + page - 1) & ~(page - 1);
+	end &= ~(page - 1);
+	if (end > start)
+		madvise((void *) start, end - start, MADV_DONTNEED);
+#endif
+	store->used[n] = 0;
+}
+
+int csf_sample_is_compressed(const void *p)
+{
+	return p && SAMPLE_HEADER(p)->store;
+}
+
+int csf_compress_sample(song_sample_t *smp)
+{
+#if HAVE_MMAP && defined(MADV_DONTNEED)
+	struct sample_store *store;
+	signed char *data = smp->data;
+	uint8_t *packed, *tmp;
+	uint32_t n, size, bound, frames;
+	uint32_t (*compress)(void *, const void *, uint32_t, int);
+
+	// (a shared buffer might be playing in another song already; see csf_pool_sample. and a high resolution
+	// sample is played from its copy anyway, so packing the 16-bit data wouldn't save much)
+	if (!data || csf_sample_is_mapped(data) || csf_sample_is_compressed(data) || csf_sample_is_shared(data)
+	    || SAMPLE_HEADER(data)->hires || (smp->flags & CHN_ADLIB) || smp->length < 4 * STORE_BLOCK)
+		return 0;
+
+	store = calloc(1, sizeof(struct sample_store));
+	if (!store)
+		return 0;
+	store->length = smp->length;
+	store->is16 = !!(smp->flags & CHN_16BIT);
+	store->stereo = !!(smp->flags & CHN_STEREO);
+	store->nblocks = (smp->length + STORE_BLOCK - 1) / STORE_BLOCK;
+	compress = store->is16 ? it_compress16 : it_compress8;
+	bound = it_compress_bound(STORE_BLOCK, store->is16);
+	store->offset = malloc(sizeof(uint32_t) * (store->nblocks + 1));
+	store->used = calloc(store->nblocks, sizeof(uint32_t));
+	store->packed = malloc((uint64_t) bound * store->nblocks * (store->stereo + 1));
+	tmp = malloc(2 * STORE_BLOCK << store->is16);
+	if (!store->offset || !store->used || !store->packed || !tmp) {
+		free(tmp);
+		free_sample_store(store);
+		return 0;
+	}
+
+	size = 0;
+	for (n = 0; n < store->nblocks; n++) {
+		signed char *src = data + ((n * STORE_BLOCK) << (store->is16 + store->stereo));
+
+		frames = MIN(STORE_BLOCK, store->length - n * STORE_BLOCK);
+		store->offset[n] = size;
+		if (store->stereo) {
+			// the compressor only does one channel at a time, so it's left, then right
+			uint32_t i;
+			if (store->is16) {
+				int16_t *s = (int16_t *) src, *l = (int16_t *) tmp, *r = l + STORE_BLOCK;
+				for (i = 0; i < frames; i++) {
+					l[i] = s[2 * i];
+					r[i] = s[2 * i + 1];
+				}
+			} else {
+				int8_t *s = (int8_t *) src, *l = (int8_t *) tmp, *r = l + STORE_BLOCK;
+				for (i = 0; i < frames; i++) {
+					l[i] = s[2 * i];
+					r[i] = s[2 * i + 1];
+				}
+			}
+			size += compress(store->packed + size, tmp, frames, 1);
+			size += compress(store->packed + size, tmp + (STORE_BLOCK << store->is16), frames, 1);
+		} else {
+			size += compress(store->packed + size, src, frames, 1);
+		}
+	}
+	store->offset[n] = size;
+	free(tmp);
+
+	// not worth it if it barely got any smaller
+	if (size > (uint64_t) smp->length * 7 / 8 << (store->is16 + store->stereo)) {
+		free_sample_store(store);
+		return 0;
+	}
+	packed = realloc(store->packed, size);
+	if (packed)
+		store->packed = packed;
+
+	store->used[0] = STORE_PINNED;
+	if (smp->flags & CHN_LOOP)
+		store->used[MIN(smp->loop_start, smp->length - 1) / STORE_BLOCK] = STORE_PINNED;
+	if (smp->flags & CHN_SUSTAINLOOP)
+		store->used[MIN(smp->sustain_start, smp->length - 1) / STORE_BLOCK] = STORE_PINNED;
+	for (n = 0; n < store->nblocks; n++) {
+		if (store->used[n] != STORE_PINNED)
+			discard_block(store, data, n);
+	}
+	SAMPLE_HEADER(data)->store = store;
+	__sync_add_and_fetch(&csf_streamed_samples, 1);
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+int csf_compress_samples(song_t *csf)
+{
+	int n, count = 0;
+
+	for (n = 1; n < MAX_SAMPLES; n++)
+		count += csf_compress_sample(csf->samples + n);
+	return count;
+}
+
+void csf_expand_sample(song_t *csf, song_sample_t *smp)
+{
+	struct sample_store *store;
+	uint32_t n;
+
+	if (!csf_sample_is_compressed(smp->data))
+		return;
+	if (csf_sample_is_shared(smp->data)) {
+		// whatever else has it (a snapshot that's being saved, say) could be reading the packed blocks
+		// right now, so they have to stay put; this sample just gets a copy of its own instead
+		signed char *copy = csf_sample_data_begin(smp), *data = smp->data;
+		if (copy) {
+			smp->data = copy;
+			csf_adjust_sample_loop(smp);
+			move_voices(csf, data, copy);
+			csf_free_sample(data);
+			return;
+		}
+	}
+	store = SAMPLE_HEADER(smp->data)->store;
+	for (n = 0; n < store->nblocks; n++) {
+		if (!store->used[n])
+			decode_block(store, smp->data, n);
+	}
+	SAMPLE_HEADER(smp->data)->store = NULL;
+	free_sample_store(store);
+	__sync_sub_and_fetch(&csf_streamed_samples, 1);
+}
+
+static void touch_store(void)
+{
+	if (!++store_clock || store_clock == STORE_PINNED)
+		store_clock = 1; // (everything's going to look old for a moment; not a big deal)
+}
+
+int csf_cache_sample(const signed char *data, uint32_t start, uint32_t frames,
+	struct sample_cache_job *jobs, int *njobs, int max)
+{
+	struct sample_store *store;
+	uint32_t n, last;
+	int j, added = 0;
+
+	if (!csf_sample_is_compressed(data) || !frames)
+		return 0;
+	store = SAMPLE_HEADER(data)->store;
+	if (start >= store->length)
+		return 0;
+	last = MIN(start + frames - 1, store->length - 1) / STORE_BLOCK;
+	touch_store();
+	for (n = start / STORE_BLOCK; n <= last; n++) {
+		if (store->used[n] == STORE_PINNED)
+			continue;
+		if (store->used[n]) {
+			store->used[n] = store_clock;
+			continue;
+		}
+		for (j = 0; j < *njobs; j++) {
+			if (jobs[j].data == data && jobs[j].block == n)
+				break;
+		}
+		if (j < *njobs)
+			continue;
+		if (*njobs >= max)
+			break;
+		// the reference keeps the packed data around until the job is done with it (see csf_expand_sample)
+		jobs[*njobs].data = csf_share_sample((signed char *) data);
+		jobs[*njobs].block = n;
+		(*njobs)++;
+		added++;
+	}
+	return added;
+}
+
+void csf_decode_cache_job(struct sample_cache_job *job)
+{
+	decode_block_to(SAMPLE_HEADER(job->data)->store, job->buf, job->block);
+}
+
+void csf_finish_cache_job(struct sample_cache_job *job)
+{
+	struct sample_store *store = SAMPLE_HEADER(job->data)->store;
+
+	// the mixer might have had to do it in the meantime
+	if (store->used[job->block])
+		return;
+	memcpy(job->data + ((job->block * STORE_BLOCK) << (store->is16 + store->stereo)), job->buf,
+		store_block_bytes(store, job->block));
+	touch_store();
+	store->used[job->block] = store_clock;
+}
+
+void csf_release_cache_job(struct sample_cache_job *job)
+{
+	csf_free_sample(job->data);
+	job->data = NULL;
+}
+
+volatile uint32_t csf_sample_cache_misses = 0;
+volatile int csf_streamed_voices = 0;
+
+int csf_cache_voice(song_voice_t *v, int count)
+{
+	struct sample_store *store;
+	uint32_t span, start, last, n;
+	uint64_t end;
+	int mapped;
+
+	if (!csf_streamed_samples || !v->current_sample_data)
+		return 0;
+	mapped = csf_sample_is_mapped(v->current_sample_data);
+	if (!mapped && !csf_sample_is_compressed(v->current_sample_data))
+		return 0;
+	csf_streamed_voices = 1;
+	// (plus a few frames on either side for the interpolation)
+	span = (((uint64_t) abs(v->increment) * count + v->position_frac) >> 16) + 8;
+	start = (v->increment < 0) ? v->position - MIN(v->position, span) : v->position - MIN(v->position, 4);
+	end = (uint64_t) v->position + ((v->increment < 0) ? 4 : span);
+	if (mapped) {
+#if HAVE_MMAP
+		// if any of it isn't in memory, the mixer is going to be waiting on the disk for it
+		uint32_t bps = ((v->flags & CHN_16BIT) ? 2 : 1) * ((v->flags & CHN_STEREO) ? 2 : 1);
+		uint64_t first = (uint64_t) start * bps;
+		end = MIN(end * bps, SAMPLE_HEADER(v->current_sample_data)->nbytes);
+		if (end > first && !slurp_is_resident(v->current_sample_data + first, end - first))
+			csf_sample_cache_misses++;
+#endif
+		return 1;
+	}
+	store = SAMPLE_HEADER(v->current_sample_data)->store;
+	last = MIN(end, store->length - 1) / STORE_BLOCK;
+	for (n = start / STORE_BLOCK; n <= last; n++) {
+		if (!store->used[n]) {
+			decode_block(store, v->current_sample_data, n);
+			touch_store();
+			store->used[n] = store_clock;
+			csf_sample_cache_misses++;
+		}
+	}
+	return 0;
+}
+
+void csf_trim_sample_cache(song_t *csf)
+{
+	static uint32_t pass = 0;
+	struct sample_store *store, *oldest;
+	signed char *oldest_data;
+	uint32_t n, b, oldest_block, count = 0;
+
+	// samples can share buffers, so the stores are marked as they're counted
+	pass++;
+	for (n = 1; n < MAX_SAMPLES; n++) {
+		if (!csf_sample_is_compressed(csf->samples[n].data))
+			continue;
+		store = SAMPLE_HEADER(csf->samples[n].data)->store;
+		if (store->seen == pass)
+			continue;
+		store->seen = pass;
+		for (b = 0; b < store->nblocks; b++)
+			count += (store->used[b] && store->used[b] != STORE_PINNED);
+	}
+
+	while (count > csf_sample_cache_blocks) {
+		oldest = NULL;
+		oldest_data = NULL;
+		oldest_block = 0;
+		for (n = 1; n < MAX_SAMPLES; n++) {
+			if (!csf_sample_is_compressed(csf->samples[n].data))
+				continue;
+			store = SAMPLE_HEADER(csf->samples[n].data)->store;
+			for (b = 0; b < store->nblocks; b++) {
+				if (store->used[b] && store->used[b] != STORE_PINNED
+				    && (!oldest || store->used[b] < oldest->used[oldest_block])) {
+					oldest = store;
+					oldest_data = csf->samples[n].data;
+					oldest_block = b;
+				}
+			}
+		}
+		if (!oldest)
+			break;
+		discard_block(oldest, oldest_data, oldest_block);
+		count--;
+	}
+}
+
+void csf_sample_cache_stats(song_t *csf, uint32_t *packed, uint32_t *cached)
+{
+	static uint32_t pass = 0;
+	struct sample_store *store;
+	uint32_t n, b;
+
+	*packed = *cached = 0;
+	pass++;
+	for (n = 1; n < MAX_SAMPLES; n++) {
+		if (!csf_sample_is_compressed(csf->samples[n].data))
+			continue;
+		store = SAMPLE_HEADER(csf->samples[n].data)->store;
+		if (store->counted == pass)
+			continue;
+		store->counted = pass;
+		*packed += store->offset[store->nblocks];
+		for (b = 0; b < store->nblocks; b++) {
+			if (store->used[b])
+				*cached += store_block_bytes(store, b);
+		}
+	}
+}
+
+signed char *csf_sample_data_begin(song_sample_t *smp)
+{
+	struct sample_store *store;
+	signed char *copy;
+	uint32_t n;
+
+	if (!csf_sample_is_compressed(smp->data))
+		return smp->data;
+	store = SAMPLE_HEADER(smp->data)->store;
+	copy = csf_allocate_sample(SAMPLE_HEADER(smp->data)->nbytes);
+	if (!copy)
+		return NULL;
+	// decoding everything again is simpler than trying to tell which blocks are really in the buffer right now
+	for (n = 0; n < store->nblocks; n++)
+		decode_block(store, copy, n);
+	return copy;
+}
+
+void csf_sample_data_end(song_sample_t *smp, signed char *data)
+{
+	if (data != smp->data)
+		csf_free_sample(data);
+}
+
+/* The peaks are made once from the data, and then each level after the first is made from the one before it,
+so it's one pass over the sample and a little bit more. They're stuck on the buffer (which is why changing it
+has to go through csf_unshare_sample) along with what the sample looked like at the time, since a sample can
+have its length or bit depth changed without getting a new buffer. */
+const struct sample_peaks *csf_sample_peaks(song_sample_t *smp)
+{
+	struct sample_header *h;
+	struct sample_peaks *peaks;
+	signed char *data;
+	int16_t *p, *q;
+	uint32_t flags = smp->flags & (CHN_16BIT | CHN_STEREO);
+	uint32_t n, i, total;
+	int chans = (smp->flags & CHN_STEREO) ? 2 : 1;
+	int c, l;
+
+	if (!smp->data || !smp->length || (smp->flags & CHN_ADLIB))
+		return NULL;
+	h = SAMPLE_HEADER(smp->data);
+	peaks = h->peaks;
+	if (peaks && peaks->length == smp->length && peaks->flags == flags)
+		return peaks;
+	if ((uint64_t) smp->length * chans * ((flags & CHN_16BIT) ? 2 : 1) > h->nbytes)
+		return NULL;
+
+	free(peaks);
+	h->peaks = NULL;
+
+	// all the levels go in one block after the struct
+	n = (smp->length + SAMPLE_PEAK_BLOCK - 1) / SAMPLE_PEAK_BLOCK;
+	for (l = 0, total = 0; l < SAMPLE_PEAK_LEVELS; l++, n = (n + 1) / 2) {
+		total += n;
+		if (n == 1)
+			break;
+	}
+	peaks = malloc(sizeof(struct sample_peaks) + (size_t) total * chans * 2 * sizeof(int16_t));
+	data = peaks ? csf_sample_data_begin(smp) : NULL;
+	if (!data) {
+		free(peaks);
+		return NULL;
+	}
+	peaks->length = smp->length;
+	peaks->flags = flags;
+	peaks->levels = MIN(l + 1, SAMPLE_PEAK_LEVELS);
+	n = (smp->length + SAMPLE_PEAK_BLOCK - 1) / SAMPLE_PEAK_BLOCK;
+	p = (int16_t *) (peaks + 1);
+	for (l = 0; l < peaks->levels; l++, n = (n + 1) / 2) {
+		peaks->count[l] = n;
+		peaks->level[l] = p;
+		p += n * chans * 2;
+	}
+
+	p = peaks->level[0];
+	for (n = 0; n < smp->length; n += SAMPLE_PEAK_BLOCK) {
+		uint32_t end = MIN(n + SAMPLE_PEAK_BLOCK, smp->length);
+		for (c = 0; c < chans; c++) {
+			int lo = INT16_MAX, hi = INT16_MIN, v;
+			for (i = n; i < end; i++) {
+				if (flags & CHN_16BIT)
+					v = ((int16_t *) data)[i * chans + c];
+				else
+					v = data[i * chans + c] * 256;
+				lo = MIN(lo, v);
+				hi = MAX(hi, v);
+			}
+			*p++ = lo;
+			*p++ = hi;
+		}
+	}
+	csf_sample_data_end(smp, data);
+
+	for (l = 1; l < peaks->levels; l++) {
+		p = peaks->level[l - 1];
+		q = peaks->level[l];
+		for (n = 0; n < peaks->count[l]; n++) {
+			// (the last entry might only have one to go on)
+			int16_t *r = (2 * n + 1 < peaks->count[l - 1]) ? p + 2 * chans : p;
+			for (c = 0; c < 2 * chans; c += 2) {
+				q[c] = MIN(p[c], r[c]);
+				q[c + 1] = MAX(p[c + 1], r[c + 1]);
+			}
+			p += 4 * chans;
+			q += 2 * chans;
+		}
+	}
+
+	h->peaks = peaks;
+	return peaks;
+}
+
+/* --------------------------------------------------------------------------------------------------------- */
+/* High resolution samples. When a sample is loaded from 24-bit, 32-bit or floating point data, the 16-bit data
+that everything else works with is made as usual, and the buffer also keeps a copy of the values exactly as they
+were in the file: 32-bit integers for the integer formats (24-bit values are in the top three bytes), and 32-bit
+floats for the float ones. The mixer plays from the copy (see hires_mix_functions), and WAV and AIFF are saved
+from it. Like the peaks, it belongs to the buffer, so it's shared along with it and thrown out as soon as the
+data is about to change (see csf_unshare_sample); anything that edits the sample gets the 16-bit version.
+
+The 16-bit data is normalized (see read_sample_hires), and the copy isn't, so the gain that was used for that
+is kept too; the mixer applies it as it goes, so both sound the same. Just like the 16-bit data, there's some
+silence ahead of the start for the interpolators, and the last frame is repeated a few times after the end. */
+
+#define HIRES_GUARD 8 // frames on either side
+
+struct sample_hires {
+	uint32_t format; // SAMPLE_HIRES_24, SAMPLE_HIRES_32, or SAMPLE_HIRES_FLOAT
+	uint32_t frames;
+	uint32_t stereo;
+	float gain; // see csf_sample_hires_gain
+};
+
+// (the integers and the floats are both four bytes)
+static uint32_t *hires_values(struct sample_hires *hires)
+{
+	return (uint32_t *) (hires + 1) + HIRES_GUARD * (hires->stereo + 1);
+}
+
+static struct sample_hires *allocate_sample_hires(uint32_t frames, int stereo, uint32_t format)
+{
+	struct sample_hires *hires = calloc(1, sizeof(struct sample_hires)
+		+ (size_t) (frames + 2 * HIRES_GUARD) * (stereo + 1) * 4);
+
+	if (!hires)
+		return NULL;
+	hires->format = format;
+	hires->frames = frames;
+	hires->stereo = !!stereo;
+	return hires;
+}
+
+// once the values are in
+static void finish_sample_hires(struct sample_hires *hires)
+{
+	uint32_t frame = hires->stereo + 1;
+	uint32_t *end = hires_values(hires) + (size_t) hires->frames * frame;
+	int n;
+
+	for (n = 0; n < HIRES_GUARD; n++)
+		memcpy(end + n * frame, end - frame, frame * 4);
+}
+
+const void *csf_sample_hires(const signed char *data, uint32_t flags, uint32_t length, int *format)
+{
+	struct sample_hires *hires;
+
+	// (what the 16-bit data is made from might have been changed since, without it getting a new buffer)
+	if (!data || !(hires = SAMPLE_HEADER(data)->hires) || !(flags & CHN_16BIT)
+	    || hires->stereo != !!(flags & CHN_STEREO) || length > hires->frames)
+		return NULL;
+	if (format)
+		*format = hires->format;
+	return hires_values(hires);
+}
+
+float csf_sample_hires_gain(const signed char *data)
+{
+	return (data && SAMPLE_HEADER(data)->hires) ? SAMPLE_HEADER(data)->hires->gain : 0;
 }
 
 void csf_forget_history(song_t *csf)
@@ -410,6 +1489,11 @@ void csf_copy_midi_cfg(song_t *dest, song_t *src)
 	memcpy(&dest->midi_config, &src->midi_config, sizeof(midi_config_t));
 }
 
+void csf_copy_eq(song_t *dest, song_t *src)
+{
+	memcpy(dest->eq, src->eq, sizeof(dest->eq));
+}
+
 
 int csf_set_wave_config(song_t *csf, uint32_t rate,uint32_t bits,uint32_t channels)
 {
@@ -419,6 +1503,7 @@ int csf_set_wave_config(song_t *csf, uint32_t rate,uint32_t bits,uint32_t channe
 	csf->mix_channels = channels;
 	csf->mix_frequency = rate;
 	csf->mix_bits_per_sample = bits;
+	prepare_filter_table(rate);
 	csf_init_player(csf, reset);
 	return 1;
 }
@@ -534,14 +1619,75 @@ void csf_loop_pattern(song_t *csf, int pat, int row)
 #define SF_FAIL(name, n) \
 	({ log_appendf(4, "%s: internal error: unsupported %s %d", __FUNCTION__, name, n); return 0; })
 
+/* 24-bit and 32-bit data is written from the high resolution copy if there is one (see csf_sample_hires), or
+else from the 8 or 16-bit data. 'len' and 'stride' are as in csf_write_sample. */
+static uint32_t write_sample_hires(disko_t *fp, song_sample_t *sample, uint32_t flags, uint32_t len, int stride)
+{
+	int format = 0;
+	const uint32_t *hires = csf_sample_hires(sample->data, sample->flags, sample->length, &format);
+	uint32_t width = ((flags & SF_BIT_MASK) == SF_24) ? 3 : 4, pos, i, u;
+	int big_endian = (flags & SF_END_MASK) == SF_BE;
+	int channel;
+	uint32_t n;
+	int32_t k;
+	uint8_t b[4];
+	double v;
+	float f;
+
+	// (saving a copy in the format it came from gets back exactly what was loaded, since each of these
+	// conversions undoes the one in read_sample_hires)
+	for (channel = 0; channel < stride; channel++) {
+		for (pos = 0; pos < len; pos++) {
+			i = pos * stride + channel;
+			if (hires && format == SAMPLE_HIRES_FLOAT) {
+				memcpy(&f, hires + i, 4);
+				v = f;
+			} else if (hires) {
+				v = (int32_t) hires[i] / 2147483648.0;
+			} else if (sample->flags & CHN_16BIT) {
+				v = ((const int16_t *) sample->data)[i] / 32768.0;
+			} else {
+				v = sample->data[i] / 128.0;
+			}
+
+			if ((flags & SF_ENC_MASK) == SF_PCMF) {
+				f = v;
+				memcpy(&u, &f, 4);
+			} else if (width == 3) {
+				k = CLAMP(lrint(v * 8388608.0), -8388608, 8388607);
+				u = (uint32_t) k;
+			} else {
+				k = CLAMP(llrint(v * 2147483648.0), INT32_MIN, INT32_MAX);
+				u = (uint32_t) k;
+			}
+			for (n = 0; n < width; n++)
+				b[big_endian ? width - 1 - n : n] = u >> (8 * n);
+			disko_write(fp, b, width);
+		}
+	}
+	return len * stride * width;
+}
+
 uint32_t csf_write_sample(disko_t *fp, song_sample_t *sample, uint32_t flags)
 {
 	uint32_t pos, len = sample->length;
 	int stride = 1;     // how much to add to the left/right pointer per sample written
 	int byteswap = 0;   // should the sample data be byte-swapped?
 	int add = 0;        // how much to add to the sample data (for converting to unsigned)
+	int compress = 0;   // IT 2.14/2.15 compressed?
 	int channel;        // counter.
 
+	if (csf_sample_is_compressed(sample->data)) {
+		// write out a fully decoded copy instead
+		song_sample_t copy = *sample;
+		copy.data = csf_sample_data_begin(sample);
+		if (!copy.data)
+			return 0;
+		len = csf_write_sample(fp, &copy, flags);
+		csf_sample_data_end(sample, copy.data);
+		return len;
+	}
+
 	// validate the write flags, and set up the save params
 	switch (flags & SF_CHN_MASK) {
 	case SF_SI:
@@ -563,7 +1709,9 @@ uint32_t csf_write_sample(disko_t *fp, song_sample_t *sample, uint32_t flags)
 	}
 
 	// TODO allow converting bit width, this will be useful
-	if ((flags & SF_BIT_MASK) != ((sample->flags & CHN_16BIT) ? SF_16 : SF_8))
+	// (it can go up to 24 or 32 bits, though; see write_sample_hires)
+	if ((flags & SF_BIT_MASK) != ((sample->flags & CHN_16BIT) ? SF_16 : SF_8)
+	    && (flags & SF_BIT_MASK) != SF_24 && (flags & SF_BIT_MASK) != SF_32)
 		SF_FAIL("bit width", flags & SF_BIT_MASK);
 
 	switch (flags & SF_END_MASK) {
@@ -590,6 +1738,17 @@ uint32_t csf_write_sample(disko_t *fp, song_sample_t *sample, uint32_t flags)
 		break;
 	case SF_PCMS:
 		break;
+	case SF_PCMF:
+		if ((flags & SF_BIT_MASK) != SF_32)
+			SF_FAIL("bit width", flags & SF_BIT_MASK);
+		break;
+	case SF_IT214:
+	case SF_IT215:
+		// the compressed data is a bitstream, so there's no endianness to worry about
+		if ((flags & SF_CHN_MASK) != SF_M)
+			SF_FAIL("channel mask", flags & SF_CHN_MASK);
+		compress = 1;
+		break;
 	default:
 		SF_FAIL("encoding", flags & SF_ENC_MASK);
 	}
@@ -598,9 +1757,26 @@ uint32_t csf_write_sample(disko_t *fp, song_sample_t *sample, uint32_t flags)
 		SF_FAIL("extra flag", flags & ~(SF_BIT_MASK | SF_CHN_MASK | SF_END_MASK | SF_ENC_MASK));
 	}
 
-	if (!sample || sample->length < 1 || sample->length > MAX_SAMPLE_LENGTH || !sample->data)
+	if (!sample || sample->length < 1 || sample->length > MAX_STREAMED_SAMPLE_LENGTH || !sample->data)
 		return 0;
 
+	if ((flags & SF_BIT_MASK) == SF_24 || (flags & SF_BIT_MASK) == SF_32) {
+		if (add || compress)
+			SF_FAIL("encoding", flags & SF_ENC_MASK);
+		return write_sample_hires(fp, sample, flags, len, stride);
+	}
+
+	if (compress) {
+		int is16 = ((flags & SF_BIT_MASK) == SF_16);
+		uint8_t *packed = mem_alloc(it_compress_bound(len, is16));
+
+		len = (is16 ? it_compress16 : it_compress8)(packed, sample->data, len,
+			(flags & SF_ENC_MASK) == SF_IT215);
+		disko_write(fp, packed, len);
+		free(packed);
+		return len;
+	}
+
 	// No point buffering the processing here -- the disk output already SHOULD have a 64kb buffer
 	if ((flags & SF_BIT_MASK) == SF_16) {
 		// 16-bit data.
@@ -638,14 +1814,80 @@ uint32_t csf_write_sample(disko_t *fp, song_sample_t *sample, uint32_t flags)
 }
 
 
+/* High resolution samples get squeezed into 16 bits, scaled so the loudest point is at full volume (but amplified
+no more than 42dB, so near-silence stays near-silent) and rounded rather than truncated. The values from the file
+go into the high resolution copy as they are, if there is one (see csf_sample_hires), along with the scale.
+'count' is the number of values, and 'width' is the size of each in bytes (24-bit and 32-bit integers, or
+32-bit floats) */
+
+// the value as it goes into the high resolution copy: an integer in the top bits, or the bits of a float
+// (except that infinities and NaNs are zero, since they can't be played)
+static uint32_t hires_raw(const uint8_t *src, uint32_t width, int is_float, int big_endian)
+{
+	uint8_t b[4];
+	uint32_t u;
+	float f;
+	int n;
+
+	for (n = 0; n < (int) width; n++)
+		b[n] = big_endian ? src[width - 1 - n] : src[n];
+	u = (b[0] << 8) | (b[1] << 16) | ((uint32_t) b[2] << 24);
+	if (width == 3)
+		return u;
+	u = (u >> 8) | ((uint32_t) b[3] << 24);
+	if (!is_float)
+		return u;
+	memcpy(&f, &u, 4);
+	return isfinite(f) ? u : 0;
+}
+
+// and how loud that is, with full scale as +/-1
+static double hires_level(uint32_t u, int is_float)
+{
+	float f;
+
+	if (!is_float)
+		return (int32_t) u / 2147483648.0;
+	memcpy(&f, &u, 4);
+	return f;
+}
+
+static void read_sample_hires(int16_t *dest, const uint8_t *src, uint32_t count, uint32_t width, int is_float,
+	int big_endian, struct sample_hires *hires)
+{
+	double peak = 1.0 / 128, scale;
+	uint32_t *h = hires ? hires_values(hires) : NULL;
+	uint32_t n, u;
+
+	for (n = 0; n < count; n++)
+		peak = MAX(peak, fabs(hires_level(hires_raw(src + n * width, width, is_float, big_endian), is_float)));
+	// the loudest point lands on 8388607 / 256, which is 24-bit full scale shifted down to 16 bits
+	scale = 8388607.0 / 256.0 / peak;
+	for (n = 0; n < count; n++) {
+		u = hires_raw(src + n * width, width, is_float, big_endian);
+		dest[n] = CLAMP(lrint(hires_level(u, is_float) * scale), -32768, 32767);
+		if (h)
+			h[n] = u;
+	}
+	if (hires) {
+		hires->gain = scale;
+		finish_sample_hires(hires);
+	}
+}
+
+volatile uint32_t csf_read_sample_count = 0;
+volatile uint32_t csf_read_sample_bytes = 0;
+volatile int csf_read_sample_abort = 0;
+
 uint32_t csf_read_sample(song_sample_t *sample, uint32_t flags, const void *filedata, uint32_t memsize)
 {
-	uint32_t len = 0, mem;
+	uint32_t len = 0, mem, bps, used = 0; // 'used' is for the progress counter, if len isn't accurate
 	const char *buffer = (const char *) filedata;
 
 	if (sample->flags & CHN_ADLIB) return 0; // no sample data
 
 	if (!sample || sample->length < 1 || !buffer) return 0;
+	if (csf_read_sample_abort) return 0;
 
 	// validate the read flags before anything else
 	switch (flags & SF_BIT_MASK) {
@@ -662,7 +1904,7 @@ uint32_t csf_read_sample(song_sample_t *sample, uint32_t flags, const void *file
 	}
 	switch (flags & SF_ENC_MASK) {
 		case SF_PCMS: case SF_PCMU: case SF_PCMD: case SF_IT214: case SF_IT215:
-		case SF_AMS: case SF_DMF: case SF_MDL: case SF_PTM:
+		case SF_AMS: case SF_DMF: case SF_MDL: case SF_PTM: case SF_PCMF:
 			break;
 		default: SF_FAIL("encoding", flags & SF_ENC_MASK);
 	}
@@ -670,20 +1912,38 @@ uint32_t csf_read_sample(song_sample_t *sample, uint32_t flags, const void *file
 		SF_FAIL("extra flag", flags & ~(SF_BIT_MASK | SF_CHN_MASK | SF_END_MASK | SF_ENC_MASK));
 	}
 
-	if (sample->length > MAX_SAMPLE_LENGTH) sample->length = MAX_SAMPLE_LENGTH;
-	mem = sample->length+6;
+	if (sample->length > MAX_STREAMED_SAMPLE_LENGTH) sample->length = MAX_STREAMED_SAMPLE_LENGTH;
+	bps = 1;
 	sample->flags &= ~(CHN_16BIT|CHN_STEREO);
 	switch (flags & SF_BIT_MASK) {
 	case SF_16: case SF_24: case SF_32:
 		// these are all stuffed into 16 bits.
-		mem *= 2;
+		bps *= 2;
 		sample->flags |= CHN_16BIT;
 	}
 	switch (flags & SF_CHN_MASK) {
 	case SF_SI: case SF_SS:
-		mem *= 2;
+		bps *= 2;
 		sample->flags |= CHN_STEREO;
 	}
+#if !WORDS_BIGENDIAN
+	switch (flags) {
+	case SF(8,M,BE,PCMS):
+	case RS_PCM8S:
+	case RS_PCM16S:
+	case RS_STIPCM8S:
+	case RS_STIPCM16S:
+		len = sample->length * bps;
+		mem = (sample->length + 6) * bps;
+		if (len <= memsize && (sample->data = csf_map_sample(buffer, len, mem)) != NULL)
+			goto mapped;
+		len = 0;
+		break;
+	}
+#endif
+	// only mapped samples can go past the usual limit, since they don't all have to be in memory at once
+	if (sample->length > MAX_SAMPLE_LENGTH) sample->length = MAX_SAMPLE_LENGTH;
+	mem = (sample->length + 6) * bps;
 	if ((sample->data = csf_allocate_sample(mem)) == NULL) {
 		sample->length = 0;
 		return 0;
@@ -694,8 +1954,7 @@ uint32_t csf_read_sample(song_sample_t *sample, uint32_t flags, const void *file
 		{
 			len = sample->length;
 			if (len > memsize) len = sample->length = memsize;
-			signed char *data = sample->data;
-			for (uint32_t j=0; j<len; j++) data[j] = (signed char)(buffer[j] - 0x80);
+			read_sample_xor8(sample->data, (const int8_t *) buffer, len, 0x80);
 		}
 		break;
 
@@ -704,13 +1963,7 @@ uint32_t csf_read_sample(song_sample_t *sample, uint32_t flags, const void *file
 		{
 			len = sample->length;
 			if (len > memsize) break;
-			signed char *data = sample->data;
-			const signed char *p = (const signed char *)buffer;
-			int delta = 0;
-			for (uint32_t j=0; j<len; j++) {
-				delta += p[j];
-				*data++ = (signed char)delta;
-			}
+			read_sample_delta8(sample->data, (const int8_t *) buffer, len);
 		}
 		break;
 
@@ -719,15 +1972,7 @@ uint32_t csf_read_sample(song_sample_t *sample, uint32_t flags, const void *file
 		{
 			len = sample->length * 2;
 			if (len > memsize) break;
-			short *data = (short *)sample->data;
-			short *p = (short *)buffer;
-			unsigned short tmp;
-			int delta16 = 0;
-			for (uint32_t j=0; j<len; j+=2) {
-				tmp = *((unsigned short *)p++);
-				delta16 += bswapLE16(tmp);
-				*data++ = (short) delta16;
-			}
+			read_sample_delta16((int16_t *) sample->data, (const int16_t *) buffer, sample->length);
 		}
 		break;
 
@@ -748,27 +1993,17 @@ uint32_t csf_read_sample(song_sample_t *sample, uint32_t flags, const void *file
 	case RS_PCM16M:
 		len = sample->length * 2;
 		if (len > memsize) len = memsize & ~1;
-		if (len > 1) {
-			signed char *data = (signed char *)sample->data;
-			signed char *src = (signed char *)buffer;
-			for (uint32_t j=0; j<len; j+=2) {
-				// data[j] = src[j+1];
-				// data[j+1] = src[j];
-				*((unsigned short *)(data+j)) = bswapBE16(*((unsigned short *)(src+j)));
-			}
-		}
+		if (len > 1)
+			read_sample_swap16((int16_t *) sample->data, (const int16_t *) buffer, len / 2);
 		break;
 
 	// 6: 16-bit unsigned PCM data
 	case RS_PCM16U:
 		{
 			len = sample->length * 2;
-			if (len <= memsize) memcpy(sample->data, buffer, len);
-			short int *data = (short int *)sample->data;
-			for (uint32_t j=0; j<len; j+=2) {
-				*data = bswapLE16(*data) - 0x8000;
-				data++;
-			}
+			if (len <= memsize)
+				read_sample_xor16((int16_t *) sample->data, (const int16_t *) buffer,
+					sample->length, 0x8000);
 		}
 		break;
 
@@ -797,21 +2032,10 @@ uint32_t csf_read_sample(song_sample_t *sample, uint32_t flags, const void *file
 	case RS_STPCM8U:
 	case RS_STPCM8D:
 		{
-			int iadd_l, iadd_r;
-			iadd_l = iadd_r = (flags == RS_STPCM8U) ? -128 : 0;
 			len = sample->length;
-			signed char *psrc = (signed char *)buffer;
-			signed char *data = (signed char *)sample->data;
 			if (len*2 > memsize) break;
-			for (uint32_t j=0; j<len; j++) {
-				data[j*2] = (signed char)(psrc[0] + iadd_l);
-				data[j*2+1] = (signed char)(psrc[len] + iadd_r);
-				psrc++;
-				if (flags == RS_STPCM8D) {
-					iadd_l = data[j*2];
-					iadd_r = data[j*2+1];
-				}
-			}
+			read_sample_split8(sample->data, (const int8_t *) buffer, len,
+				(flags == RS_STPCM8U) ? 0x80 : 0, (flags == RS_STPCM8D));
 			len *= 2;
 		}
 		break;
@@ -821,21 +2045,10 @@ uint32_t csf_read_sample(song_sample_t *sample, uint32_t flags, const void *file
 	case RS_STPCM16U:
 	case RS_STPCM16D:
 		{
-			int iadd_l, iadd_r;
-			iadd_l = iadd_r = (flags == RS_STPCM16U) ? -0x8000 : 0;
 			len = sample->length;
-			short int *psrc = (short int *)buffer;
-			short int *data = (short int *)sample->data;
 			if (len*4 > memsize) break;
-			for (uint32_t j=0; j<len; j++) {
-				data[j*2] = (short int) (bswapLE16(psrc[0]) + iadd_l);
-				data[j*2+1] = (short int) (bswapLE16(psrc[len]) + iadd_r);
-				psrc++;
-				if (flags == RS_STPCM16D) {
-					iadd_l = data[j*2];
-					iadd_r = data[j*2+1];
-				}
-			}
+			read_sample_split16((int16_t *) sample->data, (const int16_t *) buffer, len,
+				(flags == RS_STPCM16U) ? 0x8000 : 0, (flags == RS_STPCM16D));
 			len *= 4;
 		}
 		break;
@@ -848,10 +2061,10 @@ uint32_t csf_read_sample(song_sample_t *sample, uint32_t flags, const void *file
 		len = memsize;
 		if (len < 2) break;
 		if (flags == RS_IT2148 || flags == RS_IT2158) {
-			it_decompress8(sample->data, sample->length,
+			used = it_decompress8(sample->data, sample->length,
 					buffer, memsize, (flags == RS_IT2158), 1);
 		} else {
-			it_decompress16(sample->data, sample->length,
+			used = it_decompress16(sample->data, sample->length,
 					buffer, memsize, (flags == RS_IT21516), 1);
 		}
 		break;
@@ -864,12 +2077,12 @@ uint32_t csf_read_sample(song_sample_t *sample, uint32_t flags, const void *file
 		if (flags == RS_IT2148S || flags == RS_IT2158S) {
 			uint32_t offset = it_decompress8(sample->data, sample->length,
 					buffer, memsize, (flags == RS_IT2158S), 2);
-			it_decompress8(sample->data + 1, sample->length,
+			used = offset + it_decompress8(sample->data + 1, sample->length,
 					buffer + offset, memsize - offset, (flags == RS_IT2158S), 2);
 		} else {
 			uint32_t offset = it_decompress16(sample->data, sample->length,
 					buffer, memsize, (flags == RS_IT21516S), 2);
-			it_decompress16(sample->data + 2, sample->length,
+			used = offset + it_decompress16(sample->data + 2, sample->length,
 					buffer + offset, memsize - offset, (flags == RS_IT21516S), 2);
 		}
 		break;
@@ -878,17 +2091,10 @@ uint32_t csf_read_sample(song_sample_t *sample, uint32_t flags, const void *file
 	case RS_STIPCM8S:
 	case RS_STIPCM8U:
 		{
-			int iadd = 0;
-			if (flags == RS_STIPCM8U) { iadd = -0x80; }
 			len = sample->length;
 			if (len*2 > memsize) len = memsize >> 1;
-			uint8_t * psrc = (uint8_t *)buffer;
-			uint8_t * data = (uint8_t *)sample->data;
-			for (uint32_t j=0; j<len; j++) {
-				data[j*2] = (signed char)(psrc[0] + iadd);
-				data[j*2+1] = (signed char)(psrc[1] + iadd);
-				psrc+=2;
-			}
+			read_sample_xor8(sample->data, (const int8_t *) buffer, len * 2,
+				(flags == RS_STIPCM8U) ? 0x80 : 0);
 			len *= 2;
 		}
 		break;
@@ -897,17 +2103,10 @@ uint32_t csf_read_sample(song_sample_t *sample, uint32_t flags, const void *file
 	case RS_STIPCM16S:
 	case RS_STIPCM16U:
 		{
-			int iadd = 0;
-			if (flags == RS_STIPCM16U) iadd = -32768;
 			len = sample->length;
 			if (len*4 > memsize) len = memsize >> 2;
-			short int *psrc = (short int *)buffer;
-			short int *data = (short int *)sample->data;
-			for (uint32_t j=0; j<len; j++) {
-				data[j*2] = (short int)(bswapLE16(psrc[0]) + iadd);
-				data[j*2+1] = (short int)(bswapLE16(psrc[1]) + iadd);
-				psrc += 2;
-			}
+			read_sample_xor16((int16_t *) sample->data, (const int16_t *) buffer, len * 2,
+				(flags == RS_STIPCM16U) ? 0x8000 : 0);
 			len *= 4;
 		}
 		break;
@@ -934,12 +2133,7 @@ uint32_t csf_read_sample(song_sample_t *sample, uint32_t flags, const void *file
 		{
 			len = sample->length * 2;
 			if (len > memsize) break;
-			signed char *data = (signed char *)sample->data;
-			signed char delta8 = 0;
-			for (uint32_t j=0; j<len; j++) {
-				delta8 += buffer[j];
-				*data++ = delta8;
-			}
+			read_sample_delta8(sample->data, (const int8_t *) buffer, len);
 			uint16_t *data16 = (uint16_t *)sample->data;
 			for (uint32_t j=0; j<len; j+=2) {
 				*data16 = bswapLE16(*data16);
@@ -1006,60 +2200,33 @@ uint32_t csf_read_sample(song_sample_t *sample, uint32_t flags, const void *file
 		break;
 #endif
 
-	// PCM 24-bit signed -> load sample, and normalize it to 16-bit
+	// PCM 24-bit, 32-bit, and floating point -> load sample, normalize it to 16-bit, and keep a high resolution
+	// copy of it for playing and saving
 	case RS_PCM24S:
 	case RS_PCM32S:
-		len = sample->length * 3;
-		if (flags == RS_PCM32S) len += sample->length;
-		if (len > memsize) break;
-		if (len > 4*8) {
-			uint32_t slsize = (flags == RS_PCM32S) ? 4 : 3;
-			uint8_t * src = (uint8_t *)buffer;
-			int32_t max = 255;
-			if (flags == RS_PCM32S) src++;
-			for (uint32_t j=0; j<len; j+=slsize) {
-				int32_t l = ((((src[j+2] << 8) + src[j+1]) << 8) + src[j]) << 8;
-				l /= 256;
-				if (l > max) max = l;
-				if (-l > max) max = -l;
-			}
-			max = (max / 128) + 1;
-			signed short *dest = (signed short *)sample->data;
-			for (uint32_t k=0; k<len; k+=slsize) {
-				int32_t l = ((((src[k+2] << 8) + src[k+1]) << 8) + src[k]) << 8;
-				*dest++ = (signed short)(l / max);
-			}
-		}
-		break;
-
-
-	// Stereo PCM 24-bit signed -> load sample, and normalize it to 16-bit
+	case RS_PCM32F:
 	case RS_STIPCM24S:
 	case RS_STIPCM32S:
-		len = sample->length * 6;
-		if (flags == RS_STIPCM32S) len += sample->length * 2;
-		if (len > memsize) break;
-		if (len > 8*8) {
-			uint32_t slsize = (flags == RS_STIPCM32S) ? 4 : 3;
-			uint8_t * src = (uint8_t *)buffer;
-			int32_t max = 255;
-			if (flags == RS_STIPCM32S) src++;
-			for (uint32_t j=0; j<len; j+=slsize) {
-				int32_t l = ((((src[j+2] << 8) + src[j+1]) << 8) + src[j]) << 8;
-				l /= 256;
-				if (l > max) max = l;
-				if (-l > max) max = -l;
-			}
-			max = (max / 128) + 1;
-			signed short *dest = (signed short *)sample->data;
-			for (uint32_t k=0; k<len; k+=slsize) {
-				int32_t ll = ((((src[k+2] << 8) + src[k+1]) << 8) + src[k]) << 8;
-				k += slsize;
-				int32_t lr = ((((src[k+2] << 8) + src[k+1]) << 8) + src[k]) << 8;
-				dest[0] = (signed short)(ll/max);
-				dest[1] = (signed short)(lr/max);
-				dest += 2;
-			}
+	case RS_STIPCM32F:
+	case SF(PCMS,24,M,BE):
+	case SF(PCMS,32,M,BE):
+	case SF(PCMS,24,SI,BE):
+	case SF(PCMS,32,SI,BE):
+		{
+			uint32_t width = ((flags & SF_BIT_MASK) == SF_24) ? 3 : 4;
+			int stereo = (flags & SF_CHN_MASK) != SF_M;
+			uint32_t count = sample->length * (stereo ? 2 : 1);
+			int is_float = (flags & SF_ENC_MASK) == SF_PCMF;
+			struct sample_hires *hires;
+
+			len = count * width;
+			if (len > memsize) break;
+			// (if there isn't enough memory for it, the sample is just 16-bit)
+			hires = allocate_sample_hires(sample->length, stereo,
+				is_float ? SAMPLE_HIRES_FLOAT : (width == 3) ? SAMPLE_HIRES_24 : SAMPLE_HIRES_32);
+			read_sample_hires((int16_t *) sample->data, (const uint8_t *) buffer, count, width, is_float,
+				(flags & SF_END_MASK) == SF_BE, hires);
+			SAMPLE_HEADER(sample->data)->hires = hires;
 		}
 		break;
 
@@ -1100,6 +2267,9 @@ uint32_t csf_read_sample(song_sample_t *sample, uint32_t flags, const void *file
 		memcpy(sample->data, buffer, len);
 		break;
 	}
+#if !WORDS_BIGENDIAN
+mapped:
+#endif
 	if (len > memsize) {
 		if (sample->data) {
 			sample->length = 0;
@@ -1109,6 +2279,9 @@ uint32_t csf_read_sample(song_sample_t *sample, uint32_t flags, const void *file
 		return 0;
 	}
 	csf_adjust_sample_loop(sample);
+	// (samples can be read on a few threads at once; see unpack_deferred_samples)
+	__sync_fetch_and_add(&csf_read_sample_count, 1);
+	__sync_fetch_and_add(&csf_read_sample_bytes, used ?: len);
 	return len;
 }
 
@@ -1182,7 +2355,9 @@ void csf_stop_sample(song_t *csf, song_sample_t *smp)
 	if (!smp->data)
 		return;
 	for (int i = 0; i < MAX_VOICES; i++, v++) {
-		if (v->ptr_sample == smp || v->current_sample_data == smp->data) {
+		// if the data is shared, voices using it might be playing some other sample
+		if (v->ptr_sample == smp
+		    || (v->current_sample_data == smp->data && !csf_sample_is_shared(smp->data))) {
 			v->note = v->new_note = v->new_instrument = 0;
 			v->fadeout_volume = 0;
 			v->flags |= CHN_KEYOFF | CHN_NOTEFADE;
@@ -1559,7 +2734,7 @@ void csf_insert_restart_pos(song_t *csf, uint32_t restart_order)
 		if (newpat >= MAX_PATTERNS)
 			return; // no more patterns? sux
 		//log_appendf(2, "Copying pattern %d to %d for restart position", pat, newpat);
-		csf->patterns[newpat] = csf_allocate_pattern(csf->pattern_size[pat]);
+		csf->patterns[newpat] = csf_allocate_pattern(csf, csf->pattern_size[pat]);
 		csf->pattern_size[newpat] = csf->pattern_alloc_size[newpat] = csf->pattern_size[pat];
 		memcpy(csf->patterns[newpat], csf->patterns[pat],
 			sizeof(song_note_t) * MAX_CHANNELS * csf->pattern_size[pat]);
@@ -25,97 +25,168 @@
 #include "cmixer.h"
 #include <math.h>
 
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
 
 #define EQ_BANDWIDTH    2.0
 #define EQ_ZERO         0.000001
 
 
-
-typedef struct {
-    float a0, a1, a2, b1, b2;
-    float x1, x2, y1, y2;
-    float gain, center_frequency;
-    int   enabled;
-} eq_band;
+static const float f2ic = (float) (1 << 28);
+static const float i2fc = (float) (1.0 / (1 << 28));
 
 
+static inline int eq_band_active(const eq_band_t *pbs)
+{
+	return pbs->enabled && pbs->gain != 1.0f;
+}
 
-//static REAL f2ic = (REAL)(1 << 28);
-//static REAL i2fc = (REAL)(1.0 / (1 << 28));
 
-static eq_band eq[MAX_EQ_BANDS * 2] =
+static inline float eq_filter(eq_band_t *pbs, float x)
 {
-    // Default: Flat EQ
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,   120, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,   600, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,  1200, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,  3000, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,  6000, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 10000, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,   120, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,   600, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,  1200, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,  3000, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,  6000, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 10000, 0},
-};
-
-
-static void eq_filter(eq_band *pbs, float *pbuffer, unsigned int count)
-{
-	for (unsigned int i = 0; i < count; i++) {
-		float x = pbuffer[i];
-		float y = pbs->a1 * pbs->x1 +
-			  pbs->a2 * pbs->x2 +
-			  pbs->a0 * x +
-			  pbs->b1 * pbs->y1 +
-			  pbs->b2 * pbs->y2;
-
-		pbs->x2 = pbs->x1;
-		pbs->y2 = pbs->y1;
-		pbs->x1 = x;
-		pbuffer[i] = y;
-		pbs->y1 = y;
-	}
+	float y = pbs->a1 * pbs->x1 +
+		  pbs->a2 * pbs->x2 +
+		  pbs->a0 * x +
+		  pbs->b1 * pbs->y1 +
+		  pbs->b2 * pbs->y2;
+
+	pbs->x2 = pbs->x1;
+	pbs->y2 = pbs->y1;
+	pbs->x1 = x;
+	pbs->y1 = y;
+	return y;
 }
 
 
 void eq_mono(song_t *csf, int *buffer, unsigned int count)
 {
-	mono_mix_to_float(buffer, csf->mix_buffer_float, count);
+	eq_band_t *bands[MAX_EQ_BANDS];
+	unsigned int b, nbands = 0;
 
-	for (unsigned int b = 0; b < MAX_EQ_BANDS; b++)
-	{
-		if (eq[b].enabled && eq[b].gain != 1.0f)
-			eq_filter(&eq[b], csf->mix_buffer_float, count);
+	for (b = 0; b < MAX_EQ_BANDS; b++) {
+		if (eq_band_active(&csf->eq[b]))
+			bands[nbands++] = &csf->eq[b];
 	}
 
-	float_to_mono_mix(csf->mix_buffer_float, buffer, count);
+	// flat: don't touch the buffer at all
+	if (!nbands)
+		return;
+
+	for (unsigned int i = 0; i < count; i++) {
+		float x = buffer[i] * i2fc;
+
+		for (b = 0; b < nbands; b++)
+			x = eq_filter(bands[b], x);
+
+		buffer[i] = (int) (x * f2ic);
+	}
 }
 
 
-// XXX: I rolled the two loops into one. Make sure this works.
+// Each sample is run through every active band in turn, rather than
+// filtering the whole buffer once per band, so the buffer only gets read
+// and written once. With SSE2 the left and right bands run side by side in
+// lanes 0 and 1. The operations are done in the same order as eq_filter,
+// so both paths give the same result.
 void eq_stereo(song_t *csf, int *buffer, unsigned int count)
 {
-	stereo_mix_to_float(buffer, csf->mix_buffer_float, csf->mix_buffer_float + MIXBUFFERSIZE, count);
+	unsigned int band[MAX_EQ_BANDS];
+	unsigned int b, nbands = 0;
+
+	// a band pair is used if either side is; an inactive side is run as
+	// a pass-through (a0 = 1, everything else 0)
+	for (b = 0; b < MAX_EQ_BANDS; b++) {
+		if (eq_band_active(&csf->eq[b]) || eq_band_active(&csf->eq[b + MAX_EQ_BANDS]))
+			band[nbands++] = b;
+	}
 
-	for (unsigned int b = 0; b < MAX_EQ_BANDS; b++) {
-		int br = b + MAX_EQ_BANDS;
+	if (!nbands)
+		return;
+
+#ifdef __SSE2__
+	__m128 a0[MAX_EQ_BANDS], a1[MAX_EQ_BANDS], a2[MAX_EQ_BANDS], b1[MAX_EQ_BANDS], b2[MAX_EQ_BANDS];
+	__m128 x1[MAX_EQ_BANDS], x2[MAX_EQ_BANDS], y1[MAX_EQ_BANDS], y2[MAX_EQ_BANDS];
+	const __m128 vi2fc = _mm_set1_ps(i2fc);
+	const __m128 vf2ic = _mm_set1_ps(f2ic);
+
+	for (b = 0; b < nbands; b++) {
+		eq_band_t *l = &csf->eq[band[b]], *r = &csf->eq[band[b] + MAX_EQ_BANDS];
+		int la = eq_band_active(l), ra = eq_band_active(r);
+
+		a0[b] = _mm_setr_ps(la ? l->a0 : 1, ra ? r->a0 : 1, 0, 0);
+		a1[b] = _mm_setr_ps(la ? l->a1 : 0, ra ? r->a1 : 0, 0, 0);
+		a2[b] = _mm_setr_ps(la ? l->a2 : 0, ra ? r->a2 : 0, 0, 0);
+		b1[b] = _mm_setr_ps(la ? l->b1 : 0, ra ? r->b1 : 0, 0, 0);
+		b2[b] = _mm_setr_ps(la ? l->b2 : 0, ra ? r->b2 : 0, 0, 0);
+		x1[b] = _mm_setr_ps(l->x1, r->x1, 0, 0);
+		x2[b] = _mm_setr_ps(l->x2, r->x2, 0, 0);
+		y1[b] = _mm_setr_ps(l->y1, r->y1, 0, 0);
+		y2[b] = _mm_setr_ps(l->y2, r->y2, 0, 0);
+	}
 
-		// Left band
-		if (eq[b].enabled && eq[b].gain != 1.0f)
-			eq_filter(&eq[b], csf->mix_buffer_float, count);
+	for (unsigned int i = 0; i < count; i++) {
+		__m128 x = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadl_epi64((const __m128i *) (buffer + 2 * i))), vi2fc);
+
+		for (b = 0; b < nbands; b++) {
+			__m128 y = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(a1[b], x1[b]),
+				_mm_mul_ps(a2[b], x2[b])),
+				_mm_mul_ps(a0[b], x)),
+				_mm_mul_ps(b1[b], y1[b])),
+				_mm_mul_ps(b2[b], y2[b]));
+
+			x2[b] = x1[b];
+			y2[b] = y1[b];
+			x1[b] = x;
+			y1[b] = y;
+			x = y;
+		}
 
-		// Right band
-		if (eq[br].enabled && eq[br].gain != 1.0f)
-			eq_filter(&eq[br], csf->mix_buffer_float + MIXBUFFERSIZE, count);
+		_mm_storel_epi64((__m128i *) (buffer + 2 * i), _mm_cvttps_epi32(_mm_mul_ps(x, vf2ic)));
 	}
 
-	float_to_stereo_mix(csf->mix_buffer_float, csf->mix_buffer_float + MIXBUFFERSIZE, buffer, count);
+	for (b = 0; b < nbands; b++) {
+		float t[4];
+		eq_band_t *l = &csf->eq[band[b]], *r = &csf->eq[band[b] + MAX_EQ_BANDS];
+
+		// only write back the sides that were actually filtering
+		if (eq_band_active(l)) {
+			_mm_storeu_ps(t, x1[b]); l->x1 = t[0];
+			_mm_storeu_ps(t, x2[b]); l->x2 = t[0];
+			_mm_storeu_ps(t, y1[b]); l->y1 = t[0];
+			_mm_storeu_ps(t, y2[b]); l->y2 = t[0];
+		}
+		if (eq_band_active(r)) {
+			_mm_storeu_ps(t, x1[b]); r->x1 = t[1];
+			_mm_storeu_ps(t, x2[b]); r->x2 = t[1];
+			_mm_storeu_ps(t, y1[b]); r->y1 = t[1];
+			_mm_storeu_ps(t, y2[b]); r->y2 = t[1];
+		}
+	}
+#else
+	for (unsigned int i = 0; i < count; i++) {
+		float xl = buffer[2 * i] * i2fc;
+		float xr = buffer[2 * i + 1] * i2fc;
+
+		for (b = 0; b < nbands; b++) {
+			eq_band_t *l = &csf->eq[band[b]], *r = &csf->eq[band[b] + MAX_EQ_BANDS];
+
+			if (eq_band_active(l))
+				xl = eq_filter(l, xl);
+			if (eq_band_active(r))
+				xr = eq_filter(r, xr);
+		}
+
+		buffer[2 * i] = (int) (xl * f2ic);
+		buffer[2 * i + 1] = (int) (xr * f2ic);
+	}
+#endif
 }
 
 
-void initialize_eq(int reset, float freq)
+void initialize_eq(song_t *csf, int reset, float freq)
 {
 	//float fMixingFreq = (REAL)mix_frequency;
 
@@ -125,23 +196,23 @@ void initialize_eq(int reset, float freq)
 		float v0, v1;
 		int b = reset;
 
-		if (!eq[band].enabled) {
-			eq[band].a0 = 0;
-			eq[band].a1 = 0;
-			eq[band].a2 = 0;
-			eq[band].b1 = 0;
-			eq[band].b2 = 0;
-			eq[band].x1 = 0;
-			eq[band].x2 = 0;
-			eq[band].y1 = 0;
-			eq[band].y2 = 0;
+		if (!csf->eq[band].enabled) {
+			csf->eq[band].a0 = 0;
+			csf->eq[band].a1 = 0;
+			csf->eq[band].a2 = 0;
+			csf->eq[band].b1 = 0;
+			csf->eq[band].b2 = 0;
+			csf->eq[band].x1 = 0;
+			csf->eq[band].x2 = 0;
+			csf->eq[band].y1 = 0;
+			csf->eq[band].y2 = 0;
 			continue;
 		}
 
-		f = eq[band].center_frequency / freq;
+		f = csf->eq[band].center_frequency / freq;
 
 		if (f > 0.45f)
-			eq[band].gain = 1;
+			csf->eq[band].gain = 1;
 
 		//if (f > 0.25)
 		//      f = 0.25;
@@ -155,10 +226,10 @@ void initialize_eq(int reset, float freq)
 		//          k = (float) 0.707;
 
 		k2 = k*k;
-		v0 = eq[band].gain;
+		v0 = csf->eq[band].gain;
 		v1 = 1;
 
-		if (eq[band].gain < 1.0) {
+		if (csf->eq[band].gain < 1.0) {
 			v0 *= 0.5f / EQ_BANDWIDTH;
 			v1 *= 0.5f / EQ_BANDWIDTH;
 		}
@@ -169,50 +240,50 @@ void initialize_eq(int reset, float freq)
 
 		r = (1 + v0 * k + k2) / (1 + v1 * k + k2);
 
-		if (r != eq[band].a0) {
-			eq[band].a0 = r;
+		if (r != csf->eq[band].a0) {
+			csf->eq[band].a0 = r;
 			b = 1;
 		}
 
 		r = 2 * (k2 - 1) / (1 + v1 * k + k2);
 
-		if (r != eq[band].a1) {
-			eq[band].a1 = r;
+		if (r != csf->eq[band].a1) {
+			csf->eq[band].a1 = r;
 			b = 1;
 		}
 
 		r = (1 - v0 * k + k2) / (1 + v1 * k + k2);
 
-		if (r != eq[band].a2) {
-			eq[band].a2 = r;
+		if (r != csf->eq[band].a2) {
+			csf->eq[band].a2 = r;
 			b = 1;
 		}
 
 		r = -2 * (k2 - 1) / (1 + v1 * k + k2);
 
-		if (r != eq[band].b1) {
-			eq[band].b1 = r;
+		if (r != csf->eq[band].b1) {
+			csf->eq[band].b1 = r;
 			b = 1;
 		}
 
 		r = -(1 - v1 * k + k2) / (1 + v1 * k + k2);
 
-		if (r != eq[band].b2) {
-			eq[band].b2 = r;
+		if (r != csf->eq[band].b2) {
+			csf->eq[band].b2 = r;
 			b = 1;
 		}
 
 		if (b) {
-			eq[band].x1 = 0;
-			eq[band].x2 = 0;
-			eq[band].y1 = 0;
-			eq[band].y2 = 0;
+			csf->eq[band].x1 = 0;
+			csf->eq[band].x2 = 0;
+			csf->eq[band].y1 = 0;
+			csf->eq[band].y2 = 0;
 		}
 	}
 }
 
 
-void set_eq_gains(const unsigned int *gainbuff, unsigned int gains, const unsigned int *freqs,
+void set_eq_gains(song_t *csf, const unsigned int *gainbuff, unsigned int gains, const unsigned int *freqs,
 		  int reset, int mix_freq)
 {
 	for (unsigned int i = 0; i < MAX_EQ_BANDS; i++) {
@@ -233,23 +304,23 @@ void set_eq_gains(const unsigned int *gainbuff, unsigned int gains, const unsign
 			g = 1;
 		}
 
-		eq[i].gain =
-		eq[i + MAX_EQ_BANDS].gain = g;
-		eq[i].center_frequency =
-		eq[i + MAX_EQ_BANDS].center_frequency = f;
+		csf->eq[i].gain =
+		csf->eq[i + MAX_EQ_BANDS].gain = g;
+		csf->eq[i].center_frequency =
+		csf->eq[i + MAX_EQ_BANDS].center_frequency = f;
 
 		/* don't enable bands outside... */
 		if (f > 20.0f &&
 		    i < gains) {
-			eq[i].enabled =
-			eq[i + MAX_EQ_BANDS].enabled = 1;
+			csf->eq[i].enabled =
+			csf->eq[i + MAX_EQ_BANDS].enabled = 1;
 		}
 		else {
-			eq[i].enabled =
-			eq[i + MAX_EQ_BANDS].enabled = 0;
+			csf->eq[i].enabled =
+			csf->eq[i + MAX_EQ_BANDS].enabled = 0;
 		}
 	}
 
-	initialize_eq(reset, mix_freq);
+	initialize_eq(csf, reset, mix_freq);
 }
 
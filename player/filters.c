@@ -25,6 +25,8 @@
 #include "cmixer.h"
 #include "math.h"
 
+#include <stdlib.h>
+
 
 // LUT for 2 * damping factor
 static const float resonance_table[128] = {
@@ -63,24 +65,112 @@ static const float resonance_table[128] = {
 };
 
 
+// Filter coefficients for every (cutoff, resonance) pair at a given mixing
+// rate. The powf and divisions are only done when a song is set up for that
+// rate (see prepare_filter_table); per-tick filter updates (filter envelopes,
+// Zxx sweeps) just look the values up.
+//
+// The player and the disk writer can be mixing at different rates on
+// different threads at the same time, so there's a table for each rate. Once
+// a table is in filter_tables it never changes or goes away, so it can be read
+// without any locking. If all the slots are taken by other rates, the
+// coefficients are worked out directly instead, which is what happened every
+// time before there were tables.
+typedef struct filter_coefs {
+        int32_t a0, b0, b1;
+} filter_coefs_t;
+
+typedef struct filter_table {
+        int freq;
+        filter_coefs_t coefs[256][128];
+} filter_table_t;
+
+#define FILTER_TABLES 8
+static filter_table_t *filter_tables[FILTER_TABLES];
+
+
 // Simple 2-poles resonant filter
 //
 // XXX freq WAS unused but is now mix_frequency!
 //
 #define FREQ_PARAM_MULT (128.0 / (24.0 * 256.0))
+static void calc_filter_coefs(filter_coefs_t *fc, int cutoff, int resonance, int freq)
+{
+        float frequency, r, d, e, fg, fb0, fb1;
+
+        // 2 ^ (i / 24 * 256)
+        frequency = 110.0 * powf(2.0, (float) cutoff * FREQ_PARAM_MULT + 0.25);
+        if (frequency > freq / 2.0)
+                frequency = freq / 2.0;
+        r = freq / (2.0 * M_PI * frequency);
+
+        d = resonance_table[resonance] * r + resonance_table[resonance] - 1.0;
+        e = r * r;
+
+        fg = 1.0 / (1.0 + d + e);
+        fb0 = (d + e + e) / (1.0 + d + e);
+        fb1 = -e / (1.0 + d + e);
+
+        fc->a0 = (int32_t)(fg * (1 << FILTERPRECISION));
+        fc->b0 = (int32_t)(fb0 * (1 << FILTERPRECISION));
+        fc->b1 = (int32_t)(fb1 * (1 << FILTERPRECISION));
+}
+
+static const filter_table_t *find_filter_table(int freq)
+{
+        int n;
+
+        for (n = 0; n < FILTER_TABLES; n++) {
+                const filter_table_t *t = filter_tables[n];
+                if (!t)
+                        break;
+                if (t->freq == freq)
+                        return t;
+        }
+        return NULL;
+}
+
+void prepare_filter_table(int freq)
+{
+        filter_table_t *t;
+        int cutoff, resonance, n;
+
+        if (freq <= 0 || find_filter_table(freq))
+                return;
+        t = malloc(sizeof(filter_table_t));
+        if (!t)
+                return;
+        t->freq = freq;
+        for (cutoff = 0; cutoff < 256; cutoff++)
+                for (resonance = 0; resonance < 128; resonance++)
+                        calc_filter_coefs(&t->coefs[cutoff][resonance], cutoff, resonance, freq);
+
+        // (the barrier in the swap makes sure the values are there before anything can see the table)
+        for (n = 0; n < FILTER_TABLES; n++) {
+                if (__sync_bool_compare_and_swap(&filter_tables[n], NULL, t))
+                        return;
+                if (filter_tables[n]->freq == freq)
+                        break; // someone else just made the same one
+        }
+        free(t);
+}
+
 void setup_channel_filter(song_voice_t *chan, int reset, int flt_modifier, int freq)
 {
         int cutoff = chan->cutoff;
         int resonance = chan->resonance;
-        float frequency, r, d, e, fg, fb0, fb1;
+        const filter_table_t *table = find_filter_table(freq);
+        filter_coefs_t fc;
 
         cutoff = cutoff * (flt_modifier + 256) / 256;
 
         if (cutoff > 255)
                 cutoff = 255;
 
-        if (resonance > 255)
-                resonance = 255;
+        // resonance_table only covers 0-127; Zxx and the instrument
+        // resonance can't go above that anyway
+        if (resonance > 127)
+                resonance = 127;
                 
         // protman hp filter hack
         if(!SNDMIX_FILTERHACK){
@@ -107,24 +197,13 @@ void setup_channel_filter(song_voice_t *chan, int reset, int flt_modifier, int f
           }
         }
 
-
-
-        // 2 ^ (i / 24 * 256)
-        frequency = 110.0 * powf(2.0, (float) cutoff * FREQ_PARAM_MULT + 0.25);
-        if (frequency > freq / 2.0)
-                frequency = freq / 2.0;
-        r = freq / (2.0 * M_PI * frequency);
-
-        d = resonance_table[resonance] * r + resonance_table[resonance] - 1.0;
-        e = r * r;
-
-        fg = 1.0 / (1.0 + d + e);
-        fb0 = (d + e + e) / (1.0 + d + e);
-        fb1 = -e / (1.0 + d + e);
-
-        chan->filter_a0 = (int32_t)(fg * (1 << FILTERPRECISION));
-        chan->filter_b0 = (int32_t)(fb0 * (1 << FILTERPRECISION));
-        chan->filter_b1 = (int32_t)(fb1 * (1 << FILTERPRECISION));
+        if (table)
+                fc = table->coefs[cutoff][resonance];
+        else
+                calc_filter_coefs(&fc, cutoff, resonance, freq);
+        chan->filter_a0 = fc.a0;
+        chan->filter_b0 = fc.b0;
+        chan->filter_b1 = fc.b1;
 
         if (reset) {
                 chan->filter_y1 = chan->filter_y2 = 0;
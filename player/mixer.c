@@ -28,8 +28,13 @@
 #include "snd_fm.h"
 #include "snd_gm.h"
 #include "cmixer.h"
+#include "slurp.h"
 #include "util.h" // for CLAMP
 
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
 // For pingpong loops that work like most of Impulse Tracker's drivers
 // (including SB16, SBPro, and the disk writer) -- as well as XMPlay, use 2
 // To make them sound like the GUS driver, use 1.
@@ -344,14 +349,6 @@
     pvol += 2;
 
 
-#define SNDMIX_RAMPMONOVOL \
-    left_ramp_volume += chan->left_ramp; \
-    right_ramp_volume += chan->right_ramp; \
-    pvol[0] += vol * (right_ramp_volume >> VOLUMERAMPPRECISION); \
-    pvol[1] += vol * (left_ramp_volume >> VOLUMERAMPPRECISION); \
-    pvol += 2;
-
-
 #define SNDMIX_RAMPFASTMONOVOL \
     right_ramp_volume += chan->right_ramp; \
     int fastvol = vol * (right_ramp_volume >> VOLUMERAMPPRECISION); \
@@ -360,6 +357,62 @@
     pvol += 2;
 
 
+// Volume ramps (stereo output, independent left/right ramps)
+//
+// With SSE2, the right and left ramp volumes live in lanes 0 and 2 of one
+// register and are stepped together. _mm_mul_epu32 multiplies those two
+// lanes; the low 32 bits of its product are the same as a wrapped 32-bit
+// signed multiply, so the result is identical to the scalar code.
+#ifdef __SSE2__
+
+#define MIX_BEGIN_RAMP \
+    __m128i ramp_volume = _mm_set_epi32(0, channel->left_ramp_volume, 0, channel->right_ramp_volume); \
+    const __m128i ramp_delta = _mm_set_epi32(0, channel->left_ramp, 0, channel->right_ramp);
+
+
+#define MIX_END_RAMP \
+    channel->right_ramp_volume = _mm_cvtsi128_si32(ramp_volume); \
+    channel->left_ramp_volume  = _mm_cvtsi128_si32(_mm_srli_si128(ramp_volume, 8));
+
+
+// v holds the right-channel input in lane 0 and the left in lane 2
+#define SNDMIX_RAMPVOL(v) \
+    ramp_volume = _mm_add_epi32(ramp_volume, ramp_delta); \
+    { \
+        __m128i rv = _mm_mul_epu32(v, _mm_srai_epi32(ramp_volume, VOLUMERAMPPRECISION)); \
+        rv = _mm_shuffle_epi32(rv, _MM_SHUFFLE(3, 1, 2, 0)); \
+        _mm_storel_epi64((__m128i *) pvol, _mm_add_epi32(_mm_loadl_epi64((const __m128i *) pvol), rv)); \
+    } \
+    pvol += 2;
+
+
+#define SNDMIX_RAMPMONOVOL \
+    SNDMIX_RAMPVOL(_mm_set1_epi32(vol))
+
+
+#define SNDMIX_RAMPSTEREOVOL \
+    SNDMIX_RAMPVOL(_mm_set_epi32(0, vol_r, 0, vol_l))
+
+#else
+
+#define MIX_BEGIN_RAMP \
+    int right_ramp_volume = channel->right_ramp_volume; \
+    int left_ramp_volume  = channel->left_ramp_volume;
+
+
+#define MIX_END_RAMP \
+    channel->right_ramp_volume = right_ramp_volume; \
+    channel->left_ramp_volume  = left_ramp_volume;
+
+
+#define SNDMIX_RAMPMONOVOL \
+    left_ramp_volume += chan->left_ramp; \
+    right_ramp_volume += chan->right_ramp; \
+    pvol[0] += vol * (right_ramp_volume >> VOLUMERAMPPRECISION); \
+    pvol[1] += vol * (left_ramp_volume >> VOLUMERAMPPRECISION); \
+    pvol += 2;
+
+
 #define SNDMIX_RAMPSTEREOVOL \
     left_ramp_volume += chan->left_ramp; \
     right_ramp_volume += chan->right_ramp; \
@@ -367,6 +420,8 @@
     pvol[1] += vol_r * (left_ramp_volume >> VOLUMERAMPPRECISION); \
     pvol += 2;
 
+#endif
+
 
 ///////////////////////////////////////////////////
 // Resonant Filters
@@ -396,6 +451,70 @@
 
 
 // Stereo
+//
+// With SSE2, left and right run as one lane pair (lanes 0 and 2): y1/y3 and
+// y2/y4 each share a register for the whole mix call, and both taps are
+// clipped and multiplied at once. As with the ramps, only the low 32 bits
+// of each product are used, so this matches the scalar version bit for bit.
+#ifdef __SSE2__
+
+static inline __m128i filt_clip_sse2(__m128i x, __m128i lo, __m128i hi)
+{
+        __m128i m;
+
+        m = _mm_cmpgt_epi32(x, hi);
+        x = _mm_or_si128(_mm_and_si128(m, hi), _mm_andnot_si128(m, x));
+        m = _mm_cmplt_epi32(x, lo);
+        x = _mm_or_si128(_mm_and_si128(m, lo), _mm_andnot_si128(m, x));
+        return x;
+}
+
+
+#define MIX_BEGIN_STEREO_FILTER \
+    __m128i fy13 = _mm_set_epi32(0, channel->filter_y3, 0, channel->filter_y1); \
+    __m128i fy24 = _mm_set_epi32(0, channel->filter_y4, 0, channel->filter_y2); \
+    const __m128i fa0 = _mm_set1_epi32(channel->filter_a0); \
+    const __m128i fb0 = _mm_set1_epi32(channel->filter_b0); \
+    const __m128i fb1 = _mm_set1_epi32(channel->filter_b1); \
+    const __m128i fround = _mm_set1_epi32(1 << (FILTERPRECISION - 1)); \
+    const __m128i fclipmin = _mm_set1_epi32(-65536); \
+    const __m128i fclipmax = _mm_set1_epi32(65534); \
+    __m128i tab;
+
+
+#define MIX_END_STEREO_FILTER \
+    channel->filter_y1 = _mm_cvtsi128_si32(fy13); \
+    channel->filter_y3 = _mm_cvtsi128_si32(_mm_srli_si128(fy13, 8)); \
+    channel->filter_y2 = _mm_cvtsi128_si32(fy24); \
+    channel->filter_y4 = _mm_cvtsi128_si32(_mm_srli_si128(fy24, 8));
+
+
+// filters tab in place (vol_l in lane 0, vol_r in lane 2)
+#define SNDMIX_STEREOFILTER_SSE2 \
+    tab = _mm_add_epi32( \
+        _mm_add_epi32(_mm_mul_epu32(tab, fa0), \
+                      _mm_mul_epu32(filt_clip_sse2(fy13, fclipmin, fclipmax), fb0)), \
+        _mm_add_epi32(_mm_mul_epu32(filt_clip_sse2(fy24, fclipmin, fclipmax), fb1), fround)); \
+    tab = _mm_srai_epi32(tab, FILTERPRECISION); \
+    fy24 = fy13; \
+    fy13 = tab;
+
+
+#define SNDMIX_PROCESSSTEREOFILTER \
+    tab = _mm_set_epi32(0, vol_r, 0, vol_l); \
+    SNDMIX_STEREOFILTER_SSE2 \
+    vol_l = _mm_cvtsi128_si32(tab); \
+    vol_r = _mm_cvtsi128_si32(_mm_srli_si128(tab, 8));
+
+
+// filter and ramp without leaving the registers
+#define SNDMIX_PROCESSSTEREOFILTER_RAMP \
+    tab = _mm_set_epi32(0, vol_r, 0, vol_l); \
+    SNDMIX_STEREOFILTER_SSE2 \
+    SNDMIX_RAMPVOL(tab)
+
+#else
+
 #define MIX_BEGIN_STEREO_FILTER \
     int32_t fy1 = channel->filter_y1; \
     int32_t fy2 = channel->filter_y2; \
@@ -420,11 +539,34 @@
     fy4 = fy3; fy3 = tb; vol_r = tb;
 
 
+#define SNDMIX_PROCESSSTEREOFILTER_RAMP \
+    SNDMIX_PROCESSSTEREOFILTER \
+    SNDMIX_RAMPSTEREOVOL
+
+#endif
+
+
 //////////////////////////////////////////////////////////
 // Interfaces
 
 typedef void(* mix_interface_t)(song_voice_t *, int *, int *);
 
+#if HAVE_MMAP
+// For voices playing data that's mapped from a file (see csf_cache_voice): if the file is cut short while
+// it's playing, the read faults and comes back here, and this returns zero.
+static int mix_mapped(mix_interface_t mix_func, song_voice_t *channel, int *pbuffer, int *pbufmax)
+{
+        sigjmp_buf env;
+
+        if (sigsetjmp(env, 0))
+                return 0;
+        slurp_fault_jump = &env;
+        mix_func(channel, pbuffer, pbufmax);
+        slurp_fault_jump = NULL;
+        return 1;
+}
+#endif
+
 
 #define BEGIN_MIX_INTERFACE(func) \
     static void func(song_voice_t *channel, int *pbuffer, int *pbufmax) \
@@ -440,16 +582,14 @@ typedef void(* mix_interface_t)(song_voice_t *, int *, int *);
 // Volume Ramps
 #define BEGIN_RAMPMIX_INTERFACE(func) \
     BEGIN_MIX_INTERFACE(func) \
-        int right_ramp_volume = channel->right_ramp_volume; \
-        int left_ramp_volume = channel->left_ramp_volume;
+        MIX_BEGIN_RAMP
 
 
 #define END_RAMPMIX_INTERFACE() \
         SNDMIX_ENDSAMPLELOOP \
-        channel->right_ramp_volume = right_ramp_volume; \
-        channel->right_volume     = right_ramp_volume >> VOLUMERAMPPRECISION; \
-        channel->left_ramp_volume  = left_ramp_volume; \
-        channel->left_volume      = left_ramp_volume >> VOLUMERAMPPRECISION; \
+        MIX_END_RAMP \
+        channel->right_volume     = channel->right_ramp_volume >> VOLUMERAMPPRECISION; \
+        channel->left_volume      = channel->left_ramp_volume >> VOLUMERAMPPRECISION; \
     }
 
 
@@ -481,18 +621,16 @@ typedef void(* mix_interface_t)(song_voice_t *, int *, int *);
 
 #define BEGIN_RAMPMIX_FLT_INTERFACE(func) \
     BEGIN_MIX_INTERFACE(func) \
-        int right_ramp_volume = channel->right_ramp_volume; \
-        int left_ramp_volume  = channel->left_ramp_volume; \
+        MIX_BEGIN_RAMP \
         MIX_BEGIN_FILTER
 
 
 #define END_RAMPMIX_FLT_INTERFACE() \
         SNDMIX_ENDSAMPLELOOP \
         MIX_END_FILTER \
-        channel->right_ramp_volume = right_ramp_volume; \
-        channel->right_volume     = right_ramp_volume >> VOLUMERAMPPRECISION; \
-        channel->left_ramp_volume  = left_ramp_volume; \
-        channel->left_volume      = left_ramp_volume >> VOLUMERAMPPRECISION; \
+        MIX_END_RAMP \
+        channel->right_volume     = channel->right_ramp_volume >> VOLUMERAMPPRECISION; \
+        channel->left_volume      = channel->left_ramp_volume >> VOLUMERAMPPRECISION; \
     }
 
 
@@ -510,18 +648,16 @@ typedef void(* mix_interface_t)(song_voice_t *, int *, int *);
 
 #define BEGIN_RAMPMIX_STFLT_INTERFACE(func) \
     BEGIN_MIX_INTERFACE(func) \
-        int right_ramp_volume = channel->right_ramp_volume; \
-        int left_ramp_volume  = channel->left_ramp_volume; \
+        MIX_BEGIN_RAMP \
         MIX_BEGIN_STEREO_FILTER
 
 
 #define END_RAMPMIX_STFLT_INTERFACE() \
         SNDMIX_ENDSAMPLELOOP \
         MIX_END_STEREO_FILTER \
-        channel->right_ramp_volume = right_ramp_volume; \
-        channel->right_volume     = right_ramp_volume >> VOLUMERAMPPRECISION; \
-        channel->left_ramp_volume  = left_ramp_volume; \
-        channel->left_volume      = left_ramp_volume >> VOLUMERAMPPRECISION; \
+        MIX_END_RAMP \
+        channel->right_volume     = channel->right_ramp_volume >> VOLUMERAMPPRECISION; \
+        channel->left_volume      = channel->left_ramp_volume >> VOLUMERAMPPRECISION; \
     }
 
 #define BEGIN_RESAMPLE_INTERFACE(func, sampletype, numchannels) \
@@ -1036,61 +1172,767 @@ END_MIX_STFLT_INTERFACE()
 BEGIN_RAMPMIX_STFLT_INTERFACE(FilterStereo8BitRampMix)
         SNDMIX_BEGINSAMPLELOOP8
         SNDMIX_GETSTEREOVOL8NOIDO
-        SNDMIX_PROCESSSTEREOFILTER
-        SNDMIX_RAMPSTEREOVOL
+        SNDMIX_PROCESSSTEREOFILTER_RAMP
 END_RAMPMIX_STFLT_INTERFACE()
 
 BEGIN_RAMPMIX_STFLT_INTERFACE(FilterStereo16BitRampMix)
         SNDMIX_BEGINSAMPLELOOP16
         SNDMIX_GETSTEREOVOL16NOIDO
-        SNDMIX_PROCESSSTEREOFILTER
-        SNDMIX_RAMPSTEREOVOL
+        SNDMIX_PROCESSSTEREOFILTER_RAMP
 END_RAMPMIX_STFLT_INTERFACE()
 
 BEGIN_RAMPMIX_STFLT_INTERFACE(FilterStereo8BitLinearRampMix)
         SNDMIX_BEGINSAMPLELOOP8
         SNDMIX_GETSTEREOVOL8LINEAR
-        SNDMIX_PROCESSSTEREOFILTER
-        SNDMIX_RAMPSTEREOVOL
+        SNDMIX_PROCESSSTEREOFILTER_RAMP
 END_RAMPMIX_STFLT_INTERFACE()
 
 BEGIN_RAMPMIX_STFLT_INTERFACE(FilterStereo16BitLinearRampMix)
         SNDMIX_BEGINSAMPLELOOP16
         SNDMIX_GETSTEREOVOL16LINEAR
-        SNDMIX_PROCESSSTEREOFILTER
-        SNDMIX_RAMPSTEREOVOL
+        SNDMIX_PROCESSSTEREOFILTER_RAMP
 END_RAMPMIX_STFLT_INTERFACE()
 
 BEGIN_RAMPMIX_STFLT_INTERFACE(FilterStereo8BitSplineRampMix)
         SNDMIX_BEGINSAMPLELOOP8
         SNDMIX_GETSTEREOVOL8SPLINE
-        SNDMIX_PROCESSSTEREOFILTER
-        SNDMIX_RAMPSTEREOVOL
+        SNDMIX_PROCESSSTEREOFILTER_RAMP
 END_RAMPMIX_STFLT_INTERFACE()
 
 BEGIN_RAMPMIX_STFLT_INTERFACE(FilterStereo16BitSplineRampMix)
         SNDMIX_BEGINSAMPLELOOP16
         SNDMIX_GETSTEREOVOL16SPLINE
-        SNDMIX_PROCESSSTEREOFILTER
-        SNDMIX_RAMPSTEREOVOL
+        SNDMIX_PROCESSSTEREOFILTER_RAMP
 END_RAMPMIX_STFLT_INTERFACE()
 
 BEGIN_RAMPMIX_STFLT_INTERFACE(FilterStereo8BitFirFilterRampMix)
         SNDMIX_BEGINSAMPLELOOP8
         SNDMIX_GETSTEREOVOL8FIRFILTER
-        SNDMIX_PROCESSSTEREOFILTER
-        SNDMIX_RAMPSTEREOVOL
+        SNDMIX_PROCESSSTEREOFILTER_RAMP
 END_RAMPMIX_STFLT_INTERFACE()
 
 BEGIN_RAMPMIX_STFLT_INTERFACE(FilterStereo16BitFirFilterRampMix)
         SNDMIX_BEGINSAMPLELOOP16
         SNDMIX_GETSTEREOVOL16FIRFILTER
-        SNDMIX_PROCESSSTEREOFILTER
-        SNDMIX_RAMPSTEREOVOL
+        SNDMIX_PROCESSSTEREOFILTER_RAMP
 END_RAMPMIX_STFLT_INTERFACE()
 
 
 
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// High resolution samples (see csf_sample_hires)
+//
+// These play from the integer (24-bit or 32-bit, the "24Bit" functions) or float
+// copy of a sample instead of its 16-bit data. The copy has the values from the
+// file as they were, so they're scaled by the same gain as the 16-bit data on the
+// way in. They carry HIRES_BITS more bits than the 16-bit ones all the way through,
+// and are only shifted back down after they've been multiplied by the volume, so
+// the extra resolution makes it into the mix buffer. The arithmetic has to be
+// 64-bit for that, so the ramps and filters here don't have SSE2 versions.
+//
+#define HIRES_BITS 8
+
+
+#define SNDMIX_BEGINSAMPLELOOP24 \
+        register song_voice_t * const chan = channel; \
+        position = chan->position_frac; \
+        const int32_t *p = (const int32_t *) csf_sample_hires(chan->current_sample_data, chan->flags, \
+                chan->length, NULL) + chan->position; \
+        const float hires_gain = csf_sample_hires_gain(chan->current_sample_data) \
+                * (float) (1 << HIRES_BITS) / 2147483648.0f; \
+        if (chan->flags & CHN_STEREO) p += chan->position; \
+        int *pvol = pbuffer; \
+        do {
+
+
+#define SNDMIX_BEGINSAMPLELOOPFLOAT \
+        register song_voice_t * const chan = channel; \
+        position = chan->position_frac; \
+        const float *p = (const float *) csf_sample_hires(chan->current_sample_data, chan->flags, \
+                chan->length, NULL) + chan->position; \
+        const float hires_gain = csf_sample_hires_gain(chan->current_sample_data) \
+                * (float) (1 << HIRES_BITS); \
+        if (chan->flags & CHN_STEREO) p += chan->position; \
+        int *pvol = pbuffer; \
+        do {
+
+
+// value n, with 16 + HIRES_BITS bits
+#define HIRES_24(n) \
+    ((int32_t) (p[n] * hires_gain))
+
+#define HIRES_FLOAT(n) \
+    ((int32_t) (p[n] * hires_gain))
+
+
+// Mono
+#define SNDMIX_GETMONOVOLHINOIDO(S) \
+    int vol = S(position >> 16);
+
+
+#define SNDMIX_GETMONOVOLHILINEAR(S) \
+    int poshi   = position >> 16; \
+    int poslo   = (position >> 8) & 0xFF; \
+    int srcvol  = S(poshi); \
+    int destvol = S(poshi + 1); \
+    int vol     = srcvol + (int) (((int64_t) poslo * (destvol - srcvol)) >> 8);
+
+
+#define SNDMIX_GETMONOVOLHISPLINE(S) \
+    int poshi = position >> 16; \
+    int poslo = (position >> SPLINE_FRACSHIFT) & SPLINE_FRACMASK; \
+    int vol   = (int) ((cubic_spline_lut[poslo    ] * (int64_t) S(poshi - 1) + \
+                        cubic_spline_lut[poslo + 1] * (int64_t) S(poshi    ) + \
+                        cubic_spline_lut[poslo + 3] * (int64_t) S(poshi + 2) + \
+                        cubic_spline_lut[poslo + 2] * (int64_t) S(poshi + 1)) >> SPLINE_16SHIFT);
+
+
+#define SNDMIX_GETMONOVOLHIFIRFILTER(S) \
+    int poshi  = position >> 16;\
+    int poslo  = (position & 0xFFFF);\
+    int firidx = ((poslo + WFIR_FRACHALVE) >> WFIR_FRACSHIFT) & WFIR_FRACMASK; \
+    int64_t vol64 = (windowed_fir_lut[firidx + 0] * (int64_t) S(poshi + 1 - 4)); \
+        vol64    += (windowed_fir_lut[firidx + 1] * (int64_t) S(poshi + 2 - 4)); \
+        vol64    += (windowed_fir_lut[firidx + 2] * (int64_t) S(poshi + 3 - 4)); \
+        vol64    += (windowed_fir_lut[firidx + 3] * (int64_t) S(poshi + 4 - 4)); \
+        vol64    += (windowed_fir_lut[firidx + 4] * (int64_t) S(poshi + 5 - 4)); \
+        vol64    += (windowed_fir_lut[firidx + 5] * (int64_t) S(poshi + 6 - 4)); \
+        vol64    += (windowed_fir_lut[firidx + 6] * (int64_t) S(poshi + 7 - 4)); \
+        vol64    += (windowed_fir_lut[firidx + 7] * (int64_t) S(poshi + 8 - 4)); \
+    int vol    = (int) (vol64 >> WFIR_16BITSHIFT);
+
+
+// Stereo
+#define SNDMIX_GETSTEREOVOLHINOIDO(S) \
+    int vol_l = S((position >> 16) * 2    ); \
+    int vol_r = S((position >> 16) * 2 + 1);
+
+
+#define SNDMIX_GETSTEREOVOLHILINEAR(S) \
+    int poshi    = position >> 16; \
+    int poslo    = (position >> 8) & 0xFF; \
+    int srcvol_l = S(poshi * 2); \
+    int vol_l    = srcvol_l + (int) (((int64_t) poslo * (S(poshi * 2 + 2) - srcvol_l)) >> 8); \
+    int srcvol_r = S(poshi * 2 + 1); \
+    int vol_r    = srcvol_r + (int) (((int64_t) poslo * (S(poshi * 2 + 3) - srcvol_r)) >> 8);
+
+
+#define SNDMIX_GETSTEREOVOLHISPLINE(S) \
+    int poshi   = position >> 16; \
+    int poslo   = (position >> SPLINE_FRACSHIFT) & SPLINE_FRACMASK; \
+    int vol_l   = (int) ((cubic_spline_lut[poslo    ] * (int64_t) S((poshi - 1) * 2    ) + \
+                          cubic_spline_lut[poslo + 1] * (int64_t) S((poshi    ) * 2    ) + \
+                          cubic_spline_lut[poslo + 2] * (int64_t) S((poshi + 1) * 2    ) + \
+                          cubic_spline_lut[poslo + 3] * (int64_t) S((poshi + 2) * 2    )) >> SPLINE_16SHIFT); \
+    int vol_r   = (int) ((cubic_spline_lut[poslo    ] * (int64_t) S((poshi - 1) * 2 + 1) + \
+                          cubic_spline_lut[poslo + 1] * (int64_t) S((poshi    ) * 2 + 1) + \
+                          cubic_spline_lut[poslo + 2] * (int64_t) S((poshi + 1) * 2 + 1) + \
+                          cubic_spline_lut[poslo + 3] * (int64_t) S((poshi + 2) * 2 + 1)) >> SPLINE_16SHIFT);
+
+
+#define SNDMIX_GETSTEREOVOLHIFIRFILTER(S) \
+    int poshi   = position >> 16;\
+    int poslo   = (position & 0xFFFF);\
+    int firidx  = ((poslo + WFIR_FRACHALVE) >> WFIR_FRACSHIFT) & WFIR_FRACMASK; \
+    int64_t vol64_l = (windowed_fir_lut[firidx + 0] * (int64_t) S((poshi + 1 - 4) * 2)); \
+        vol64_l    += (windowed_fir_lut[firidx + 1] * (int64_t) S((poshi + 2 - 4) * 2)); \
+        vol64_l    += (windowed_fir_lut[firidx + 2] * (int64_t) S((poshi + 3 - 4) * 2)); \
+        vol64_l    += (windowed_fir_lut[firidx + 3] * (int64_t) S((poshi + 4 - 4) * 2)); \
+        vol64_l    += (windowed_fir_lut[firidx + 4] * (int64_t) S((poshi + 5 - 4) * 2)); \
+        vol64_l    += (windowed_fir_lut[firidx + 5] * (int64_t) S((poshi + 6 - 4) * 2)); \
+        vol64_l    += (windowed_fir_lut[firidx + 6] * (int64_t) S((poshi + 7 - 4) * 2)); \
+        vol64_l    += (windowed_fir_lut[firidx + 7] * (int64_t) S((poshi + 8 - 4) * 2)); \
+    int vol_l   = (int) (vol64_l >> WFIR_16BITSHIFT); \
+    int64_t vol64_r = (windowed_fir_lut[firidx + 0] * (int64_t) S((poshi + 1 - 4) * 2 + 1)); \
+        vol64_r    += (windowed_fir_lut[firidx + 1] * (int64_t) S((poshi + 2 - 4) * 2 + 1)); \
+        vol64_r    += (windowed_fir_lut[firidx + 2] * (int64_t) S((poshi + 3 - 4) * 2 + 1)); \
+        vol64_r    += (windowed_fir_lut[firidx + 3] * (int64_t) S((poshi + 4 - 4) * 2 + 1)); \
+        vol64_r    += (windowed_fir_lut[firidx + 4] * (int64_t) S((poshi + 5 - 4) * 2 + 1)); \
+        vol64_r    += (windowed_fir_lut[firidx + 5] * (int64_t) S((poshi + 6 - 4) * 2 + 1)); \
+        vol64_r    += (windowed_fir_lut[firidx + 6] * (int64_t) S((poshi + 7 - 4) * 2 + 1)); \
+        vol64_r    += (windowed_fir_lut[firidx + 7] * (int64_t) S((poshi + 8 - 4) * 2 + 1)); \
+    int vol_r   = (int) (vol64_r >> WFIR_16BITSHIFT);
+
+
+#define SNDMIX_STOREMONOVOLHI \
+    pvol[0] += (int) (((int64_t) vol * chan->right_volume) >> HIRES_BITS); \
+    pvol[1] += (int) (((int64_t) vol * chan->left_volume) >> HIRES_BITS); \
+    pvol += 2;
+
+
+#define SNDMIX_STORESTEREOVOLHI \
+    pvol[0] += (int) (((int64_t) vol_l * chan->right_volume) >> HIRES_BITS); \
+    pvol[1] += (int) (((int64_t) vol_r * chan->left_volume) >> HIRES_BITS); \
+    pvol += 2;
+
+
+// Volume ramps
+#define MIX_BEGIN_HIRES_RAMP \
+    int right_ramp_volume = channel->right_ramp_volume; \
+    int left_ramp_volume  = channel->left_ramp_volume;
+
+
+#define MIX_END_HIRES_RAMP \
+    channel->right_ramp_volume = right_ramp_volume; \
+    channel->left_ramp_volume  = left_ramp_volume;
+
+
+#define SNDMIX_RAMPMONOVOLHI \
+    left_ramp_volume += chan->left_ramp; \
+    right_ramp_volume += chan->right_ramp; \
+    pvol[0] += (int) (((int64_t) vol * (right_ramp_volume >> VOLUMERAMPPRECISION)) >> HIRES_BITS); \
+    pvol[1] += (int) (((int64_t) vol * (left_ramp_volume >> VOLUMERAMPPRECISION)) >> HIRES_BITS); \
+    pvol += 2;
+
+
+#define SNDMIX_RAMPSTEREOVOLHI \
+    left_ramp_volume += chan->left_ramp; \
+    right_ramp_volume += chan->right_ramp; \
+    pvol[0] += (int) (((int64_t) vol_l * (right_ramp_volume >> VOLUMERAMPPRECISION)) >> HIRES_BITS); \
+    pvol[1] += (int) (((int64_t) vol_r * (left_ramp_volume >> VOLUMERAMPPRECISION)) >> HIRES_BITS); \
+    pvol += 2;
+
+
+// Resonant filters (the state is kept in the voice at the usual scale, so nothing jumps if a
+// voice goes from one kind of data to the other)
+#define HIRES_FILT_CLIP(i) CLAMP(i, -(65536 << HIRES_BITS), 65534 << HIRES_BITS)
+
+
+#define MIX_BEGIN_HIRES_FILTER \
+    int64_t fy1 = (int64_t) channel->filter_y1 * (1 << HIRES_BITS); \
+    int64_t fy2 = (int64_t) channel->filter_y2 * (1 << HIRES_BITS); \
+    int64_t ta;
+
+
+#define MIX_END_HIRES_FILTER \
+    channel->filter_y1 = fy1 >> HIRES_BITS; \
+    channel->filter_y2 = fy2 >> HIRES_BITS;
+
+
+#define SNDMIX_PROCESSHIRESFILTER \
+    ta = ((int64_t) vol * chan->filter_a0 + HIRES_FILT_CLIP(fy1) * chan->filter_b0 \
+        + HIRES_FILT_CLIP(fy2) * chan->filter_b1 + (1 << (FILTERPRECISION - 1))) >> FILTERPRECISION; \
+    fy2 = fy1; \
+    fy1 = ta; \
+    vol = ta - (chan->filter_hp * vol); // protman hp filter hack
+
+
+#define MIX_BEGIN_HIRES_STEREO_FILTER \
+    int64_t fy1 = (int64_t) channel->filter_y1 * (1 << HIRES_BITS); \
+    int64_t fy2 = (int64_t) channel->filter_y2 * (1 << HIRES_BITS); \
+    int64_t fy3 = (int64_t) channel->filter_y3 * (1 << HIRES_BITS); \
+    int64_t fy4 = (int64_t) channel->filter_y4 * (1 << HIRES_BITS); \
+    int64_t ta, tb;
+
+
+#define MIX_END_HIRES_STEREO_FILTER \
+    channel->filter_y1 = fy1 >> HIRES_BITS; \
+    channel->filter_y2 = fy2 >> HIRES_BITS; \
+    channel->filter_y3 = fy3 >> HIRES_BITS; \
+    channel->filter_y4 = fy4 >> HIRES_BITS;
+
+
+#define SNDMIX_PROCESSHIRESSTEREOFILTER \
+    ta = ((int64_t) vol_l * chan->filter_a0 + HIRES_FILT_CLIP(fy1) * chan->filter_b0 \
+        + HIRES_FILT_CLIP(fy2) * chan->filter_b1 + (1 << (FILTERPRECISION - 1))) >> FILTERPRECISION; \
+    tb = ((int64_t) vol_r * chan->filter_a0 + HIRES_FILT_CLIP(fy3) * chan->filter_b0 \
+        + HIRES_FILT_CLIP(fy4) * chan->filter_b1 + (1 << (FILTERPRECISION - 1))) >> FILTERPRECISION; \
+    fy2 = fy1; fy1 = ta; vol_l = ta; \
+    fy4 = fy3; fy3 = tb; vol_r = tb;
+
+
+// Interfaces
+#define BEGIN_HIRES_RAMPMIX_INTERFACE(func) \
+    BEGIN_MIX_INTERFACE(func) \
+        MIX_BEGIN_HIRES_RAMP
+
+
+#define END_HIRES_RAMPMIX_INTERFACE() \
+        SNDMIX_ENDSAMPLELOOP \
+        MIX_END_HIRES_RAMP \
+        channel->right_volume     = channel->right_ramp_volume >> VOLUMERAMPPRECISION; \
+        channel->left_volume      = channel->left_ramp_volume >> VOLUMERAMPPRECISION; \
+    }
+
+
+#define BEGIN_HIRES_MIX_FLT_INTERFACE(func) \
+    BEGIN_MIX_INTERFACE(func) \
+    MIX_BEGIN_HIRES_FILTER
+
+
+#define END_HIRES_MIX_FLT_INTERFACE() \
+        SNDMIX_ENDSAMPLELOOP \
+        MIX_END_HIRES_FILTER \
+    }
+
+
+#define BEGIN_HIRES_RAMPMIX_FLT_INTERFACE(func) \
+    BEGIN_MIX_INTERFACE(func) \
+        MIX_BEGIN_HIRES_RAMP \
+        MIX_BEGIN_HIRES_FILTER
+
+
+#define END_HIRES_RAMPMIX_FLT_INTERFACE() \
+        SNDMIX_ENDSAMPLELOOP \
+        MIX_END_HIRES_FILTER \
+        MIX_END_HIRES_RAMP \
+        channel->right_volume     = channel->right_ramp_volume >> VOLUMERAMPPRECISION; \
+        channel->left_volume      = channel->left_ramp_volume >> VOLUMERAMPPRECISION; \
+    }
+
+
+#define BEGIN_HIRES_MIX_STFLT_INTERFACE(func) \
+    BEGIN_MIX_INTERFACE(func) \
+    MIX_BEGIN_HIRES_STEREO_FILTER
+
+
+#define END_HIRES_MIX_STFLT_INTERFACE() \
+        SNDMIX_ENDSAMPLELOOP \
+        MIX_END_HIRES_STEREO_FILTER \
+    }
+
+
+#define BEGIN_HIRES_RAMPMIX_STFLT_INTERFACE(func) \
+    BEGIN_MIX_INTERFACE(func) \
+        MIX_BEGIN_HIRES_RAMP \
+        MIX_BEGIN_HIRES_STEREO_FILTER
+
+
+#define END_HIRES_RAMPMIX_STFLT_INTERFACE() \
+        SNDMIX_ENDSAMPLELOOP \
+        MIX_END_HIRES_STEREO_FILTER \
+        MIX_END_HIRES_RAMP \
+        channel->right_volume     = channel->right_ramp_volume >> VOLUMERAMPPRECISION; \
+        channel->left_volume      = channel->left_ramp_volume >> VOLUMERAMPPRECISION; \
+    }
+
+
+// Mono
+BEGIN_MIX_INTERFACE(Mono24BitMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETMONOVOLHINOIDO(HIRES_24)
+        SNDMIX_STOREMONOVOLHI
+END_MIX_INTERFACE()
+
+BEGIN_MIX_INTERFACE(MonoFloatMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETMONOVOLHINOIDO(HIRES_FLOAT)
+        SNDMIX_STOREMONOVOLHI
+END_MIX_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_INTERFACE(Mono24BitRampMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETMONOVOLHINOIDO(HIRES_24)
+        SNDMIX_RAMPMONOVOLHI
+END_HIRES_RAMPMIX_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_INTERFACE(MonoFloatRampMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETMONOVOLHINOIDO(HIRES_FLOAT)
+        SNDMIX_RAMPMONOVOLHI
+END_HIRES_RAMPMIX_INTERFACE()
+
+BEGIN_MIX_INTERFACE(Mono24BitLinearMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETMONOVOLHILINEAR(HIRES_24)
+        SNDMIX_STOREMONOVOLHI
+END_MIX_INTERFACE()
+
+BEGIN_MIX_INTERFACE(MonoFloatLinearMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETMONOVOLHILINEAR(HIRES_FLOAT)
+        SNDMIX_STOREMONOVOLHI
+END_MIX_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_INTERFACE(Mono24BitLinearRampMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETMONOVOLHILINEAR(HIRES_24)
+        SNDMIX_RAMPMONOVOLHI
+END_HIRES_RAMPMIX_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_INTERFACE(MonoFloatLinearRampMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETMONOVOLHILINEAR(HIRES_FLOAT)
+        SNDMIX_RAMPMONOVOLHI
+END_HIRES_RAMPMIX_INTERFACE()
+
+BEGIN_MIX_INTERFACE(Mono24BitSplineMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETMONOVOLHISPLINE(HIRES_24)
+        SNDMIX_STOREMONOVOLHI
+END_MIX_INTERFACE()
+
+BEGIN_MIX_INTERFACE(MonoFloatSplineMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETMONOVOLHISPLINE(HIRES_FLOAT)
+        SNDMIX_STOREMONOVOLHI
+END_MIX_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_INTERFACE(Mono24BitSplineRampMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETMONOVOLHISPLINE(HIRES_24)
+        SNDMIX_RAMPMONOVOLHI
+END_HIRES_RAMPMIX_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_INTERFACE(MonoFloatSplineRampMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETMONOVOLHISPLINE(HIRES_FLOAT)
+        SNDMIX_RAMPMONOVOLHI
+END_HIRES_RAMPMIX_INTERFACE()
+
+BEGIN_MIX_INTERFACE(Mono24BitFirFilterMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETMONOVOLHIFIRFILTER(HIRES_24)
+        SNDMIX_STOREMONOVOLHI
+END_MIX_INTERFACE()
+
+BEGIN_MIX_INTERFACE(MonoFloatFirFilterMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETMONOVOLHIFIRFILTER(HIRES_FLOAT)
+        SNDMIX_STOREMONOVOLHI
+END_MIX_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_INTERFACE(Mono24BitFirFilterRampMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETMONOVOLHIFIRFILTER(HIRES_24)
+        SNDMIX_RAMPMONOVOLHI
+END_HIRES_RAMPMIX_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_INTERFACE(MonoFloatFirFilterRampMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETMONOVOLHIFIRFILTER(HIRES_FLOAT)
+        SNDMIX_RAMPMONOVOLHI
+END_HIRES_RAMPMIX_INTERFACE()
+
+
+// Stereo
+BEGIN_MIX_INTERFACE(Stereo24BitMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETSTEREOVOLHINOIDO(HIRES_24)
+        SNDMIX_STORESTEREOVOLHI
+END_MIX_INTERFACE()
+
+BEGIN_MIX_INTERFACE(StereoFloatMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETSTEREOVOLHINOIDO(HIRES_FLOAT)
+        SNDMIX_STORESTEREOVOLHI
+END_MIX_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_INTERFACE(Stereo24BitRampMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETSTEREOVOLHINOIDO(HIRES_24)
+        SNDMIX_RAMPSTEREOVOLHI
+END_HIRES_RAMPMIX_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_INTERFACE(StereoFloatRampMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETSTEREOVOLHINOIDO(HIRES_FLOAT)
+        SNDMIX_RAMPSTEREOVOLHI
+END_HIRES_RAMPMIX_INTERFACE()
+
+BEGIN_MIX_INTERFACE(Stereo24BitLinearMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETSTEREOVOLHILINEAR(HIRES_24)
+        SNDMIX_STORESTEREOVOLHI
+END_MIX_INTERFACE()
+
+BEGIN_MIX_INTERFACE(StereoFloatLinearMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETSTEREOVOLHILINEAR(HIRES_FLOAT)
+        SNDMIX_STORESTEREOVOLHI
+END_MIX_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_INTERFACE(Stereo24BitLinearRampMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETSTEREOVOLHILINEAR(HIRES_24)
+        SNDMIX_RAMPSTEREOVOLHI
+END_HIRES_RAMPMIX_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_INTERFACE(StereoFloatLinearRampMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETSTEREOVOLHILINEAR(HIRES_FLOAT)
+        SNDMIX_RAMPSTEREOVOLHI
+END_HIRES_RAMPMIX_INTERFACE()
+
+BEGIN_MIX_INTERFACE(Stereo24BitSplineMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETSTEREOVOLHISPLINE(HIRES_24)
+        SNDMIX_STORESTEREOVOLHI
+END_MIX_INTERFACE()
+
+BEGIN_MIX_INTERFACE(StereoFloatSplineMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETSTEREOVOLHISPLINE(HIRES_FLOAT)
+        SNDMIX_STORESTEREOVOLHI
+END_MIX_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_INTERFACE(Stereo24BitSplineRampMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETSTEREOVOLHISPLINE(HIRES_24)
+        SNDMIX_RAMPSTEREOVOLHI
+END_HIRES_RAMPMIX_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_INTERFACE(StereoFloatSplineRampMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETSTEREOVOLHISPLINE(HIRES_FLOAT)
+        SNDMIX_RAMPSTEREOVOLHI
+END_HIRES_RAMPMIX_INTERFACE()
+
+BEGIN_MIX_INTERFACE(Stereo24BitFirFilterMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETSTEREOVOLHIFIRFILTER(HIRES_24)
+        SNDMIX_STORESTEREOVOLHI
+END_MIX_INTERFACE()
+
+BEGIN_MIX_INTERFACE(StereoFloatFirFilterMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETSTEREOVOLHIFIRFILTER(HIRES_FLOAT)
+        SNDMIX_STORESTEREOVOLHI
+END_MIX_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_INTERFACE(Stereo24BitFirFilterRampMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETSTEREOVOLHIFIRFILTER(HIRES_24)
+        SNDMIX_RAMPSTEREOVOLHI
+END_HIRES_RAMPMIX_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_INTERFACE(StereoFloatFirFilterRampMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETSTEREOVOLHIFIRFILTER(HIRES_FLOAT)
+        SNDMIX_RAMPSTEREOVOLHI
+END_HIRES_RAMPMIX_INTERFACE()
+
+
+// Mono, filtered
+BEGIN_HIRES_MIX_FLT_INTERFACE(FilterMono24BitMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETMONOVOLHINOIDO(HIRES_24)
+        SNDMIX_PROCESSHIRESFILTER
+        SNDMIX_STOREMONOVOLHI
+END_HIRES_MIX_FLT_INTERFACE()
+
+BEGIN_HIRES_MIX_FLT_INTERFACE(FilterMonoFloatMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETMONOVOLHINOIDO(HIRES_FLOAT)
+        SNDMIX_PROCESSHIRESFILTER
+        SNDMIX_STOREMONOVOLHI
+END_HIRES_MIX_FLT_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_FLT_INTERFACE(FilterMono24BitRampMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETMONOVOLHINOIDO(HIRES_24)
+        SNDMIX_PROCESSHIRESFILTER
+        SNDMIX_RAMPMONOVOLHI
+END_HIRES_RAMPMIX_FLT_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_FLT_INTERFACE(FilterMonoFloatRampMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETMONOVOLHINOIDO(HIRES_FLOAT)
+        SNDMIX_PROCESSHIRESFILTER
+        SNDMIX_RAMPMONOVOLHI
+END_HIRES_RAMPMIX_FLT_INTERFACE()
+
+BEGIN_HIRES_MIX_FLT_INTERFACE(FilterMono24BitLinearMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETMONOVOLHILINEAR(HIRES_24)
+        SNDMIX_PROCESSHIRESFILTER
+        SNDMIX_STOREMONOVOLHI
+END_HIRES_MIX_FLT_INTERFACE()
+
+BEGIN_HIRES_MIX_FLT_INTERFACE(FilterMonoFloatLinearMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETMONOVOLHILINEAR(HIRES_FLOAT)
+        SNDMIX_PROCESSHIRESFILTER
+        SNDMIX_STOREMONOVOLHI
+END_HIRES_MIX_FLT_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_FLT_INTERFACE(FilterMono24BitLinearRampMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETMONOVOLHILINEAR(HIRES_24)
+        SNDMIX_PROCESSHIRESFILTER
+        SNDMIX_RAMPMONOVOLHI
+END_HIRES_RAMPMIX_FLT_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_FLT_INTERFACE(FilterMonoFloatLinearRampMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETMONOVOLHILINEAR(HIRES_FLOAT)
+        SNDMIX_PROCESSHIRESFILTER
+        SNDMIX_RAMPMONOVOLHI
+END_HIRES_RAMPMIX_FLT_INTERFACE()
+
+BEGIN_HIRES_MIX_FLT_INTERFACE(FilterMono24BitSplineMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETMONOVOLHISPLINE(HIRES_24)
+        SNDMIX_PROCESSHIRESFILTER
+        SNDMIX_STOREMONOVOLHI
+END_HIRES_MIX_FLT_INTERFACE()
+
+BEGIN_HIRES_MIX_FLT_INTERFACE(FilterMonoFloatSplineMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETMONOVOLHISPLINE(HIRES_FLOAT)
+        SNDMIX_PROCESSHIRESFILTER
+        SNDMIX_STOREMONOVOLHI
+END_HIRES_MIX_FLT_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_FLT_INTERFACE(FilterMono24BitSplineRampMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETMONOVOLHISPLINE(HIRES_24)
+        SNDMIX_PROCESSHIRESFILTER
+        SNDMIX_RAMPMONOVOLHI
+END_HIRES_RAMPMIX_FLT_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_FLT_INTERFACE(FilterMonoFloatSplineRampMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETMONOVOLHISPLINE(HIRES_FLOAT)
+        SNDMIX_PROCESSHIRESFILTER
+        SNDMIX_RAMPMONOVOLHI
+END_HIRES_RAMPMIX_FLT_INTERFACE()
+
+BEGIN_HIRES_MIX_FLT_INTERFACE(FilterMono24BitFirFilterMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETMONOVOLHIFIRFILTER(HIRES_24)
+        SNDMIX_PROCESSHIRESFILTER
+        SNDMIX_STOREMONOVOLHI
+END_HIRES_MIX_FLT_INTERFACE()
+
+BEGIN_HIRES_MIX_FLT_INTERFACE(FilterMonoFloatFirFilterMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETMONOVOLHIFIRFILTER(HIRES_FLOAT)
+        SNDMIX_PROCESSHIRESFILTER
+        SNDMIX_STOREMONOVOLHI
+END_HIRES_MIX_FLT_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_FLT_INTERFACE(FilterMono24BitFirFilterRampMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETMONOVOLHIFIRFILTER(HIRES_24)
+        SNDMIX_PROCESSHIRESFILTER
+        SNDMIX_RAMPMONOVOLHI
+END_HIRES_RAMPMIX_FLT_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_FLT_INTERFACE(FilterMonoFloatFirFilterRampMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETMONOVOLHIFIRFILTER(HIRES_FLOAT)
+        SNDMIX_PROCESSHIRESFILTER
+        SNDMIX_RAMPMONOVOLHI
+END_HIRES_RAMPMIX_FLT_INTERFACE()
+
+
+// Stereo, filtered
+BEGIN_HIRES_MIX_STFLT_INTERFACE(FilterStereo24BitMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETSTEREOVOLHINOIDO(HIRES_24)
+        SNDMIX_PROCESSHIRESSTEREOFILTER
+        SNDMIX_STORESTEREOVOLHI
+END_HIRES_MIX_STFLT_INTERFACE()
+
+BEGIN_HIRES_MIX_STFLT_INTERFACE(FilterStereoFloatMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETSTEREOVOLHINOIDO(HIRES_FLOAT)
+        SNDMIX_PROCESSHIRESSTEREOFILTER
+        SNDMIX_STORESTEREOVOLHI
+END_HIRES_MIX_STFLT_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_STFLT_INTERFACE(FilterStereo24BitRampMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETSTEREOVOLHINOIDO(HIRES_24)
+        SNDMIX_PROCESSHIRESSTEREOFILTER
+        SNDMIX_RAMPSTEREOVOLHI
+END_HIRES_RAMPMIX_STFLT_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_STFLT_INTERFACE(FilterStereoFloatRampMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETSTEREOVOLHINOIDO(HIRES_FLOAT)
+        SNDMIX_PROCESSHIRESSTEREOFILTER
+        SNDMIX_RAMPSTEREOVOLHI
+END_HIRES_RAMPMIX_STFLT_INTERFACE()
+
+BEGIN_HIRES_MIX_STFLT_INTERFACE(FilterStereo24BitLinearMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETSTEREOVOLHILINEAR(HIRES_24)
+        SNDMIX_PROCESSHIRESSTEREOFILTER
+        SNDMIX_STORESTEREOVOLHI
+END_HIRES_MIX_STFLT_INTERFACE()
+
+BEGIN_HIRES_MIX_STFLT_INTERFACE(FilterStereoFloatLinearMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETSTEREOVOLHILINEAR(HIRES_FLOAT)
+        SNDMIX_PROCESSHIRESSTEREOFILTER
+        SNDMIX_STORESTEREOVOLHI
+END_HIRES_MIX_STFLT_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_STFLT_INTERFACE(FilterStereo24BitLinearRampMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETSTEREOVOLHILINEAR(HIRES_24)
+        SNDMIX_PROCESSHIRESSTEREOFILTER
+        SNDMIX_RAMPSTEREOVOLHI
+END_HIRES_RAMPMIX_STFLT_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_STFLT_INTERFACE(FilterStereoFloatLinearRampMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETSTEREOVOLHILINEAR(HIRES_FLOAT)
+        SNDMIX_PROCESSHIRESSTEREOFILTER
+        SNDMIX_RAMPSTEREOVOLHI
+END_HIRES_RAMPMIX_STFLT_INTERFACE()
+
+BEGIN_HIRES_MIX_STFLT_INTERFACE(FilterStereo24BitSplineMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETSTEREOVOLHISPLINE(HIRES_24)
+        SNDMIX_PROCESSHIRESSTEREOFILTER
+        SNDMIX_STORESTEREOVOLHI
+END_HIRES_MIX_STFLT_INTERFACE()
+
+BEGIN_HIRES_MIX_STFLT_INTERFACE(FilterStereoFloatSplineMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETSTEREOVOLHISPLINE(HIRES_FLOAT)
+        SNDMIX_PROCESSHIRESSTEREOFILTER
+        SNDMIX_STORESTEREOVOLHI
+END_HIRES_MIX_STFLT_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_STFLT_INTERFACE(FilterStereo24BitSplineRampMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETSTEREOVOLHISPLINE(HIRES_24)
+        SNDMIX_PROCESSHIRESSTEREOFILTER
+        SNDMIX_RAMPSTEREOVOLHI
+END_HIRES_RAMPMIX_STFLT_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_STFLT_INTERFACE(FilterStereoFloatSplineRampMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETSTEREOVOLHISPLINE(HIRES_FLOAT)
+        SNDMIX_PROCESSHIRESSTEREOFILTER
+        SNDMIX_RAMPSTEREOVOLHI
+END_HIRES_RAMPMIX_STFLT_INTERFACE()
+
+BEGIN_HIRES_MIX_STFLT_INTERFACE(FilterStereo24BitFirFilterMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETSTEREOVOLHIFIRFILTER(HIRES_24)
+        SNDMIX_PROCESSHIRESSTEREOFILTER
+        SNDMIX_STORESTEREOVOLHI
+END_HIRES_MIX_STFLT_INTERFACE()
+
+BEGIN_HIRES_MIX_STFLT_INTERFACE(FilterStereoFloatFirFilterMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETSTEREOVOLHIFIRFILTER(HIRES_FLOAT)
+        SNDMIX_PROCESSHIRESSTEREOFILTER
+        SNDMIX_STORESTEREOVOLHI
+END_HIRES_MIX_STFLT_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_STFLT_INTERFACE(FilterStereo24BitFirFilterRampMix)
+        SNDMIX_BEGINSAMPLELOOP24
+        SNDMIX_GETSTEREOVOLHIFIRFILTER(HIRES_24)
+        SNDMIX_PROCESSHIRESSTEREOFILTER
+        SNDMIX_RAMPSTEREOVOLHI
+END_HIRES_RAMPMIX_STFLT_INTERFACE()
+
+BEGIN_HIRES_RAMPMIX_STFLT_INTERFACE(FilterStereoFloatFirFilterRampMix)
+        SNDMIX_BEGINSAMPLELOOPFLOAT
+        SNDMIX_GETSTEREOVOLHIFIRFILTER(HIRES_FLOAT)
+        SNDMIX_PROCESSHIRESSTEREOFILTER
+        SNDMIX_RAMPSTEREOVOLHI
+END_HIRES_RAMPMIX_STFLT_INTERFACE()
+
+
+
 // Public resampling Methods (
 BEGIN_RESAMPLE_INTERFACE(ResampleMono8BitFirFilter, signed char, 1)
         SNDMIX_GETMONOVOL8FIRFILTER
@@ -1242,6 +2084,58 @@ static const mix_interface_t fastmix_functions[2 * 2 * 16] = {
 };
 
 
+// Same layout as mix_functions, except that bit 0 picks float instead of 24-bit
+static const mix_interface_t hires_mix_functions[2 * 2 * 16] = {
+        // No SRC
+        Mono24BitMix,                       MonoFloatMix,
+        Stereo24BitMix,                     StereoFloatMix,
+        Mono24BitRampMix,                   MonoFloatRampMix,
+        Stereo24BitRampMix,                 StereoFloatRampMix,
+
+        // No SRC, Filter
+        FilterMono24BitMix,                 FilterMonoFloatMix,
+        FilterStereo24BitMix,               FilterStereoFloatMix,
+        FilterMono24BitRampMix,             FilterMonoFloatRampMix,
+        FilterStereo24BitRampMix,           FilterStereoFloatRampMix,
+
+        // Linear SRC
+        Mono24BitLinearMix,                 MonoFloatLinearMix,
+        Stereo24BitLinearMix,               StereoFloatLinearMix,
+        Mono24BitLinearRampMix,             MonoFloatLinearRampMix,
+        Stereo24BitLinearRampMix,           StereoFloatLinearRampMix,
+
+        // Linear SRC, Filter
+        FilterMono24BitLinearMix,           FilterMonoFloatLinearMix,
+        FilterStereo24BitLinearMix,         FilterStereoFloatLinearMix,
+        FilterMono24BitLinearRampMix,       FilterMonoFloatLinearRampMix,
+        FilterStereo24BitLinearRampMix,     FilterStereoFloatLinearRampMix,
+
+        // Spline SRC
+        Mono24BitSplineMix,                 MonoFloatSplineMix,
+        Stereo24BitSplineMix,               StereoFloatSplineMix,
+        Mono24BitSplineRampMix,             MonoFloatSplineRampMix,
+        Stereo24BitSplineRampMix,           StereoFloatSplineRampMix,
+
+        // Spline SRC, Filter
+        FilterMono24BitSplineMix,           FilterMonoFloatSplineMix,
+        FilterStereo24BitSplineMix,         FilterStereoFloatSplineMix,
+        FilterMono24BitSplineRampMix,       FilterMonoFloatSplineRampMix,
+        FilterStereo24BitSplineRampMix,     FilterStereoFloatSplineRampMix,
+
+        // FirFilter SRC
+        Mono24BitFirFilterMix,              MonoFloatFirFilterMix,
+        Stereo24BitFirFilterMix,            StereoFloatFirFilterMix,
+        Mono24BitFirFilterRampMix,          MonoFloatFirFilterRampMix,
+        Stereo24BitFirFilterRampMix,        StereoFloatFirFilterRampMix,
+
+        // FirFilter SRC, Filter
+        FilterMono24BitFirFilterMix,        FilterMonoFloatFirFilterMix,
+        FilterStereo24BitFirFilterMix,      FilterStereoFloatFirFilterMix,
+        FilterMono24BitFirFilterRampMix,    FilterMonoFloatFirFilterRampMix,
+        FilterStereo24BitFirFilterRampMix,  FilterStereoFloatFirFilterRampMix
+};
+
+
 static int get_sample_count(song_voice_t *chan, int samples)
 {
         int loop_start = (chan->flags & CHN_LOOP) ? chan->loop_start : 0;
@@ -1401,6 +2295,8 @@ unsigned int csf_create_stereo_mix(song_t *csf, int count)
         for (unsigned int nchan = 0; nchan < csf->num_voices; nchan++) {
                 const mix_interface_t *mix_func_table;
                 song_voice_t *const channel = &csf->voices[csf->voice_mix[nchan]];
+                const void *hires;
+                int hires_format;
                 unsigned int flags;
                 unsigned int nrampsamples;
                 int smpcount;
@@ -1435,7 +2331,13 @@ unsigned int csf_create_stereo_mix(song_t *csf, int count)
                                 flags |= MIXNDX_LINEARSRC;    // use
                 }
 
-                if ((flags < 0x40) &&
+                if ((hires = csf_sample_hires(channel->current_sample_data, channel->flags,
+                                channel->length, &hires_format)) != NULL) {
+                        flags &= ~MIXNDX_16BIT;
+                        if (hires_format == SAMPLE_HIRES_FLOAT)
+                                flags |= MIXNDX_16BIT;
+                        mix_func_table = hires_mix_functions;
+                } else if ((flags < 0x40) &&
                         (channel->left_volume == channel->right_volume) &&
                         ((!channel->ramp_length) ||
                         (channel->left_ramp == channel->right_ramp))) {
@@ -1507,6 +2409,9 @@ unsigned int csf_create_stereo_mix(song_t *csf, int count)
 
                                 /* Mix the stream, unless we're in AdLib mode */
                                 if (!(channel->flags & CHN_ADLIB)) {
+                                        // decodes anything that's missing, and wakes up the prefetch thread
+                                        int mapped = csf_cache_voice(channel, smpcount);
+
                                         // Choose function for mixing
                                         mix_interface_t mix_func;
                                         mix_func = channel->ramp_length
@@ -1516,7 +2421,15 @@ unsigned int csf_create_stereo_mix(song_t *csf, int count)
                                         channel->rofs = -*(pbufmax - 2);
                                         channel->lofs = -*(pbufmax - 1);
 
-                                        mix_func(channel, pbuffer, pbufmax);
+                                        if (!mapped) {
+                                                mix_func(channel, pbuffer, pbufmax);
+#if HAVE_MMAP
+                                        } else if (!mix_mapped(mix_func, channel, pbuffer, pbufmax)) {
+                                                // the rest of the sample's gone from the file, so that's it
+                                                channel->length = 0;
+                                                channel->current_sample_data = NULL;
+#endif
+                                        }
                                         channel->rofs += *(pbufmax - 2);
                                         channel->lofs += *(pbufmax - 1);
                                         pbuffer = pbufmax;
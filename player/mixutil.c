@@ -25,6 +25,10 @@
 
 #include "sndfile.h"
 
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
 #include "cmixer.h"
 
 #define OFSDECAYSHIFT 8
@@ -94,79 +98,162 @@ void mono_from_stereo(int *mix_buf, unsigned int samples)
 }
 
 
-static const float f2ic = (float) (1 << 28);
-static const float i2fc = (float) (1.0 / (1 << 28));
-
-
-void stereo_mix_to_float(const int *src, float *out1, float *out2, unsigned int count)
+// ----------------------------------------------------------------------------
+// Clip and convert functions
+// ----------------------------------------------------------------------------
+// XXX mins/max were int[2]
+//
+// The original C version was written by Rani Assaf <rani@magic.metawire.com>
+//
+// With SSE2, four samples (two stereo frames) are clamped at a time, and the
+// VU meter min/max is kept in a register per lane and folded into mins/maxs
+// once at the end. Lanes 0 and 2 are left, 1 and 3 are right. Whatever is
+// left over after the last full vector goes through the scalar loop.
+//
+// The scalar loop only raises maxs for a sample that didn't lower mins. That
+// only matters while mins > maxs, which is how csf_read starts them off, so
+// the vector loop waits until that's sorted out for both channels (and until
+// it's at a multiple of four, so the lanes line up) to get the same results.
+
+
+// TPDF dither: two uniform values of up to one output LSB each, summed and
+// centered, added before the shift. The generator is a four-lane xorshift;
+// sample i always draws from lane (i & 3), so the SSE2 and scalar paths
+// produce the same noise. Its state belongs to the song being mixed (so the
+// player and the disk writer don't trample on each other's), and is passed
+// to every clip function; the ones that don't dither never touch it.
+void csf_reset_dither(song_t *csf)
 {
-    for (unsigned int i = 0; i < count; i++) {
-	*out1++ = *src * i2fc;
-	src++;
-
-	*out2++ = *src * i2fc;
-	src++;
-    }
+    csf->dither_state[0] = 0x2545f491;
+    csf->dither_state[1] = 0x9e3779b9;
+    csf->dither_state[2] = 0x6a09e667;
+    csf->dither_state[3] = 0xbb67ae85;
 }
 
-
-void float_to_stereo_mix(const float *in1, const float *in2, int *out, unsigned int count)
+static inline int dither_next(uint32_t *dither_state, unsigned int lane, int shift)
 {
-    for (unsigned int i = 0; i < count; i++) {
-	*out++ = (int) (*in1 * f2ic);
-	*out++ = (int) (*in2 * f2ic);
-	in1++;
-	in2++;
-    }
+    uint32_t x = dither_state[lane];
+    int mask = (1 << shift) - 1;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    dither_state[lane] = x;
+    return (int) (x & mask) + (int) ((x >> 16) & mask) - (mask + 1);
 }
 
 
-void mono_mix_to_float(const int *src, float *out, unsigned int count)
+#ifdef __SSE2__
+
+static inline __m128i mm_min_epi32(__m128i a, __m128i b)
 {
-    for (unsigned int i = 0; i < count; i++) {
-	*out++ = *src * i2fc;
-	src++;
-    }
+    __m128i m = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(m, b), _mm_andnot_si128(m, a));
 }
 
-
-void float_to_mono_mix(const float *in, int *out, unsigned int count)
+static inline __m128i mm_max_epi32(__m128i a, __m128i b)
 {
-    for (unsigned int i = 0; i < count; i++) {
-	*out++ = (int) (*in * f2ic);
-	in++;
-    }
+    __m128i m = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
 }
 
 
-// ----------------------------------------------------------------------------
-// Clip and convert functions
-// ----------------------------------------------------------------------------
-// XXX mins/max were int[2]
-//
-// The original C version was written by Rani Assaf <rani@magic.metawire.com>
+#define CLIP_SSE2_READY(i) \
+    (!((i) & 3) && mins[0] <= maxs[0] && mins[1] <= maxs[1])
+
+
+#define CLIP_BEGIN_SSE2(dither) \
+    const __m128i clipmin = _mm_set1_epi32(MIXING_CLIPMIN); \
+    const __m128i clipmax = _mm_set1_epi32(MIXING_CLIPMAX); \
+    __m128i vmin = _mm_set_epi32(mins[1], mins[0], mins[1], mins[0]); \
+    __m128i vmax = _mm_set_epi32(maxs[1], maxs[0], maxs[1], maxs[0]); \
+    __m128i rng = (dither) ? _mm_loadu_si128((const __m128i *) dither_state) : _mm_setzero_si128();
+
+
+#define CLIP_END_SSE2(dither) \
+    { \
+        int t[4]; \
+        vmin = mm_min_epi32(vmin, _mm_shuffle_epi32(vmin, _MM_SHUFFLE(1, 0, 3, 2))); \
+        vmax = mm_max_epi32(vmax, _mm_shuffle_epi32(vmax, _MM_SHUFFLE(1, 0, 3, 2))); \
+        _mm_storeu_si128((__m128i *) t, vmin); \
+        mins[0] = t[0]; \
+        mins[1] = t[1]; \
+        _mm_storeu_si128((__m128i *) t, vmax); \
+        maxs[0] = t[0]; \
+        maxs[1] = t[1]; \
+    } \
+    if (dither) \
+        _mm_storeu_si128((__m128i *) dither_state, rng);
+
+
+// v = the next four samples, clamped, with the VU meter updated;
+// if dither is nonzero, TPDF noise of 'dither' bits is added first
+#define CLIP_LOAD_SSE2(v, src, dither) \
+    __m128i v = _mm_loadu_si128((const __m128i *) (src)); \
+    if (dither) { \
+        const __m128i dmask = _mm_set1_epi32((1 << (dither)) - 1); \
+        rng = _mm_xor_si128(rng, _mm_slli_epi32(rng, 13)); \
+        rng = _mm_xor_si128(rng, _mm_srli_epi32(rng, 17)); \
+        rng = _mm_xor_si128(rng, _mm_slli_epi32(rng, 5)); \
+        v = _mm_add_epi32(v, _mm_sub_epi32( \
+            _mm_add_epi32(_mm_and_si128(rng, dmask), _mm_and_si128(_mm_srli_epi32(rng, 16), dmask)), \
+            _mm_set1_epi32(1 << (dither)))); \
+    } \
+    v = mm_min_epi32(mm_max_epi32(v, clipmin), clipmax); \
+    vmin = mm_min_epi32(vmin, v); \
+    vmax = mm_max_epi32(vmax, v);
+
+#endif
+
+
+#define CLIP_SCALAR(n, i, dither) \
+    int n = buffer[i]; \
+    if (dither) \
+        n += dither_next(dither_state, i & 3, dither); \
+    if (n < MIXING_CLIPMIN) \
+        n = MIXING_CLIPMIN; \
+    else if (n > MIXING_CLIPMAX) \
+        n = MIXING_CLIPMAX; \
+    if (n < mins[i & 1]) \
+        mins[i & 1] = n; \
+    else if (n > maxs[i & 1]) \
+        maxs[i & 1] = n;
 
 
 // Clip and convert to 8 bit. mins and maxs returned in 27bits: [MIXING_CLIPMIN..MIXING_CLIPMAX]. mins[0] left, mins[1] right.
-unsigned int clip_32_to_8(void *ptr, int *buffer, unsigned int samples, int *mins, int *maxs)
+unsigned int clip_32_to_8(void *ptr, int *buffer, unsigned int samples, int *mins, int *maxs,
+    uint32_t *dither_state)
 {
     unsigned char *p = (unsigned char *) ptr;
-
-    for (unsigned int i = 0; i < samples; i++) {
-	int n = buffer[i];
-
-	if (n < MIXING_CLIPMIN)
-	    n = MIXING_CLIPMIN;
-	else if (n > MIXING_CLIPMAX)
-	    n = MIXING_CLIPMAX;
-
-	if (n < mins[i & 1])
-	    mins[i & 1] = n;
-	else if (n > maxs[i & 1])
-	    maxs[i & 1] = n;
-
-	// 8-bit unsigned
-	p[i] = (n >> (24 - MIXING_ATTENUATION)) ^ 0x80;
+    unsigned int i = 0;
+
+    while (i < samples) {
+#ifdef __SSE2__
+        if (i + 16 <= samples && CLIP_SSE2_READY(i)) {
+            CLIP_BEGIN_SSE2(0)
+            const __m128i sign = _mm_set1_epi8((char) 0x80);
+
+            for (; i + 16 <= samples; i += 16) {
+                CLIP_LOAD_SSE2(a, buffer + i, 0)
+                CLIP_LOAD_SSE2(b, buffer + i + 4, 0)
+                CLIP_LOAD_SSE2(c, buffer + i + 8, 0)
+                CLIP_LOAD_SSE2(d, buffer + i + 12, 0)
+                __m128i ab = _mm_packs_epi32(_mm_srai_epi32(a, 24 - MIXING_ATTENUATION),
+                                             _mm_srai_epi32(b, 24 - MIXING_ATTENUATION));
+                __m128i cd = _mm_packs_epi32(_mm_srai_epi32(c, 24 - MIXING_ATTENUATION),
+                                             _mm_srai_epi32(d, 24 - MIXING_ATTENUATION));
+                // 8-bit unsigned
+                _mm_storeu_si128((__m128i *) (p + i), _mm_xor_si128(_mm_packs_epi16(ab, cd), sign));
+            }
+            CLIP_END_SSE2(0)
+            continue;
+        }
+#endif
+        CLIP_SCALAR(n, i, 0)
+
+        // 8-bit unsigned
+        p[i] = (n >> (24 - MIXING_ATTENUATION)) ^ 0x80;
+        i++;
     }
 
     return samples;
@@ -174,85 +261,138 @@ unsigned int clip_32_to_8(void *ptr, int *buffer, unsigned int samples, int *min
 
 
 // Clip and convert to 16 bit. mins and maxs returned in 27bits: [MIXING_CLIPMIN..MIXING_CLIPMAX]. mins[0] left, mins[1] right.
-unsigned int clip_32_to_16(void *ptr, int *buffer, unsigned int samples, int *mins, int *maxs)
+static inline unsigned int _clip_32_to_16(void *ptr, int *buffer, unsigned int samples, int *mins, int *maxs,
+    uint32_t *dither_state, int dither)
 {
     signed short *p = (signed short *) ptr;
-
-    for (unsigned int i = 0; i < samples; i++) {
-	int n = buffer[i];
-
-	if (n < MIXING_CLIPMIN)
-	    n = MIXING_CLIPMIN;
-	else if (n > MIXING_CLIPMAX)
-	    n = MIXING_CLIPMAX;
-
-	if (n < mins[i & 1])
-	    mins[i & 1] = n;
-	else if (n > maxs[i & 1])
-	    maxs[i & 1] = n;
-
-	// 16-bit signed
-	p[i] = n >> (16 - MIXING_ATTENUATION);
+    unsigned int i = 0;
+
+    while (i < samples) {
+#ifdef __SSE2__
+        if (i + 8 <= samples && CLIP_SSE2_READY(i)) {
+            CLIP_BEGIN_SSE2(dither)
+
+            for (; i + 8 <= samples; i += 8) {
+                CLIP_LOAD_SSE2(a, buffer + i, dither)
+                CLIP_LOAD_SSE2(b, buffer + i + 4, dither)
+                // 16-bit signed
+                _mm_storeu_si128((__m128i *) (p + i),
+                    _mm_packs_epi32(_mm_srai_epi32(a, 16 - MIXING_ATTENUATION),
+                                    _mm_srai_epi32(b, 16 - MIXING_ATTENUATION)));
+            }
+            CLIP_END_SSE2(dither)
+            continue;
+        }
+#endif
+        CLIP_SCALAR(n, i, dither)
+
+        // 16-bit signed
+        p[i] = n >> (16 - MIXING_ATTENUATION);
+        i++;
     }
 
     return samples * 2;
 }
 
+unsigned int clip_32_to_16(void *ptr, int *buffer, unsigned int samples, int *mins, int *maxs,
+    uint32_t *dither_state)
+{
+    return _clip_32_to_16(ptr, buffer, samples, mins, maxs, dither_state, 0);
+}
+
+unsigned int clip_32_to_16_dither(void *ptr, int *buffer, unsigned int samples, int *mins, int *maxs,
+    uint32_t *dither_state)
+{
+    return _clip_32_to_16(ptr, buffer, samples, mins, maxs, dither_state, 16 - MIXING_ATTENUATION);
+}
+
 
 // Clip and convert to 24 bit. mins and maxs returned in 27bits: [MIXING_CLIPMIN..MIXING_CLIPMAX]. mins[0] left, mins[1] right.
 // Note, this is 24bit, not 24-in-32bits. The former is used in .wav. The latter is used in audio IO
-unsigned int clip_32_to_24(void *ptr, int *buffer, unsigned int samples, int *mins, int *maxs)
+static inline unsigned int _clip_32_to_24(void *ptr, int *buffer, unsigned int samples, int *mins, int *maxs,
+    uint32_t *dither_state, int dither)
 {
     /* the inventor of 24bit anything should be shot */
     unsigned char *p = (unsigned char *) ptr;
-
-    for (unsigned int i = 0; i < samples; i++) {
-	int n = buffer[i];
-
-	if (n < MIXING_CLIPMIN)
-	    n = MIXING_CLIPMIN;
-	else if (n > MIXING_CLIPMAX)
-	    n = MIXING_CLIPMAX;
-
-	if (n < mins[i & 1])
-	    mins[i & 1] = n;
-	else if (n > maxs[i & 1])
-	    maxs[i & 1] = n;
-
-	// 24-bit signed
-	n = n >> (8 - MIXING_ATTENUATION);
-
-	/* err, assume same endian */
-	memcpy(p, &n, 3);
-	p += 3;
+    unsigned int i = 0;
+
+    while (i < samples) {
+#ifdef __SSE2__
+        if (i + 4 <= samples && CLIP_SSE2_READY(i)) {
+            CLIP_BEGIN_SSE2(dither)
+
+            for (; i + 4 <= samples; i += 4) {
+                int t[4];
+
+                CLIP_LOAD_SSE2(a, buffer + i, dither)
+                // 24-bit signed
+                _mm_storeu_si128((__m128i *) t, _mm_srai_epi32(a, 8 - MIXING_ATTENUATION));
+
+                /* err, assume same endian */
+                memcpy(p, &t[0], 3);
+                memcpy(p + 3, &t[1], 3);
+                memcpy(p + 6, &t[2], 3);
+                memcpy(p + 9, &t[3], 3);
+                p += 12;
+            }
+            CLIP_END_SSE2(dither)
+            continue;
+        }
+#endif
+        CLIP_SCALAR(n, i, dither)
+
+        // 24-bit signed
+        n = n >> (8 - MIXING_ATTENUATION);
+
+        /* err, assume same endian */
+        memcpy(p, &n, 3);
+        p += 3;
+        i++;
     }
 
     return samples * 3;
 }
 
-
-// Clip and convert to 32 bit(int). mins and maxs returned in 27bits: [MIXING_CLIPMIN..MIXING_CLIPMAX]. mins[0] left, mins[1] right.
-unsigned int clip_32_to_32(void *ptr, int *buffer, unsigned int samples, int *mins, int *maxs)
+unsigned int clip_32_to_24(void *ptr, int *buffer, unsigned int samples, int *mins, int *maxs,
+    uint32_t *dither_state)
 {
-    signed int *p = (signed int *) ptr;
-
-    for (unsigned int i = 0; i < samples; i++) {
-	int n = buffer[i];
+    return _clip_32_to_24(ptr, buffer, samples, mins, maxs, dither_state, 0);
+}
 
-	if (n < MIXING_CLIPMIN)
-	    n = MIXING_CLIPMIN;
-	else if (n > MIXING_CLIPMAX)
-	    n = MIXING_CLIPMAX;
+unsigned int clip_32_to_24_dither(void *ptr, int *buffer, unsigned int samples, int *mins, int *maxs,
+    uint32_t *dither_state)
+{
+    return _clip_32_to_24(ptr, buffer, samples, mins, maxs, dither_state, 8 - MIXING_ATTENUATION);
+}
 
-	if (n < mins[i & 1])
-	    mins[i & 1] = n;
-	else if (n > maxs[i & 1])
-	    maxs[i & 1] = n;
 
-	// 32-bit signed
-	p[i] = (n << MIXING_ATTENUATION);
+// Clip and convert to 32 bit(int). mins and maxs returned in 27bits: [MIXING_CLIPMIN..MIXING_CLIPMAX]. mins[0] left, mins[1] right.
+unsigned int clip_32_to_32(void *ptr, int *buffer, unsigned int samples, int *mins, int *maxs,
+    uint32_t *dither_state)
+{
+    signed int *p = (signed int *) ptr;
+    unsigned int i = 0;
+
+    while (i < samples) {
+#ifdef __SSE2__
+        if (i + 4 <= samples && CLIP_SSE2_READY(i)) {
+            CLIP_BEGIN_SSE2(0)
+
+            for (; i + 4 <= samples; i += 4) {
+                CLIP_LOAD_SSE2(a, buffer + i, 0)
+                // 32-bit signed
+                _mm_storeu_si128((__m128i *) (p + i), _mm_slli_epi32(a, MIXING_ATTENUATION));
+            }
+            CLIP_END_SSE2(0)
+            continue;
+        }
+#endif
+        CLIP_SCALAR(n, i, 0)
+
+        // 32-bit signed
+        p[i] = (n << MIXING_ATTENUATION);
+        i++;
     }
 
     return samples * 4;
 }
-
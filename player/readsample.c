@@ -0,0 +1,232 @@
+/*
+ * Schism Tracker - a cross-platform Impulse Tracker clone
+ * copyright (c) 2003-2005 Storlek <storlek@rigelseven.com>
+ * copyright (c) 2005-2008 Mrs. Brisby <mrs.brisby@nimh.org>
+ * copyright (c) 2009 Storlek & Mrs. Brisby
+ * copyright (c) 2010-2012 Storlek
+ * URL: http://schismtracker.org/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "headers.h"
+
+#include <stdint.h>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+#include "sndfile.h"
+
+/* Conversion loops for csf_read_sample. With SSE2 these run sixteen bytes at a time (the delta decoders use
+a log-step prefix sum, carrying the last value over to the next block), and the scalar code finishes off
+whatever's left; either way the results are identical (tests/readsample-check makes sure of that). None of
+this is used on big-endian machines, where the byteswapping cases need the scalar versions anyway. */
+
+#if defined(__SSE2__) && !WORDS_BIGENDIAN
+# define READ_SAMPLE_SSE2 1
+
+// every lane of the result = the last 8-bit lane of v
+static inline __m128i mm_last_epi8(__m128i v)
+{
+	v = _mm_unpackhi_epi8(v, v);
+	v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm_unpackhi_epi64(v, v);
+}
+
+// every lane of the result = the last 16-bit lane of v
+static inline __m128i mm_last_epi16(__m128i v)
+{
+	v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm_unpackhi_epi64(v, v);
+}
+
+// running sum of v, plus the carry from the previous block
+static inline __m128i mm_prefix_epi8(__m128i v, __m128i carry)
+{
+	v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+	v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+	v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+	v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+	return _mm_add_epi8(v, carry);
+}
+
+static inline __m128i mm_prefix_epi16(__m128i v, __m128i carry)
+{
+	v = _mm_add_epi16(v, _mm_slli_si128(v, 2));
+	v = _mm_add_epi16(v, _mm_slli_si128(v, 4));
+	v = _mm_add_epi16(v, _mm_slli_si128(v, 8));
+	return _mm_add_epi16(v, carry);
+}
+#endif
+
+// dest[j] = src[j] ^ flip (flip is 0x80 for unsigned 8-bit data)
+void read_sample_xor8(int8_t *dest, const int8_t *src, uint32_t len, uint8_t flip)
+{
+	uint32_t j = 0;
+#ifdef READ_SAMPLE_SSE2
+	const __m128i f = _mm_set1_epi8(flip);
+	for (; j + 16 <= len; j += 16)
+		_mm_storeu_si128((__m128i *) (dest + j),
+			_mm_xor_si128(_mm_loadu_si128((const __m128i *) (src + j)), f));
+#endif
+	for (; j < len; j++)
+		dest[j] = src[j] ^ flip;
+}
+
+// same for little-endian 16-bit data (flip is 0x8000 for unsigned)
+void read_sample_xor16(int16_t *dest, const int16_t *src, uint32_t len, uint16_t flip)
+{
+	uint32_t j = 0;
+#ifdef READ_SAMPLE_SSE2
+	const __m128i f = _mm_set1_epi16(flip);
+	for (; j + 8 <= len; j += 8)
+		_mm_storeu_si128((__m128i *) (dest + j),
+			_mm_xor_si128(_mm_loadu_si128((const __m128i *) (src + j)), f));
+#endif
+	for (; j < len; j++)
+		dest[j] = bswapLE16(src[j]) ^ flip;
+}
+
+// 16-bit big-endian to native
+void read_sample_swap16(int16_t *dest, const int16_t *src, uint32_t len)
+{
+	uint32_t j = 0;
+#ifdef READ_SAMPLE_SSE2
+	for (; j + 8 <= len; j += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (src + j));
+		_mm_storeu_si128((__m128i *) (dest + j), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+	}
+#endif
+	for (; j < len; j++)
+		dest[j] = bswapBE16(src[j]);
+}
+
+// 8-bit delta values to PCM
+void read_sample_delta8(int8_t *dest, const int8_t *src, uint32_t len)
+{
+	uint32_t j = 0;
+	int8_t delta = 0;
+#ifdef READ_SAMPLE_SSE2
+	__m128i carry = _mm_setzero_si128();
+	for (; j + 16 <= len; j += 16) {
+		carry = mm_prefix_epi8(_mm_loadu_si128((const __m128i *) (src + j)), carry);
+		_mm_storeu_si128((__m128i *) (dest + j), carry);
+		carry = mm_last_epi8(carry);
+	}
+	if (j)
+		delta = dest[j - 1];
+#endif
+	for (; j < len; j++)
+		dest[j] = delta += src[j];
+}
+
+// 16-bit little-endian delta values to PCM
+void read_sample_delta16(int16_t *dest, const int16_t *src, uint32_t len)
+{
+	uint32_t j = 0;
+	int16_t delta = 0;
+#ifdef READ_SAMPLE_SSE2
+	__m128i carry = _mm_setzero_si128();
+	for (; j + 8 <= len; j += 8) {
+		carry = mm_prefix_epi16(_mm_loadu_si128((const __m128i *) (src + j)), carry);
+		_mm_storeu_si128((__m128i *) (dest + j), carry);
+		carry = mm_last_epi16(carry);
+	}
+	if (j)
+		delta = dest[j - 1];
+#endif
+	for (; j < len; j++)
+		dest[j] = delta += (int16_t) bswapLE16(src[j]);
+}
+
+// split stereo (all of the left channel, then all of the right) to interleaved,
+// flipping the sign bit with 'flip' or delta-decoding each channel if 'delta' is set
+void read_sample_split8(int8_t *dest, const int8_t *src, uint32_t len, uint8_t flip, int delta)
+{
+	uint32_t j = 0;
+	int8_t l = 0, r = 0;
+#ifdef READ_SAMPLE_SSE2
+	const __m128i f = _mm_set1_epi8(flip);
+	__m128i cl = _mm_setzero_si128(), cr = _mm_setzero_si128();
+	for (; j + 16 <= len; j += 16) {
+		__m128i vl = _mm_loadu_si128((const __m128i *) (src + j));
+		__m128i vr = _mm_loadu_si128((const __m128i *) (src + len + j));
+		if (delta) {
+			vl = cl = mm_prefix_epi8(vl, cl);
+			vr = cr = mm_prefix_epi8(vr, cr);
+			cl = mm_last_epi8(cl);
+			cr = mm_last_epi8(cr);
+		} else {
+			vl = _mm_xor_si128(vl, f);
+			vr = _mm_xor_si128(vr, f);
+		}
+		_mm_storeu_si128((__m128i *) (dest + 2 * j), _mm_unpacklo_epi8(vl, vr));
+		_mm_storeu_si128((__m128i *) (dest + 2 * j + 16), _mm_unpackhi_epi8(vl, vr));
+	}
+	if (j && delta) {
+		l = dest[2 * j - 2];
+		r = dest[2 * j - 1];
+	}
+#endif
+	for (; j < len; j++) {
+		if (delta) {
+			dest[2 * j] = l += src[j];
+			dest[2 * j + 1] = r += src[len + j];
+		} else {
+			dest[2 * j] = src[j] ^ flip;
+			dest[2 * j + 1] = src[len + j] ^ flip;
+		}
+	}
+}
+
+// same for 16-bit little-endian data
+void read_sample_split16(int16_t *dest, const int16_t *src, uint32_t len, uint16_t flip, int delta)
+{
+	uint32_t j = 0;
+	int16_t l = 0, r = 0;
+#ifdef READ_SAMPLE_SSE2
+	const __m128i f = _mm_set1_epi16(flip);
+	__m128i cl = _mm_setzero_si128(), cr = _mm_setzero_si128();
+	for (; j + 8 <= len; j += 8) {
+		__m128i vl = _mm_loadu_si128((const __m128i *) (src + j));
+		__m128i vr = _mm_loadu_si128((const __m128i *) (src + len + j));
+		if (delta) {
+			vl = cl = mm_prefix_epi16(vl, cl);
+			vr = cr = mm_prefix_epi16(vr, cr);
+			cl = mm_last_epi16(cl);
+			cr = mm_last_epi16(cr);
+		} else {
+			vl = _mm_xor_si128(vl, f);
+			vr = _mm_xor_si128(vr, f);
+		}
+		_mm_storeu_si128((__m128i *) (dest + 2 * j), _mm_unpacklo_epi16(vl, vr));
+		_mm_storeu_si128((__m128i *) (dest + 2 * j + 8), _mm_unpackhi_epi16(vl, vr));
+	}
+	if (j && delta) {
+		l = dest[2 * j - 2];
+		r = dest[2 * j - 1];
+	}
+#endif
+	for (; j < len; j++) {
+		if (delta) {
+			dest[2 * j] = l += (int16_t) bswapLE16(src[j]);
+			dest[2 * j + 1] = r += (int16_t) bswapLE16(src[len + j]);
+		} else {
+			dest[2 * j] = bswapLE16(src[j]) ^ flip;
+			dest[2 * j + 1] = bswapLE16(src[len + j]) ^ flip;
+		}
+	}
+}
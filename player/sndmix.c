@@ -44,7 +44,7 @@ unsigned int global_vu_right = 0;
 int32_t g_dry_rofs_vol = 0;
 int32_t g_dry_lofs_vol = 0;
 
-typedef uint32_t (* convert_t)(void *, int *, uint32_t, int *, int *);
+typedef uint32_t (* convert_t)(void *, int *, uint32_t, int *, int *, uint32_t *);
 
 
 // see also csf_midi_out_raw in effects.c
@@ -719,7 +719,7 @@ int csf_init_player(song_t *csf, int reset)
 		global_vu_right = 0;
 	}
 
-	initialize_eq(reset, csf->mix_frequency);
+	initialize_eq(csf, reset, csf->mix_frequency);
 
 	// retarded hackaround to get adlib to suck less
 	if (csf->mix_frequency != 4000)
@@ -749,6 +749,13 @@ unsigned int csf_read(song_t *csf, void * v_buffer, unsigned int bufsize)
 	else if (csf->mix_bits_per_sample == 24) { sample_size *= 3; convert_func = clip_32_to_24; }
 	else if (csf->mix_bits_per_sample == 32) { sample_size *= 4; convert_func = clip_32_to_32; }
 
+	if (csf->mix_flags & SNDMIX_DITHER) {
+		if (convert_func == clip_32_to_16)
+			convert_func = clip_32_to_16_dither;
+		else if (convert_func == clip_32_to_24)
+			convert_func = clip_32_to_24_dither;
+	}
+
 	max = bufsize / sample_size;
 
 	if (!max || !buffer) {
@@ -822,7 +829,7 @@ unsigned int csf_read(song_t *csf, void * v_buffer, unsigned int bufsize)
 			for (unsigned int n = 0; n < 64; n++) {
 				if (csf->multi_write[n].used) {
 					unsigned int bytes = convert_func(buffer, csf->multi_write[n].buffer,
-						smpcount, vu_min, vu_max);
+						smpcount, vu_min, vu_max, csf->dither_state);
 					csf->multi_write[n].write(csf->multi_write[n].data, buffer, bytes);
 				} else {
 					csf->multi_write[n].silence(csf->multi_write[n].data,
@@ -831,7 +838,8 @@ unsigned int csf_read(song_t *csf, void * v_buffer, unsigned int bufsize)
 			}
 		} else {
 			// Perform clipping + VU-Meter
-			buffer += convert_func(buffer, csf->mix_buffer, smpcount, vu_min, vu_max);
+			buffer += convert_func(buffer, csf->mix_buffer, smpcount, vu_min, vu_max,
+				csf->dither_state);
 		}
 
 		// Buffer ready
@@ -927,8 +935,9 @@ static int increment_order(song_t *csf)
 	}
 
 	if (!csf->pattern_size[csf->current_pattern] || !csf->patterns[csf->current_pattern]) {
-		/* okay, this is wrong. allocate the pattern _NOW_ */
-		csf->patterns[csf->current_pattern] = csf_allocate_pattern(64);
+		/* okay, this is wrong. play it as 64 empty rows, like csf_process_effects does (the editor
+		allocates it for real when it wants it -- the mixer stays out of the pattern allocator) */
+		csf->patterns[csf->current_pattern] = NULL;
 		csf->pattern_size[csf->current_pattern] = 64;
 		csf->pattern_alloc_size[csf->current_pattern] = 64;
 	}
@@ -985,7 +994,7 @@ int csf_process_tick(song_t *csf)
 
 		// Reset channel values
 		song_voice_t *chan = csf->voices;
-		song_note_t *m = csf->patterns[csf->current_pattern] + csf->row * MAX_CHANNELS;
+		const song_note_t *m = (csf->patterns[csf->current_pattern] ?: blank_pattern) + csf->row * MAX_CHANNELS;
 
 		for (unsigned int nchan=0; nchan<MAX_CHANNELS; chan++, nchan++, m++) {
 			// this is where we're going to spit out our midi
@@ -1018,7 +1027,7 @@ int csf_process_tick(song_t *csf)
 		/* [Update effects for each channel as required.] */
 
 		if (csf_midi_out_note) {
-			song_note_t *m = csf->patterns[csf->current_pattern] + csf->row * MAX_CHANNELS;
+			const song_note_t *m = (csf->patterns[csf->current_pattern] ?: blank_pattern) + csf->row * MAX_CHANNELS;
 
 			for (unsigned int nchan=0; nchan<MAX_CHANNELS; nchan++, m++) {
 				/* m==NULL allows schism to receive notification of SDx and Scx commands */
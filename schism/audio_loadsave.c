@@ -99,6 +99,9 @@ void song_new(int flags)
 {
 	int i;
 
+	// (a save that's still going would give its filename to the new song when it finished)
+	song_save_sync(1);
+
 	song_lock_audio();
 
 	song_stop_unlocked(0);
@@ -109,7 +112,7 @@ void song_new(int flags)
 
 		for (i = 0; i < MAX_PATTERNS; i++) {
 			if (current_song->patterns[i]) {
-				csf_free_pattern(current_song->patterns[i]);
+				csf_free_pattern(current_song, current_song->patterns[i]);
 				current_song->patterns[i] = NULL;
 			}
 			current_song->pattern_size[i] = 64;
@@ -172,6 +175,14 @@ static fmt_load_song_func load_song_funcs[] = {
 	NULL,
 };
 
+#define LOAD_SONG(x) { #x, 0, 0, 0 },
+static struct fmt_probe_stats load_song_stats[] = {
+#include "fmt-types.h"
+	{ NULL, 0, 0, 0 },
+};
+
+static void loader_stats_init(void);
+
 
 const char *fmt_strerror(int n)
 {
@@ -187,17 +198,26 @@ const char *fmt_strerror(int n)
 
 song_t *song_create_load(const char *file)
 {
-	fmt_load_song_func *func;
-	int ok = 0, err = 0;
-
-	slurp_t *s = slurp(file, NULL, 0);
+	slurp_t *s = slurp_windowed(file, NULL, 0);
 	if (!s)
 		return NULL;
 
+	song_t *newsong = song_create_load_ex(s, 0);
+	int err = errno;
+
+	unslurp(s);
+	errno = err;
+	return newsong;
+}
+
+/* a new song with the current song's mixer settings, for a loader to fill in */
+static song_t *song_prepare_load(void)
+{
 	song_t *newsong = csf_allocate();
 
 	if (current_song) {
 		newsong->mix_flags = current_song->mix_flags;
+		csf_copy_eq(newsong, current_song);
 		csf_set_wave_config(newsong,
 			current_song->mix_frequency,
 			current_song->mix_bits_per_sample,
@@ -209,10 +229,32 @@ song_t *song_create_load(const char *file)
 		csf_copy_midi_cfg(newsong, current_song);
 	}
 
-	for (func = load_song_funcs; *func && !ok; func++) {
+	return newsong;
+}
+
+/* this doesn't touch anything but 'newsong' and 's', so it's safe to run on another thread.
+returns zero and sets errno on failure (the song still has to be freed) */
+static void unpack_deferred_samples(song_t *song, slurp_t *fp);
+
+static int song_run_loaders(song_t *newsong, slurp_t *s, unsigned int lflags)
+{
+	fmt_load_song_func *func;
+	struct fmt_probe_stats *stats;
+	int ok = 0, err = 0;
+
+	for (func = load_song_funcs, stats = load_song_stats; *func && !ok; func++, stats++) {
+		/* (this goes every time, since a loader that didn't pan out might have read enough of the file
+		to get the start of it thrown out of the window) */
 		slurp_rewind(s);
-		switch ((*func)(newsong, s, 0)) {
+		slurp_peek(s, FMT_MAGIC_BYTES);
+		if (!fmt_magic_possible(stats->type, s->data, slurp_available(s))) {
+			fmt_probe_count(stats->skipped);
+			continue;
+		}
+		fmt_probe_count(stats->probes);
+		switch ((*func)(newsong, s, (lflags & LOAD_DEFERSAMPLES) ? lflags : (lflags | LOAD_DEFERCOMPRESSED))) {
 		case LOAD_SUCCESS:
+			fmt_probe_count(stats->hits);
 			err = 0;
 			ok = 1;
 			break;
@@ -227,52 +269,77 @@ song_t *song_create_load(const char *file)
 			break;
 		}
 		if (err) {
-			csf_free(newsong);
-			unslurp(s);
 			errno = err;
-			return NULL;
+			return 0;
 		}
 	}
 
-	unslurp(s);
-
 	if (err) {
 		// awwww, nerts!
-		csf_free(newsong);
 		errno = err;
-		return NULL;
+		return 0;
 	}
 
+	if (!(lflags & LOAD_DEFERSAMPLES))
+		unpack_deferred_samples(newsong, s);
 	newsong->stop_at_order = newsong->stop_at_row = -1;
+	csf_pool_samples(newsong);
 
-	return newsong;
+	return 1;
 }
 
-int song_load_unchecked(const char *file)
+song_t *song_create_load_ex(slurp_t *s, unsigned int lflags)
 {
-	const char *base = get_basename(file);
-	int was_playing;
 	song_t *newsong;
+	int err;
 
-	// IT stops the song even if the new song can't be loaded
-	if (status.flags & PLAY_AFTER_LOAD) {
-		was_playing = (song_get_mode() == MODE_PLAYING);
-	} else {
-		was_playing = 0;
-		song_stop();
+	loader_stats_init();
+
+	newsong = song_prepare_load();
+	if (!song_run_loaders(newsong, s, lflags)) {
+		err = errno;
+		csf_free(newsong);
+		errno = err;
+		return NULL;
 	}
+	return newsong;
+}
+
+static void song_load_start(const char *file)
+{
+	const char *base = get_basename(file);
+
+	// same as in song_new
+	song_save_sync(1);
 
 	log_nl();
 	log_nl();
 	log_appendf(2, "Loading %s", base);
 	log_underline(strlen(base) + 8);
+}
 
-	newsong = song_create_load(file);
+/* called right before the new song goes in (a background load leaves the old one playing until then);
+returns whether the song was playing */
+static int song_load_stop(void)
+{
+	// IT stops the song even if the new song can't be loaded
+	if (status.flags & PLAY_AFTER_LOAD)
+		return (song_get_mode() == MODE_PLAYING);
+	song_stop();
+	return 0;
+}
+
+/* newsong is NULL (with errno set) if the load failed */
+static int song_load_finish(const char *file, song_t *newsong, int was_playing)
+{
 	if (!newsong) {
 		log_appendf(4, " %s", fmt_strerror(errno));
 		return 0;
 	}
 
+	// (a background load has already done this, and then it doesn't do anything the second time)
+	if (audio_settings.compress_samples)
+		csf_compress_samples(newsong);
 
 	song_set_filename(file);
 
@@ -317,17 +384,197 @@ int song_load_unchecked(const char *file)
 	return 1;
 }
 
+int song_load_unchecked(const char *file)
+{
+	int was_playing;
+	song_t *newsong;
+
+	song_load_start(file);
+	was_playing = song_load_stop();
+	newsong = song_create_load(file);
+	return song_load_finish(file, newsong, was_playing);
+}
+
+// ------------------------------------------------------------------------------------------------------------
+// background loading
+
+static struct {
+	SDL_Thread *thread;
+	SDL_mutex *lock;
+	char *file;
+	song_t *song; /* NULL if the load failed */
+	int err;
+	int done, canceled;
+	size_t length; /* of the file, for the progress bar */
+} bgload;
+
+static struct widget bgload_widgets[1];
+
+static int bgload_thread(UNUSED void *data)
+{
+	slurp_t *s = slurp_windowed(bgload.file, NULL, 0);
+	song_t *newsong = bgload.song;
+	int err = 0;
+
+	if (!s) {
+		err = errno;
+	} else {
+		bgload.length = s->length;
+		if (!song_run_loaders(newsong, s, 0))
+			err = errno;
+		else if (audio_settings.compress_samples && !csf_read_sample_abort)
+			csf_compress_samples(newsong);
+		unslurp(s);
+	}
+
+	SDL_mutexP(bgload.lock);
+	bgload.err = err;
+	bgload.done = 1;
+	SDL_mutexV(bgload.lock);
+	return 0;
+}
+
+static void bgload_draw(void)
+{
+	char buf[32];
+	int pos = 0;
+
+	if (bgload.length)
+		pos = MIN((uint64_t) csf_read_sample_bytes * 64 / bgload.length, 64);
+	snprintf(buf, 32, "Loading song...%9u smp", csf_read_sample_count);
+	buf[31] = '\0';
+	draw_text(buf, 27, 27, 0, 2);
+	draw_fill_chars(24, 30, 55, 30, 0);
+	draw_vu_meter(24, 30, 32, pos, 4, 4);
+	draw_box(23, 29, 56, 31, BOX_THIN | BOX_INNER | BOX_INSET);
+}
+
+static void bgload_cancel(UNUSED void *ignored)
+{
+	/* the loader gives up at the next sample it reads (see csf_read_sample_abort), and whatever it
+	managed to load is thrown away. 'canceled' also keeps song_load_sync from destroying the dialog
+	a second time. */
+	SDL_mutexP(bgload.lock);
+	bgload.canceled = 1;
+	csf_read_sample_abort = 1;
+	SDL_mutexV(bgload.lock);
+}
+
+static void bgload_dialog_setup(void);
+
+// same key-up workaround as the disk writer dialog
+static void bgload_reset(UNUSED void *ignored)
+{
+	bgload_dialog_setup();
+}
+
+static void bgload_dialog_setup(void)
+{
+	struct dialog *d = dialog_create_custom(22, 25, 36, 8, bgload_widgets, 0, 0, bgload_draw, NULL);
+	d->action_yes = bgload_reset;
+	d->action_no = bgload_reset;
+	d->action_cancel = bgload_cancel;
+}
+
+int song_load_background(const char *file)
+{
+	if (status.flags & SONG_LOADING) {
+		log_appendf(4, "Already loading %s", get_basename(bgload.file));
+		return 0;
+	}
+	if (!bgload.lock)
+		bgload.lock = SDL_CreateMutex();
+
+	/* the current song keeps playing until the new one is ready to go in */
+	song_load_start(file);
+
+	loader_stats_init();
+	csf_read_sample_count = csf_read_sample_bytes = 0;
+	csf_read_sample_abort = 0;
+
+	bgload.file = str_dup(file);
+	bgload.song = song_prepare_load();
+	bgload.length = 0;
+	bgload.err = 0;
+	bgload.done = bgload.canceled = 0;
+	bgload.thread = bgload.lock ? SDL_CreateThread(bgload_thread, NULL) : NULL;
+	if (!bgload.thread) {
+		/* no threads? oh well, do it the slow way */
+		int ok, was_playing = song_load_stop();
+		song_t *newsong = song_create_load(file);
+
+		csf_free(bgload.song);
+		bgload.song = NULL;
+		ok = song_load_finish(file, newsong, was_playing);
+		free(bgload.file);
+		bgload.file = NULL;
+		set_page((ok && song_get_mode() == MODE_PLAYING) ? PAGE_INFO : PAGE_LOG);
+		return ok;
+	}
+
+	status.flags |= SONG_LOADING;
+	bgload_dialog_setup();
+	return 1;
+}
+
+int song_load_sync(void)
+{
+	int done, canceled, ok = 0;
+
+	if (!(status.flags & SONG_LOADING))
+		return 0;
+
+	log_flush();
+	status.flags |= NEED_UPDATE;
+
+	SDL_mutexP(bgload.lock);
+	done = bgload.done;
+	canceled = bgload.canceled;
+	SDL_mutexV(bgload.lock);
+	if (!done)
+		return 1;
+
+	SDL_WaitThread(bgload.thread, NULL);
+	bgload.thread = NULL;
+	status.flags &= ~SONG_LOADING;
+	csf_read_sample_abort = 0;
+	log_flush();
+
+	if (canceled) {
+		/* (and the old song just keeps going) */
+		csf_free(bgload.song);
+		log_appendf(4, " Canceled");
+	} else {
+		int was_playing = song_load_stop();
+
+		dialog_destroy();
+		if (bgload.err) {
+			csf_free(bgload.song);
+			errno = bgload.err;
+			ok = song_load_finish(bgload.file, NULL, was_playing);
+		} else {
+			ok = song_load_finish(bgload.file, bgload.song, was_playing);
+		}
+	}
+	bgload.song = NULL;
+	free(bgload.file);
+	bgload.file = NULL;
+
+	set_page((ok && song_get_mode() == MODE_PLAYING) ? PAGE_INFO : PAGE_LOG);
+	return 0;
+}
+
 // ------------------------------------------------------------------------------------------------------------
 
 static song_instrument_t blank_instrument; // should be zero, it's coming from bss
 
 // set iti_file if saving an instrument to disk by itself
-static void _save_it_instrument(int n, disko_t *fp, int iti_file)
+static void _save_it_instrument(song_t *song, int n, disko_t *fp, int iti_file)
 {
 	n++; // FIXME: this is dumb; really all the numbering should be one-based to make it simple
 
 	struct it_instrument iti;
-	song_instrument_t *i = current_song->instruments[n];
+	song_instrument_t *i = song->instruments[n];
 
 	if (!i)
 		i = &blank_instrument;
@@ -457,23 +704,22 @@ static void _save_it_instrument(int n, disko_t *fp, int iti_file)
 
 			iti_map[o] = qp;
 			qp += 80; /* header is 80 bytes */
-			save_its_header(fp, current_song->samples + o);
+			save_its_header(fp, song->samples + o,
+				its_sample_flags(song->samples + o, 0));
 		}
 		for (int j = 0; j < iti_nalloc; j++) {
 			unsigned int op, tmp;
 
 			int o = iti_invmap[ j ];
 
-			song_sample_t *smp = current_song->samples + o;
+			song_sample_t *smp = song->samples + o;
 
 			op = disko_tell(fp);
 			tmp = bswapLE32(op);
 			disko_seek(fp, iti_map[o]+0x48, SEEK_SET);
 			disko_write(fp, &tmp, 4);
 			disko_seek(fp, op, SEEK_SET);
-			csf_write_sample(fp, smp, SF_LE | SF_PCMS
-					| ((smp->flags & CHN_16BIT) ? SF_16 : SF_8)
-					| ((smp->flags & CHN_STEREO) ? SF_SS : SF_M));
+			csf_write_sample(fp, smp, its_sample_flags(smp, 0));
 		}
 	}
 }
@@ -589,18 +835,143 @@ static void _save_it_pattern(disko_t *fp, song_note_t *pat, int patsize)
 	disko_write(fp, data, pos);
 }
 
-// why on earth isn't this using the 'song' parameter? will finding this out hurt my head?
-static int _save_it(disko_t *fp, UNUSED song_t *song)
+/* Compressing samples is slow enough that it's worth spreading across a few threads. Everything is
+packed before the sample data gets written, and then written out in order from the main thread. Loading
+works the same way in reverse (see unpack_deferred_samples). */
+
+#define PACK_THREADS 4
+
+struct pack_job {
+	song_sample_t *smp; /* NULL if there's nothing to do for this one */
+	uint32_t flags;
+	uint8_t *data;
+	uint32_t length;
+};
+
+struct pack_work {
+	SDL_mutex *lock;
+	struct pack_job *jobs;
+	int num_jobs;
+	int next_job;
+	void (*run)(struct pack_job *job);
+};
+
+static int pack_thread(void *data)
+{
+	struct pack_work *work = data;
+	struct pack_job *job;
+
+	for (;;) {
+		SDL_mutexP(work->lock);
+		job = (work->next_job < work->num_jobs) ? work->jobs + work->next_job++ : NULL;
+		SDL_mutexV(work->lock);
+		if (!job)
+			return 0;
+		if (job->smp)
+			work->run(job);
+	}
+}
+
+/* the calling thread works on the jobs too, so this still gets everything done if threads can't be made.
+(and without a lock, it does them all by itself) */
+static void pack_run_jobs(struct pack_job *jobs, int num_jobs, void (*run)(struct pack_job *job))
+{
+	SDL_Thread *threads[PACK_THREADS - 1];
+	struct pack_work work;
+	int n, nthreads = 0;
+
+	work.lock = SDL_CreateMutex();
+	work.jobs = jobs;
+	work.num_jobs = num_jobs;
+	work.next_job = 0;
+	work.run = run;
+
+	if (!work.lock) {
+		for (n = 0; n < num_jobs; n++)
+			if (jobs[n].smp)
+				run(jobs + n);
+		return;
+	}
+	for (n = 0; n < PACK_THREADS - 1 && n < num_jobs - 1; n++) {
+		threads[nthreads] = SDL_CreateThread(pack_thread, &work);
+		if (threads[nthreads])
+			nthreads++;
+	}
+	pack_thread(&work);
+	for (n = 0; n < nthreads; n++)
+		SDL_WaitThread(threads[n], NULL);
+	SDL_DestroyMutex(work.lock);
+}
+
+static void pack_sample(struct pack_job *job)
+{
+	signed char *src;
+	int is16;
+
+	// (if this fails, it gets saved the slow way instead)
+	src = csf_sample_data_begin(job->smp);
+	if (!src)
+		return;
+	is16 = !!(job->smp->flags & CHN_16BIT);
+	job->data = mem_alloc(it_compress_bound(job->smp->length, is16));
+	job->length = (is16 ? it_compress16 : it_compress8)(job->data, src,
+		job->smp->length, (job->flags & SF_ENC_MASK) == SF_IT215);
+	csf_sample_data_end(job->smp, src);
+}
+
+static void pack_samples(struct pack_job *jobs, int num_jobs)
+{
+	pack_run_jobs(jobs, num_jobs, pack_sample);
+}
+
+static void unpack_sample(struct pack_job *job)
+{
+	csf_read_sample(job->smp, job->flags, job->data, job->length);
+}
+
+/* decodes the samples that a loader left for later with LOAD_DEFERCOMPRESSED, several at once */
+static void unpack_deferred_samples(song_t *song, slurp_t *fp)
+{
+	struct pack_job jobs[MAX_SAMPLES];
+	song_sample_t *smp;
+	int n;
+
+	memset(jobs, 0, sizeof(jobs));
+	for (n = 1; n < MAX_SAMPLES; n++) {
+		smp = song->samples + n;
+		if (!smp->deferred_flags)
+			continue;
+		jobs[n].flags = smp->deferred_flags;
+		jobs[n].data = fmt_copy_deferred_sample(smp, fp, &jobs[n].length);
+		if (jobs[n].data)
+			jobs[n].smp = smp;
+		smp->deferred_flags = 0;
+	}
+	pack_run_jobs(jobs, MAX_SAMPLES, unpack_sample);
+	for (n = 1; n < MAX_SAMPLES; n++) {
+		if (!jobs[n].flags)
+			continue;
+		free(jobs[n].data);
+		if (!song->samples[n].data)
+			song->samples[n].length = 0;
+	}
+}
+
+// compress is 0 for plain PCM, or SF_IT214/SF_IT215 (see its_sample_flags)
+static int _save_it_song(song_t *song, disko_t *fp, uint32_t compress)
 {
 	struct it_file hdr;
 	int n;
 	int nord, nins, nsmp, npat;
-	int msglen = strlen(current_song->message);
+	int msglen = strlen(song->message);
 	int warned_adlib = 0;
 	uint32_t para_ins[256], para_smp[256], para_pat[256];
+	struct pack_job jobs[256];
+	unsigned long packed_from = 0, packed_to = 0;
+	int npacked = 0;
 	// how much extra data is stuffed between the parapointers and the rest of the file
 	// (2 bytes for edit history length, and 8 per entry including the current session)
-	uint32_t extra = 2 + 8 * current_song->histlen + 8;
+	uint32_t extra = 2 + 8 * song->histlen + 8;
 
 	memset(&hdr, 0, sizeof(hdr));
 
@@ -611,20 +982,20 @@ static int _save_it(disko_t *fp, UNUSED song_t *song)
 	case where order 255 has data, writing an extra 0xFF at the end will result in a file that can't be
 	loaded back (for now). Eventually this can be fixed, but at least for a while it's probably a great
 	idea not to save things that other versions won't load. */
-	nord = csf_get_num_orders(current_song);
+	nord = csf_get_num_orders(song);
 	nord = CLAMP(nord + 1, 2, MAX_ORDERS);
 
-	nins = csf_get_num_instruments(current_song);
-	nsmp = csf_get_num_samples(current_song);
+	nins = csf_get_num_instruments(song);
+	nsmp = csf_get_num_samples(song);
 
 	// IT always saves at least one pattern.
-	npat = csf_get_num_patterns(current_song) ?: 1;
+	npat = csf_get_num_patterns(song) ?: 1;
 
 	hdr.id = bswapLE32(0x4D504D49); // IMPM
-	strncpy((char *) hdr.songname, current_song->title, 25);
+	strncpy((char *) hdr.songname, song->title, 25);
 	hdr.songname[25] = 0;
-	hdr.hilight_major = current_song->row_highlight_major;
-	hdr.hilight_minor = current_song->row_highlight_minor;
+	hdr.hilight_major = song->row_highlight_major;
+	hdr.hilight_minor = song->row_highlight_minor;
 	hdr.ordnum = bswapLE16(nord);
 	hdr.insnum = bswapLE16(nins);
 	hdr.smpnum = bswapLE16(nsmp);
@@ -642,27 +1013,29 @@ static int _save_it(disko_t *fp, UNUSED song_t *song)
 	//     instrument filters = 2.17
 	hdr.cmwt = bswapLE16(0x0214);   // compatible with IT 2.14
 	for (n = 1; n < nins; n++) {
-		song_instrument_t *i = current_song->instruments[n];
+		song_instrument_t *i = song->instruments[n];
 		if (!i) continue;
 		if (i->flags & ENV_FILTER) {
 			hdr.cmwt = bswapLE16(0x0217);
 			break;
 		}
 	}
+	if (compress == SF_IT215 && bswapLE16(hdr.cmwt) < 0x0215)
+		hdr.cmwt = bswapLE16(0x0215);
 
 	hdr.flags = 0;
 	hdr.special = 2 | 4;            // 2 = edit history, 4 = row highlight
 
-	if (song_is_stereo())               hdr.flags |= 1;
-	if (song_is_instrument_mode())      hdr.flags |= 4;
-	if (song_has_linear_pitch_slides()) hdr.flags |= 8;
-	if (song_has_old_effects())         hdr.flags |= 16;
-	if (song_has_compatible_gxx())      hdr.flags |= 32;
+	if (!(song->flags & SONG_NOSTEREO))      hdr.flags |= 1;
+	if (song->flags & SONG_INSTRUMENTMODE)  hdr.flags |= 4;
+	if (song->flags & SONG_LINEARSLIDES)    hdr.flags |= 8;
+	if (song->flags & SONG_ITOLDEFFECTS)    hdr.flags |= 16;
+	if (song->flags & SONG_COMPATGXX)       hdr.flags |= 32;
 	if (midi_flags & MIDI_PITCHBEND) {
 		hdr.flags |= 64;
 		hdr.pwd = midi_pitch_depth;
 	}
-	if (current_song->flags & SONG_EMBEDMIDICFG) {
+	if (song->flags & SONG_EMBEDMIDICFG) {
 		hdr.flags |= 128;
 		hdr.special |= 8;
 		extra += sizeof(midi_config_t);
@@ -675,11 +1048,11 @@ static int _save_it(disko_t *fp, UNUSED song_t *song)
 	hdr.special = bswapLE16(hdr.special);
 
 	// 16+ = reserved (always off?)
-	hdr.globalvol = current_song->initial_global_volume;
-	hdr.mv = current_song->mixing_volume;
-	hdr.speed = current_song->initial_speed;
-	hdr.tempo = current_song->initial_tempo;
-	hdr.sep = current_song->pan_separation;
+	hdr.globalvol = song->initial_global_volume;
+	hdr.mv = song->mixing_volume;
+	hdr.speed = song->initial_speed;
+	hdr.tempo = song->initial_tempo;
+	hdr.sep = song->pan_separation;
 	if (msglen) {
 		hdr.msgoffset = bswapLE32(extra + 0xc0 + nord + 4 * (nins + nsmp + npat));
 		hdr.msglength = bswapLE16(msglen);
@@ -687,15 +1060,15 @@ static int _save_it(disko_t *fp, UNUSED song_t *song)
 	// hdr.reserved2
 
 	for (n = 0; n < 64; n++) {
-		hdr.chnpan[n] = ((current_song->channels[n].flags & CHN_SURROUND)
-				 ? 100 : (current_song->channels[n].panning / 4));
-		hdr.chnvol[n] = current_song->channels[n].volume;
-		if (current_song->channels[n].flags & CHN_MUTE)
+		hdr.chnpan[n] = ((song->channels[n].flags & CHN_SURROUND)
+				 ? 100 : (song->channels[n].panning / 4));
+		hdr.chnvol[n] = song->channels[n].volume;
+		if (song->channels[n].flags & CHN_MUTE)
 			hdr.chnpan[n] += 128;
 	}
 
 	disko_write(fp, &hdr, sizeof(hdr));
-	disko_write(fp, current_song->orderlist, nord);
+	disko_write(fp, song->orderlist, nord);
 
 	// we'll get back to these later
 	disko_write(fp, para_ins, 4*nins);
@@ -708,17 +1081,17 @@ static int _save_it(disko_t *fp, UNUSED song_t *song)
 	struct tm loadtm;
 	uint16_t h;
 	//x86/x64 compatibility
-	time_t thetime = current_song->editstart.tv_sec;
+	time_t thetime = song->editstart.tv_sec;
 	localtime_r(&thetime, &loadtm);
 	gettimeofday(&savetime, NULL);
-	timersub(&savetime, &current_song->editstart, &elapsed);
+	timersub(&savetime, &song->editstart, &elapsed);
 
 	// item count
-	h = current_song->histlen + 1;
+	h = song->histlen + 1;
 	h = bswapLE16(h);
 	disko_write(fp, &h, 2);
 	// old data
-	disko_write(fp, current_song->histdata, 8 * current_song->histlen);
+	disko_write(fp, song->histdata, 8 * song->histlen);
 	// 16-bit date
 	h = loadtm.tm_mday | ((loadtm.tm_mon + 1) << 5) | ((loadtm.tm_year - 80) << 9);
 	h = bswapLE16(h);
@@ -735,37 +1108,49 @@ static int _save_it(disko_t *fp, UNUSED song_t *song)
 	// here comes MIDI configuration
 	// here comes MIDI configuration
 	// right down MIDI configuration lane
-	if (current_song->flags & SONG_EMBEDMIDICFG) {
-		disko_write(fp, &current_song->midi_config, sizeof(current_song->midi_config));
+	if (song->flags & SONG_EMBEDMIDICFG) {
+		disko_write(fp, &song->midi_config, sizeof(song->midi_config));
 	}
 
-	disko_write(fp, current_song->message, msglen);
+	disko_write(fp, song->message, msglen);
 
 	// instruments, samples, and patterns
 	for (n = 0; n < nins; n++) {
 		para_ins[n] = disko_tell(fp);
 		para_ins[n] = bswapLE32(para_ins[n]);
-		_save_it_instrument(n, fp, 0);
+		_save_it_instrument(song, n, fp, 0);
 	}
 	for (n = 0; n < nsmp; n++) {
 		// the sample parapointers are byte-swapped later
 		para_smp[n] = disko_tell(fp);
-		save_its_header(fp, current_song->samples + n + 1);
+		save_its_header(fp, song->samples + n + 1,
+			its_sample_flags(song->samples + n + 1, compress));
 	}
 	for (n = 0; n < npat; n++) {
-		if (csf_pattern_is_empty(current_song, n)) {
+		if (csf_pattern_is_empty(song, n)) {
 			para_pat[n] = 0;
 		} else {
 			para_pat[n] = disko_tell(fp);
 			para_pat[n] = bswapLE32(para_pat[n]);
-			_save_it_pattern(fp, current_song->patterns[n], current_song->pattern_size[n]);
+			_save_it_pattern(fp, song->patterns[n], song->pattern_size[n]);
 		}
 	}
 
 	// sample data
+	memset(jobs, 0, sizeof(jobs));
+	if (compress) {
+		for (n = 0; n < nsmp; n++) {
+			song_sample_t *smp = song->samples + (n + 1);
+
+			jobs[n].flags = its_sample_flags(smp, compress);
+			if ((jobs[n].flags & SF_ENC_MASK) == compress && smp->length <= MAX_SAMPLE_LENGTH)
+				jobs[n].smp = smp;
+		}
+		pack_samples(jobs, nsmp);
+	}
 	for (n = 0; n < nsmp; n++) {
 		unsigned int tmp, op;
-		song_sample_t *smp = current_song->samples + (n + 1);
+		song_sample_t *smp = song->samples + (n + 1);
 
 		// Always save the data pointer, even if there's not actually any data being pointed to
 		op = disko_tell(fp);
@@ -773,10 +1158,15 @@ static int _save_it(disko_t *fp, UNUSED song_t *song)
 		disko_seek(fp, para_smp[n]+0x48, SEEK_SET);
 		disko_write(fp, &tmp, 4);
 		disko_seek(fp, op, SEEK_SET);
-		if (smp->data)
-			csf_write_sample(fp, smp, SF_LE | SF_PCMS
-					| ((smp->flags & CHN_16BIT) ? SF_16 : SF_8)
-					| ((smp->flags & CHN_STEREO) ? SF_SS : SF_M));
+		if (jobs[n].data) {
+			disko_write(fp, jobs[n].data, jobs[n].length);
+			free(jobs[n].data);
+			packed_from += smp->length * ((smp->flags & CHN_16BIT) ? 2 : 1);
+			packed_to += jobs[n].length;
+			npacked++;
+		} else if (smp->data) {
+			csf_write_sample(fp, smp, its_sample_flags(smp, compress));
+		}
 		// done using the pointer internally, so *now* swap it
 		para_smp[n] = bswapLE32(para_smp[n]);
 
@@ -785,6 +1175,10 @@ static int _save_it(disko_t *fp, UNUSED song_t *song)
 			warned_adlib = 1;
 		}
 	}
+	if (npacked)
+		log_appendf(5, " Compressed %d sample%s: %lu bytes saved (%lu -> %lu)",
+			npacked, npacked == 1 ? "" : "s",
+			packed_from > packed_to ? packed_from - packed_to : 0, packed_from, packed_to);
 
 	// rewrite the parapointers
 	disko_seek(fp, 0xc0 + nord, SEEK_SET);
@@ -795,11 +1189,22 @@ static int _save_it(disko_t *fp, UNUSED song_t *song)
 	return SAVE_SUCCESS;
 }
 
+static int _save_it(disko_t *fp, song_t *song)
+{
+	return _save_it_song(song, fp, 0);
+}
+
+static int _save_it215(disko_t *fp, song_t *song)
+{
+	return _save_it_song(song, fp, SF_IT215);
+}
+
 /* ------------------------------------------------------------------------- */
 
 const struct save_format song_save_formats[] = {
 	{"IT", "Impulse Tracker", ".it", {.save_song = _save_it}},
 	{"S3M", "Scream Tracker 3", ".s3m", {.save_song = fmt_s3m_save_song}},
+	{"IT215", "Impulse Tracker 2.15 (compressed)", ".it", {.save_song = _save_it215}},
 	{.label = NULL}
 };
 
@@ -818,6 +1223,7 @@ const struct save_format song_export_formats[] = {
 
 const struct save_format sample_save_formats[] = {
 	{"ITS", "Impulse Tracker", ".its", {.save_sample = fmt_its_save_sample}},
+	{"ITSC", "Impulse Tracker 2.15 (compressed)", ".its", {.save_sample = fmt_its215_save_sample}},
 	//{"S3I", "Scream Tracker", ".s3i", {.save_sample = fmt_s3i_save_sample}},
 	{"AIFF", "Audio IFF", ".aiff", {.save_sample = fmt_aiff_save_sample}},
 	{"AU", "Sun/NeXT", ".au", {.save_sample = fmt_au_save_sample}},
@@ -906,9 +1312,148 @@ int song_export(const char *filename, const char *type)
 }
 
 
+// ------------------------------------------------------------------------------------------------------------
+// background saving
+
+static struct {
+	SDL_Thread *thread;
+	SDL_mutex *lock;
+	song_t *song; /* the snapshot that's being written */
+	const struct save_format *format;
+	char *file;
+	int backup;
+	int autosave; /* leave the filename and SONG_NEEDS_SAVE alone */
+	int ret, err;
+	int done;
+} bgsave;
+
+static int bgsave_thread(UNUSED void *data)
+{
+	disko_t *fp = disko_open(bgsave.file);
+	int ret, err;
+
+	if (!fp) {
+		ret = SAVE_FILE_ERROR;
+	} else {
+		ret = bgsave.format->f.save_song(fp, bgsave.song);
+		if (ret != SAVE_SUCCESS)
+			disko_seterror(fp, EINVAL);
+		if (disko_close(fp, bgsave.backup) == DW_ERROR && ret == SAVE_SUCCESS) {
+			// this was not as successful as originally claimed!
+			ret = SAVE_FILE_ERROR;
+		}
+	}
+	err = errno;
+
+	SDL_mutexP(bgsave.lock);
+	bgsave.ret = ret;
+	bgsave.err = err;
+	bgsave.done = 1;
+	SDL_mutexV(bgsave.lock);
+	return 0;
+}
+
+// 'async' is set if nobody's around anymore to complain about a failed save
+static int bgsave_finish(int async)
+{
+	int ret = bgsave.ret;
+
+	switch (ret) {
+	case SAVE_SUCCESS:
+		if (bgsave.autosave) {
+			log_appendf(5, " Autosaved to %s", bgsave.file);
+		} else {
+			if (strcasecmp(song_filename, bgsave.file))
+				song_set_filename(bgsave.file);
+			log_appendf(5, " Done");
+		}
+		break;
+	case SAVE_FILE_ERROR:
+		errno = bgsave.err;
+		log_perror(bgsave.file);
+		break;
+	case SAVE_INTERNAL_ERROR:
+	default: // ???
+		log_appendf(4, " Internal error saving song");
+		break;
+	}
+	if (ret != SAVE_SUCCESS && !bgsave.autosave) {
+		// whatever was in the snapshot still isn't saved anywhere
+		status.flags |= SONG_NEEDS_SAVE;
+		if (async)
+			dialog_create(DIALOG_OK, "Could not save file", NULL, NULL, 0, NULL);
+	}
+
+	csf_free(bgsave.song);
+	bgsave.song = NULL;
+	free(bgsave.file);
+	bgsave.file = NULL;
+	return ret;
+}
+
+int song_save_sync(int wait)
+{
+	int done;
+
+	if (!bgsave.thread)
+		return 0;
+
+	log_flush();
+	if (!wait) {
+		SDL_mutexP(bgsave.lock);
+		done = bgsave.done;
+		SDL_mutexV(bgsave.lock);
+		if (!done)
+			return 1;
+	}
+
+	SDL_WaitThread(bgsave.thread, NULL);
+	bgsave.thread = NULL;
+	log_flush();
+	bgsave_finish(1);
+	return 0;
+}
+
+static int song_save_start(const char *file, const struct save_format *format, int autosave)
+{
+	song_t *snap;
+
+	if (!bgsave.lock)
+		bgsave.lock = SDL_CreateMutex();
+
+	song_lock_audio();
+	snap = csf_snapshot(current_song);
+	song_unlock_audio();
+	if (!snap) {
+		log_perror(file);
+		return SAVE_FILE_ERROR;
+	}
+
+	bgsave.song = snap;
+	bgsave.format = format;
+	bgsave.file = str_dup(file);
+	bgsave.autosave = autosave;
+	bgsave.backup = (autosave || !(status.flags & MAKE_BACKUPS)) ? 0
+		      : (status.flags & NUMBERED_BACKUPS) ? 65536 : 1;
+	bgsave.ret = SAVE_INTERNAL_ERROR;
+	bgsave.err = 0;
+	bgsave.done = 0;
+	// anything that gets changed from here on isn't in the snapshot
+	if (!autosave)
+		status.flags &= ~SONG_NEEDS_SAVE;
+
+	bgsave.thread = bgsave.lock ? SDL_CreateThread(bgsave_thread, NULL) : NULL;
+	if (!bgsave.thread) {
+		/* no threads? oh well, do it the slow way */
+		bgsave_thread(NULL);
+		return bgsave_finish(0);
+	}
+	return SAVE_SUCCESS;
+}
+
 int song_save(const char *filename, const char *type)
 {
-	int ret, backup;
+	int ret;
 	const struct save_format *format = get_save_format(song_save_formats, type);
 	char *mangle;
 
@@ -917,6 +1462,9 @@ int song_save(const char *filename, const char *type)
 
 	mangle = mangle_filename(filename, NULL, format->ext);
 
+	// one at a time
+	song_save_sync(1);
+
 	log_nl();
 	log_nl();
 	log_appendf(2, "Saving %s module", format->name);
@@ -947,41 +1495,22 @@ saying "Could not save file". This can be seen rather easily by trying to save a
 such as "abc|def.it". This dialog is presented both when saving from F10 and Ctrl-S.
 */
 
-	disko_t *fp = disko_open(mangle);
-	if (!fp) {
-		log_perror(mangle);
-		free(mangle);
-		return SAVE_FILE_ERROR;
-	}
-
-	ret = format->f.save_song(fp, current_song);
-	if (ret != SAVE_SUCCESS)
-		disko_seterror(fp, EINVAL);
-	backup = ((status.flags & MAKE_BACKUPS)
-		  ? (status.flags & NUMBERED_BACKUPS)
-		  ? 65536 : 1 : 0);
-	if (disko_close(fp, backup) == DW_ERROR && ret == SAVE_SUCCESS) {
-		// this was not as successful as originally claimed!
-		ret = SAVE_FILE_ERROR;
-	}
+	ret = song_save_start(mangle, format, 0);
+	free(mangle);
+	return ret;
+}
 
-	switch (ret) {
-	case SAVE_SUCCESS:
-		status.flags &= ~SONG_NEEDS_SAVE;
-		if (strcasecmp(song_filename, mangle))
-			song_set_filename(mangle);
-		log_appendf(5, " Done");
-		break;
-	case SAVE_FILE_ERROR:
-		log_perror(mangle);
-		break;
-	case SAVE_INTERNAL_ERROR:
-	default: // ???
-		log_appendf(4, " Internal error saving song");
-		break;
-	}
+int song_autosave(void)
+{
+	char *file;
+	int ret;
 
-	free(mangle);
+	// if the last one's still going, this one can wait its turn
+	if (bgsave.thread)
+		return SAVE_SUCCESS;
+	file = dmoz_path_concat(cfg_dir_dotschism, "autosave.it");
+	ret = song_save_start(file, get_save_format(song_save_formats, "IT"), 1);
+	free(file);
 	return ret;
 }
 
@@ -1048,6 +1577,30 @@ static fmt_load_instrument_func load_instrument_funcs[] = {
 	NULL,
 };
 
+#define LOAD_SAMPLE(x) { #x, 0, 0, 0 },
+static struct fmt_probe_stats load_sample_stats[] = {
+#include "fmt-types.h"
+	{ NULL, 0, 0, 0 },
+};
+
+#define LOAD_INSTRUMENT(x) { #x, 0, 0, 0 },
+static struct fmt_probe_stats load_instrument_stats[] = {
+#include "fmt-types.h"
+	{ NULL, 0, 0, 0 },
+};
+
+static void loader_stats_init(void)
+{
+	static int done = 0;
+
+	if (done)
+		return;
+	done = 1;
+	fmt_probe_stats_register("load_song", load_song_stats);
+	fmt_probe_stats_register("load_sample", load_sample_stats);
+	fmt_probe_stats_register("load_instrument", load_instrument_stats);
+}
+
 
 void song_clear_sample(int n)
 {
@@ -1060,20 +1613,36 @@ void song_clear_sample(int n)
 	song_unlock_audio();
 }
 
-void song_copy_sample(int n, song_sample_t *src)
+// library songs are loaded with LOAD_DEFERSAMPLES, so their data is only decoded once it's needed
+static void read_deferred_sample(song_sample_t *smp, slurp_t *fp)
 {
-	memcpy(current_song->samples + n, src, sizeof(song_sample_t));
+	uint32_t flags = smp->deferred_flags;
+
+	if (!flags)
+		return;
+	smp->deferred_flags = 0;
+	if (fp && slurp_seek(fp, smp->deferred_offset, SEEK_SET) == 0)
+		fmt_read_sample(smp, flags, fp);
+	if (!smp->data)
+		smp->length = 0;
+	// if it's already in the song (or was previewed before), this is where the copy goes away
+	csf_pool_sample(NULL, smp);
+}
 
-	if (src->data) {
-		unsigned long bytelength = src->length;
-		if (src->flags & CHN_16BIT)
-			bytelength *= 2;
-		if (src->flags & CHN_STEREO)
-			bytelength *= 2;
+static slurp_t *library_file = NULL;
 
-		current_song->samples[n].data = csf_allocate_sample(bytelength);
-		memcpy(current_song->samples[n].data, src->data, bytelength);
-	}
+void song_copy_sample(int n, song_sample_t *src)
+{
+	if (src == current_song->samples + n)
+		return;
+	read_deferred_sample(src, library_file);
+
+	song_lock_audio();
+	csf_destroy_sample(current_song, n);
+	memcpy(current_song->samples + n, src, sizeof(song_sample_t));
+	// the data gets copied if and when either sample is edited
+	csf_share_sample(src->data);
+	song_unlock_audio();
 }
 
 int song_load_instrument_ex(int target, const char *file, const char *libf, int n)
@@ -1115,9 +1684,12 @@ int song_load_instrument_ex(int target, const char *file, const char *libf, int
 	}
 
 	if (libf) { /* file is ignored */
-		song_t *xl = song_create_load(libf);
+		s = slurp(libf, NULL, 0);
+		song_t *xl = s ? song_create_load_ex(s, LOAD_NOPATTERNS | LOAD_DEFERSAMPLES) : NULL;
 		if (!xl) {
 			log_appendf(4, "%s: %s", libf, fmt_strerror(errno));
+			if (s)
+				unslurp(s);
 			song_unlock_audio();
 			return 0;
 		}
@@ -1139,6 +1711,7 @@ int song_load_instrument_ex(int target, const char *file, const char *libf, int
 						}
 						xl->samples[x].name[25] = 0;
 
+						read_deferred_sample(&xl->samples[x], s);
 						song_copy_sample(k, &xl->samples[x]);
 						break;
 					}
@@ -1157,6 +1730,8 @@ int song_load_instrument_ex(int target, const char *file, const char *libf, int
 			];
 		}
 
+		csf_free(xl);
+		unslurp(s);
 		song_unlock_audio();
 		return 1;
 	}
@@ -1170,9 +1745,18 @@ int song_load_instrument_ex(int target, const char *file, const char *libf, int
 	}
 
 	r = 0;
+	loader_stats_init();
 	for (x = 0; load_instrument_funcs[x]; x++) {
+		if (!fmt_magic_possible(load_instrument_stats[x].type, s->data, s->length)) {
+			fmt_probe_count(load_instrument_stats[x].skipped);
+			continue;
+		}
+		fmt_probe_count(load_instrument_stats[x].probes);
 		r = load_instrument_funcs[x](s->data, s->length, target);
-		if (r) break;
+		if (r) {
+			fmt_probe_count(load_instrument_stats[x].hits);
+			break;
+		}
 	}
 
 	unslurp(s);
@@ -1194,6 +1778,8 @@ int song_preload_sample(dmoz_file_t *file)
 	if (file->sample) {
 		song_sample_t *smp = song_get_sample(FAKE_SLOT);
 
+		// decode before taking the lock, IT215 can take a while
+		read_deferred_sample(file->sample, library_file);
 		song_lock_audio();
 		csf_destroy_sample(current_song, FAKE_SLOT);
 		song_copy_sample(FAKE_SLOT, file->sample);
@@ -1212,6 +1798,7 @@ int song_preload_sample(dmoz_file_t *file)
 int song_load_sample(int n, const char *file)
 {
 	fmt_load_sample_func *load;
+	struct fmt_probe_stats *stats;
 	song_sample_t smp;
 
 	const char *base = get_basename(file);
@@ -1228,8 +1815,15 @@ int song_load_sample(int n, const char *file)
 	memset(&smp, 0, sizeof(smp));
 	strncpy(smp.name, base, 25);
 
-	for (load = load_sample_funcs; *load; load++) {
+	loader_stats_init();
+	for (load = load_sample_funcs, stats = load_sample_stats; *load; load++, stats++) {
+		if (!fmt_magic_possible(stats->type, s->data, s->length)) {
+			fmt_probe_count(stats->skipped);
+			continue;
+		}
+		fmt_probe_count(stats->probes);
 		if ((*load)(s->data, s->length, &smp)) {
+			fmt_probe_count(stats->hits);
 			break;
 		}
 	}
@@ -1241,6 +1835,8 @@ int song_load_sample(int n, const char *file)
 		return 0;
 	}
 
+	csf_pool_sample(NULL, &smp);
+
 	// this is after the loaders because i don't trust them, even though i wrote them ;)
 	strncpy(smp.filename, base, 12);
 	smp.filename[12] = 0;
@@ -1299,7 +1895,7 @@ int song_save_instrument(int n, const char *file)
 		log_perror(get_basename(file));
 		return 0;
 	}
-	_save_it_instrument(n-1 /* grr.... */, fp, 1);
+	_save_it_instrument(current_song, n-1 /* grr.... */, fp, 1);
 	if (disko_close(fp, 0) == DW_ERROR) {
 		log_perror(get_basename(file));
 		return 0;
@@ -1326,6 +1922,31 @@ const char *song_get_basename(void)
 // FIXME: unload the module when leaving the library 'directory'
 static song_t *library = NULL;
 
+// only the headers are parsed when browsing; the file is kept around for read_deferred_sample
+static int library_load(const char *path)
+{
+	csf_stop_sample(current_song, current_song->samples + 0);
+	csf_free(library);
+	library = NULL;
+	if (library_file) {
+		unslurp(library_file);
+		library_file = NULL;
+	}
+
+	library_file = slurp(path, NULL, 0);
+	if (!library_file)
+		return -1;
+	library = song_create_load_ex(library_file, LOAD_NOPATTERNS | LOAD_DEFERSAMPLES);
+	if (!library) {
+		int err = errno;
+		unslurp(library_file);
+		library_file = NULL;
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
 
 // TODO: stat the file?
 int dmoz_read_instrument_library(const char *path, dmoz_filelist_t *flist, UNUSED dmoz_dirlist_t *dlist)
@@ -1333,12 +1954,8 @@ int dmoz_read_instrument_library(const char *path, dmoz_filelist_t *flist, UNUSE
 	unsigned int j;
 	int x;
 
-	csf_stop_sample(current_song, current_song->samples + 0);
-	csf_free(library);
-
 	const char *base = get_basename(path);
-	library = song_create_load(path);
-	if (!library) {
+	if (library_load(path) < 0) {
 		log_appendf(4, "%s: %s", base, fmt_strerror(errno));
 		return -1;
 	}
@@ -1380,12 +1997,8 @@ int dmoz_read_instrument_library(const char *path, dmoz_filelist_t *flist, UNUSE
 
 int dmoz_read_sample_library(const char *path, dmoz_filelist_t *flist, UNUSED dmoz_dirlist_t *dlist)
 {
-	csf_stop_sample(current_song, current_song->samples + 0);
-	csf_free(library);
-
 	const char *base = get_basename(path);
-	library = song_create_load(path);
-	if (!library) {
+	if (library_load(path) < 0) {
 		/* FIXME: try loading as an instrument before giving up */
 		log_appendf(4, "%s: %s", base, fmt_strerror(errno));
 		errno = ENOTDIR;
@@ -946,7 +946,9 @@ void cfg_load_audio(cfg_file_t *cfg)
 	CFG_GET_M(channel_limit, DEF_CHANNEL_LIMIT);
 	CFG_GET_M(interpolation_mode, SRCMODE_LINEAR);
 	CFG_GET_M(no_ramping, 0);
+	CFG_GET_M(dither, 0);
 	CFG_GET_M(surround_effect, 1);
+	CFG_GET_M(compress_samples, 0);
 
 	if (audio_settings.channels != 1 && audio_settings.channels != 2)
 		audio_settings.channels = 2;
@@ -984,9 +986,11 @@ void cfg_atexit_save_audio(cfg_file_t *cfg)
 	CFG_SET_M(channel_limit);
 	CFG_SET_M(interpolation_mode);
 	CFG_SET_M(no_ramping);
+	CFG_SET_M(dither);
 
 	// Say, what happened to the switch for this in the gui?
 	CFG_SET_M(surround_effect);
+	CFG_SET_M(compress_samples);
 
 	// hmmm....
 	//     [Equalizer]
@@ -1443,7 +1447,9 @@ void song_init_eq(int do_reset)
 			* (current_song->mix_frequency / 128) / 1024);
 	}
 
-	set_eq_gains(pg, 4, pf, do_reset, current_song->mix_frequency);
+	song_lock_audio();
+	set_eq_gains(current_song, pg, 4, pf, do_reset, current_song->mix_frequency);
+	song_unlock_audio();
 }
 
 
@@ -1457,6 +1463,10 @@ void song_init_modplug(void)
 		current_song->mix_flags |= SNDMIX_NORAMPING;
 	else
 		current_song->mix_flags &= ~SNDMIX_NORAMPING;
+	if (audio_settings.dither)
+		current_song->mix_flags |= SNDMIX_DITHER;
+	else
+		current_song->mix_flags &= ~SNDMIX_DITHER;
 
 	// disable the S91 effect? (this doesn't make anything faster, it
 	// just sounds better with one woofer.)
@@ -1472,6 +1482,213 @@ void song_init_modplug(void)
 	song_unlock_audio();
 }
 
+/* --------------------------------------------------------------------------------------------------------- */
+/* Samples that are mapped from the file (see csf_read_sample) are only read from disk as they're played.
+To keep the mixer from waiting on the disk, this thread reads in about a second ahead of wherever each voice
+is, and keeps it locked in memory (if the system allows) until the voices have moved on. That's done a
+STREAM_WINDOW at a time, and each window holds a reference to its sample, so the sample can't be unmapped
+while it's locked. All of the reading and locking happens with the audio unlocked; under the lock, this only
+notes where the voices are and takes a reference to what they're playing. If the mixer gets to something that
+isn't in memory anyway, csf_cache_voice counts it, so the underrun count is of the times the mixer really did
+have to wait. Compressed samples (see csf_compress_sample) get the same treatment, except that the blocks are
+decoded here instead, with the audio unlocked, and copied in afterward. The thread doesn't touch the audio
+lock at all unless the mixer has been playing some data that's mapped or compressed, and it's stopped by
+song_shutdown. */
+
+#if HAVE_MMAP
+#define STREAM_AHEAD_MS 1000
+#define STREAM_INTERVAL_MS 50
+#define STREAM_DECODE_BLOCKS 16 // at most, per interval (see csf_cache_sample)
+#define STREAM_WINDOW (256 * 1024) // bytes (and they're aligned to this)
+#define STREAM_WINDOWS 1024 // locked at once, at most; past that, the rest only gets a hint
+
+static volatile int stream_quit = 0;
+static SDL_Thread *stream_thread = NULL;
+
+static struct stream_window {
+	signed char *data; // the sample it's in
+	const signed char *start;
+	size_t length;
+	int wanted;
+} stream_windows[STREAM_WINDOWS];
+static int stream_nwindows = 0;
+
+// make sure [start, start + length) is read in and locked; 'end' is the end of the sample's data
+static void stream_lock(signed char *data, const signed char *end, const signed char *start, size_t length)
+{
+	const signed char *p, *next, *wstart, *stop = start + length;
+	struct stream_window *w;
+	int n;
+
+	for (p = start; p < stop; p = next) {
+		next = (const signed char *) (((uintptr_t) p | (STREAM_WINDOW - 1)) + 1);
+		if (next > end)
+			next = end;
+		// (the windows always start on a boundary, or at the start of the sample)
+		wstart = MAX(data, (const signed char *) ((uintptr_t) p & ~(STREAM_WINDOW - 1)));
+		for (n = 0, w = stream_windows; n < stream_nwindows; n++, w++) {
+			if (w->start == wstart && w->length == (size_t) (next - wstart))
+				break;
+		}
+		if (n < stream_nwindows) {
+			w->wanted = 1;
+		} else if (stream_nwindows == STREAM_WINDOWS) {
+			slurp_prefetch(p, next - p);
+		} else if (slurp_lock(wstart, next - wstart) >= 0) {
+			// (if part of it is gone from the file, the mixer finds out for itself)
+			w->data = csf_share_sample(data);
+			w->start = wstart;
+			w->length = next - wstart;
+			w->wanted = 1;
+			stream_nwindows++;
+		}
+	}
+}
+
+// let go of the windows that weren't wanted this time around (or all of them)
+static void stream_unlock(int all)
+{
+	struct stream_window *w;
+	int n;
+
+	for (n = 0; n < stream_nwindows; n++) {
+		w = stream_windows + n;
+		if (w->wanted && !all) {
+			w->wanted = 0;
+			continue;
+		}
+		slurp_unlock(w->start, w->length);
+		csf_free_sample(w->data);
+		*w = stream_windows[--stream_nwindows];
+		n--;
+	}
+}
+
+static int stream_prefetch_thread(UNUSED void *data)
+{
+	struct {
+		signed char *data; // holds a reference
+		const signed char *end, *start;
+		size_t length;
+	} want[2 * MAX_VOICES];
+	static signed char scratch[STREAM_DECODE_BLOCKS][SAMPLE_CACHE_BLOCK_BYTES];
+	struct sample_cache_job jobs[STREAM_DECODE_BLOCKS];
+	song_voice_t *v;
+	int n, nwant, njobs;
+
+	for (n = 0; n < STREAM_DECODE_BLOCKS; n++)
+		jobs[n].buf = scratch[n];
+
+	while (!stream_quit) {
+		SDL_Delay(STREAM_INTERVAL_MS);
+		// (the mixer says when it's playing any of it; see csf_cache_voice)
+		if (!csf_streamed_samples || !__sync_lock_test_and_set(&csf_streamed_voices, 0)) {
+			// nothing's playing from the windows that are still locked
+			stream_unlock(1);
+			continue;
+		}
+
+		nwant = 0;
+		njobs = 0;
+		song_lock_audio();
+		for (n = 0, v = current_song->voices; n < MAX_VOICES; n++, v++) {
+			uint32_t bps, ahead, start, end, wrap = 0;
+			int packed;
+
+			if (!v->current_sample_data || !v->increment || v->position >= v->length)
+				continue;
+			packed = csf_sample_is_compressed(v->current_sample_data);
+			if (!packed && !csf_sample_is_mapped(v->current_sample_data))
+				continue;
+			bps = ((v->flags & CHN_16BIT) ? 2 : 1) * ((v->flags & CHN_STEREO) ? 2 : 1);
+			ahead = ((uint64_t) abs(v->increment) * current_song->mix_frequency
+				* STREAM_AHEAD_MS / 1000) >> 16;
+
+			if (v->increment > 0) {
+				start = v->position;
+				end = MIN((uint64_t) start + ahead, v->length);
+				if ((v->flags & (CHN_LOOP | CHN_PINGPONGLOOP)) == CHN_LOOP
+				    && (uint64_t) start + ahead > v->length) {
+					// it's going to wrap around to the loop start
+					wrap = MIN(start + ahead - v->length, v->length - v->loop_start);
+				}
+			} else {
+				// (pingpong loops going backward; forward again from the loop start is covered by this)
+				end = v->position + 1;
+				start = (v->position > v->loop_start + ahead) ? v->position - ahead : v->loop_start;
+			}
+
+			if (packed) {
+				// (if the mixer gets there first, it decodes the block itself and counts a miss)
+				csf_cache_sample(v->current_sample_data, start, end - start,
+					jobs, &njobs, STREAM_DECODE_BLOCKS);
+				if (wrap)
+					csf_cache_sample(v->current_sample_data, v->loop_start, wrap,
+						jobs, &njobs, STREAM_DECODE_BLOCKS);
+				continue;
+			}
+			if (wrap) {
+				want[nwant].data = csf_share_sample(v->current_sample_data);
+				want[nwant].end = v->current_sample_data + v->length * bps;
+				want[nwant].start = v->current_sample_data + v->loop_start * bps;
+				want[nwant].length = wrap * bps;
+				nwant++;
+			}
+			want[nwant].data = csf_share_sample(v->current_sample_data);
+			want[nwant].end = v->current_sample_data + v->length * bps;
+			want[nwant].start = v->current_sample_data + start * bps;
+			want[nwant].length = (end - start) * bps;
+			nwant++;
+		}
+		csf_trim_sample_cache(current_song);
+		song_unlock_audio();
+
+		if (njobs) {
+			// the jobs each hold a reference, so the packed data is still there
+			for (n = 0; n < njobs; n++)
+				csf_decode_cache_job(jobs + n);
+			song_lock_audio();
+			for (n = 0; n < njobs; n++)
+				csf_finish_cache_job(jobs + n);
+			song_unlock_audio();
+			for (n = 0; n < njobs; n++)
+				csf_release_cache_job(jobs + n);
+		}
+
+		// the voices could be anywhere by now, but the data is still there
+		for (n = 0; n < nwant; n++)
+			stream_lock(want[n].data, want[n].end, want[n].start, want[n].length);
+		stream_unlock(0);
+		for (n = 0; n < nwant; n++)
+			csf_free_sample(want[n].data);
+	}
+	stream_unlock(1);
+	return 0;
+}
+#endif
+
+unsigned int song_get_stream_underruns(void)
+{
+#if HAVE_MMAP
+	return csf_sample_cache_misses;
+#else
+	return 0;
+#endif
+}
+
+int song_stream_fault(void)
+{
+#if HAVE_MMAP
+	if (slurp_fault_flag) {
+		slurp_fault_flag = 0;
+		return 1;
+	}
+#endif
+	return 0;
+}
+
+/* --------------------------------------------------------------------------------------------------------- */
+
 void song_initialise(void)
 {
 	csf_midi_out_note = _schism_midi_out_note;
@@ -1486,5 +1703,22 @@ void song_initialise(void)
 
 	// hmm.
 	current_song->mix_flags |= SNDMIX_MUTECHNMODE;
+
+#if HAVE_MMAP
+	stream_thread = SDL_CreateThread(stream_prefetch_thread, NULL);
+	if (!stream_thread)
+		log_appendf(4, "Couldn't start sample prefetch thread: %s", SDL_GetError());
+#endif
+}
+
+void song_shutdown(void)
+{
+#if HAVE_MMAP
+	if (stream_thread) {
+		stream_quit = 1;
+		SDL_WaitThread(stream_thread, NULL);
+		stream_thread = NULL;
+	}
+#endif
 }
 
@@ -193,6 +193,7 @@ void cfg_load(void)
 		status.flags |= NUMBERED_BACKUPS;
 	else
 		status.flags &= ~NUMBERED_BACKUPS;
+	status.autosave_interval = MAX(0, cfg_get_number(&cfg, "General", "autosave_interval", 0));
 
 	i = cfg_get_number(&cfg, "General", "time_display", TIME_PLAY_ELAPSED);
 	/* default to play/elapsed for invalid values */
@@ -295,6 +296,7 @@ void cfg_atexit_save(void)
 	free(ptr);
 
 	cfg_atexit_save_audio(&cfg);
+	dmoz_infocache_save();
 
 	/* TODO: move these config options to video.c, this is lame :)
 	Or put everything here, which is what the note in audio_loadsave.cc
@@ -309,6 +311,7 @@ void cfg_atexit_save(void)
 	cfg_set_number(&cfg, "General", "classic_mode", !!(status.flags & CLASSIC_MODE));
 	cfg_set_number(&cfg, "General", "make_backups", !!(status.flags & MAKE_BACKUPS));
 	cfg_set_number(&cfg, "General", "numbered_backups", !!(status.flags & NUMBERED_BACKUPS));
+	cfg_set_number(&cfg, "General", "autosave_interval", status.autosave_interval);
 
 	cfg_set_number(&cfg, "General", "accidentals_as_flats", !!(status.flags & ACCIDENTALS_AS_FLATS));
 	cfg_set_number(&cfg, "General", "meta_is_ctrl", !!(status.flags & META_IS_CTRL));
@@ -380,6 +380,7 @@ static void _export_setup(song_t *dwsong, int *bps)
 	dwsong->flags &= ~(SONG_PAUSED | SONG_PATTERNLOOP | SONG_ENDREACHED);
 	dwsong->stop_at_order = -1;
 	dwsong->stop_at_row = -1;
+	csf_reset_dither(dwsong); /* same noise for every render of the same song */
 
 	*bps = dwsong->mix_channels * ((dwsong->mix_bits_per_sample + 7) / 8);
 
@@ -28,6 +28,7 @@
 #include "headers.h"
 
 #include "it.h"
+#include "sdlmain.h"
 #include "song.h"
 #include "dmoz.h"
 #include "slurp.h"
@@ -76,6 +77,11 @@ static const char *devices[] = {
 #define FILE_BLOCK_SIZE 256
 #define DIR_BLOCK_SIZE 32
 
+/* number of threads reading file info in the background, and how many files the worker goes through
+before squeezing the filtered-out ones out of the list */
+#define SCAN_THREADS 4
+#define FILTER_BATCH_SIZE 64
+
 /* --------------------------------------------------------------------------------------------------------- */
 /* file format tables */
 
@@ -86,6 +92,13 @@ static const fmt_read_info_func read_info_funcs[] = {
 	NULL /* This needs to be at the bottom of the list! */
 };
 
+#define READ_INFO(t) { #t, 0, 0, 0 },
+
+static struct fmt_probe_stats read_info_stats[] = {
+#include "fmt-types.h"
+	{ NULL, 0, 0, 0 }
+};
+
 /* --------------------------------------------------------------------------------------------------------- */
 /* sorting stuff */
 
@@ -225,6 +238,371 @@ void dmoz_cache_lookup(const char *path, dmoz_filelist_t *fl, dmoz_dirlist_t *dl
 	}
 }
 
+/* --------------------------------------------------------------------------------------------------------- */
+/* file info cache
+
+This remembers what file_info_get found out about every file, keyed by (path, size, mtime), and is kept in
+~/.schism/infocache between sessions so that directories don't have to be probed all over again. It's a
+flat native-endian file: a header followed by variable-length records, each one a fixed part and then the
+path, description, title, artist, and sample filename as NUL-terminated strings, padded out to 8 bytes.
+The file is mapped in (or read, where there's no mmap) when the config is loaded, and the entries point
+straight into it; it's only rewritten on exit if something changed, and entries that haven't been seen in a
+while are dropped then. Only the main thread touches any of this. */
+
+#define INFOCACHE_MAGIC "SCic"
+#define INFOCACHE_VERSION 1
+#define INFOCACHE_EXPIRE_DAYS 180
+
+struct infocache_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t num_entries;
+	uint32_t byte_order; /* 0x01020304, so that a cache from a different machine just gets ignored */
+};
+
+struct infocache_record {
+	uint64_t filesize;
+	int64_t timestamp;
+	uint32_t type;
+	uint32_t last_used; /* days since the epoch */
+	uint32_t smp_speed, smp_loop_start, smp_loop_end, smp_sustain_start, smp_sustain_end;
+	uint32_t smp_length, smp_flags, smp_defvol, smp_gblvol;
+	uint32_t smp_vibrato_speed, smp_vibrato_depth, smp_vibrato_rate;
+	uint16_t len[5]; /* string lengths, not including the NUL */
+	uint16_t reserved;
+};
+
+enum { IC_PATH, IC_DESCRIPTION, IC_TITLE, IC_ARTIST, IC_SMP_FILENAME };
+
+struct infocache_entry {
+	struct infocache_record rec;
+	const char *str[5];
+	uint32_t hash;
+	int owned; /* str[] was allocated, rather than pointing into the mapped file */
+};
+
+static struct {
+	slurp_t *map;
+	struct infocache_entry *entries;
+	int num_entries, alloc_entries;
+	int *table; /* open addressing, indices into entries; -1 = empty */
+	int table_size;
+	uint32_t today;
+	int dirty;
+} infocache;
+
+static uint32_t infocache_hash(const char *s)
+{
+	uint32_t h = 2166136261u;
+
+	while (*s)
+		h = (h ^ (unsigned char) *s++) * 16777619u;
+	return h;
+}
+
+static int *infocache_find_slot(const char *path, uint32_t hash)
+{
+	int n = hash & (infocache.table_size - 1);
+
+	while (infocache.table[n] >= 0) {
+		struct infocache_entry *e = infocache.entries + infocache.table[n];
+		if (e->hash == hash && strcmp(e->str[IC_PATH], path) == 0)
+			break;
+		n = (n + 1) & (infocache.table_size - 1);
+	}
+	return infocache.table + n;
+}
+
+static void infocache_rehash(void)
+{
+	int n;
+
+	free(infocache.table);
+	infocache.table_size = 256;
+	while (infocache.table_size < 2 * infocache.alloc_entries)
+		infocache.table_size <<= 1;
+	infocache.table = mem_alloc(infocache.table_size * sizeof(int));
+	memset(infocache.table, 0xff, infocache.table_size * sizeof(int));
+	for (n = 0; n < infocache.num_entries; n++) {
+		struct infocache_entry *e = infocache.entries + n;
+		if (e->str[IC_PATH])
+			*infocache_find_slot(e->str[IC_PATH], e->hash) = n;
+	}
+}
+
+/* entries that get replaced are left in the array with a NULL path (a file might still be using the
+description) and just aren't written out again */
+static struct infocache_entry *infocache_add(const struct infocache_record *rec, const char **str, int owned)
+{
+	struct infocache_entry *e;
+	int *slot;
+	uint32_t hash = infocache_hash(str[IC_PATH]);
+
+	if (infocache.num_entries >= infocache.alloc_entries) {
+		infocache.alloc_entries = infocache.alloc_entries ? 2 * infocache.alloc_entries : 256;
+		infocache.entries = mem_realloc(infocache.entries,
+			infocache.alloc_entries * sizeof(struct infocache_entry));
+		infocache_rehash();
+	}
+
+	slot = infocache_find_slot(str[IC_PATH], hash);
+	if (*slot >= 0) {
+		e = infocache.entries + *slot;
+		if (e->owned) {
+			free((char *) e->str[IC_PATH]);
+			free((char *) e->str[IC_TITLE]);
+			free((char *) e->str[IC_ARTIST]);
+			free((char *) e->str[IC_SMP_FILENAME]);
+		}
+		e->str[IC_PATH] = NULL;
+	}
+	*slot = infocache.num_entries;
+	e = infocache.entries + infocache.num_entries++;
+	e->rec = *rec;
+	memcpy(e->str, str, sizeof(e->str));
+	e->hash = hash;
+	e->owned = owned;
+	return e;
+}
+
+static void infocache_clear(void)
+{
+	int n;
+
+	for (n = 0; n < infocache.num_entries; n++) {
+		struct infocache_entry *e = infocache.entries + n;
+		if (e->owned && e->str[IC_PATH]) {
+			free((char *) e->str[IC_PATH]);
+			free((char *) e->str[IC_TITLE]);
+			free((char *) e->str[IC_ARTIST]);
+			free((char *) e->str[IC_SMP_FILENAME]);
+		}
+	}
+	free(infocache.entries);
+	free(infocache.table);
+	infocache.entries = NULL;
+	infocache.table = NULL;
+	infocache.num_entries = infocache.alloc_entries = infocache.table_size = 0;
+	if (infocache.map) {
+		unslurp(infocache.map);
+		infocache.map = NULL;
+	}
+}
+
+static void infocache_read(const char *filename)
+{
+	struct infocache_header hdr;
+	struct infocache_record rec;
+	const char *str[5];
+	size_t pos;
+	uint32_t n;
+	int s;
+
+	infocache.today = time(NULL) / 86400;
+	infocache.map = slurp(filename, NULL, 0);
+	if (!infocache.map)
+		return;
+	if (infocache.map->length < sizeof(hdr))
+		return;
+	memcpy(&hdr, infocache.map->data, sizeof(hdr));
+	if (memcmp(hdr.magic, INFOCACHE_MAGIC, 4) != 0 || hdr.version != INFOCACHE_VERSION
+	    || hdr.byte_order != 0x01020304)
+		return;
+
+	pos = sizeof(hdr);
+	for (n = 0; n < hdr.num_entries; n++) {
+		if (pos + sizeof(rec) > infocache.map->length)
+			break;
+		memcpy(&rec, infocache.map->data + pos, sizeof(rec));
+		pos += sizeof(rec);
+		for (s = 0; s < 5; s++) {
+			if (pos + rec.len[s] + 1 > infocache.map->length || infocache.map->data[pos + rec.len[s]])
+				break;
+			str[s] = (const char *) infocache.map->data + pos;
+			pos += rec.len[s] + 1;
+		}
+		if (s < 5)
+			break; /* truncated or garbage */
+		pos = (pos + 7) & ~7;
+		infocache_add(&rec, str, 0);
+	}
+}
+
+static int infocache_write(const char *filename)
+{
+	struct infocache_header hdr;
+	static const char zero[8];
+	FILE *fp;
+	int n, s;
+
+	fp = fopen(filename, "wb");
+	if (!fp)
+		return -1;
+
+	memcpy(hdr.magic, INFOCACHE_MAGIC, 4);
+	hdr.version = INFOCACHE_VERSION;
+	hdr.num_entries = 0;
+	hdr.byte_order = 0x01020304;
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+
+	for (n = 0; n < infocache.num_entries; n++) {
+		struct infocache_entry *e = infocache.entries + n;
+		size_t len = sizeof(e->rec);
+
+		if (!e->str[IC_PATH] || (int32_t) (infocache.today - e->rec.last_used) > INFOCACHE_EXPIRE_DAYS)
+			continue;
+		fwrite(&e->rec, sizeof(e->rec), 1, fp);
+		for (s = 0; s < 5; s++) {
+			fwrite(e->str[s], e->rec.len[s] + 1, 1, fp);
+			len += e->rec.len[s] + 1;
+		}
+		fwrite(zero, -len & 7, 1, fp);
+		hdr.num_entries++;
+	}
+
+	fseek(fp, 0, SEEK_SET);
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+	if (ferror(fp)) {
+		fclose(fp);
+		return -1;
+	}
+	return fclose(fp);
+}
+
+void dmoz_infocache_load(void)
+{
+	char *filename = dmoz_path_concat(cfg_dir_dotschism, "infocache");
+
+	infocache_clear();
+	infocache_read(filename);
+	infocache.dirty = 0;
+	free(filename);
+}
+
+void dmoz_infocache_save(void)
+{
+	char *filename, *tmp;
+
+	if (!infocache.dirty)
+		return;
+	filename = dmoz_path_concat(cfg_dir_dotschism, "infocache");
+	tmp = str_concat(filename, ".tmp", NULL);
+	if (infocache_write(tmp) == 0) {
+		/* the old file has to be let go of before it can be replaced (on some systems, anyway) */
+		infocache_clear();
+		if (rename_file(tmp, filename, 1) != 0)
+			unlink(tmp);
+		infocache_read(filename);
+		infocache.dirty = 0;
+	} else {
+		log_perror(tmp);
+		unlink(tmp);
+	}
+	free(tmp);
+	free(filename);
+}
+
+/* descriptions are shared and never freed, so they're kept around for as long as anything could use them */
+static const char *infocache_description(const char *descr)
+{
+	static const char **descrs = NULL;
+	static int num_descrs = 0;
+	int n;
+
+	for (n = 0; n < num_descrs; n++) {
+		if (strcmp(descrs[n], descr) == 0)
+			return descrs[n];
+	}
+	descrs = mem_realloc(descrs, (num_descrs + 1) * sizeof(char *));
+	return descrs[num_descrs++] = str_dup(descr);
+}
+
+/* fill in the ext data for a file that's in the cache; return 1 if it was there */
+static int infocache_lookup(dmoz_file_t *file)
+{
+	struct infocache_entry *e;
+	int *slot;
+
+	if (!infocache.table)
+		return 0;
+	slot = infocache_find_slot(file->path, infocache_hash(file->path));
+	if (*slot < 0)
+		return 0;
+	e = infocache.entries + *slot;
+	if (e->rec.filesize != file->filesize || e->rec.timestamp != file->timestamp)
+		return 0;
+
+	if (e->rec.last_used != infocache.today) {
+		e->rec.last_used = infocache.today;
+		infocache.dirty = 1;
+	}
+	file->type = e->rec.type;
+	file->description = infocache_description(e->str[IC_DESCRIPTION]);
+	file->title = str_dup(e->str[IC_TITLE]);
+	file->artist = e->rec.len[IC_ARTIST] ? str_dup(e->str[IC_ARTIST]) : NULL;
+	file->smp_filename = e->rec.len[IC_SMP_FILENAME] ? str_dup(e->str[IC_SMP_FILENAME]) : NULL;
+	file->smp_speed = e->rec.smp_speed;
+	file->smp_loop_start = e->rec.smp_loop_start;
+	file->smp_loop_end = e->rec.smp_loop_end;
+	file->smp_sustain_start = e->rec.smp_sustain_start;
+	file->smp_sustain_end = e->rec.smp_sustain_end;
+	file->smp_length = e->rec.smp_length;
+	file->smp_flags = e->rec.smp_flags;
+	file->smp_defvol = e->rec.smp_defvol;
+	file->smp_gblvol = e->rec.smp_gblvol;
+	file->smp_vibrato_speed = e->rec.smp_vibrato_speed;
+	file->smp_vibrato_depth = e->rec.smp_vibrato_depth;
+	file->smp_vibrato_rate = e->rec.smp_vibrato_rate;
+	return 1;
+}
+
+static char *infocache_strdup(const char *s, uint16_t *len)
+{
+	size_t n = s ? MIN(strlen(s), 65535) : 0;
+	char *r = mem_alloc(n + 1);
+
+	if (n)
+		memcpy(r, s, n);
+	r[n] = '\0';
+	*len = n;
+	return r;
+}
+
+static void infocache_store(dmoz_file_t *file)
+{
+	struct infocache_record rec;
+	const char *str[5];
+
+	memset(&rec, 0, sizeof(rec));
+	rec.filesize = file->filesize;
+	rec.timestamp = file->timestamp;
+	rec.type = file->type & ~TYPE_INTERNAL_FLAGS;
+	rec.last_used = infocache.today;
+	rec.smp_speed = file->smp_speed;
+	rec.smp_loop_start = file->smp_loop_start;
+	rec.smp_loop_end = file->smp_loop_end;
+	rec.smp_sustain_start = file->smp_sustain_start;
+	rec.smp_sustain_end = file->smp_sustain_end;
+	rec.smp_length = file->smp_length;
+	rec.smp_flags = file->smp_flags;
+	rec.smp_defvol = file->smp_defvol;
+	rec.smp_gblvol = file->smp_gblvol;
+	rec.smp_vibrato_speed = file->smp_vibrato_speed;
+	rec.smp_vibrato_depth = file->smp_vibrato_depth;
+	rec.smp_vibrato_rate = file->smp_vibrato_rate;
+
+	str[IC_PATH] = infocache_strdup(file->path, &rec.len[IC_PATH]);
+	/* descriptions are always static strings, so no need to copy them */
+	str[IC_DESCRIPTION] = file->description ? file->description : "";
+	rec.len[IC_DESCRIPTION] = MIN(strlen(str[IC_DESCRIPTION]), 65535);
+	str[IC_TITLE] = infocache_strdup(file->title, &rec.len[IC_TITLE]);
+	str[IC_ARTIST] = infocache_strdup(file->artist, &rec.len[IC_ARTIST]);
+	str[IC_SMP_FILENAME] = infocache_strdup(file->smp_filename, &rec.len[IC_SMP_FILENAME]);
+
+	infocache_add(&rec, str, 1);
+	infocache.dirty = 1;
+}
+
 /* --------------------------------------------------------------------------------------------------------- */
 /* path string hacking */
 
@@ -422,10 +800,27 @@ static void free_dir(dmoz_dir_t *dir)
 	free(dir);
 }
 
+static void scan_stop(void);
+static void scan_start(dmoz_filelist_t *flist, int first);
+static void scan_take(dmoz_file_t *file);
+
+static int current_dmoz_file = 0;
+static dmoz_filelist_t *current_dmoz_filelist = NULL;
+static int (*current_dmoz_filter)(dmoz_file_t *) = NULL;
+static int *current_dmoz_file_pointer = NULL;
+static void (*dmoz_worker_onmove)(void) = NULL;
+static int current_dmoz_hidden = 0;
+
 void dmoz_free(dmoz_filelist_t *flist, dmoz_dirlist_t *dlist)
 {
 	int n;
 
+	if (flist && flist == current_dmoz_filelist) {
+		scan_stop();
+		current_dmoz_filelist = NULL;
+		current_dmoz_filter = NULL;
+	}
+
 	if (flist) {
 		for (n = 0; n < flist->num_files; n++)
 			free_file(flist->files[n]);
@@ -445,19 +840,49 @@ void dmoz_free(dmoz_filelist_t *flist, dmoz_dirlist_t *dlist)
 	}
 }
 
-static int current_dmoz_file = 0;
-static dmoz_filelist_t *current_dmoz_filelist = NULL;
-static int (*current_dmoz_filter)(dmoz_file_t *) = NULL;
-static int *current_dmoz_file_pointer = NULL;
-static void (*dmoz_worker_onmove)(void) = NULL;
+/* squeeze out everything the filter rejected, and keep the cursor on the same file */
+static void dmoz_worker_compact(void)
+{
+	dmoz_filelist_t *flist = current_dmoz_filelist;
+	int n, removed = 0, pointer_removed = 0;
+
+	for (n = 0; n < flist->num_files; n++) {
+		dmoz_file_t *file = flist->files[n];
+
+		if (file->type & TYPE_HIDDEN) {
+			if (current_dmoz_file_pointer && *current_dmoz_file_pointer >= n)
+				pointer_removed++;
+			free_file(file);
+			removed++;
+		} else {
+			flist->files[n - removed] = file;
+		}
+	}
+	flist->num_files -= removed;
+	current_dmoz_file -= current_dmoz_hidden;
+	current_dmoz_hidden = 0;
+
+	if (current_dmoz_file_pointer) {
+		*current_dmoz_file_pointer -= pointer_removed;
+		if (*current_dmoz_file_pointer >= flist->num_files)
+			*current_dmoz_file_pointer = flist->num_files - 1;
+	}
+	if (dmoz_worker_onmove)
+		dmoz_worker_onmove();
+	status.flags |= NEED_UPDATE;
+}
 
 int dmoz_worker(void)
 {
-	dmoz_file_t *nf;
+	dmoz_file_t *file;
+	int had_ext_data;
 
 	if (!current_dmoz_filelist || !current_dmoz_filter)
 		return 0;
 	if (current_dmoz_file >= current_dmoz_filelist->num_files) {
+		scan_stop();
+		if (current_dmoz_hidden)
+			dmoz_worker_compact();
 		current_dmoz_filelist = NULL;
 		current_dmoz_filter = NULL;
 		if (dmoz_worker_onmove)
@@ -465,55 +890,48 @@ int dmoz_worker(void)
 		return 0;
 	}
 
-	if (!current_dmoz_filter(current_dmoz_filelist->files[ current_dmoz_file ])) {
-		if (current_dmoz_filelist->num_files == current_dmoz_file+1) {
-			current_dmoz_filelist->num_files--;
-			current_dmoz_filelist = NULL;
-			current_dmoz_filter = NULL;
-			if (dmoz_worker_onmove)
-				dmoz_worker_onmove();
-			return 0;
-		}
+	file = current_dmoz_filelist->files[current_dmoz_file];
+	scan_take(file);
+	had_ext_data = file->type & TYPE_EXT_DATA_MASK;
 
-		nf = current_dmoz_filelist->files[ current_dmoz_file ];
-		memmove(&current_dmoz_filelist->files[ current_dmoz_file ],
-			&current_dmoz_filelist->files[ current_dmoz_file+1 ],
-			sizeof(dmoz_file_t *) * (current_dmoz_filelist->num_files
-						- current_dmoz_file));
-		free_file(nf);
-		current_dmoz_filelist->num_files--;
-		if (current_dmoz_file_pointer && *current_dmoz_file_pointer >=
-					current_dmoz_file) {
-			(*current_dmoz_file_pointer) = (*current_dmoz_file_pointer) - 1;
-			if (dmoz_worker_onmove) dmoz_worker_onmove();
-		}
-		if (current_dmoz_file_pointer && *current_dmoz_file_pointer >=
-					current_dmoz_filelist->num_files) {
-			(*current_dmoz_file_pointer) = (current_dmoz_filelist->num_files-1);
-			if (dmoz_worker_onmove) dmoz_worker_onmove();
-		}
-		status.flags |= NEED_UPDATE;
-	} else {
-		current_dmoz_file++;
+	if (!current_dmoz_filter(file)) {
+		file->type |= TYPE_HIDDEN;
+		current_dmoz_hidden++;
 	}
+	current_dmoz_file++;
+
+	/* if the filter just had to look inside the file, it'll want to look at the rest of them too, so get
+	the scan threads started on them */
+	if (!had_ext_data && (file->type & TYPE_EXT_DATA_MASK))
+		scan_start(current_dmoz_filelist, current_dmoz_file);
+
+	if (current_dmoz_hidden && (current_dmoz_file % FILTER_BATCH_SIZE) == 0)
+		dmoz_worker_compact();
 	return 1;
 }
 
+void dmoz_worker_pause(void)
+{
+	if (current_dmoz_filelist && current_dmoz_hidden)
+		dmoz_worker_compact();
+}
+
 
 /* filters a filelist and removes rejected entries. this works in-place
 so it can't generate error conditions. */
 void dmoz_filter_filelist(dmoz_filelist_t *flist, int (*grep)(dmoz_file_t *f), int *pointer, void (*fn)(void))
 {
+	scan_stop();
 	current_dmoz_filelist = flist;
 	current_dmoz_filter = grep;
 	current_dmoz_file = 0;
 	current_dmoz_file_pointer = pointer;
+	current_dmoz_hidden = 0;
 	dmoz_worker_onmove = fn;
 }
 
 /* TODO:
 - create a one-shot filter that runs all its files at once
-- make these filters not actually drop the files from the list, but instead set the hidden flag
 - add a 'num_unfiltered' variable to the struct that indicates the total number
 */
 
@@ -549,6 +967,9 @@ dmoz_file_t *dmoz_add_file(dmoz_filelist_t *flist, char *path, char *base, struc
 		file->filesize = 0;
 	}
 
+	if (file->type == TYPE_FILE_MASK)
+		infocache_lookup(file);
+
 	if (flist->num_files >= flist->alloc_size)
 		allocate_more_files(flist);
 	flist->files[flist->num_files++] = file;
@@ -644,6 +1065,9 @@ void cfg_load_dmoz(cfg_file_t *cfg)
 	const char *ptr;
 	int i;
 
+	dmoz_infocache_load();
+	fmt_probe_stats_register("read_info", read_info_stats);
+
 	ptr = cfg_get_string(cfg, "Directories", "sort_with", NULL, 0, NULL);
 	if (ptr) {
 		for (i = 0; compare_funcs[i].name; i++) {
@@ -856,10 +1280,12 @@ enum {
 	FINF_ERRNO = (-1),      /* check errno */
 };
 
+/* this is called from the scan threads as well, so all the read_info functions have to be thread-safe */
 static int file_info_get(dmoz_file_t *file)
 {
 	slurp_t *t;
 	const fmt_read_info_func *func;
+	struct fmt_probe_stats *stats;
 
 	if (file->filesize == 0)
 		return FINF_EMPTY;
@@ -870,8 +1296,14 @@ static int file_info_get(dmoz_file_t *file)
 	file->title = NULL;
 	file->smp_defvol = 64;
 	file->smp_gblvol = 64;
-	for (func = read_info_funcs; *func; func++) {
+	for (func = read_info_funcs, stats = read_info_stats; *func; func++, stats++) {
+		if (!fmt_magic_possible(stats->type, t->data, t->length)) {
+			fmt_probe_count(stats->skipped);
+			continue;
+		}
+		fmt_probe_count(stats->probes);
 		if ((*func) (file, t->data, t->length)) {
+			fmt_probe_count(stats->hits);
 			if (file->artist)
 				trim_string(file->artist);
 			if (file->title == NULL)
@@ -884,17 +1316,8 @@ static int file_info_get(dmoz_file_t *file)
 	return file->title ? FINF_SUCCESS : FINF_UNSUPPORTED;
 }
 
-/* return: 1 on success, 0 on error. in either case, it fills the data in with *something*. */
-int dmoz_filter_ext_data(dmoz_file_t *file)
+static int file_info_apply(dmoz_file_t *file, int ret)
 {
-	int ret;
-
-	if ((file->type & TYPE_EXT_DATA_MASK)
-	|| (file->type == TYPE_DIRECTORY)) {
-		/* nothing to do */
-		return 1;
-	}
-	ret = file_info_get(file);
 	switch (ret) {
 	case FINF_SUCCESS:
 		return 1;
@@ -921,6 +1344,23 @@ int dmoz_filter_ext_data(dmoz_file_t *file)
 	return 0;
 }
 
+/* return: 1 on success, 0 on error. in either case, it fills the data in with *something*. */
+int dmoz_filter_ext_data(dmoz_file_t *file)
+{
+	int ret, ok;
+
+	if ((file->type & TYPE_EXT_DATA_MASK)
+	|| (file->type == TYPE_DIRECTORY)) {
+		/* nothing to do */
+		return 1;
+	}
+	ret = file_info_get(file);
+	ok = file_info_apply(file, ret);
+	if (ret != FINF_ERRNO)
+		infocache_store(file);
+	return ok;
+}
+
 /* same as dmoz_filter_ext_data, except without the filtering effect when used with dmoz_filter_filelist */
 int dmoz_fill_ext_data(dmoz_file_t *file)
 {
@@ -928,3 +1368,167 @@ int dmoz_fill_ext_data(dmoz_file_t *file)
 	return 1;
 }
 
+
+/* --------------------------------------------------------------------------------------------------------- */
+/* background file info scanning
+
+While a filter is going through a list, these threads run ahead of it and read the file info into a
+private copy of each file. The worker picks the results up in order and copies them into the list, so the
+list itself is only ever touched from the main thread. */
+
+enum {
+	SCAN_PENDING,   /* nobody's looked at it yet */
+	SCAN_WORKING,   /* a thread is reading it */
+	SCAN_DONE,      /* result is ready to be picked up */
+	SCAN_TAKEN,     /* the worker has gotten to it (or it didn't need checking) */
+};
+
+struct scan_job {
+	dmoz_file_t *file;
+	dmoz_file_t result;
+	int state;
+	int ret, err;
+};
+
+static struct {
+	SDL_mutex *lock;
+	SDL_cond *done;
+	SDL_Thread *threads[SCAN_THREADS];
+	struct scan_job *jobs;
+	int num_jobs;
+	int next_job; /* next one for a thread to grab */
+	int cursor; /* next one for the worker to pick up */
+	int cancel;
+} scan;
+
+static int scan_thread(UNUSED void *data)
+{
+	struct scan_job *job;
+
+	SDL_mutexP(scan.lock);
+	while (!scan.cancel && scan.next_job < scan.num_jobs) {
+		job = scan.jobs + scan.next_job++;
+		if (job->state != SCAN_PENDING)
+			continue;
+		job->state = SCAN_WORKING;
+		memset(&job->result, 0, sizeof(job->result));
+		job->result.path = job->file->path;
+		job->result.base = job->file->base;
+		job->result.filesize = job->file->filesize;
+		SDL_mutexV(scan.lock);
+
+		job->ret = file_info_get(&job->result);
+		job->err = errno;
+
+		SDL_mutexP(scan.lock);
+		job->state = SCAN_DONE;
+		SDL_CondBroadcast(scan.done);
+	}
+	SDL_mutexV(scan.lock);
+	return 0;
+}
+
+static void scan_free_result(dmoz_file_t *result)
+{
+	if (result->smp_filename != result->base && result->smp_filename != result->title)
+		free(result->smp_filename);
+	free(result->artist);
+	free(result->title);
+}
+
+static void scan_start(dmoz_filelist_t *flist, int first)
+{
+	int n, threads;
+
+	if (scan.jobs || flist->num_files - first < 2)
+		return;
+	if (!scan.lock) {
+		scan.lock = SDL_CreateMutex();
+		scan.done = SDL_CreateCond();
+		if (!scan.lock || !scan.done)
+			return;
+	}
+
+	scan.num_jobs = flist->num_files - first;
+	scan.jobs = mem_alloc(scan.num_jobs * sizeof(struct scan_job));
+	for (n = 0; n < scan.num_jobs; n++) {
+		dmoz_file_t *file = flist->files[first + n];
+
+		scan.jobs[n].file = file;
+		scan.jobs[n].state = ((file->type & TYPE_EXT_DATA_MASK) || file->type == TYPE_DIRECTORY)
+			? SCAN_TAKEN : SCAN_PENDING;
+	}
+	scan.next_job = scan.cursor = 0;
+	scan.cancel = 0;
+
+	threads = MIN(SCAN_THREADS, scan.num_jobs);
+	for (n = 0; n < threads; n++)
+		scan.threads[n] = SDL_CreateThread(scan_thread, NULL);
+}
+
+static void scan_stop(void)
+{
+	int n;
+
+	if (!scan.jobs)
+		return;
+
+	SDL_mutexP(scan.lock);
+	scan.cancel = 1;
+	SDL_mutexV(scan.lock);
+	for (n = 0; n < SCAN_THREADS; n++) {
+		if (scan.threads[n]) {
+			SDL_WaitThread(scan.threads[n], NULL);
+			scan.threads[n] = NULL;
+		}
+	}
+
+	for (n = scan.cursor; n < scan.num_jobs; n++) {
+		if (scan.jobs[n].state == SCAN_DONE)
+			scan_free_result(&scan.jobs[n].result);
+	}
+	free(scan.jobs);
+	scan.jobs = NULL;
+	scan.num_jobs = 0;
+}
+
+/* called by the worker right before it filters a file, so it gets the data the threads read for it */
+static void scan_take(dmoz_file_t *file)
+{
+	struct scan_job *job;
+	dmoz_file_t *result;
+
+	if (!scan.jobs || scan.cursor >= scan.num_jobs)
+		return;
+	job = scan.jobs + scan.cursor++;
+	if (job->file != file)
+		return; /* shouldn't happen */
+
+	SDL_mutexP(scan.lock);
+	while (job->state == SCAN_WORKING)
+		SDL_CondWait(scan.done, scan.lock);
+	if (job->state == SCAN_PENDING)
+		job->state = SCAN_TAKEN; /* the filter can read it itself */
+	SDL_mutexV(scan.lock);
+
+	if (job->state != SCAN_DONE)
+		return;
+	job->state = SCAN_TAKEN;
+	result = &job->result;
+	if (file->type & TYPE_EXT_DATA_MASK) {
+		/* someone beat us to it */
+		scan_free_result(result);
+		return;
+	}
+
+	result->sort_order = file->sort_order;
+	result->timestamp = file->timestamp;
+	result->sample = file->sample;
+	result->sampsize = file->sampsize;
+	result->instnum = file->instnum;
+	*file = *result;
+	errno = job->err;
+	file_info_apply(file, job->ret);
+	if (job->ret != FINF_ERRNO)
+		infocache_store(file);
+}
@@ -70,7 +70,7 @@ unsigned int memused_history(void)
 	if (_cache_ok & 4) return h_cached;
 	_cache_ok |= 4;
 	memused_get_pattern_saved(NULL, &q);
-	return h_cached = (q * 256);
+	return h_cached = q;
 }
 unsigned int memused_samples(void)
 {
@@ -91,6 +91,17 @@ unsigned int memused_samples(void)
 	}
 	return s_cache = q;
 }
+/* for compressed samples: how big the compressed data is, and how much of it is decoded at the moment.
+returns zero if there aren't any, which is usually the case. (this changes as the song plays, so it's not cached) */
+int memused_samples_packed(unsigned int *packed, unsigned int *cached)
+{
+	uint32_t p, c;
+
+	csf_sample_cache_stats(current_song, &p, &c);
+	*packed = p;
+	*cached = c;
+	return p != 0;
+}
 unsigned int memused_instruments(void)
 {
 	static unsigned int i_cache;
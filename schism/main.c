@@ -477,7 +477,7 @@ static void check_update(void)
 			if (SDL_GetTicks() < next)
 				return;
 			next = SDL_GetTicks() + 500;
-		} else if (status.flags & (DISKWRITER_ACTIVE | DISKWRITER_ACTIVE_PATTERN)) {
+		} else if (status.flags & (DISKWRITER_ACTIVE | DISKWRITER_ACTIVE_PATTERN | SONG_LOADING)) {
 			if (SDL_GetTicks() < next)
 				return;
 			next = SDL_GetTicks() + 100;
@@ -543,11 +543,13 @@ static void event_loop(void)
 	SDLKey last_key = 0;
 	int modkey;
 	time_t startdown;
+	time_t last_autosave;
 #ifdef USE_X11
 	time_t last_ss;
 #endif
 	int downtrip;
 	int sawrep;
+	unsigned int underruns = 0;
 	char *debug_s;
 	int fix_numlock_key;
 
@@ -571,6 +573,7 @@ static void event_loop(void)
 #endif
 	time(&status.now);
 	localtime_r(&status.now, &status.tmnow);
+	last_autosave = status.now;
 	while (SDL_WaitEvent(&event)) {
 		struct key_event kk = {
 			.midi_volume = -1,
@@ -926,6 +929,8 @@ Also why these would not be defined, I'm not sure either, but hey. */
 				status.flags &= ~(CLIPPY_PASTE_BUFFER|CLIPPY_PASTE_SELECTION);
 			}
 
+			// pick up anything other threads have logged
+			log_flush();
 			check_update();
 
 			switch (song_get_mode()) {
@@ -942,6 +947,30 @@ Also why these would not be defined, I'm not sure either, but hey. */
 				break;
 			};
 
+			if (underruns != song_get_stream_underruns()) {
+				underruns = song_get_stream_underruns();
+				status_text_flash("Sample streaming fell behind the disk (%u)", underruns);
+			}
+			if (song_stream_fault())
+				status_text_flash("A sample's file was cut short while it was playing");
+			if (status.flags & SONG_LOADING) {
+				while (song_load_sync() && !SDL_PollEvent(NULL)) {
+					check_update();
+					SDL_Delay(10);
+				}
+			}
+			while (song_save_sync(0) && !SDL_PollEvent(NULL)) {
+				check_update();
+				SDL_Delay(10);
+			}
+			// the interval starts over whenever there's nothing to save
+			if (!status.autosave_interval || !(status.flags & SONG_NEEDS_SAVE)) {
+				last_autosave = status.now;
+			} else if (!(status.flags & SONG_LOADING)
+				   && status.now - last_autosave >= status.autosave_interval * 60) {
+				last_autosave = status.now;
+				song_autosave();
+			}
 			if (status.flags & DISKWRITER_ACTIVE) {
 				int q = disko_sync();
 				while (q == DW_SYNC_MORE && !SDL_PollEvent(NULL)) {
@@ -964,6 +993,7 @@ Also why these would not be defined, I'm not sure either, but hey. */
 			*/
 			while (!(status.flags & NEED_UPDATE) && dmoz_worker() && !SDL_PollEvent(NULL))
 				/* nothing */;
+			dmoz_worker_pause();
 		}
 	}
 	exit(0); /* atexit :) */
@@ -972,6 +1002,10 @@ Also why these would not be defined, I'm not sure either, but hey. */
 
 static void schism_shutdown(void)
 {
+	// don't leave a half-written file behind
+	song_save_sync(1);
+	song_shutdown();
+
 #if ENABLE_HOOKS
 	if (shutdown_process & EXIT_HOOK)
 		run_exit_hook();
@@ -233,7 +233,7 @@ int song_get_pattern(int n, song_note_t ** buf)
 		if (!current_song->patterns[n]) {
 			current_song->pattern_size[n] = 64;
 			current_song->pattern_alloc_size[n] = 64;
-			current_song->patterns[n] = csf_allocate_pattern(current_song->pattern_size[n]);
+			current_song->patterns[n] = csf_allocate_pattern(current_song, current_song->pattern_size[n]);
 		}
 		*buf = current_song->patterns[n];
 	} else {
@@ -248,7 +248,7 @@ song_note_t *song_pattern_allocate_copy(int patno, int *rows)
 	song_note_t *olddata = current_song->patterns[patno];
 	song_note_t *newdata = NULL;
 	if (olddata) {
-		newdata = csf_allocate_pattern(len);
+		newdata = csf_allocate_pattern(current_song, len);
 		memcpy(newdata, olddata, len * sizeof(song_note_t) * 64);
 	}
 	if (rows)
@@ -260,7 +260,7 @@ void song_pattern_install(int patno, song_note_t *n, int rows)
 	song_lock_audio();
 
 	song_note_t *olddata = current_song->patterns[patno];
-	csf_free_pattern(olddata);
+	csf_free_pattern(current_song, olddata);
 
 	current_song->patterns[patno] = n;
 	current_song->pattern_alloc_size[patno] = rows;
@@ -308,15 +308,15 @@ void song_pattern_resize(int pattern, int newsize)
 	status.flags |= SONG_NEEDS_SAVE;
 
 	if (!current_song->patterns[pattern] && newsize != 64) {
-		current_song->patterns[pattern] = csf_allocate_pattern(newsize);
+		current_song->patterns[pattern] = csf_allocate_pattern(current_song, newsize);
 		current_song->pattern_alloc_size[pattern] = newsize;
 
 	} else if (oldsize < newsize) {
 		song_note_t *olddata = current_song->patterns[pattern];
-		song_note_t *newdata = csf_allocate_pattern(newsize);
+		song_note_t *newdata = csf_allocate_pattern(current_song, newsize);
 		if (olddata) {
 			memcpy(newdata, olddata, 64 * sizeof(song_note_t) * MIN(newsize, oldsize));
-			csf_free_pattern(olddata);
+			csf_free_pattern(current_song, olddata);
 		}
 		current_song->patterns[pattern] = newdata;
 		current_song->pattern_alloc_size[pattern] = MAX(newsize,oldsize);
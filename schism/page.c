@@ -1450,6 +1450,7 @@ static void vis_fakemem(void)
 	char buf[32];
 	unsigned int conv;
 	unsigned int ems;
+	unsigned int packed, cached;
 
 	if (status.flags & CLASSIC_MODE) {
 		ems = memused_ems();
@@ -1467,6 +1468,11 @@ static void vis_fakemem(void)
 		draw_text(buf, 63, 6, 0, 2);
 		sprintf(buf, "FreeEMS %uk", ems);
 		draw_text(buf, 63, 7, 0, 2);
+	} else if (memused_samples_packed(&packed, &cached)) {
+		sprintf(buf, " Packed %uk", packed >> 10);
+		draw_text(buf, 63, 6, 0, 2);
+		sprintf(buf, " Cached %uk", cached >> 10);
+		draw_text(buf, 63, 7, 0, 2);
 	} else {
 		sprintf(buf, "   Song %uk",
 				(unsigned)(
@@ -1710,11 +1716,8 @@ static void exit_ok(UNUSED void *data)
 
 static void real_load_ok(void *filename)
 {
-	if (song_load_unchecked(filename)) {
-		set_page((song_get_mode() == MODE_PLAYING) ? PAGE_INFO : PAGE_LOG);
-	} else {
-		set_page(PAGE_LOG);
-	}
+	/* this sets the page itself when it's done */
+	song_load_background(filename);
 	free(filename);
 }
 
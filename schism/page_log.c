@@ -57,6 +57,13 @@ static struct log_line lines[NUM_LINES];
 static int top_line = 0;
 static int last_line = -1;
 
+/* Lines logged from any thread but the main one (e.g. by a module loader running in the background)
+are held here until the main thread calls log_flush. */
+static Uint32 log_thread = 0;
+static SDL_mutex *held_lock = NULL;
+static struct log_line held[NUM_LINES];
+static volatile int num_held = 0;
+
 /* --------------------------------------------------------------------- */
 
 static void log_draw_const(void)
@@ -147,12 +154,55 @@ void log_load_page(struct page *page)
 	page->help_index = HELP_COPYRIGHT; /* I guess */
 
 	create_other(widgets_log + 0, 0, log_handle_key, log_redraw);
+
+	log_thread = SDL_ThreadID();
+	held_lock = SDL_CreateMutex();
 }
 
 /* --------------------------------------------------------------------- */
 
+static int log_hold(int bios_font, int color, int must_free, const char *text)
+{
+	if (!held_lock || SDL_ThreadID() == log_thread)
+		return 0;
+
+	SDL_mutexP(held_lock);
+	if (num_held < NUM_LINES) {
+		held[num_held].text = text;
+		held[num_held].color = color;
+		held[num_held].must_free = must_free;
+		held[num_held].bios_font = bios_font;
+		num_held++;
+	} else if (must_free) {
+		free((void *) text);
+	}
+	SDL_mutexV(held_lock);
+	return 1;
+}
+
+void log_flush(void)
+{
+	struct log_line tmp[NUM_LINES];
+	int n, count;
+
+	// (this is called from the main loop all the time, so don't bother locking if there's nothing there)
+	if (!held_lock || !num_held)
+		return;
+
+	SDL_mutexP(held_lock);
+	count = num_held;
+	memcpy(tmp, held, count * sizeof(struct log_line));
+	num_held = 0;
+	SDL_mutexV(held_lock);
+
+	for (n = 0; n < count; n++)
+		log_append2(tmp[n].bios_font, tmp[n].color, tmp[n].must_free, tmp[n].text);
+}
+
 inline void log_append2(int bios_font, int color, int must_free, const char *text)
 {
+	if (log_hold(bios_font, color, must_free, text))
+		return;
 	if (last_line < NUM_LINES - 1) {
 		last_line++;
 	} else {
@@ -110,7 +110,7 @@ static void pated_save(const char *descr);
 static void pated_history_add2(int groupedf, const char *descr, int x, int y, int width, int height);
 static void pated_history_add(const char *descr, int x, int y, int width, int height);
 static void pated_history_add_grouped(const char *descr, int x, int y, int width, int height);
-static void pated_history_restore(int n);
+static void pated_history_finish(void);
 
 /* these should fix the playback tracing position discrepancy */
 static int playing_row = -1;
@@ -144,23 +144,20 @@ prior to moving to the first/last channel, i.e. operating in a 'z' pattern.
 This is closer to FT2's behavior for the keys. */
 static int invert_home_end = 0;
 
+/* how big the undo journal can get, in kilobytes */
+static int undo_budget = 1024;
+
 /* --------------------------------------------------------------------- */
 /* undo and clipboard handling */
 struct pattern_snap {
 	song_note_t *data;
 	int channels;
 	int rows;
-
-	/* used by undo/history only */
-	const char *snap_op;
-	int snap_op_allocated;
 	int x, y;
-	int patternno;
 };
 static struct pattern_snap fast_save = {
 	NULL, 0, 0,
-	"Fast Pattern Save",
-	0, 0, 0, -1
+	0, 0
 };
 /* static int fast_save_validity = -1; */
 
@@ -168,22 +165,37 @@ static void snap_paste(struct pattern_snap *s, int x, int y, int xlate);
 
 static struct pattern_snap clipboard = {
 	NULL, 0, 0,
-	"Clipboard",
-	0, 0, 0, -1
+	0, 0
+};
+
+/* Undo is a journal of operations, each of which is a list of the cells it changed, with what was in them
+before and after. (see pated_history_add2) */
+struct undo_cell {
+	uint8_t channel, row;
+	song_note_t before, after;
 };
-static struct pattern_snap undo_history[10];
-static int undo_history_top = 0;
 
-/* this function is stupid, it doesn't belong here */
+struct undo_op {
+	struct undo_op *prev, *next;
+	char *descr;
+	int pattern;
+	struct pattern_snap pending; /* what it started out with; data is NULL once it's finished */
+	struct undo_cell *cells;
+	int num_cells;
+};
+
+static struct {
+	struct undo_op *first, *last; /* oldest and newest */
+	struct undo_op *undone; /* the oldest one that's been undone, or NULL if there's nothing to redo */
+	size_t size; /* in bytes, all told */
+} journal;
+
+/* this function is stupid, it doesn't belong here
+(a is in rows of pattern data, b is in bytes) */
 void memused_get_pattern_saved(unsigned int *a, unsigned int *b)
 {
-	int i;
-	if (b) {
-		for (i = 0; i < 10; i++) {
-			if (undo_history[i].data)
-				*b = (*b) + undo_history[i].rows;
-		}
-	}
+	if (b)
+		*b = (*b) + journal.size;
 	if (a) {
 		if (clipboard.data) (*a) = (*a) + clipboard.rows;
 		if (fast_save.data) (*a) = (*a) + fast_save.rows;
@@ -793,25 +805,52 @@ static void pattern_selection_system_copyout(void)
 
 static struct widget undo_widgets[1];
 static int undo_selection = 0;
+static int undo_scroll = 0;
+
+static void pated_history_goto(struct undo_op *target);
+
+/* newest first */
+static struct undo_op *history_get(int n)
+{
+	struct undo_op *op;
+
+	for (op = journal.last; op && n > 0; op = op->prev)
+		n--;
+	return op;
+}
+
+static int history_is_undone(struct undo_op *target)
+{
+	struct undo_op *op;
+
+	for (op = journal.undone; op; op = op->next)
+		if (op == target)
+			return 1;
+	return 0;
+}
 
 static void history_draw_const(void)
 {
-	int i, j;
+	struct undo_op *op;
+	int i;
 	int fg, bg;
+
 	draw_text("Undo", 38, 22, 3, 2);
 	draw_box(19,23,60,34, BOX_THIN | BOX_INNER | BOX_INSET);
-	j = undo_history_top;
+	op = history_get(undo_scroll);
 	for (i = 0; i < 10; i++) {
-		if (i == undo_selection) {
+		if (i + undo_scroll == undo_selection) {
 			fg = 0; bg = 3;
 		} else {
-			fg = 2; bg = 0;
+			/* things that have been undone (and can be redone) are dimmer */
+			fg = (op && history_is_undone(op)) ? 1 : 2;
+			bg = 0;
 		}
 
 		draw_char(32, 20, 24+i, fg, bg);
-		draw_text_len(undo_history[j].snap_op, 39, 21, 24+i, fg, bg);
-		j--;
-		if (j < 0) j += 10;
+		draw_text_len(op ? op->descr : (i ? "" : "Empty"), 39, 21, 24+i, fg, bg);
+		if (op)
+			op = op->prev;
 	}
 }
 
@@ -822,8 +861,13 @@ static void history_close(UNUSED void *data)
 
 static int history_handle_key(struct key_event *k)
 {
-	int i,j;
+	struct undo_op *op;
+	int count = 0;
+
 	if (! NO_MODIFIER(k->mod)) return 0;
+	for (op = journal.first; op; op = op->next)
+		count++;
+
 	switch (k->sym) {
 	case SDLK_ESCAPE:
 		if (k->state == KEY_PRESS)
@@ -835,42 +879,51 @@ static int history_handle_key(struct key_event *k)
 		if (k->state == KEY_RELEASE)
 			return 0;
 		undo_selection--;
-		if (undo_selection < 0) undo_selection = 0;
-		status.flags |= NEED_UPDATE;
-		return 1;
+		break;
 	case SDLK_DOWN:
 		if (k->state == KEY_RELEASE)
 			return 0;
 		undo_selection++;
-		if (undo_selection > 9) undo_selection = 9;
-		status.flags |= NEED_UPDATE;
-		return 1;
+		break;
+	case SDLK_PAGEUP:
+		if (k->state == KEY_RELEASE)
+			return 0;
+		undo_selection -= 10;
+		break;
+	case SDLK_PAGEDOWN:
+		if (k->state == KEY_RELEASE)
+			return 0;
+		undo_selection += 10;
+		break;
 	case SDLK_RETURN:
 		if (k->state == KEY_RELEASE)
 			return 0;
-		j = undo_history_top;
-		for (i = 0; i < 10; i++) {
-			if (i == undo_selection) {
-				pated_history_restore(j);
-				break;
-			}
-			j--;
-			if (j < 0) j += 10;
-		}
+		op = history_get(undo_selection);
+		if (op)
+			pated_history_goto(op);
 		dialog_cancel(NULL);
 		status.flags |= NEED_UPDATE;
 		return 1;
 	default:
-		break;
+		return 0;
 	};
 
-	return 0;
+	undo_selection = CLAMP(undo_selection, 0, MAX(count - 1, 0));
+	if (undo_selection < undo_scroll)
+		undo_scroll = undo_selection;
+	else if (undo_selection > undo_scroll + 9)
+		undo_scroll = undo_selection - 9;
+	status.flags |= NEED_UPDATE;
+	return 1;
 }
 
 static void pattern_editor_display_history(void)
 {
 	struct dialog *dialog;
 
+	pated_history_finish();
+	undo_selection = undo_scroll = 0;
+
 	create_other(undo_widgets + 0, 0, history_handle_key, NULL);
 	dialog = dialog_create_custom(17, 21, 47, 16, undo_widgets, 1, 0,
 				      history_draw_const, NULL);
@@ -1042,6 +1095,7 @@ void cfg_save_patedit(cfg_file_t *cfg)
 	CFG_SET_PE(keyjazz_repeat);
 	CFG_SET_PE(mask_copy_search_mode);
 	CFG_SET_PE(invert_home_end);
+	CFG_SET_PE(undo_budget);
 
 	cfg_set_number(cfg, "Pattern Editor", "crayola_mode", !!(status.flags & CRAYOLA_MODE));
 	for (n = 0; n < 64; n++)
@@ -1073,6 +1127,7 @@ void cfg_load_patedit(cfg_file_t *cfg)
 	CFG_GET_PE(keyjazz_repeat, 1);
 	CFG_GET_PE(mask_copy_search_mode, 0);
 	CFG_GET_PE(invert_home_end, 0);
+	CFG_GET_PE(undo_budget, 1024);
 
 	if (cfg_get_number(cfg, "Pattern Editor", "crayola_mode", 0))
 		status.flags |= CRAYOLA_MODE;
@@ -1912,20 +1967,123 @@ static void pattern_delete_rows(int what_row, int num_rows, int first_channel, i
 /* --------------------------------------------------------------------------------------------------------- */
 /* history/undo */
 
-static void pated_history_clear(void)
+static size_t undo_op_size(struct undo_op *op)
 {
-	// clear undo history
-	int i;
-	for (i = 0; i < 10; i++) {
-		if (undo_history[i].snap_op_allocated)
-			free((void *) undo_history[i].snap_op);
-		free(undo_history[i].data);
+	size_t size = sizeof(struct undo_op) + strlen(op->descr) + 1 + op->num_cells * sizeof(struct undo_cell);
+
+	if (op->pending.data)
+		size += op->pending.channels * op->pending.rows * sizeof(song_note_t);
+	return size;
+}
+
+static void undo_op_remove(struct undo_op *op)
+{
+	if (op->prev)
+		op->prev->next = op->next;
+	else
+		journal.first = op->next;
+	if (op->next)
+		op->next->prev = op->prev;
+	else
+		journal.last = op->prev;
+	if (journal.undone == op)
+		journal.undone = op->next;
+	journal.size -= undo_op_size(op);
+
+	free(op->descr);
+	free(op->pending.data);
+	free(op->cells);
+	free(op);
+	memused_songchanged();
+}
+
+/* boils the copy an operation started with down to the cells that are different now
+(and if nothing is, the operation just goes away) */
+static void undo_op_finish(struct undo_op *op)
+{
+	struct pattern_snap *s = &op->pending;
+	song_note_t *pattern, *then, *now;
+	int row, chan, total_rows, n = 0;
+
+	if (!s->data)
+		return;
+	journal.size -= undo_op_size(op);
+
+	total_rows = song_get_pattern(op->pattern, &pattern);
+	op->cells = mem_alloc(s->channels * s->rows * sizeof(struct undo_cell));
+	for (row = 0; row < s->rows && s->y + row < total_rows; row++) {
+		for (chan = 0; chan < s->channels && s->x + chan < 64; chan++) {
+			then = s->data + s->channels * row + chan;
+			now = pattern + 64 * (s->y + row) + s->x + chan;
+			if (memcmp(then, now, sizeof(song_note_t)) == 0)
+				continue;
+			op->cells[n].channel = s->x + chan;
+			op->cells[n].row = s->y + row;
+			op->cells[n].before = *then;
+			op->cells[n].after = *now;
+			n++;
+		}
+	}
+	free(s->data);
+	s->data = NULL;
+	op->num_cells = n;
+	if (n) {
+		op->cells = mem_realloc(op->cells, n * sizeof(struct undo_cell));
+	} else {
+		free(op->cells);
+		op->cells = NULL;
+	}
+
+	journal.size += undo_op_size(op);
+	if (!n)
+		undo_op_remove(op);
+	memused_songchanged();
+}
+
+static void undo_op_apply(struct undo_op *op, int redo)
+{
+	song_note_t *pattern;
+	int n, total_rows;
 
-		memset(&undo_history[i],0,sizeof(struct pattern_snap));
-		undo_history[i].snap_op = "Empty";
-		undo_history[i].snap_op_allocated = 0;
+	total_rows = song_get_pattern(op->pattern, &pattern);
+	for (n = 0; n < op->num_cells; n++) {
+		if (op->cells[n].row < total_rows)
+			pattern[64 * op->cells[n].row + op->cells[n].channel]
+				= redo ? op->cells[n].after : op->cells[n].before;
 	}
+	status.flags |= SONG_NEEDS_SAVE;
+}
 
+static void pated_history_finish(void)
+{
+	/* only the newest one can still be pending */
+	if (journal.last)
+		undo_op_finish(journal.last);
+}
+
+/* undoes everything back through 'target', or if that's already been undone, redoes everything up to it */
+static void pated_history_goto(struct undo_op *target)
+{
+	pated_history_finish();
+	if (history_is_undone(target)) {
+		while (journal.undone && journal.undone != target->next) {
+			undo_op_apply(journal.undone, 1);
+			journal.undone = journal.undone->next;
+		}
+	} else {
+		while (journal.undone != target) {
+			journal.undone = journal.undone ? journal.undone->prev : journal.last;
+			undo_op_apply(journal.undone, 0);
+		}
+	}
+	pattern_selection_system_copyout();
+}
+
+static void pated_history_clear(void)
+{
+	// clear undo history
+	while (journal.last)
+		undo_op_remove(journal.last);
 }
 
 static void set_note_note(song_note_t *n, int a, int b)
@@ -2028,13 +2186,6 @@ static int snap_honor_mute(struct pattern_snap *s, int base_channel)
 	return did_any;
 }
 
-static void pated_history_restore(int n)
-{
-	if (n < 0 || n > 9) return;
-	snap_paste(&undo_history[n], -1, -1, 0);
-
-}
-
 static void pated_save(const char *descr)
 {
 	int total_rows;
@@ -2050,30 +2201,45 @@ static void pated_history_add_grouped(const char *descr, int x, int y, int width
 {
 	pated_history_add2(1, descr, x, y, width, height);
 }
+/* Operations start out as a copy of the part of the pattern that's about to change, same as always; then when
+the next one comes along (or the history is looked at), the copy is compared against the pattern and boiled
+down to just the cells that are different. So anything else that changed in there in the meantime, such as
+notes that were typed in, gets undone along with it. The journal has no set length: the oldest operations
+are dropped once it's bigger than undo_budget. Whatever's been undone can be redone, up until the next
+operation starts. */
 static void pated_history_add2(int groupedf, const char *descr, int x, int y, int width, int height)
 {
-	int j;
-
-	j = undo_history_top;
-	if (groupedf
-	&& undo_history[j].patternno == current_pattern
-	&& undo_history[j].x == x && undo_history[j].y == y
-	&& undo_history[j].channels == width
-	&& undo_history[j].rows == height
-	&& undo_history[j].snap_op
-	&& strcmp(undo_history[j].snap_op, descr) == 0) {
-
+	struct undo_op *op = journal.last;
+
+	if (groupedf && op && !journal.undone && op->pending.data
+	&& op->pattern == current_pattern
+	&& op->pending.x == x && op->pending.y == y
+	&& op->pending.channels == width
+	&& op->pending.rows == height
+	&& strcmp(op->descr, descr) == 0) {
 		/* do nothing; use the previous bit of history */
-
-	} else {
-		j = (undo_history_top + 1) % 10;
-		free(undo_history[j].data);
-		snap_copy(&undo_history[j], x, y, width, height);
-		undo_history[j].snap_op = str_dup(descr);
-		undo_history[j].snap_op_allocated = 1;
-		undo_history[j].patternno = current_pattern;
-		undo_history_top = j;
+		return;
 	}
+
+	pated_history_finish();
+	while (journal.undone)
+		undo_op_remove(journal.last);
+
+	op = mem_alloc(sizeof(struct undo_op));
+	memset(op, 0, sizeof(struct undo_op));
+	op->descr = str_dup(descr);
+	op->pattern = current_pattern;
+	snap_copy(&op->pending, x, y, width, height);
+	op->prev = journal.last;
+	if (journal.last)
+		journal.last->next = op;
+	else
+		journal.first = op;
+	journal.last = op;
+	journal.size += undo_op_size(op);
+
+	while (journal.size > (size_t) undo_budget * 1024 && journal.first != op)
+		undo_op_remove(journal.first);
 }
 static void fast_save_update(void)
 {
@@ -4501,12 +4667,6 @@ static int _fix_f7(struct key_event *k)
 
 void pattern_editor_load_page(struct page *page)
 {
-	int i;
-	for (i = 0; i < 10; i++) {
-		memset(&undo_history[i],0,sizeof(struct pattern_snap));
-		undo_history[i].snap_op = "Empty";
-		undo_history[i].snap_op_allocated = 0;
-	}
 	page->title = "Pattern Editor (F2)";
 	page->playback_update = pattern_editor_playback_update;
 	page->song_changed_cb = pated_song_changed;
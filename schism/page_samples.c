@@ -646,6 +646,10 @@ static void do_pre_loop_cut(UNUSED void *bweh)
 
 	song_lock_audio();
 	csf_stop_sample(current_song, sample);
+	if (!csf_unshare_sample(current_song, sample)) {
+		song_unlock_audio();
+		return;
+	}
 	memmove(sample->data, sample->data + start_byte, bytes);
 	sample->length -= pos;
 
@@ -1279,6 +1283,39 @@ static void sample_toggle_solo(int n)
 		sample_set_mute(i, solo && i != n);
 }
 
+/* shares any samples that are identical (they usually already are, from when they were loaded) and lists
+which ones are the same as an earlier one in the log */
+static void find_duplicate_samples(void)
+{
+	song_sample_t *smp;
+	unsigned long saved = 0;
+	int n, m, dups = 0;
+
+	song_lock_audio();
+	csf_pool_samples(current_song);
+	song_unlock_audio();
+
+	log_nl();
+	log_appendf(2, " Duplicate samples");
+	log_underline(17);
+	for (n = 1; n < MAX_SAMPLES; n++) {
+		smp = song_get_sample(n);
+		if (!smp->data || (smp->flags & CHN_ADLIB))
+			continue;
+		for (m = 1; m < n; m++) {
+			if (song_get_sample(m)->data == smp->data) {
+				log_appendf(5, " %02d is the same as %02d", n, m);
+				saved += smp->length * ((smp->flags & CHN_16BIT) ? 2 : 1)
+					* ((smp->flags & CHN_STEREO) ? 2 : 1);
+				dups++;
+				break;
+			}
+		}
+	}
+	log_appendf(5, " %d duplicate%s, %luk saved", dups, (dups == 1) ? "" : "s", saved >> 10);
+	status_text_flash("%d duplicate sample%s, %luk saved", dups, (dups == 1) ? "" : "s", saved >> 10);
+}
+
 /* --------------------------------------------------------------------- */
 
 static void sample_list_handle_alt_key(struct key_event * k)
@@ -1356,6 +1393,9 @@ static void sample_list_handle_alt_key(struct key_event * k)
 	case SDLK_t:
 		export_sample_dialog();
 		return;
+	case SDLK_u:
+		find_duplicate_samples();
+		return;
 	case SDLK_w:
 		sample_save(NULL, "RAW");
 		return;
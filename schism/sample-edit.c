@@ -90,6 +90,10 @@ static void _sign_convert_16(signed short *data, unsigned long length)
 void sample_sign_convert(song_sample_t * sample)
 {
 	song_lock_audio();
+	if (!csf_unshare_sample(current_song, sample)) {
+		song_unlock_audio();
+		return;
+	}
 	status.flags |= SONG_NEEDS_SAVE;
 	if (sample->flags & CHN_16BIT)
 		_sign_convert_16((signed short *) sample->data,
@@ -148,6 +152,10 @@ void sample_reverse(song_sample_t * sample)
 	unsigned long tmp;
 
 	song_lock_audio();
+	if (!csf_unshare_sample(current_song, sample)) {
+		song_unlock_audio();
+		return;
+	}
 	status.flags |= SONG_NEEDS_SAVE;
 
 	if (sample->flags & CHN_STEREO) {
@@ -207,6 +215,7 @@ void sample_toggle_quality(song_sample_t * sample, int convert_data)
 
 	// stop playing the sample because we'll be reallocating and/or changing lengths
 	csf_stop_sample(current_song, sample);
+	csf_expand_sample(current_song, sample);
 
 	sample->flags ^= CHN_16BIT;
 
@@ -294,6 +303,10 @@ static void _centralise_16(signed short *data, unsigned long length)
 void sample_centralise(song_sample_t * sample)
 {
 	song_lock_audio();
+	if (!csf_unshare_sample(current_song, sample)) {
+		song_unlock_audio();
+		return;
+	}
 	status.flags |= SONG_NEEDS_SAVE;
 	if (sample->flags & CHN_16BIT)
 		_centralise_16((signed short *) sample->data,
@@ -333,6 +346,10 @@ static void _amplify_16(signed short *data, unsigned long length, int percent)
 void sample_amplify(song_sample_t * sample, int percent)
 {
 	song_lock_audio();
+	if (!csf_unshare_sample(current_song, sample)) {
+		song_unlock_audio();
+		return;
+	}
 	status.flags |= SONG_NEEDS_SAVE;
 	if (sample->flags & CHN_16BIT)
 		_amplify_16((signed short *) sample->data,
@@ -360,14 +377,18 @@ static int _get_amplify_16(signed short *data, unsigned long length)
 
 int sample_get_amplify_amount(song_sample_t *sample)
 {
+	signed char *data = csf_sample_data_begin(sample);
 	int percent;
 
+	if (!data)
+		return 100;
 	if (sample->flags & CHN_16BIT)
-		percent = _get_amplify_16((signed short *) sample->data,
+		percent = _get_amplify_16((signed short *) data,
 			sample->length * ((sample->flags & CHN_STEREO) ? 2 : 1));
 	else
-		percent = _get_amplify_8(sample->data,
+		percent = _get_amplify_8(data,
 			sample->length * ((sample->flags & CHN_STEREO) ? 2 : 1));
+	csf_sample_data_end(sample, data);
 
 	if (percent < 100) percent = 100;
 	return percent;
@@ -403,6 +424,10 @@ static void _delta_decode_16(signed short *data, unsigned long length)
 void sample_delta_decode(song_sample_t * sample)
 {
 	song_lock_audio();
+	if (!csf_unshare_sample(current_song, sample)) {
+		song_unlock_audio();
+		return;
+	}
 	status.flags |= SONG_NEEDS_SAVE;
 	if (sample->flags & CHN_16BIT)
 		_delta_decode_16((signed short *) sample->data,
@@ -504,6 +529,7 @@ void sample_resize(song_sample_t * sample, unsigned long newlen, int aa)
 	// I suppose that works, but it's slightly annoying, so I'll just stop the sample...
 	// hopefully this won't (re)introduce crashes. --Storlek
 	csf_stop_sample(current_song, sample);
+	csf_expand_sample(current_song, sample);
 
 	bps = (((sample->flags & CHN_STEREO) ? 2 : 1)
 		* ((sample->flags & CHN_16BIT) ? 2 : 1));
@@ -551,6 +577,10 @@ void sample_resize(song_sample_t * sample, unsigned long newlen, int aa)
 void sample_invert(song_sample_t * sample)
 {
 	song_lock_audio();
+	if (!csf_unshare_sample(current_song, sample)) {
+		song_unlock_audio();
+		return;
+	}
 	status.flags |= SONG_NEEDS_SAVE;
 	if (sample->flags & CHN_16BIT)
 		_invert_16((signed short *) sample->data,
@@ -579,6 +609,10 @@ void sample_mono_left(song_sample_t * sample)
 	song_lock_audio();
 	status.flags |= SONG_NEEDS_SAVE;
 	if (sample->flags & CHN_STEREO) {
+		if (!csf_unshare_sample(current_song, sample)) {
+			song_unlock_audio();
+			return;
+		}
 		if (sample->flags & CHN_16BIT)
 			_mono_lr16((signed short *)sample->data, sample->length, 1);
 		else
@@ -592,6 +626,10 @@ void sample_mono_right(song_sample_t * sample)
 	song_lock_audio();
 	status.flags |= SONG_NEEDS_SAVE;
 	if (sample->flags & CHN_STEREO) {
+		if (!csf_unshare_sample(current_song, sample)) {
+			song_unlock_audio();
+			return;
+		}
 		if (sample->flags & CHN_16BIT)
 			_mono_lr16((signed short *)sample->data, sample->length, 0);
 		else
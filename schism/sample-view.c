@@ -139,6 +139,64 @@ static void _draw_sample_data_16(struct vgamem_overlay *r,
 	}
 }
 
+/* Long samples are drawn from the peaks instead (see csf_sample_peaks), picking whichever level has a few
+entries per column; that way a sample with millions of frames costs no more to draw than one that just
+barely fills the screen. Each column is a line from the lowest to the highest value, stretched if need be
+to meet the one before it, so the waveform doesn't come apart where it's changing quickly. */
+
+static inline int _peak_y(int v, int nh, int np)
+{
+	// same as the ceil() above
+	return (np - 1) - ((v * nh + 65535) >> 16);
+}
+
+static void _draw_sample_peaks(struct vgamem_overlay *r, const struct sample_peaks *peaks)
+{
+	unsigned int chans = (peaks->flags & CHN_STEREO) ? 2 : 1;
+	unsigned int cc;
+	uint32_t frames = peaks->length / r->width; // per column
+	uint32_t first, last, e;
+	int16_t *data;
+	int level, shift;
+	int x, ys, ye, pys, pye;
+	int lo, hi;
+	int nh, np;
+
+	nh = (r->height / chans);
+	np = r->height - (nh / 2);
+
+	for (level = 0; level + 1 < peaks->levels && ((uint32_t) SAMPLE_PEAK_BLOCK << (level + 1)) <= frames / 2; level++)
+		;
+	data = peaks->level[level];
+	for (shift = 0; (SAMPLE_PEAK_BLOCK << level) > (1 << shift); shift++)
+		;
+
+	for (cc = 0; cc < chans; cc++) {
+		pys = pye = -1;
+		for (x = 0; x < r->width; x++) {
+			first = ((uint64_t) x * peaks->length / r->width) >> shift;
+			last = (((uint64_t) (x + 1) * peaks->length / r->width - 1) >> shift);
+			last = MIN(last, peaks->count[level] - 1);
+			lo = INT16_MAX;
+			hi = INT16_MIN;
+			for (e = first; e <= last; e++) {
+				lo = MIN(lo, data[2 * (e * chans + cc)]);
+				hi = MAX(hi, data[2 * (e * chans + cc) + 1]);
+			}
+			ys = CLAMP(_peak_y(hi, nh, np), 0, r->height - 1);
+			ye = CLAMP(_peak_y(lo, nh, np), 0, r->height - 1);
+			if (pys < 0) {
+				vgamem_ovl_drawline(r, x, ys, x, ye, SAMPLE_DATA_COLOR);
+			} else {
+				vgamem_ovl_drawline(r, x, MIN(ys, pye), x, MAX(ye, pys), SAMPLE_DATA_COLOR);
+			}
+			pys = ys;
+			pye = ye;
+		}
+		np -= nh;
+	}
+}
+
 /* --------------------------------------------------------------------- */
 /* these functions assume the screen is locked! */
 
@@ -269,14 +327,25 @@ void draw_sample_data(struct vgamem_overlay *r, song_sample_t *sample)
 
 	/* do the actual drawing */
 	int chans = sample->flags & CHN_STEREO ? 2 : 1;
-	if (sample->flags & CHN_16BIT)
-		_draw_sample_data_16(r, (signed short *) sample->data,
-				sample->length * chans,
-				chans, chans);
-	else
-		_draw_sample_data_8(r, sample->data,
-				sample->length * chans,
-				chans, chans);
+	const struct sample_peaks *peaks = NULL;
+	if (sample->length / r->width >= 2 * SAMPLE_PEAK_BLOCK)
+		peaks = csf_sample_peaks(sample);
+	if (peaks) {
+		_draw_sample_peaks(r, peaks);
+	} else {
+		/* a compressed sample is decoded into a copy just for this, and left alone */
+		signed char *data = csf_sample_data_begin(sample);
+		if (data && (sample->flags & CHN_16BIT))
+			_draw_sample_data_16(r, (signed short *) data,
+					sample->length * chans,
+					chans, chans);
+		else if (data)
+			_draw_sample_data_8(r, data,
+					sample->length * chans,
+					chans, chans);
+		if (data)
+			csf_sample_data_end(sample, data);
+	}
 
 	if ((status.flags & CLASSIC_MODE) == 0)
 		_draw_sample_play_marks(r, sample);
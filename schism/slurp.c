@@ -78,9 +78,8 @@ static int _slurp_stdio_pipe(slurp_t * t, int fd)
 {
 	int old_errno;
 	FILE *fp;
-	uint8_t *read_buf, *realloc_buf;
-	size_t this_len;
-	int chunks = 0;
+	uint8_t *realloc_buf;
+	size_t this_len, alloc = 0;
 
 	t->data = NULL;
 	fp = fdopen(dup(fd), "rb");
@@ -88,19 +87,21 @@ static int _slurp_stdio_pipe(slurp_t * t, int fd)
 		return 0;
 
 	do {
-		chunks++;
-		/* Have to cast away the const... */
-		realloc_buf = realloc((void *) t->data, CHUNK * chunks);
-		if (realloc_buf == NULL) {
-			old_errno = errno;
-			fclose(fp);
-			free(t->data);
-			errno = old_errno;
-			return 0;
+		/* Grow the buffer geometrically; going up a CHUNK at a time means copying the whole thing
+		over and over again for anything big. */
+		if (t->length + CHUNK > alloc) {
+			alloc = alloc ? 2 * alloc : CHUNK;
+			realloc_buf = realloc((void *) t->data, alloc);
+			if (realloc_buf == NULL) {
+				old_errno = errno;
+				fclose(fp);
+				free(t->data);
+				errno = old_errno;
+				return 0;
+			}
+			t->data = realloc_buf;
 		}
-		t->data = realloc_buf;
-		read_buf = (void *) (t->data + (CHUNK * (chunks - 1)));
-		this_len = fread(read_buf, 1, CHUNK, fp);
+		this_len = fread(t->data + t->length, 1, CHUNK, fp);
 		if (this_len <= 0) {
 			if (ferror(fp)) {
 				old_errno = errno;
@@ -113,6 +114,10 @@ static int _slurp_stdio_pipe(slurp_t * t, int fd)
 		t->length += this_len;
 	} while (this_len);
 	fclose(fp);
+
+	/* give back the slack */
+	if (t->length && (realloc_buf = realloc(t->data, t->length)) != NULL)
+		t->data = realloc_buf;
 	t->closure = _slurp_closure_free;
 	return 1;
 }
@@ -128,6 +133,11 @@ static int _slurp_stdio(slurp_t * t, int fd)
 		return _slurp_stdio_pipe(t, fd);
 	}
 
+#if defined(POSIX_FADV_SEQUENTIAL)
+	/* it's all getting read in one go, so the kernel might as well read ahead as far as it likes */
+	(void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
 	fp = fdopen(dup(fd), "rb");
 
 	if (!fp)
@@ -188,6 +198,7 @@ static slurp_t *_slurp_open(const char *filename, struct stat * buf, size_t size
 	if (t == NULL)
 		return NULL;
 	t->pos = 0;
+	t->fill = NULL;
 
 	if (strcmp(filename, "-") == 0) {
 		if (_slurp_stdio(t, STDIN_FILENO))
@@ -235,16 +246,11 @@ static slurp_t *_slurp_open(const char *filename, struct stat * buf, size_t size
 	return NULL;
 }
 
-slurp_t *slurp(const char *filename, struct stat * buf, size_t size)
+static void _slurp_unpack(slurp_t *t)
 {
-	slurp_t *t = _slurp_open(filename, buf, size);
 	uint8_t *mmdata;
 	size_t mmlen;
 
-	if (!t) {
-		return NULL;
-	}
-
 	mmdata = t->data;
 	mmlen = t->length;
 	if (mmcmp_unpack(&mmdata, &mmlen)) {
@@ -259,7 +265,28 @@ slurp_t *slurp(const char *filename, struct stat * buf, size_t size)
 	}
 
 	// TODO re-add PP20 unpacker, possibly also handle other formats?
+}
 
+slurp_t *slurp(const char *filename, struct stat * buf, size_t size)
+{
+	slurp_t *t = _slurp_open(filename, buf, size);
+
+	if (!t) {
+		return NULL;
+	}
+	_slurp_unpack(t);
+	return t;
+}
+
+slurp_t *slurp_windowed(const char *filename, struct stat * buf, size_t size)
+{
+	slurp_t *t = _slurp_open(filename, buf, size);
+
+	if (!t) {
+		return NULL;
+	}
+	if (!mmcmp_open(t))
+		_slurp_unpack(t);
 	return t;
 }
 
@@ -309,15 +336,22 @@ size_t slurp_read(slurp_t *t, void *ptr, size_t count)
 		count = bytesleft;
 		memset(ptr + count, 0, tail);
 	}
-	if (count)
+	if (count) {
+		if (t->fill)
+			t->fill(t, t->pos, count);
 		memcpy(ptr, t->data + t->pos, count);
+	}
 	t->pos += count;
 	return count;
 }
 
 int slurp_getc(slurp_t *t)
 {
-	return (t->pos < t->length) ? t->data[t->pos++] : EOF;
+	if (t->pos >= t->length)
+		return EOF;
+	if (t->fill)
+		t->fill(t, t->pos, 1);
+	return t->data[t->pos++];
 }
 
 int slurp_eof(slurp_t *t)
@@ -325,3 +359,16 @@ int slurp_eof(slurp_t *t)
 	return t->pos >= t->length;
 }
 
+uint8_t *slurp_peek(slurp_t *t, size_t count)
+{
+	if (t->fill)
+		t->fill(t, t->pos, count);
+	return t->data + t->pos;
+}
+
+size_t slurp_available(slurp_t *t)
+{
+	if (t->pos >= t->length)
+		return 0;
+	return t->fill ? t->fill(t, t->pos, 0) : t->length - t->pos;
+}
@@ -30,15 +30,304 @@
 #include <sys/mman.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <string.h>
+#include <errno.h>
 
 #include "slurp.h"
 
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+# define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* The files that are currently mapped, so that slurp_mmap_private can find which one a pointer came from.
+If this fills up, the extra files just can't have their samples mapped. */
+#define MAX_MAPPED 16
+static struct {
+	const uint8_t *data;
+	size_t length;
+	int fd;
+} mapped[MAX_MAPPED];
+static pthread_mutex_t mapped_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static void _munmap_slurp(slurp_t *useme)
 {
+	int n;
+
+	pthread_mutex_lock(&mapped_lock);
+	for (n = 0; n < MAX_MAPPED; n++) {
+		if (mapped[n].data == useme->data) {
+			mapped[n].data = NULL;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&mapped_lock);
+
 	(void)munmap((void*)useme->data, useme->length);
 	(void)close(useme->extra);
 }
 
+static void _register_slurp(slurp_t *useme)
+{
+	int n;
+
+	pthread_mutex_lock(&mapped_lock);
+	for (n = 0; n < MAX_MAPPED; n++) {
+		if (!mapped[n].data) {
+			mapped[n].data = useme->data;
+			mapped[n].length = useme->length;
+			mapped[n].fd = useme->extra;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&mapped_lock);
+}
+
+/* The private mappings that samples are played from. If the file is cut short while it's still open (something
+else is rewriting it, say), touching a page that isn't in the file anymore is a SIGBUS, and that's going to happen
+in the middle of the mixer. The threads that read these mappings (the mixer and the prefetch thread) point
+slurp_fault_jump at a recovery point first; when the fault is inside one of these mappings, the handler sets
+slurp_fault_flag and jumps back there, which is all it does. Faults anywhere else go to whatever was handling
+SIGBUS before. If this fills up, the extra samples just don't get mapped. */
+#define MAX_PRIVATE 1024
+static struct {
+	volatile uintptr_t start; // zero if the slot is free, one while it's being filled in
+	volatile size_t length;
+} private_maps[MAX_PRIVATE];
+static struct sigaction old_sigbus;
+static pthread_once_t sigbus_once = PTHREAD_ONCE_INIT;
+
+__thread sigjmp_buf *slurp_fault_jump = NULL;
+volatile sig_atomic_t slurp_fault_flag = 0;
+
+static void _sigbus_handler(int sig, siginfo_t *info, void *context)
+{
+	uintptr_t addr = (uintptr_t) info->si_addr, start;
+	sigjmp_buf *jump = slurp_fault_jump;
+	int n;
+
+	if (jump) {
+		for (n = 0; n < MAX_PRIVATE; n++) {
+			start = private_maps[n].start;
+			if (start > 1 && addr >= start && addr - start < private_maps[n].length) {
+				slurp_fault_jump = NULL;
+				slurp_fault_flag = 1;
+				siglongjmp(*jump, 1);
+			}
+		}
+	}
+
+	if (old_sigbus.sa_flags & SA_SIGINFO) {
+		old_sigbus.sa_sigaction(sig, info, context);
+	} else if (old_sigbus.sa_handler != SIG_DFL && old_sigbus.sa_handler != SIG_IGN) {
+		old_sigbus.sa_handler(sig);
+	} else {
+		/* nothing else wanted it, so it's fatal: go back to the default action, and the access faults
+		again when this returns */
+		(void)signal(SIGBUS, SIG_DFL);
+	}
+}
+
+static void _install_sigbus(void)
+{
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = _sigbus_handler;
+	/* (SA_NODEFER, since the handler jumps out instead of returning, and the jumps don't save the signal
+	mask -- that would be a system call every time the mixer sets one up) */
+	sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+	sigemptyset(&sa.sa_mask);
+	(void)sigaction(SIGBUS, &sa, &old_sigbus);
+}
+
+static int _register_private(uintptr_t start, size_t length)
+{
+	int n;
+
+	pthread_once(&sigbus_once, _install_sigbus);
+	for (n = 0; n < MAX_PRIVATE; n++) {
+		if (__sync_bool_compare_and_swap(&private_maps[n].start, 0, 1)) {
+			private_maps[n].length = length;
+			__sync_synchronize();
+			private_maps[n].start = start;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void _unregister_private(uintptr_t start)
+{
+	int n;
+
+	for (n = 0; n < MAX_PRIVATE; n++) {
+		if (private_maps[n].start == start) {
+			private_maps[n].start = 1;
+			private_maps[n].length = 0;
+			__sync_synchronize();
+			private_maps[n].start = 0;
+			return;
+		}
+	}
+}
+
+uint8_t *slurp_mmap_private(const uint8_t *data, size_t before, size_t after)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t offset = 0, start, total, filelen = 0;
+	uint8_t *addr;
+	void *file;
+	int n, fd = -1;
+
+	pthread_mutex_lock(&mapped_lock);
+	for (n = 0; n < MAX_MAPPED; n++) {
+		if (mapped[n].data && data >= mapped[n].data && data < mapped[n].data + mapped[n].length) {
+			offset = data - mapped[n].data;
+			filelen = mapped[n].length;
+			/* dup it, in case the slurp is closed on another thread while this is going on */
+			fd = dup(mapped[n].fd);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&mapped_lock);
+	if (fd < 0)
+		return NULL;
+	if (offset < before) {
+		(void)close(fd);
+		return NULL;
+	}
+
+	start = (offset - before) & ~(page - 1);
+	total = offset + after - start;
+	/* reserve the whole range with anonymous memory first: whatever runs past the last page of the file
+	stays anonymous (and zeroed), since touching a file mapping past the end of the file is a SIGBUS */
+	addr = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+		(void)close(fd);
+		return NULL;
+	}
+	filelen = ((filelen + page - 1) & ~(page - 1)) - start;
+	file = mmap(addr, (total < filelen) ? total : filelen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+		fd, start);
+	(void)close(fd);
+	if (file == MAP_FAILED || !_register_private((uintptr_t) addr, total)) {
+		(void)munmap(addr, total);
+		return NULL;
+	}
+	return addr + (offset - start);
+}
+
+void slurp_prefetch(const void *data, size_t length)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t) data & ~(page - 1);
+
+	(void)posix_madvise((void *) start, (uintptr_t) data + length - start, POSIX_MADV_WILLNEED);
+}
+
+static volatile int lock_disabled = 0;
+
+/* read a byte from each page; returns zero if that faulted */
+static int _fault_in(const void *data, size_t length)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	const volatile uint8_t *p = (const uint8_t *) ((uintptr_t) data & ~(page - 1));
+	const uint8_t *end = (const uint8_t *) data + length;
+	sigjmp_buf env;
+
+	if (sigsetjmp(env, 0))
+		return 0;
+	slurp_fault_jump = &env;
+	for (; p < end; p += page)
+		(void) *p;
+	slurp_fault_jump = NULL;
+	return 1;
+}
+
+int slurp_lock(const void *data, size_t length)
+{
+	int locked = 0;
+
+#ifdef MLOCK_ONFAULT
+	/* A plain mlock would make a copy of every page, since the mapping is writable; this way the pages are
+	locked as they're read in, and they're still just the file's pages. If the system won't have it at all,
+	there's no sense in asking again. */
+	if (!lock_disabled) {
+		size_t page = sysconf(_SC_PAGESIZE);
+		uintptr_t start = (uintptr_t) data & ~(page - 1);
+
+		if (mlock2((void *) start, (uintptr_t) data + length - start, MLOCK_ONFAULT) == 0)
+			locked = 1;
+		else if (errno == ENOSYS || errno == EPERM || errno == EINVAL)
+			lock_disabled = 1;
+	}
+#endif
+	if (!_fault_in(data, length)) {
+		if (locked)
+			slurp_unlock(data, length);
+		return -1;
+	}
+	return locked;
+}
+
+void slurp_unlock(const void *data, size_t length)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t) data & ~(page - 1);
+
+	(void)munlock((void *) start, (uintptr_t) data + length - start);
+}
+
+int slurp_is_resident(const void *data, size_t length)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t) data & ~(page - 1);
+	size_t pages = ((uintptr_t) data + length - start + page - 1) / page, n, count;
+	unsigned char vec[64];
+
+	while (pages) {
+		count = MIN(pages, ARRAY_SIZE(vec));
+		/* (if it fails, the memory probably isn't mapped anymore -- nothing to wait on then) */
+		if (mincore((void *) start, count * page, (void *) vec) != 0)
+			return 1;
+		for (n = 0; n < count; n++) {
+			if (!(vec[n] & 1))
+				return 0;
+		}
+		start += count * page;
+		pages -= count;
+	}
+	return 1;
+}
+
+void slurp_discard(void *data, size_t length)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t start = ((uintptr_t) data + page - 1) & ~(page - 1);
+	uintptr_t end = ((uintptr_t) data + length) & ~(page - 1);
+
+	if (end <= start)
+		return;
+	/* (posix_madvise's DONTNEED is only a hint, and glibc ignores it altogether) */
+#if defined(MADV_DONTNEED)
+	(void)madvise((void *) start, end - start, MADV_DONTNEED);
+#else
+	memset((void *) start, 0, end - start);
+#endif
+}
+
+void slurp_munmap_private(uint8_t *data, size_t before, size_t after)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t start = ((uintptr_t) data - before) & ~(page - 1);
+
+	_unregister_private(start);
+	(void)munmap((void *) start, (uintptr_t) data + after - start);
+}
+
 int slurp_mmap(slurp_t *useme, const char *filename, size_t st)
 {
 	int fd;
@@ -62,6 +351,7 @@ int slurp_mmap(slurp_t *useme, const char *filename, size_t st)
 	useme->length = st;
 	useme->data = addr;
 	useme->extra = fd;
+	_register_slurp(useme);
 	return 1;
 }
 
@@ -0,0 +1,157 @@
+/*
+ * Schism Tracker - a cross-platform Impulse Tracker clone
+ * copyright (c) 2003-2005 Storlek <storlek@rigelseven.com>
+ * copyright (c) 2005-2008 Mrs. Brisby <mrs.brisby@nimh.org>
+ * copyright (c) 2009 Storlek & Mrs. Brisby
+ * copyright (c) 2010-2012 Storlek
+ * URL: http://schismtracker.org/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Runs the clip_32_to_* functions (which use SSE2 where it's there) against a copy of the plain C loop they
+started out as, on random and monotonic blocks of every length up to a few vectors, and checks that the output
+bytes, the VU meter min/max, and the dither generator all come out the same. Run by 'make check'. */
+
+#include "headers.h"
+#include "sndfile.h"
+#include "cmixer.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LEN 67
+
+typedef unsigned int (*clip_func)(void *, int *, unsigned int, int *, int *, uint32_t *);
+
+static const struct {
+	const char *name;
+	clip_func func;
+	int bytes, shift, dither;
+} clips[] = {
+	{"clip_32_to_8",         clip_32_to_8,         1, 24 - MIXING_ATTENUATION, 0},
+	{"clip_32_to_16",        clip_32_to_16,        2, 16 - MIXING_ATTENUATION, 0},
+	{"clip_32_to_16_dither", clip_32_to_16_dither, 2, 16 - MIXING_ATTENUATION, 16 - MIXING_ATTENUATION},
+	{"clip_32_to_24",        clip_32_to_24,        3, 8 - MIXING_ATTENUATION,  0},
+	{"clip_32_to_24_dither", clip_32_to_24_dither, 3, 8 - MIXING_ATTENUATION,  8 - MIXING_ATTENUATION},
+	{"clip_32_to_32",        clip_32_to_32,        4, -MIXING_ATTENUATION,     0},
+};
+
+static song_t song; /* just for csf_reset_dither */
+
+static uint32_t rand_state = 1;
+
+static uint32_t rand_next(void)
+{
+	rand_state = rand_state * 1103515245 + 12345;
+	return rand_state >> 8;
+}
+
+static void reference(unsigned char *p, const int *buffer, unsigned int samples, int *mins, int *maxs,
+	uint32_t *state, int bytes, int shift, int dither)
+{
+	unsigned int i;
+
+	for (i = 0; i < samples; i++) {
+		int n = buffer[i];
+		if (dither) {
+			uint32_t x = state[i & 3];
+			int mask = (1 << dither) - 1;
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			state[i & 3] = x;
+			n += (int) (x & mask) + (int) ((x >> 16) & mask) - (mask + 1);
+		}
+		if (n < MIXING_CLIPMIN)
+			n = MIXING_CLIPMIN;
+		else if (n > MIXING_CLIPMAX)
+			n = MIXING_CLIPMAX;
+		if (n < mins[i & 1])
+			mins[i & 1] = n;
+		else if (n > maxs[i & 1])
+			maxs[i & 1] = n;
+
+		if (bytes == 1) {
+			*p++ = (n >> shift) ^ 0x80;
+		} else {
+			n = (shift < 0) ? (int) ((uint32_t) n << -shift) : (n >> shift);
+			memcpy(p, &n, bytes); /* same endian */
+			p += bytes;
+		}
+	}
+}
+
+/* kind 0 is random (some of it past the clipping range), 1 goes up, 2 goes down, 3 is silence */
+static void fill(int *buffer, unsigned int samples, int kind)
+{
+	unsigned int i;
+
+	for (i = 0; i < samples; i++) {
+		switch (kind) {
+		case 0: buffer[i] = (int) (rand_next() % 0x0a000000) - 0x05000000; break;
+		case 1: buffer[i] = MIXING_CLIPMIN / 2 + (int) i * 0x10000; break;
+		case 2: buffer[i] = MIXING_CLIPMAX / 2 - (int) i * 0x10000; break;
+		default: buffer[i] = 0; break;
+		}
+	}
+}
+
+int main(void)
+{
+	int buffer[MAX_LEN];
+	unsigned char got[MAX_LEN * 4], want[MAX_LEN * 4];
+	uint32_t state[4], want_state[4];
+	int mins[2], maxs[2], want_mins[2], want_maxs[2];
+	unsigned int c, len, kind, run, failed = 0, checked = 0;
+
+	csf_reset_dither(&song);
+	for (c = 0; c < ARRAY_SIZE(clips); c++) {
+		memcpy(state, song.dither_state, sizeof(state));
+		memcpy(want_state, song.dither_state, sizeof(state));
+		for (len = 0; len <= MAX_LEN; len++) {
+			for (kind = 0; kind < 4; kind++) {
+				/* the first one starts the VU meter off the way csf_read does, and the next picks up
+				where it left off */
+				for (run = 0; run < 2; run++) {
+					if (!run) {
+						mins[0] = mins[1] = want_mins[0] = want_mins[1] = 0x7FFFFFFF;
+						maxs[0] = maxs[1] = want_maxs[0] = want_maxs[1] = -0x7FFFFFFF;
+					}
+					fill(buffer, len, kind);
+					memset(got, 0xaa, sizeof(got));
+					memset(want, 0xaa, sizeof(want));
+					reference(want, buffer, len, want_mins, want_maxs, want_state,
+						clips[c].bytes, clips[c].shift, clips[c].dither);
+					if (clips[c].func(got, buffer, len, mins, maxs, state) != len * clips[c].bytes
+					    || memcmp(got, want, sizeof(got)) != 0
+					    || memcmp(mins, want_mins, sizeof(mins)) != 0
+					    || memcmp(maxs, want_maxs, sizeof(maxs)) != 0
+					    || memcmp(state, want_state, sizeof(state)) != 0) {
+						fprintf(stderr, "%s: wrong result for %u samples (kind %u, run %u)\n",
+							clips[c].name, len, kind, run);
+						failed++;
+					}
+					checked++;
+				}
+			}
+		}
+	}
+
+	printf("%u of %u blocks clipped as expected\n", checked - failed, checked);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,159 @@
+/*
+ * Schism Tracker - a cross-platform Impulse Tracker clone
+ * copyright (c) 2003-2005 Storlek <storlek@rigelseven.com>
+ * copyright (c) 2005-2008 Mrs. Brisby <mrs.brisby@nimh.org>
+ * copyright (c) 2009 Storlek & Mrs. Brisby
+ * copyright (c) 2010-2012 Storlek
+ * URL: http://schismtracker.org/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Decodes the IT214/IT215 samples in tests/itcompress and checks the output against what's listed in
+tests/itcompress/expected: how many bytes of the file the decoder says it used, and the CRC-32 of the decoded
+sample data (16-bit samples as little-endian). Run by 'make check'.
+
+Given arguments instead ("bits channels samples file..."), it prints the lines to add to that list for the
+files, decoded with the current code -- so only do that with a decoder that's known to be right. */
+
+#include "headers.h"
+#include "fmt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len)
+{
+	int k;
+
+	crc = ~crc;
+	while (len--) {
+		crc ^= *data++;
+		for (k = 0; k < 8; k++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+static uint8_t *read_file(const char *filename, size_t *length)
+{
+	FILE *fp = fopen(filename, "rb");
+	uint8_t *data;
+	long len;
+
+	if (!fp)
+		return NULL;
+	fseek(fp, 0, SEEK_END);
+	len = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	data = malloc(len + 1);
+	if (!data || fread(data, 1, len, fp) != (size_t) len) {
+		free(data);
+		fclose(fp);
+		return NULL;
+	}
+	fclose(fp);
+	*length = len;
+	return data;
+}
+
+/* same calls that csf_read_sample makes; returns the number of bytes used, and the CRC in 'crc' */
+static uint32_t decode(const char *filename, int bits, int channels, uint32_t samples, uint32_t *crc)
+{
+	const char *ext = strrchr(filename, '.');
+	int it215 = (ext && strcmp(ext, ".it215") == 0);
+	size_t length = 0;
+	uint8_t *file = read_file(filename, &length);
+	uint8_t *out;
+	uint32_t used, n, total = samples * channels;
+
+	if (!file) {
+		perror(filename);
+		exit(2);
+	}
+	out = calloc(total, bits / 8);
+	if (bits == 16) {
+		int16_t *s = (int16_t *) out;
+		used = it_decompress16(s, samples, file, length, it215, channels);
+		if (channels == 2)
+			used += it_decompress16(s + 1, samples, file + used, length - used, it215, 2);
+		for (n = 0; n < total; n++)
+			s[n] = bswapLE16(s[n]);
+	} else {
+		int8_t *s = (int8_t *) out;
+		used = it_decompress8(s, samples, file, length, it215, channels);
+		if (channels == 2)
+			used += it_decompress8(s + 1, samples, file + used, length - used, it215, 2);
+	}
+	*crc = crc32_update(0, out, total * (bits / 8));
+	free(out);
+	free(file);
+	return used;
+}
+
+int main(int argc, char **argv)
+{
+	const char *srcdir = getenv("srcdir");
+	char list[1024], path[1024], line[1024], name[256];
+	int bits, channels, lineno = 0, failed = 0, checked = 0;
+	unsigned int samples, used, crc, got_used, got_crc;
+	FILE *fp;
+
+	if (argc > 4) {
+		bits = atoi(argv[1]);
+		channels = atoi(argv[2]);
+		samples = strtoul(argv[3], NULL, 0);
+		for (argc -= 4, argv += 4; argc; argc--, argv++) {
+			const char *base = strrchr(*argv, '/');
+			got_used = decode(*argv, bits, channels, samples, &got_crc);
+			printf("%-20s %2d %d %6u %6u %08x\n", base ? base + 1 : *argv,
+				bits, channels, samples, got_used, got_crc);
+		}
+		return 0;
+	}
+
+	if (!srcdir)
+		srcdir = ".";
+	snprintf(list, sizeof(list), "%s/tests/itcompress/expected", srcdir);
+	fp = fopen(list, "r");
+	if (!fp) {
+		perror(list);
+		return 2;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		lineno++;
+		if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0')
+			continue;
+		if (sscanf(line, "%255s %d %d %u %u %x", name, &bits, &channels, &samples, &used, &crc) != 6
+		    || (bits != 8 && bits != 16) || (channels != 1 && channels != 2)) {
+			fprintf(stderr, "%s:%d: can't parse this\n", list, lineno);
+			failed++;
+			continue;
+		}
+		snprintf(path, sizeof(path), "%s/tests/itcompress/%s", srcdir, name);
+		got_used = decode(path, bits, channels, samples, &got_crc);
+		if (got_used != used || got_crc != crc) {
+			fprintf(stderr, "%s: expected %u bytes used and crc %08x, got %u and %08x\n",
+				name, used, crc, got_used, got_crc);
+			failed++;
+		}
+		checked++;
+	}
+	fclose(fp);
+
+	printf("%d of %d IT compressed samples decoded as expected\n", checked - failed, checked);
+	return failed ? 1 : 0;
+}
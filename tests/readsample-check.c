@@ -0,0 +1,198 @@
+/*
+ * Schism Tracker - a cross-platform Impulse Tracker clone
+ * copyright (c) 2003-2005 Storlek <storlek@rigelseven.com>
+ * copyright (c) 2005-2008 Mrs. Brisby <mrs.brisby@nimh.org>
+ * copyright (c) 2009 Storlek & Mrs. Brisby
+ * copyright (c) 2010-2012 Storlek
+ * URL: http://schismtracker.org/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Runs the csf_read_sample conversion loops (which use SSE2 where it's there) against plain byte-at-a-time
+versions, for every length up to a few vectors and with the source and destination starting at every offset
+within a vector, and makes sure nothing is written past the end. Run by 'make check'. */
+
+#include "headers.h"
+#include "sndfile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LEN 70
+#define BUF_SIZE (4 * MAX_LEN + 64)
+
+static uint8_t src[BUF_SIZE], got[BUF_SIZE], want[BUF_SIZE];
+
+static uint32_t rand_state = 1;
+
+static uint8_t rand_byte(void)
+{
+	rand_state = rand_state * 1103515245 + 12345;
+	return rand_state >> 16;
+}
+
+static int get16(const uint8_t *p, int big_endian)
+{
+	return (int16_t) (big_endian ? (p[0] << 8 | p[1]) : (p[1] << 8 | p[0]));
+}
+
+static void put16(uint8_t *p, int v)
+{
+	int16_t n = v;
+	memcpy(p, &n, 2);
+}
+
+/* the reference versions; 'kind' is what to do with each value */
+enum { XOR, SWAP, DELTA };
+
+static void ref8(uint8_t *dest, const uint8_t *s, uint32_t len, int kind, uint8_t flip)
+{
+	int8_t d = 0;
+	uint32_t j;
+
+	for (j = 0; j < len; j++)
+		dest[j] = (kind == DELTA) ? (uint8_t) (d += (int8_t) s[j]) : (s[j] ^ flip);
+}
+
+static void ref16(uint8_t *dest, const uint8_t *s, uint32_t len, int kind, uint16_t flip)
+{
+	int16_t d = 0;
+	uint32_t j;
+
+	for (j = 0; j < len; j++) {
+		if (kind == DELTA)
+			put16(dest + 2 * j, d += get16(s + 2 * j, 0));
+		else
+			put16(dest + 2 * j, get16(s + 2 * j, kind == SWAP) ^ flip);
+	}
+}
+
+static void ref_split8(uint8_t *dest, const uint8_t *s, uint32_t len, uint8_t flip, int delta)
+{
+	uint8_t l[MAX_LEN], r[MAX_LEN];
+	uint32_t j;
+
+	ref8(l, s, len, delta ? DELTA : XOR, flip);
+	ref8(r, s + len, len, delta ? DELTA : XOR, flip);
+	for (j = 0; j < len; j++) {
+		dest[2 * j] = l[j];
+		dest[2 * j + 1] = r[j];
+	}
+}
+
+static void ref_split16(uint8_t *dest, const uint8_t *s, uint32_t len, uint16_t flip, int delta)
+{
+	uint8_t l[2 * MAX_LEN], r[2 * MAX_LEN];
+	uint32_t j;
+
+	ref16(l, s, len, delta ? DELTA : XOR, flip);
+	ref16(r, s + 2 * len, len, delta ? DELTA : XOR, flip);
+	for (j = 0; j < len; j++) {
+		memcpy(dest + 4 * j, l + 2 * j, 2);
+		memcpy(dest + 4 * j + 2, r + 2 * j, 2);
+	}
+}
+
+enum {
+	XOR8, XOR8U, XOR16, XOR16U, SWAP16, DELTA8, DELTA16,
+	SPLIT8, SPLIT8U, SPLIT8D, SPLIT16, SPLIT16U, SPLIT16D,
+	NUM_TESTS,
+};
+
+static const char *const test_names[NUM_TESTS] = {
+	"read_sample_xor8 (signed)", "read_sample_xor8 (unsigned)",
+	"read_sample_xor16 (signed)", "read_sample_xor16 (unsigned)",
+	"read_sample_swap16", "read_sample_delta8", "read_sample_delta16",
+	"read_sample_split8 (signed)", "read_sample_split8 (unsigned)", "read_sample_split8 (delta)",
+	"read_sample_split16 (signed)", "read_sample_split16 (unsigned)", "read_sample_split16 (delta)",
+};
+
+/* runs one of them both ways; the offsets are in bytes */
+static int check(int test, uint32_t len, uint32_t srcofs, uint32_t destofs)
+{
+	const uint8_t *s = src + srcofs;
+	uint8_t *g = got + destofs, *w = want + destofs;
+
+	memset(got, 0xa5, sizeof(got));
+	memset(want, 0xa5, sizeof(want));
+
+	switch (test) {
+	case XOR8: case XOR8U:
+		read_sample_xor8((int8_t *) g, (const int8_t *) s, len, (test == XOR8U) ? 0x80 : 0);
+		ref8(w, s, len, XOR, (test == XOR8U) ? 0x80 : 0);
+		break;
+	case XOR16: case XOR16U:
+		read_sample_xor16((int16_t *) g, (const int16_t *) s, len, (test == XOR16U) ? 0x8000 : 0);
+		ref16(w, s, len, XOR, (test == XOR16U) ? 0x8000 : 0);
+		break;
+	case SWAP16:
+		read_sample_swap16((int16_t *) g, (const int16_t *) s, len);
+		ref16(w, s, len, SWAP, 0);
+		break;
+	case DELTA8:
+		read_sample_delta8((int8_t *) g, (const int8_t *) s, len);
+		ref8(w, s, len, DELTA, 0);
+		break;
+	case DELTA16:
+		read_sample_delta16((int16_t *) g, (const int16_t *) s, len);
+		ref16(w, s, len, DELTA, 0);
+		break;
+	case SPLIT8: case SPLIT8U: case SPLIT8D:
+		read_sample_split8((int8_t *) g, (const int8_t *) s, len, (test == SPLIT8U) ? 0x80 : 0,
+			test == SPLIT8D);
+		ref_split8(w, s, len, (test == SPLIT8U) ? 0x80 : 0, test == SPLIT8D);
+		break;
+	case SPLIT16: case SPLIT16U: case SPLIT16D:
+		read_sample_split16((int16_t *) g, (const int16_t *) s, len, (test == SPLIT16U) ? 0x8000 : 0,
+			test == SPLIT16D);
+		ref_split16(w, s, len, (test == SPLIT16U) ? 0x8000 : 0, test == SPLIT16D);
+		break;
+	}
+
+	/* (the whole buffer, so anything written out of bounds shows up too) */
+	if (memcmp(got, want, sizeof(got)) == 0)
+		return 1;
+	fprintf(stderr, "%s: wrong result for %u values (source at +%u, destination at +%u)\n",
+		test_names[test], len, srcofs, destofs);
+	return 0;
+}
+
+int main(void)
+{
+	unsigned int test, len, srcofs, destofs, step, failed = 0, checked = 0;
+	size_t n;
+
+	for (n = 0; n < sizeof(src); n++)
+		src[n] = rand_byte();
+
+	for (test = 0; test < NUM_TESTS; test++) {
+		/* 16-bit data is only ever read from an even address */
+		step = (test == XOR8 || test == XOR8U || test == DELTA8 || test == SPLIT8 || test == SPLIT8U
+			|| test == SPLIT8D) ? 1 : 2;
+		for (len = 0; len <= MAX_LEN; len++) {
+			for (srcofs = 0; srcofs < 16; srcofs += step) {
+				for (destofs = 0; destofs < 16; destofs += step) {
+					failed += !check(test, len, srcofs, destofs);
+					checked++;
+				}
+			}
+		}
+	}
+
+	printf("%u of %u conversions matched\n", checked - failed, checked);
+	return failed ? 1 : 0;
+}